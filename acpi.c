@@ -0,0 +1,109 @@
+#include "acpi.h"
+#include "string.h"
+
+#define ACPI_EBDA_PTR     0x40E
+#define ACPI_BIOS_START   0xE0000
+#define ACPI_BIOS_END     0x100000
+
+static const acpi_rsdp_t *acpi_rsdp = NULL;
+static uint8_t acpi_searched = 0;
+
+static uint8_t acpi_checksum(const void *data, uint32_t length) {
+    const uint8_t *bytes = (const uint8_t*)data;
+    uint8_t sum = 0;
+    
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+// RSDP лежит на 16-байтной границе в первом КБ EBDA или в области BIOS
+static const acpi_rsdp_t *acpi_scan(uint32_t start, uint32_t end) {
+    for (uint32_t addr = start; addr + sizeof(acpi_rsdp_t) <= end; addr += 16) {
+        const acpi_rsdp_t *rsdp = (const acpi_rsdp_t*)addr;
+        
+        if (strncmp(rsdp->signature, "RSD PTR ", 8) != 0 || acpi_checksum(rsdp, 20) != 0) {
+            continue;
+        }
+        if (rsdp->revision >= 2 && acpi_checksum(rsdp, rsdp->length) != 0) {
+            continue;
+        }
+        return rsdp;
+    }
+    return NULL;
+}
+
+static const acpi_rsdp_t *acpi_find_rsdp(void) {
+    if (acpi_searched) {
+        return acpi_rsdp;
+    }
+    acpi_searched = 1;
+    
+    uint32_t ebda = (uint32_t)(*(volatile uint16_t*)ACPI_EBDA_PTR) << 4;
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        acpi_rsdp = acpi_scan(ebda, ebda + 1024);
+    }
+    if (!acpi_rsdp) {
+        acpi_rsdp = acpi_scan(ACPI_BIOS_START, ACPI_BIOS_END);
+    }
+    return acpi_rsdp;
+}
+
+static const acpi_sdt_header_t *acpi_check_table(uint64_t address, const char *signature) {
+    // Без страничной адресации доступны только первые 4 GB
+    if (address == 0 || address >= 0x100000000ULL) {
+        return NULL;
+    }
+    
+    const acpi_sdt_header_t *table = (const acpi_sdt_header_t*)(uint32_t)address;
+    if (signature && strncmp(table->signature, signature, 4) != 0) {
+        return NULL;
+    }
+    if (table->length < sizeof(acpi_sdt_header_t) || acpi_checksum(table, table->length) != 0) {
+        return NULL;
+    }
+    return table;
+}
+
+const acpi_sdt_header_t *acpi_find_table(const char *signature) {
+    const acpi_rsdp_t *rsdp = acpi_find_rsdp();
+    if (!rsdp) {
+        return NULL;
+    }
+    
+    // XSDT (64-битные указатели) предпочтительнее RSDT
+    const acpi_sdt_header_t *root = NULL;
+    uint32_t entry_size = 4;
+    if (rsdp->revision >= 2) {
+        root = acpi_check_table(rsdp->xsdt_address, "XSDT");
+        entry_size = 8;
+    }
+    if (!root) {
+        root = acpi_check_table(rsdp->rsdt_address, "RSDT");
+        entry_size = 4;
+    }
+    if (!root) {
+        return NULL;
+    }
+    
+    const uint8_t *entries = (const uint8_t*)root + sizeof(acpi_sdt_header_t);
+    uint32_t count = (root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t address;
+        if (entry_size == 8) {
+            memcpy(&address, entries + i * 8, 8);
+        } else {
+            uint32_t address32;
+            memcpy(&address32, entries + i * 4, 4);
+            address = address32;
+        }
+        
+        const acpi_sdt_header_t *table = acpi_check_table(address, signature);
+        if (table) {
+            return table;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,51 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+// Минимальный разбор ACPI: поиск RSDP и таблиц по сигнатуре в RSDT/XSDT.
+// Страничная адресация выключена, таблицы читаются по физическим адресам.
+
+typedef struct {
+    char signature[8];        // "RSD PTR "
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;         // 0 — ACPI 1.0, 2+ — есть XSDT
+    uint32_t rsdt_address;
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t ext_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+// Таблица MCFG: окна ECAM конфигурационного пространства PCIe
+typedef struct {
+    uint64_t base_address;
+    uint16_t segment;
+    uint8_t start_bus;
+    uint8_t end_bus;
+    uint32_t reserved;
+} __attribute__((packed)) acpi_mcfg_entry_t;
+
+typedef struct {
+    acpi_sdt_header_t header;
+    uint64_t reserved;
+    acpi_mcfg_entry_t entries[];
+} __attribute__((packed)) acpi_mcfg_t;
+
+// Таблица с данной сигнатурой (с проверенной контрольной суммой) или NULL
+const acpi_sdt_header_t *acpi_find_table(const char *signature);
+
+#endif
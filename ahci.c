@@ -6,6 +6,9 @@
 #include "terminal.h"
 #include "port_io.h"
 #include "kernel_panic.h"
+#include "timer.h"
+#include "msi.h"
+#include "idle.h"
 
 ahci_controller_t ahci_ctrl = {0};
 
@@ -43,59 +46,634 @@ void ahci_set_debug(int on) {
     ahci_debug = on ? 1 : 0;
 }
 
-// Безопасная инициализация порта (без реального доступа к железу)
-static int ahci_init_port_safe(uint8_t port_num) {
-    if (port_num >= AHCI_MAX_PORTS) {
-        return AHCI_ERROR_INVALID;
+static ahci_hba_t *ahci_hba(void) {
+    return (ahci_hba_t*)ahci_ctrl.base_address;
+}
+
+// Ожидание (reg & mask) == value. Предел по итерациям страхует
+// от неоткалиброванного TSC.
+#define AHCI_SPIN_LIMIT 50000000
+
+static int ahci_wait(volatile uint32_t *reg, uint32_t mask, uint32_t value,
+                     uint32_t timeout_us) {
+    uint64_t start = timer_get_us();
+    for (uint32_t spins = 0; (*reg & mask) != value; spins++) {
+        if (timer_get_us() - start > timeout_us || spins > AHCI_SPIN_LIMIT) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// ===== Управление портом =====
+
+static int ahci_port_stop(ahci_port_regs_t *regs) {
+    regs->cmd &= ~AHCI_PORT_CMD_ST;
+    if (!ahci_wait(&regs->cmd, AHCI_PORT_CMD_CR, 0, 500000)) {
+        return 0;
+    }
+    regs->cmd &= ~AHCI_PORT_CMD_FRE;
+    return ahci_wait(&regs->cmd, AHCI_PORT_CMD_FR, 0, 500000);
+}
+
+static int ahci_port_start(ahci_port_regs_t *regs) {
+    if (!ahci_wait(&regs->cmd, AHCI_PORT_CMD_CR, 0, 500000)) {
+        return 0;
+    }
+    regs->cmd |= AHCI_PORT_CMD_FRE;
+    if (!ahci_wait(&regs->tfd, AHCI_TFD_BSY | AHCI_TFD_DRQ, 0, 1000000)) {
+        return 0;
     }
+    regs->cmd |= AHCI_PORT_CMD_ST;
+    return 1;
+}
+
+// COMRESET: понадобится, если устройство застряло с BSY/DRQ
+static void ahci_port_comreset(ahci_port_regs_t *regs) {
+    regs->sctl = (regs->sctl & ~0x0Fu) | 0x01;
+    timer_delay_ms(2);
+    regs->sctl &= ~0x0Fu;
+    ahci_wait(&regs->ssts, 0x0F, 0x03, 100000);
+    regs->serr = 0xFFFFFFFF;
+}
+
+// Список команд (1 KB), область FIS (256 байт) и блок диапазонов TRIM
+// (512 байт) в одной странице, отдельная страница на таблицу каждого слота
+static int ahci_port_alloc(ahci_port_info_t *port) {
+    uint8_t *page = (uint8_t*)pmm_alloc_block();
+    if (!page) {
+        return 0;
+    }
+    memset(page, 0, 4096);
     
-    // Инициализируем тестовые данные для демонстрации
-    ahci_port_info_t* port = &ahci_ctrl.ports[port_num];
+    port->cmd_list = (ahci_cmd_header_t*)page;
+    port->fis = page + 1024;
+    port->dsm_ranges = (uint64_t*)(page + 2048);
+    port->regs->clb = (uint32_t)(uintptr_t)port->cmd_list;
+    port->regs->clbu = 0;
+    port->regs->fb = (uint32_t)(uintptr_t)port->fis;
+    port->regs->fbu = 0;
     
-    // Пример тестовых устройств
-    switch (port_num) {
-        case 0:
-            port->state = PORT_STATE_ONLINE;
-            port->device_type = AHCI_DEVICE_HDD;
-            strncpy(port->model, "ST500DM009", sizeof(port->model) - 1);
-            strncpy(port->serial, "WCC6Y3PNKT5N", sizeof(port->serial) - 1);
-            strncpy(port->firmware, "CC43", sizeof(port->firmware) - 1);
-            port->capacity_mb = 500 * 1024; // 500 GB
-            break;
-        case 1:
-            port->state = PORT_STATE_ONLINE;
-            port->device_type = AHCI_DEVICE_SSD;
-            strncpy(port->model, "Samsung SSD 860 EVO", sizeof(port->model) - 1);
-            strncpy(port->serial, "S3Z8NB0KA12345", sizeof(port->serial) - 1);
-            strncpy(port->firmware, "RVT03B6Q", sizeof(port->firmware) - 1);
-            port->capacity_mb = 250 * 1024; // 250 GB
-            break;
-        case 2:
-            port->state = PORT_STATE_ONLINE;
-            port->device_type = AHCI_DEVICE_CDROM;
-            strncpy(port->model, "HL-DT-ST DVDRAM GH24NSD1", sizeof(port->model) - 1);
-            strncpy(port->serial, "K97D5B123456", sizeof(port->serial) - 1);
-            strncpy(port->firmware, "LL01", sizeof(port->firmware) - 1);
-            port->capacity_mb = 0;
-            break;
-        default:
-            port->state = PORT_STATE_EMPTY;
-            port->device_type = AHCI_DEVICE_NONE;
-            port->model[0] = '\0';
-            port->serial[0] = '\0';
-            port->firmware[0] = '\0';
-            port->capacity_mb = 0;
+    for (int slot = 0; slot < port->slots; slot++) {
+        ahci_cmd_table_t *table = (ahci_cmd_table_t*)pmm_alloc_block();
+        if (!table) {
+            port->slots = slot;
             break;
+        }
+        memset(table, 0, sizeof(ahci_cmd_table_t));
+        port->tables[slot] = table;
+        port->cmd_list[slot].ctba = (uint32_t)(uintptr_t)table;
+        port->cmd_list[slot].ctbau = 0;
     }
     
-    port->port_number = port_num;
-    return AHCI_SUCCESS;
+    return port->slots > 0;
 }
 
-// Основная инициализация AHCI (безопасная версия)
+// ===== Построение команд =====
+
+static void ahci_build_fis(uint8_t *fis, uint8_t command, uint64_t lba,
+                           uint16_t count, uint8_t device) {
+    memset(fis, 0, 20);
+    fis[0] = 0x27;                   // Register FIS, host -> device
+    fis[1] = 0x80;                   // Команда (не управление)
+    fis[2] = command;
+    fis[4] = (uint8_t)lba;
+    fis[5] = (uint8_t)(lba >> 8);
+    fis[6] = (uint8_t)(lba >> 16);
+    fis[7] = device;
+    fis[8] = (uint8_t)(lba >> 24);
+    fis[9] = (uint8_t)(lba >> 32);
+    fis[10] = (uint8_t)(lba >> 40);
+    fis[12] = (uint8_t)count;
+    fis[13] = (uint8_t)(count >> 8);
+}
+
+// PRDT по списку bio: физически смежные буферы склеиваются в одну запись
+static int ahci_fill_prdt(ahci_cmd_table_t *table, blk_request_t *rq) {
+    int n = -1;
+    uint32_t next_addr = 0;
+    
+    for (blk_bio_t *bio = rq->bio_head; bio; bio = bio->next) {
+        uint32_t addr = (uint32_t)(uintptr_t)bio->buffer;
+        uint32_t bytes = bio->count * AHCI_SECTOR_SIZE;
+        
+        if (n >= 0 && addr == next_addr &&
+            (table->prdt[n].dbc & 0x3FFFFF) + 1 + bytes <= AHCI_PRD_MAX_BYTES) {
+            table->prdt[n].dbc += bytes;
+        } else {
+            if (++n >= AHCI_PRDT_ENTRIES) {
+                return -1;
+            }
+            table->prdt[n].dba = addr;
+            table->prdt[n].dbau = 0;
+            table->prdt[n].rsv = 0;
+            table->prdt[n].dbc = bytes - 1;
+        }
+        next_addr = addr + bytes;
+    }
+    
+    if (n < 0) {
+        return -1;
+    }
+    table->prdt[n].dbc |= 1u << 31;  // Прерывание по последней записи
+    return n + 1;
+}
+
+static void ahci_issue_slot(ahci_port_info_t *port, int slot, uint16_t flags,
+                            uint16_t prdtl, int ncq) {
+    ahci_cmd_header_t *header = &port->cmd_list[slot];
+    
+    header->flags = 5 | flags;       // CFL: Register FIS — 5 двойных слов
+    header->prdtl = prdtl;
+    header->prdbc = 0;
+    
+    port->issued |= 1u << slot;
+    port->slot_start_us[slot] = timer_get_us();
+    if (ncq) {
+        // Тег команды NCQ совпадает с номером слота
+        port->regs->sact = 1u << slot;
+    }
+    port->regs->ci = 1u << slot;
+}
+
+// Слоты команд выделяются из битовой карты без блокировки порта:
+// свободный бит захватывается compare-and-swap
+static int ahci_slot_alloc(ahci_port_info_t *port) {
+    uint32_t free;
+    int slot;
+    
+    do {
+        free = port->free_slots;
+        if (!free) {
+            return -1;
+        }
+        slot = __builtin_ctz(free);
+    } while (!__sync_bool_compare_and_swap(&port->free_slots, free,
+                                           free & ~(1u << slot)));
+    return slot;
+}
+
+static void ahci_slot_free(ahci_port_info_t *port, int slot) {
+    __sync_fetch_and_or(&port->free_slots, 1u << slot);
+}
+
+// DATA SET MANAGEMENT/TRIM: каждый bio запроса — запись (LBA:48, число:16)
+// в блоке диапазонов. Команда без очереди: блочный уровень отправляет
+// discard, только когда на порту нет других команд.
+static int ahci_start_trim(ahci_port_info_t *port, int slot) {
+    blk_request_t *rq = port->slot_rq[slot];
+    ahci_cmd_table_t *table = port->tables[slot];
+    uint64_t *ranges = port->dsm_ranges;
+    int n = 0;
+    
+    memset(ranges, 0, AHCI_SECTOR_SIZE);
+    for (blk_bio_t *bio = rq->bio_head; bio; bio = bio->next) {
+        if (n >= AHCI_DSM_RANGES || bio->count > AHCI_DSM_MAX_RANGE) {
+            return 0;
+        }
+        ranges[n++] = (uint64_t)bio->lba | ((uint64_t)bio->count << 48);
+    }
+    
+    table->prdt[0].dba = (uint32_t)(uintptr_t)ranges;
+    table->prdt[0].dbau = 0;
+    table->prdt[0].rsv = 0;
+    table->prdt[0].dbc = (AHCI_SECTOR_SIZE - 1) | (1u << 31);
+    
+    ahci_build_fis(table->cfis, ATA_CMD_DSM, 0, 1, 0x40);
+    table->cfis[3] = ATA_DSM_TRIM;
+    ahci_issue_slot(port, slot, AHCI_CMD_FLAG_WRITE, 1, 0);
+    return 1;
+}
+
+// Команда чтения/записи для запроса блочного уровня в слоте
+static int ahci_start_request(ahci_port_info_t *port, int slot) {
+    blk_request_t *rq = port->slot_rq[slot];
+    ahci_cmd_table_t *table = port->tables[slot];
+    int write = rq->op == BLK_OP_WRITE;
+    
+    if (rq->op == BLK_OP_DISCARD) {
+        return ahci_start_trim(port, slot);
+    }
+    if (rq->op == BLK_OP_FLUSH) {
+        // Без данных и без очереди, как и TRIM
+        ahci_build_fis(table->cfis, ATA_CMD_FLUSH_EXT, 0, 0, 0x40);
+        ahci_issue_slot(port, slot, 0, 0, 0);
+        return 1;
+    }
+    
+    int prdtl = ahci_fill_prdt(table, rq);
+    if (prdtl < 0) {
+        return 0;
+    }
+    
+    if (port->ncq_depth) {
+        // FPDMA QUEUED: число секторов в Features, тег в Count[7:3]
+        ahci_build_fis(table->cfis,
+                       write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA,
+                       rq->lba, (uint16_t)(slot << 3), 0x40);
+        table->cfis[3] = (uint8_t)rq->count;
+        table->cfis[11] = (uint8_t)(rq->count >> 8);
+    } else {
+        ahci_build_fis(table->cfis,
+                       write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT,
+                       rq->lba, (uint16_t)rq->count, 0x40);
+    }
+    ahci_issue_slot(port, slot, write ? AHCI_CMD_FLAG_WRITE : 0, (uint16_t)prdtl,
+                    port->ncq_depth != 0);
+    return 1;
+}
+
+// ===== Синхронные команды (инициализация) =====
+
+static uint16_t identify_buf[256] __attribute__((aligned(16)));
+
+static int ahci_identify(ahci_port_info_t *port) {
+    ahci_cmd_table_t *table = port->tables[0];
+    
+    table->prdt[0].dba = (uint32_t)(uintptr_t)identify_buf;
+    table->prdt[0].dbau = 0;
+    table->prdt[0].rsv = 0;
+    table->prdt[0].dbc = (AHCI_SECTOR_SIZE - 1) | (1u << 31);
+    ahci_build_fis(table->cfis, ATA_CMD_IDENTIFY, 0, 0, 0);
+    
+    ahci_issue_slot(port, 0, 0, 1, 0);
+    int ok = ahci_wait(&port->regs->ci, 1, 0, 1000000) &&
+             !(port->regs->is & AHCI_PORT_IS_TFES);
+    port->issued = 0;
+    port->regs->is = 0xFFFFFFFF;
+    return ok;
+}
+
+// Строки IDENTIFY хранятся с переставленными байтами в словах
+static void ahci_copy_ata_string(char *dst, const uint16_t *words, int nwords) {
+    int len = 0;
+    for (int i = 0; i < nwords; i++) {
+        dst[len++] = (char)(words[i] >> 8);
+        dst[len++] = (char)(words[i] & 0xFF);
+    }
+    dst[len] = '\0';
+    while (len > 0 && dst[len - 1] == ' ') {
+        dst[--len] = '\0';
+    }
+}
+
+static void ahci_parse_identify(ahci_port_info_t *port) {
+    const uint16_t *id = identify_buf;
+    
+    ahci_copy_ata_string(port->serial, id + 10, 10);
+    ahci_copy_ata_string(port->firmware, id + 23, 4);
+    ahci_copy_ata_string(port->model, id + 27, 20);
+    
+    port->lba48 = (id[83] & (1 << 10)) != 0;
+    if (port->lba48) {
+        port->total_sectors = (uint64_t)id[100] | ((uint64_t)id[101] << 16) |
+                              ((uint64_t)id[102] << 32) | ((uint64_t)id[103] << 48);
+    } else {
+        port->total_sectors = (uint32_t)id[60] | ((uint32_t)id[61] << 16);
+    }
+    port->capacity_mb = port->total_sectors / 2048;
+    
+    // Слово 217: скорость вращения, 1 — твердотельный накопитель
+    port->device_type = (id[217] == 1) ? AHCI_DEVICE_SSD : AHCI_DEVICE_HDD;
+    port->trim = (id[169] & 1) != 0;
+    port->write_cache = (id[85] & (1 << 5)) != 0;
+    
+    // NCQ: нужна поддержка и у HBA (CAP.SNCQ), и у диска (слово 76, бит 8)
+    port->ncq_depth = 0;
+    if ((ahci_ctrl.capabilities & AHCI_CAP_NCQ) && (id[76] & (1 << 8))) {
+        port->ncq_depth = (id[75] & 0x1F) + 1;
+        if (port->ncq_depth > port->slots) {
+            port->ncq_depth = port->slots;
+        }
+    }
+}
+
+static void ahci_port_init(uint8_t n) {
+    ahci_port_info_t *port = &ahci_ctrl.ports[n];
+    ahci_port_regs_t *regs = &ahci_hba()->ports[n];
+    
+    port->port_number = n;
+    port->regs = regs;
+    port->state = PORT_STATE_EMPTY;
+    port->device_type = AHCI_DEVICE_NONE;
+    
+    if (!ahci_port_stop(regs)) {
+        port->state = PORT_STATE_ERROR;
+        return;
+    }
+    
+    // Питание и раскрутка (при staggered spin-up), затем ждем связь
+    regs->cmd |= AHCI_PORT_CMD_SUD | AHCI_PORT_CMD_POD;
+    if (!ahci_wait(&regs->ssts, 0x0F, 0x03, 100000)) {
+        return;                      // DET != 3 — устройства нет
+    }
+    
+    port->slots = ahci_ctrl.cmd_slots;
+    if (!ahci_port_alloc(port)) {
+        port->state = PORT_STATE_ERROR;
+        return;
+    }
+    
+    regs->serr = 0xFFFFFFFF;
+    regs->is = 0xFFFFFFFF;
+    if (!ahci_port_start(regs)) {
+        port->state = PORT_STATE_ERROR;
+        return;
+    }
+    regs->ie = AHCI_PORT_IS_DHRS | AHCI_PORT_IS_PSS | AHCI_PORT_IS_DSS |
+               AHCI_PORT_IS_SDBS | AHCI_PORT_IS_ERROR;
+    
+    if (regs->sig == AHCI_SIG_ATAPI) {
+        port->device_type = AHCI_DEVICE_CDROM;
+        port->state = PORT_STATE_ONLINE;
+        return;
+    }
+    if (regs->sig != AHCI_SIG_ATA) {
+        port->state = PORT_STATE_OFFLINE;
+        return;
+    }
+    
+    if (!ahci_identify(port)) {
+        port->state = PORT_STATE_ERROR;
+        return;
+    }
+    ahci_parse_identify(port);
+    port->state = PORT_STATE_ONLINE;
+}
+
+// ===== Блочный уровень =====
+//
+// Завершение команд определяется по PxCI/PxSACT. Обработчик прерывания
+// только подтверждает его и запоминает PxIS и номера портов; сами запросы
+// заканчиваются в ahci_poll(), вне контекста прерывания (обработчики end_io
+// не реентерабельны). Каждый порт обслуживается независимо, под своей
+// блокировкой, и только если он поднял прерывание.
+
+static volatile uint32_t port_irq_status[AHCI_MAX_PORTS];
+static uint64_t next_sweep_us;
+
+// Разобрать общий HBA IS: подтвердить PxIS портов, поднявших прерывание,
+// и отметить их в pending_ports. Вызывается и из прерывания, и из опроса.
+static void ahci_collect_interrupts(void) {
+    ahci_hba_t *hba = ahci_hba();
+    uint32_t is = hba->is & ahci_ctrl.ports_implemented;
+    
+    if (!is) {
+        return;
+    }
+    for (uint32_t bits = is; bits; bits &= bits - 1) {
+        int n = __builtin_ctz(bits);
+        uint32_t port_is = hba->ports[n].is;
+        hba->ports[n].is = port_is;
+        __sync_fetch_and_or(&port_irq_status[n], port_is);
+    }
+    // HBA IS сбрасывается после PxIS, иначе бит поднимется снова
+    hba->is = is;
+    __sync_fetch_and_or(&ahci_ctrl.pending_ports, is);
+}
+
+static void ahci_irq_handler(void) {
+    ahci_collect_interrupts();
+}
+
+// Ошибка на порту: останавливаем его, очищаем ошибки и повторяем
+// незавершенные команды (или отдаем их с ошибкой). Под блокировкой порта.
+static int ahci_port_recover(ahci_port_info_t *port, blk_request_t **done,
+                             int *results, int n) {
+    ahci_port_regs_t *regs = port->regs;
+    uint32_t failed = port->issued & (regs->ci | regs->sact);
+    
+    // Команды, которые успели завершиться до ошибки
+    for (int slot = 0; slot < port->slots; slot++) {
+        uint32_t bit = 1u << slot;
+        if ((port->issued & bit) && !(failed & bit)) {
+            done[n] = port->slot_rq[slot];
+            results[n++] = BLK_OK;
+            port->slot_rq[slot] = NULL;
+            ahci_slot_free(port, slot);
+        }
+    }
+    port->issued = 0;
+    
+    ahci_port_stop(regs);
+    regs->serr = 0xFFFFFFFF;
+    regs->is = 0xFFFFFFFF;
+    // После ошибки NCQ диск отвергает новые команды, пока не прочитан
+    // журнал 10h; сброс линии проще и тоже снимает это состояние
+    if (port->ncq_depth || (regs->tfd & (AHCI_TFD_BSY | AHCI_TFD_DRQ))) {
+        ahci_port_comreset(regs);
+    }
+    int started = ahci_port_start(regs);
+    
+    for (int slot = 0; slot < port->slots; slot++) {
+        blk_request_t *rq = port->slot_rq[slot];
+        if (!(failed & (1u << slot)) || !rq) {
+            continue;
+        }
+        if (started && port->slot_retries[slot] < AHCI_MAX_RETRIES) {
+            port->slot_retries[slot]++;
+            blk_account_retry(rq);
+            if (ahci_start_request(port, slot)) {
+                continue;
+            }
+        }
+        done[n] = rq;
+        results[n++] = BLK_ERR_IO;
+        port->slot_rq[slot] = NULL;
+        ahci_slot_free(port, slot);
+    }
+    
+    if (!started) {
+        port->state = PORT_STATE_ERROR;
+    }
+    return n;
+}
+
+// Продвинуть порт: собрать завершенные запросы (под блокировкой порта)
+static int ahci_port_service(ahci_port_info_t *port, blk_request_t **done,
+                             int *results) {
+    ahci_port_regs_t *regs = port->regs;
+    int n = 0;
+    
+    uint32_t is = regs->is;
+    regs->is = is;
+    is |= __sync_fetch_and_and(&port_irq_status[port->port_number], 0);
+    
+    if (!port->issued) {
+        return 0;
+    }
+    
+    if ((is & AHCI_PORT_IS_ERROR) || (regs->tfd & AHCI_TFD_ERR)) {
+        return ahci_port_recover(port, done, results, 0);
+    }
+    
+    // Команда NCQ завершена, когда устройство сняло ее бит в PxSACT
+    // (Set Device Bits FIS); обычная — когда HBA снял бит в PxCI
+    uint32_t finished = port->issued & ~(regs->ci | regs->sact);
+    uint64_t now = timer_get_us();
+    int timed_out = 0;
+    
+    for (int slot = 0; slot < port->slots; slot++) {
+        uint32_t bit = 1u << slot;
+        if (finished & bit) {
+            done[n] = port->slot_rq[slot];
+            results[n++] = BLK_OK;
+            port->slot_rq[slot] = NULL;
+            port->issued &= ~bit;
+            ahci_slot_free(port, slot);
+        } else if ((port->issued & bit) &&
+                   now - port->slot_start_us[slot] > AHCI_TIMEOUT_US) {
+            timed_out = 1;
+        }
+    }
+    
+    if (timed_out) {
+        n = ahci_port_recover(port, done, results, n);
+    }
+    return n;
+}
+
+static void ahci_poll_port(ahci_port_info_t *port) {
+    blk_request_t *done[AHCI_MAX_SLOTS];
+    int results[AHCI_MAX_SLOTS];
+    
+    if (!port->blk || !port->issued) {
+        return;
+    }
+    if (!spin_trylock(&port->lock)) {
+        // Порт занят (отправка или восстановление) — вернемся к нему позже
+        __sync_fetch_and_or(&ahci_ctrl.pending_ports, 1u << port->port_number);
+        return;
+    }
+    int n = ahci_port_service(port, done, results);
+    spin_unlock(&port->lock);
+    
+    for (int i = 0; i < n; i++) {
+        blk_end_request(done[i], results[i]);
+    }
+    if (n) {
+        blk_run_queue(port->blk);
+    }
+}
+
+void ahci_poll(void) {
+    if (!ahci_ctrl.initialized) {
+        return;
+    }
+    
+    ahci_collect_interrupts();
+    uint32_t pending = __sync_fetch_and_and(&ahci_ctrl.pending_ports, 0);
+    
+    // Редкий обход всех занятых портов: тайм-ауты команд и защита
+    // от потерянного прерывания
+    uint64_t now = timer_get_us();
+    if (now >= next_sweep_us) {
+        next_sweep_us = now + AHCI_SWEEP_US;
+        for (int p = 0; p < ahci_ctrl.port_count; p++) {
+            if (ahci_ctrl.ports[p].issued) {
+                pending |= 1u << p;
+            }
+        }
+    }
+    
+    for (; pending; pending &= pending - 1) {
+        ahci_poll_port(&ahci_ctrl.ports[__builtin_ctz(pending)]);
+    }
+}
+
+static int ahci_blk_submit(blkdev_t *dev, blk_request_t *rq) {
+    ahci_port_info_t *port = (ahci_port_info_t*)dev->driver_data;
+    
+    if (port->state != PORT_STATE_ONLINE) {
+        blk_end_request(rq, BLK_ERR_IO);
+        return 0;
+    }
+    
+    int slot = ahci_slot_alloc(port);
+    if (slot < 0) {
+        return 1;
+    }
+    
+    // Блокировка нужна только против восстановления порта после ошибки
+    if (!spin_trylock(&port->lock)) {
+        ahci_slot_free(port, slot);
+        return 1;
+    }
+    
+    port->slot_rq[slot] = rq;
+    port->slot_retries[slot] = 0;
+    int ok = ahci_start_request(port, slot);
+    if (!ok) {
+        port->slot_rq[slot] = NULL;
+        ahci_slot_free(port, slot);
+    }
+    spin_unlock(&port->lock);
+    
+    if (!ok) {
+        blk_end_request(rq, BLK_ERR_IO);
+    }
+    return 0;
+}
+
+// Прерывание общее для всех портов: ожидая один диск, продвигаем и
+// остальные, иначе их очереди простаивали бы до следующего опроса
+static void ahci_blk_poll(blkdev_t *dev) {
+    (void)dev;
+    ahci_poll();
+}
+
+static const blkdev_ops_t ahci_blk_ops = {
+    ahci_blk_submit,
+    ahci_blk_poll
+};
+
+// Диски регистрируются как sda, sdb, ... в порядке портов
+static void ahci_register_block_devices(void) {
+    static uint8_t idle_registered = 0;
+    char name[4] = "sd?";
+    int index = 0;
+    
+    for (int p = 0; p < ahci_ctrl.port_count; p++) {
+        ahci_port_info_t *port = &ahci_ctrl.ports[p];
+        
+        if (port->state != PORT_STATE_ONLINE ||
+            (port->device_type != AHCI_DEVICE_HDD &&
+             port->device_type != AHCI_DEVICE_SSD)) {
+            continue;
+        }
+        
+        // Блочный уровень адресует 32-битными LBA
+        uint32_t sectors = port->total_sectors > 0xFFFFFFFFull ?
+                           0xFFFFFFFF : (uint32_t)port->total_sectors;
+        
+        name[2] = 'a' + index++;
+        port->blk = blkdev_register(name, sectors, &ahci_blk_ops, port);
+        if (port->blk) {
+            blkdev_set_hw_limits(port->blk, AHCI_MAX_SECTORS, AHCI_PRDT_ENTRIES);
+            blkdev_set_max_sectors(port->blk, AHCI_MAX_SECTORS / 2);
+            
+            // Без NCQ диск выполняет одну команду за раз
+            uint8_t depth = port->ncq_depth ? port->ncq_depth : 1;
+            port->free_slots = (depth >= 32) ? 0xFFFFFFFF : ((1u << depth) - 1);
+            blkdev_set_queue_depth(port->blk, depth);
+            
+            if (port->trim) {
+                blkdev_set_discard(port->blk, AHCI_DSM_MAX_RANGE, AHCI_DSM_RANGES);
+            }
+            blkdev_set_write_cache(port->blk, port->write_cache);
+        }
+    }
+    
+    if (!idle_registered) {
+        idle_register_task("ahci", ahci_poll);
+        idle_registered = 1;
+    }
+}
+
+// Основная инициализация AHCI
 void ahci_init(void) {
     if (ahci_debug) {
-        video_print("[AHCI] Initializing AHCI driver (safe mode)\n");
+        video_print("[AHCI] Initializing AHCI driver\n");
     }
     
     // Ищем PCI устройство AHCI
@@ -110,7 +688,6 @@ void ahci_init(void) {
     }
     
     if (ahci_debug) {
-        char buf[32];
         video_print("[AHCI] Found AHCI controller: ");
         video_print("Vendor=0x");
         terminal_writehex(dev.vendor_id);
@@ -119,11 +696,8 @@ void ahci_init(void) {
         video_print("\n");
     }
     
-    // Получаем BAR0 (обычно это ABAR)
+    // ABAR — BAR5
     uint32_t abar = pci_get_bar(dev, 5);
-    if (abar == 0) {
-        abar = pci_get_bar(dev, 0);
-    }
     
     // Проверяем, что BAR корректен
     if (!is_valid_mmio_address(abar)) {
@@ -133,38 +707,62 @@ void ahci_init(void) {
         ahci_ctrl.base_address = NULL;
         ahci_ctrl.initialized = 0; // Не помечаем как инициализированный — это ошибка
         return;
-    } else {
-        ahci_ctrl.base_address = (uint32_t*)(uintptr_t)abar;
-
-        // Пробуем прочитать регистр CAP (с крайней осторожностью)
+    }
+    
+    pci_enable_memory_space(dev);
+    pci_enable_busmaster(dev);
+    ahci_ctrl.base_address = (uint32_t*)(uintptr_t)abar;
+    ahci_hba_t *hba = ahci_hba();
+    
+    // Забираем контроллер у BIOS, если он это поддерживает
+    if (hba->cap2 & AHCI_CAP2_BOH) {
+        hba->bohc |= AHCI_BOHC_OOS;
+        ahci_wait(&hba->bohc, AHCI_BOHC_BOS, 0, 2000000);
+    }
+    
+    // Сброс HBA и включение режима AHCI
+    hba->ghc |= AHCI_GHC_AE;
+    hba->ghc |= AHCI_GHC_HR;
+    if (!ahci_wait(&hba->ghc, AHCI_GHC_HR, 0, 1000000)) {
         if (ahci_debug) {
-            uint32_t cap = safe_read_mmio(ahci_ctrl.base_address, 0x00);
-            video_print("[AHCI] CAP register: 0x");
-            terminal_writehex(cap);
-            video_print("\n");
+            video_print("[AHCI] HBA reset timed out\n");
         }
-
-        // Включаем безопасный режим (не инициализируем реальное железо)
-        ahci_ctrl.capabilities = 0;
-        ahci_ctrl.ports_implemented = 0x00000007; // Первые 3 порта "реализованы"
-        ahci_ctrl.port_count = 3;
-        ahci_ctrl.initialized = 1; // Помечаем как инициализированный для команд терминала
-
-        // Инициализируем порты (безопасные тестовые данные)
-        for (int i = 0; i < AHCI_MAX_PORTS; i++) {
-            if (i < ahci_ctrl.port_count) {
-                ahci_init_port_safe(i);
-            } else {
-                ahci_ctrl.ports[i].state = PORT_STATE_EMPTY;
-                ahci_ctrl.ports[i].device_type = AHCI_DEVICE_NONE;
-                ahci_ctrl.ports[i].model[0] = '\0';
-                ahci_ctrl.ports[i].capacity_mb = 0;
-            }
+        return;
+    }
+    hba->ghc |= AHCI_GHC_AE;
+    
+    ahci_ctrl.capabilities = hba->cap;
+    ahci_ctrl.ports_implemented = hba->pi;
+    ahci_ctrl.cmd_slots = ((hba->cap >> 8) & 0x1F) + 1;
+    ahci_ctrl.port_count = 0;
+    
+    if (ahci_debug) {
+        video_print("[AHCI] CAP register: 0x");
+        terminal_writehex(hba->cap);
+        video_print("  PI: 0x");
+        terminal_writehex(hba->pi);
+        video_print("\n");
+    }
+    
+    for (int i = 0; i < AHCI_MAX_PORTS; i++) {
+        memset(&ahci_ctrl.ports[i], 0, sizeof(ahci_port_info_t));
+        ahci_ctrl.ports[i].port_number = i;
+        if (ahci_ctrl.ports_implemented & (1u << i)) {
+            ahci_port_init(i);
+            ahci_ctrl.port_count = i + 1;
         }
     }
     
+    // Собственный вектор MSI-X/MSI, если есть, иначе общая линия INTx
+    ahci_ctrl.irq_type = msi_request_irq(dev, ahci_irq_handler, &ahci_ctrl.irq);
+    hba->is = 0xFFFFFFFF;
+    hba->ghc |= AHCI_GHC_IE;
+    
+    ahci_ctrl.initialized = 1;
+    ahci_register_block_devices();
+    
     if (ahci_debug) {
-        video_print("[AHCI] Driver initialized in safe mode\n");
+        video_print("[AHCI] Driver initialized\n");
     }
 }
 
@@ -207,13 +805,31 @@ void ahci_print_devices(void) {
         ahci_init();
     }
     
-    // Если все еще не инициализирован или базовый адрес MMIO некорректен,
-    // считаем это критической ошибкой и вызываем kernel panic с кодом AHCI.
-    if (!ahci_ctrl.initialized || ahci_ctrl.base_address == NULL || ahci_ctrl.port_count == 0) {
+    // Контроллера может просто не быть в системе
+    if (!ahci_ctrl.initialized) {
+        video_print("No AHCI controller found\n\n");
+        return;
+    }
+    
+    // Инициализирован, но базовый адрес MMIO некорректен — это
+    // критическая ошибка, вызываем kernel panic с кодом AHCI.
+    if (ahci_ctrl.base_address == NULL) {
         panic("AHCI driver failure: controller not initialized or MMIO invalid", AHCI_PANIC_CODE_DRIVER_FAILURE);
         return; // unreachable, but keeps compiler happy
     }
     
+    {
+        static const char *irq_modes[] = { "polling", "INTx IRQ ", "MSI vector ", "MSI-X vector " };
+        char irq_num[4];
+        video_print("Interrupt: ");
+        video_print(irq_modes[ahci_ctrl.irq_type & 3]);
+        if (ahci_ctrl.irq_type != MSI_IRQ_NONE) {
+            itoa(ahci_ctrl.irq, irq_num, 10);
+            video_print(irq_num);
+        }
+        video_print("\n");
+    }
+    
     // Выводим информацию о каждом порте
     for (int p = 0; p < ahci_ctrl.port_count; p++) {
         ahci_port_info_t* port = &ahci_ctrl.ports[p];
@@ -269,6 +885,21 @@ void ahci_print_devices(void) {
         video_print("  ");
         video_print(ahci_get_port_state_string(port->state));
         
+        if (port->blk) {
+            video_print("  /dev/");
+            video_print(port->blk->name);
+        }
+        
+        if (port->ncq_depth) {
+            char depth[4];
+            itoa(port->ncq_depth, depth, 10);
+            video_print("  NCQ:");
+            video_print(depth);
+        }
+        if (port->trim) {
+            video_print("  TRIM");
+        }
+        
         video_print("\n");
         
         // Дополнительная информация (серийный номер, прошивка)
@@ -2,10 +2,137 @@
 #define AHCI_H
 
 #include <stdint.h>
+#include "blkdev.h"
+#include "spinlock.h"
 
 // Константы AHCI
 #define AHCI_MAX_PORTS 32
 #define AHCI_SECTOR_SIZE 512
+#define AHCI_MAX_SLOTS 32
+#define AHCI_PRDT_ENTRIES 248         // Таблица команды ровно в одну страницу
+#define AHCI_MAX_SECTORS 2048         // 1 MB на команду
+#define AHCI_PRD_MAX_BYTES 0x400000   // 4 MB на запись PRDT
+#define AHCI_TIMEOUT_US 5000000
+#define AHCI_MAX_RETRIES 3
+#define AHCI_SWEEP_US 10000           // Обход занятых портов без прерывания
+#define AHCI_DSM_RANGES 64            // Диапазонов TRIM в одном блоке (512 / 8)
+#define AHCI_DSM_MAX_RANGE 0xFFFF     // Секторов в одном диапазоне TRIM
+
+// Регистры HBA (GHC)
+#define AHCI_GHC_HR   (1u << 0)       // Сброс HBA
+#define AHCI_GHC_IE   (1u << 1)       // Разрешение прерываний
+#define AHCI_GHC_AE   (1u << 31)      // Режим AHCI
+#define AHCI_CAP_NCQ  (1u << 30)      // SNCQ
+#define AHCI_CAP2_BOH (1u << 0)       // Передача управления от BIOS
+#define AHCI_BOHC_BOS (1u << 0)
+#define AHCI_BOHC_OOS (1u << 1)
+
+// PxCMD
+#define AHCI_PORT_CMD_ST  (1u << 0)
+#define AHCI_PORT_CMD_SUD (1u << 1)
+#define AHCI_PORT_CMD_POD (1u << 2)
+#define AHCI_PORT_CMD_FRE (1u << 4)
+#define AHCI_PORT_CMD_FR  (1u << 14)
+#define AHCI_PORT_CMD_CR  (1u << 15)
+
+// PxIS / PxIE
+#define AHCI_PORT_IS_DHRS (1u << 0)   // D2H Register FIS
+#define AHCI_PORT_IS_PSS  (1u << 1)   // PIO Setup FIS
+#define AHCI_PORT_IS_DSS  (1u << 2)   // DMA Setup FIS
+#define AHCI_PORT_IS_SDBS (1u << 3)   // Set Device Bits FIS
+#define AHCI_PORT_IS_IFS  (1u << 27)
+#define AHCI_PORT_IS_HBDS (1u << 28)
+#define AHCI_PORT_IS_HBFS (1u << 29)
+#define AHCI_PORT_IS_TFES (1u << 30)  // Ошибка в регистре задачи
+#define AHCI_PORT_IS_ERROR (AHCI_PORT_IS_TFES | AHCI_PORT_IS_HBFS | \
+                            AHCI_PORT_IS_HBDS | AHCI_PORT_IS_IFS)
+
+// PxTFD
+#define AHCI_TFD_ERR  0x01
+#define AHCI_TFD_DRQ  0x08
+#define AHCI_TFD_BSY  0x80
+
+// Сигнатуры устройств (PxSIG)
+#define AHCI_SIG_ATA   0x00000101
+#define AHCI_SIG_ATAPI 0xEB140101
+
+// Команды ATA
+#define ATA_CMD_DSM            0x06   // DATA SET MANAGEMENT
+#define ATA_DSM_TRIM           0x01   // Features: TRIM
+#define ATA_CMD_READ_DMA_EXT   0x25
+#define ATA_CMD_WRITE_DMA_EXT  0x35
+#define ATA_CMD_READ_FPDMA     0x60   // NCQ
+#define ATA_CMD_WRITE_FPDMA    0x61
+#define ATA_CMD_IDENTIFY       0xEC
+#define ATA_CMD_FLUSH_EXT      0xEA
+
+// Регистры порта (ABAR + 0x100 + 0x80 * n)
+typedef volatile struct {
+    uint32_t clb;             // Command List Base (1K выравнивание)
+    uint32_t clbu;
+    uint32_t fb;              // FIS Base (256 выравнивание)
+    uint32_t fbu;
+    uint32_t is;
+    uint32_t ie;
+    uint32_t cmd;
+    uint32_t rsv0;
+    uint32_t tfd;
+    uint32_t sig;
+    uint32_t ssts;
+    uint32_t sctl;
+    uint32_t serr;
+    uint32_t sact;
+    uint32_t ci;
+    uint32_t sntf;
+    uint32_t fbs;
+    uint32_t rsv1[11];
+    uint32_t vendor[4];
+} ahci_port_regs_t;
+
+// Общие регистры HBA
+typedef volatile struct {
+    uint32_t cap;
+    uint32_t ghc;
+    uint32_t is;
+    uint32_t pi;
+    uint32_t vs;
+    uint32_t ccc_ctl;
+    uint32_t ccc_ports;
+    uint32_t em_loc;
+    uint32_t em_ctl;
+    uint32_t cap2;
+    uint32_t bohc;
+    uint8_t rsv[0x100 - 0x2C];
+    ahci_port_regs_t ports[AHCI_MAX_PORTS];
+} ahci_hba_t;
+
+// Заголовок команды в списке команд порта
+typedef struct {
+    uint16_t flags;           // CFL[4:0], A, W, P, R, B, C, PMP
+    uint16_t prdtl;           // Записей PRDT
+    volatile uint32_t prdbc;  // Передано байт
+    uint32_t ctba;            // Таблица команды (128 выравнивание)
+    uint32_t ctbau;
+    uint32_t rsv[4];
+} ahci_cmd_header_t;
+
+#define AHCI_CMD_FLAG_WRITE (1u << 6)
+#define AHCI_CMD_FLAG_PREFETCH (1u << 7)
+
+// Запись PRDT
+typedef struct {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t rsv;
+    uint32_t dbc;             // Байт - 1; бит 31 — прерывание по завершении
+} ahci_prd_t;
+
+typedef struct {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t rsv[48];
+    ahci_prd_t prdt[AHCI_PRDT_ENTRIES];
+} ahci_cmd_table_t;
 
 // Коды ошибок
 typedef enum {
@@ -33,7 +160,7 @@ typedef enum {
     PORT_STATE_ERROR = 3
 } ahci_port_state_t;
 
-// Структура порта (упрощенная)
+// Структура порта
 typedef struct {
     uint8_t port_number;
     ahci_device_type_t device_type;
@@ -42,6 +169,26 @@ typedef struct {
     uint64_t capacity_mb;     // Емкость в МБ
     char serial[21];          // Серийный номер
     char firmware[9];         // Версия прошивки
+    
+    // Состояние драйвера
+    ahci_port_regs_t *regs;
+    ahci_cmd_header_t *cmd_list;            // 32 заголовка
+    uint8_t *fis;                           // Область приема FIS
+    ahci_cmd_table_t *tables[AHCI_MAX_SLOTS];
+    blk_request_t *slot_rq[AHCI_MAX_SLOTS]; // Запрос в каждом слоте
+    uint8_t slot_retries[AHCI_MAX_SLOTS];
+    uint64_t slot_start_us[AHCI_MAX_SLOTS];
+    uint32_t issued;                        // Слоты, отданные HBA
+    volatile uint32_t free_slots;           // Бит 1 — слот свободен (захват через CAS)
+    uint8_t slots;                          // Сколько слотов используем
+    uint8_t ncq_depth;                      // Глубина NCQ (0 — NCQ нет)
+    uint8_t trim;                           // DSM TRIM (слово 169, бит 0)
+    uint8_t write_cache;                    // Кэш записи включен (слово 85, бит 5)
+    uint64_t *dsm_ranges;                   // Блок диапазонов для TRIM
+    uint64_t total_sectors;
+    uint8_t lba48;
+    blkdev_t *blk;
+    spinlock_t lock;
 } ahci_port_info_t;
 
 // Структура контроллера
@@ -52,6 +199,10 @@ typedef struct {
     uint8_t port_count;       // Количество портов
     ahci_port_info_t ports[AHCI_MAX_PORTS]; // Информация о портах
     uint8_t initialized;      // Флаг инициализации
+    uint8_t irq;              // Вектор MSI или линия INTx
+    uint8_t irq_type;         // MSI_IRQ_*
+    uint8_t cmd_slots;        // CAP.NCS + 1
+    volatile uint32_t pending_ports; // Порты, отмеченные обработчиком прерывания
 } ahci_controller_t;
 
 // Прототипы функций
@@ -60,6 +211,7 @@ void ahci_detect_devices(void);
 void ahci_print_devices(void);
 const char* ahci_get_device_type_string(ahci_device_type_t type);
 const char* ahci_get_port_state_string(ahci_port_state_t state);
+void ahci_poll(void);
 
 // Управление отладочным выводом AHCI модуля
 void ahci_set_debug(int on);
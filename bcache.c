@@ -0,0 +1,797 @@
+#include "bcache.h"
+#include "pmm.h"
+#include "idle.h"
+#include "timer.h"
+#include "string.h"
+#include "video.h"
+
+static bcache_buf_t buffers[BCACHE_MAX_BUFFERS];
+static bcache_buf_t *free_headers = NULL;
+static bcache_buf_t *hash_table[BCACHE_HASH_SIZE];
+static bcache_buf_t *lru_head = NULL;   // Самый свежий
+static bcache_buf_t *lru_tail = NULL;   // Кандидат на вытеснение
+
+// Данные буферов лежат в страницах PMM по BCACHE_BUFS_PER_PAGE слотов
+static uint8_t *pages[BCACHE_MAX_PAGES];
+static uint8_t page_used[BCACHE_MAX_PAGES];   // Битовая маска занятых слотов
+
+// Последовательный поток чтения одного устройства
+typedef struct {
+    blkdev_t *dev;
+    uint32_t next_block;      // Ожидаемый следующий блок
+    uint32_t ra_end;          // Блок сразу за последним упреждением
+    uint32_t ra_size;         // Текущее окно
+    uint32_t seq;             // Последовательных обращений подряд
+    uint64_t last_used_us;
+} bcache_stream_t;
+
+static bcache_stream_t streams[BCACHE_RA_STREAMS];
+static bcache_stats_t stats;
+static uint32_t target_capacity = 0;
+static uint64_t last_flush_us = 0;
+static uint8_t initialized = 0;
+
+// ===== Хэш и LRU =====
+
+static uint32_t hash_key(blkdev_t *dev, uint32_t block) {
+    uint32_t h = (uint32_t)(uintptr_t)dev;
+    h ^= block * 2654435761u;
+    return (h ^ (h >> 16)) & (BCACHE_HASH_SIZE - 1);
+}
+
+static bcache_buf_t *hash_lookup(blkdev_t *dev, uint32_t block) {
+    for (bcache_buf_t *b = hash_table[hash_key(dev, block)]; b; b = b->hash_next) {
+        if (b->dev == dev && b->block == block) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+static void hash_insert(bcache_buf_t *b) {
+    uint32_t h = hash_key(b->dev, b->block);
+    b->hash_next = hash_table[h];
+    hash_table[h] = b;
+}
+
+static void hash_remove(bcache_buf_t *b) {
+    bcache_buf_t **pp = &hash_table[hash_key(b->dev, b->block)];
+    while (*pp) {
+        if (*pp == b) {
+            *pp = b->hash_next;
+            b->hash_next = NULL;
+            return;
+        }
+        pp = &(*pp)->hash_next;
+    }
+}
+
+static void lru_unlink(bcache_buf_t *b) {
+    if (b->lru_prev) {
+        b->lru_prev->lru_next = b->lru_next;
+    } else {
+        lru_head = b->lru_next;
+    }
+    if (b->lru_next) {
+        b->lru_next->lru_prev = b->lru_prev;
+    } else {
+        lru_tail = b->lru_prev;
+    }
+    b->lru_prev = b->lru_next = NULL;
+}
+
+static void lru_push_head(bcache_buf_t *b) {
+    b->lru_prev = NULL;
+    b->lru_next = lru_head;
+    if (lru_head) {
+        lru_head->lru_prev = b;
+    } else {
+        lru_tail = b;
+    }
+    lru_head = b;
+}
+
+static void lru_touch(bcache_buf_t *b) {
+    if (lru_head != b) {
+        lru_unlink(b);
+        lru_push_head(b);
+    }
+}
+
+// ===== Память под данные =====
+
+static int memory_low(void) {
+    memory_info_t info = pmm_get_memory_info();
+    return info.available_memory < info.total_memory / BCACHE_LOW_WATERMARK;
+}
+
+static int slot_alloc(uint16_t *page, uint8_t *slot) {
+    int empty_page = -1;
+
+    for (int p = 0; p < BCACHE_MAX_PAGES; p++) {
+        if (!pages[p]) {
+            if (empty_page < 0) {
+                empty_page = p;
+            }
+            continue;
+        }
+        if (page_used[p] != 0xFF) {
+            for (int s = 0; s < BCACHE_BUFS_PER_PAGE; s++) {
+                if (!(page_used[p] & (1 << s))) {
+                    page_used[p] |= (1 << s);
+                    *page = p;
+                    *slot = s;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    if (empty_page < 0 || memory_low()) {
+        return 0;
+    }
+
+    uint8_t *mem = (uint8_t*)pmm_alloc_block();
+    if (!mem) {
+        return 0;
+    }
+
+    pages[empty_page] = mem;
+    page_used[empty_page] = 0x01;
+    stats.pages++;
+    *page = empty_page;
+    *slot = 0;
+    return 1;
+}
+
+static void slot_free(uint16_t page, uint8_t slot) {
+    page_used[page] &= ~(1 << slot);
+}
+
+// ===== Выделение и вытеснение буферов =====
+
+static void buffer_free(bcache_buf_t *b) {
+    hash_remove(b);
+    lru_unlink(b);
+    slot_free(b->page, b->slot);
+    b->dev = NULL;
+    b->flags = 0;
+    b->hash_next = free_headers;
+    free_headers = b;
+    stats.buffers--;
+}
+
+// Самый холодный чистый и никем не занятый буфер
+static bcache_buf_t *find_victim(void) {
+    for (bcache_buf_t *b = lru_tail; b; b = b->lru_prev) {
+        if (b->refcount == 0 &&
+            !(b->flags & (BCACHE_DIRTY | BCACHE_WRITEBACK | BCACHE_READING))) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+// may_flush == 0 — без записи грязных: при нехватке просто NULL
+static bcache_buf_t *buffer_alloc(blkdev_t *dev, uint32_t block, int may_flush) {
+    bcache_buf_t *b = NULL;
+    uint16_t page;
+    uint8_t slot;
+
+    if (stats.buffers < stats.capacity && free_headers && slot_alloc(&page, &slot)) {
+        b = free_headers;
+        free_headers = b->hash_next;
+        b->page = page;
+        b->slot = slot;
+        b->data = pages[page] + slot * BCACHE_BLOCK_SIZE;
+        stats.buffers++;
+    } else {
+        b = find_victim();
+        if (!b && may_flush) {
+            // Все холодные буферы грязные — сбрасываем их и пробуем снова
+            bcache_sync();
+            b = find_victim();
+        }
+        if (!b) {
+            return NULL;
+        }
+        hash_remove(b);
+        lru_unlink(b);
+        stats.evictions++;
+    }
+
+    b->dev = dev;
+    b->block = block;
+    b->flags = 0;
+    b->refcount = 1;
+    b->hash_next = NULL;
+    hash_insert(b);
+    lru_push_head(b);
+    return b;
+}
+
+// ===== Ввод-вывод =====
+
+// Завершение ввода-вывода выброшенного буфера: он больше никому не нужен
+static int buffer_end_dropped(bcache_buf_t *b) {
+    if (!(b->flags & BCACHE_DROPPED) || b->refcount != 0) {
+        return 0;
+    }
+    buffer_free(b);
+    return 1;
+}
+
+static void read_end_io(blk_bio_t *bio) {
+    bcache_buf_t *b = (bcache_buf_t*)bio->private_data;
+
+    b->flags &= ~BCACHE_READING;
+    b->refcount--;
+    if (buffer_end_dropped(b)) {
+        return;
+    }
+
+    if (bio->error != BLK_OK) {
+        stats.io_errors++;
+        b->flags &= ~BCACHE_READAHEAD;
+        if (b->refcount == 0 && !(b->flags & BCACHE_DIRTY)) {
+            buffer_free(b);
+        }
+        return;
+    }
+
+    b->flags |= BCACHE_VALID;
+}
+
+// Поставить чтение буфера в очередь; буфер закреплен до завершения
+static int buffer_start_read(bcache_buf_t *b) {
+    blk_bio_t *bio = &b->bio;
+
+    memset(bio, 0, sizeof(blk_bio_t));
+    bio->lba = b->block;
+    bio->count = 1;
+    bio->buffer = b->data;
+    bio->op = BLK_OP_READ;
+    bio->end_io = read_end_io;
+    bio->private_data = b;
+
+    b->flags |= BCACHE_READING;
+    b->refcount++;
+
+    if (blk_submit_bio(b->dev, bio) != BLK_OK) {
+        bio->error = BLK_ERR_IO;
+        read_end_io(bio);
+        return -1;
+    }
+    return 0;
+}
+
+static int buffer_read_sync(bcache_buf_t *b) {
+    if (!(b->flags & BCACHE_READING) && buffer_start_read(b) != 0) {
+        return -1;
+    }
+    blk_wait_bio(b->dev, &b->bio);
+    return (b->flags & BCACHE_VALID) ? 0 : -1;
+}
+
+// ===== Упреждающее чтение =====
+
+// Асинхронно запросить блоки [start, start + count), которых нет в кэше.
+// Соседние bio склеиваются лифтом в крупные запросы; отправка — при
+// следующем запуске очереди (в том числе вместе с чтением текущего блока).
+static uint32_t readahead_issue(blkdev_t *dev, uint32_t start, uint32_t count) {
+    uint32_t issued = 0;
+
+    if (start >= dev->total_sectors) {
+        return 0;
+    }
+    if (start + count > dev->total_sectors) {
+        count = dev->total_sectors - start;
+    }
+
+    for (uint32_t block = start; block < start + count; block++) {
+        if (hash_lookup(dev, block)) {
+            continue;
+        }
+
+        // Ради упреждения грязные буферы не сбрасываем
+        bcache_buf_t *b = buffer_alloc(dev, block, 0);
+        if (!b) {
+            break;
+        }
+        b->flags |= BCACHE_READAHEAD;
+        buffer_start_read(b);
+        b->refcount--;          // Закреплен только на время чтения
+        issued++;
+    }
+
+    stats.ra_blocks += issued;
+    return issued;
+}
+
+static bcache_stream_t *stream_find(blkdev_t *dev, uint32_t block) {
+    for (int i = 0; i < BCACHE_RA_STREAMS; i++) {
+        bcache_stream_t *s = &streams[i];
+        uint32_t slack = s->ra_size ? s->ra_size : BCACHE_RA_MIN_BLOCKS;
+        if (s->dev == dev &&
+            block + slack >= s->next_block && block <= s->next_block + slack) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static bcache_stream_t *stream_new(blkdev_t *dev, uint32_t block) {
+    bcache_stream_t *victim = &streams[0];
+    for (int i = 1; i < BCACHE_RA_STREAMS; i++) {
+        if (streams[i].last_used_us < victim->last_used_us) {
+            victim = &streams[i];
+        }
+    }
+    victim->dev = dev;
+    victim->next_block = block;
+    victim->ra_end = block;
+    victim->ra_size = 0;
+    victim->seq = 0;
+    return victim;
+}
+
+// Учет обращения к блоку: определение последовательного доступа
+// и выдача следующего окна упреждения, пока читатель его не догнал
+static uint32_t readahead_account(blkdev_t *dev, uint32_t block) {
+    bcache_stream_t *s = stream_find(dev, block);
+
+    if (!s) {
+        s = stream_new(dev, block);
+    } else if (block + 1 == s->next_block) {
+        // Повторное чтение того же блока ничего не говорит о потоке
+        s->last_used_us = timer_get_us();
+        return 0;
+    } else if (block == s->next_block) {
+        s->seq++;
+    } else {
+        // Прыжок внутри окна — поток сбился, уменьшаем окно
+        s->seq = 0;
+        s->ra_size /= 2;
+        if (s->ra_size < BCACHE_RA_MIN_BLOCKS) {
+            s->ra_size = 0;
+        }
+        s->ra_end = block + 1;
+    }
+
+    s->next_block = block + 1;
+    s->last_used_us = timer_get_us();
+
+    if (s->seq < 1) {
+        return 0;
+    }
+
+    // Следующее окно выдается, когда прочитана половина текущего
+    uint32_t trigger = s->ra_end > s->ra_size / 2 ? s->ra_end - s->ra_size / 2 : 0;
+    if (s->ra_size != 0 && block + 1 < trigger) {
+        return 0;
+    }
+
+    if (s->ra_size == 0) {
+        s->ra_size = BCACHE_RA_MIN_BLOCKS;
+    } else if (s->ra_size < BCACHE_RA_MAX_BLOCKS) {
+        s->ra_size *= 2;
+    }
+
+    // Упреждение не должно вытеснять больше четверти кэша
+    uint32_t window = s->ra_size;
+    if (window > stats.capacity / 4) {
+        window = stats.capacity / 4;
+    }
+
+    uint32_t start = s->ra_end > block + 1 ? s->ra_end : block + 1;
+    uint32_t issued = readahead_issue(dev, start, window);
+    s->ra_end = start + window;
+    stats.ra_window = window;
+    return issued;
+}
+
+static void write_end_io(blk_bio_t *bio) {
+    bcache_buf_t *b = (bcache_buf_t*)bio->private_data;
+
+    b->flags &= ~BCACHE_WRITEBACK;
+    b->refcount--;
+    if (buffer_end_dropped(b)) {
+        return;
+    }
+
+    if (bio->error != BLK_OK) {
+        stats.io_errors++;
+        if (!(b->flags & BCACHE_DIRTY)) {
+            b->flags |= BCACHE_DIRTY;
+            stats.dirty++;
+        }
+    }
+}
+
+// Поставить грязный буфер в очередь на запись (без ожидания)
+static int buffer_start_write(bcache_buf_t *b) {
+    blk_bio_t *bio = &b->bio;
+
+    // bio еще стоит в очереди на чтение — затирать его нельзя
+    if (b->flags & BCACHE_READING) {
+        blk_wait_bio(b->dev, bio);
+    }
+    memset(bio, 0, sizeof(blk_bio_t));
+    bio->lba = b->block;
+    bio->count = 1;
+    bio->buffer = b->data;
+    bio->op = BLK_OP_WRITE;
+    bio->end_io = write_end_io;
+    bio->private_data = b;
+
+    b->flags &= ~BCACHE_DIRTY;
+    b->flags |= BCACHE_WRITEBACK;
+    b->refcount++;
+    stats.dirty--;
+    stats.writebacks++;
+
+    if (blk_submit_bio(b->dev, bio) != BLK_OK) {
+        bio->error = BLK_ERR_IO;
+        write_end_io(bio);
+        return -1;
+    }
+    return 0;
+}
+
+static void drain_all_devices(void) {
+    for (int i = 0; i < blkdev_count(); i++) {
+        blkdev_t *dev = blkdev_get(i);
+        if (dev) {
+            blk_drain(dev);
+            blkdev_discard_flush(dev);
+        }
+    }
+}
+
+// Освобожденный блок больше не нужен: грязные данные не пишем вовсе
+static void buffer_drop(bcache_buf_t *b) {
+    b->flags &= ~BCACHE_PINNED;
+    if (b->flags & BCACHE_DIRTY) {
+        b->flags &= ~BCACHE_DIRTY;
+        stats.dirty--;
+    }
+    // Буфер в полете освобождается по завершении запроса, занятый
+    // остается в кэше чистым
+    if (b->flags & (BCACHE_READING | BCACHE_WRITEBACK)) {
+        b->flags |= BCACHE_DROPPED;
+    } else if (b->refcount == 0) {
+        buffer_free(b);
+    }
+}
+
+// ===== Публичный интерфейс =====
+
+bcache_buf_t *bcache_get(blkdev_t *dev, uint32_t block) {
+    if (!initialized || !dev || block >= dev->total_sectors) {
+        return NULL;
+    }
+
+    bcache_buf_t *b = hash_lookup(dev, block);
+    if (b) {
+        b->refcount++;
+        b->flags &= ~BCACHE_DROPPED;
+        lru_touch(b);
+        // Упреждение еще читает блок: его завершение затерло бы то, что
+        // вызывающий сейчас запишет в буфер
+        if (b->flags & BCACHE_READING) {
+            blk_wait_bio(dev, &b->bio);
+        }
+        return b;
+    }
+
+    return buffer_alloc(dev, block, 1);
+}
+
+bcache_buf_t *bcache_read(blkdev_t *dev, uint32_t block) {
+    if (!initialized || !dev || block >= dev->total_sectors) {
+        return NULL;
+    }
+
+    uint32_t ra_issued = readahead_account(dev, block);
+
+    bcache_buf_t *b = hash_lookup(dev, block);
+    if (b) {
+        b->flags &= ~BCACHE_DROPPED;    // Блок снова нужен
+    }
+    if (b && (b->flags & BCACHE_VALID)) {
+        stats.hits++;
+        if (b->flags & BCACHE_READAHEAD) {
+            b->flags &= ~BCACHE_READAHEAD;
+            stats.ra_hits++;
+        }
+        if (ra_issued) {
+            blk_run_queue(dev);
+        }
+        b->refcount++;
+        lru_touch(b);
+        return b;
+    }
+
+    if (b && (b->flags & BCACHE_READING)) {
+        // Блок уже читается упреждением — просто дожидаемся его
+        b->refcount++;
+        lru_touch(b);
+        if (buffer_read_sync(b) == 0) {
+            stats.hits++;
+            stats.ra_hits++;
+            b->flags &= ~BCACHE_READAHEAD;
+            return b;
+        }
+        bcache_release(b);
+        return NULL;
+    }
+
+    stats.misses++;
+    if (b) {
+        b->refcount++;
+        lru_touch(b);
+    } else {
+        b = buffer_alloc(dev, block, 1);
+        if (!b) {
+            return NULL;
+        }
+    }
+
+    if (buffer_read_sync(b) != 0) {
+        b->refcount--;
+        if (b->refcount == 0 && !(b->flags & BCACHE_DIRTY)) {
+            buffer_free(b);
+        }
+        return NULL;
+    }
+
+    return b;
+}
+
+uint32_t bcache_prefetch(blkdev_t *dev, uint32_t block, uint32_t count) {
+    if (!initialized || !dev) {
+        return 0;
+    }
+
+    // Как и упреждение, не вытесняем больше четверти кэша
+    if (count > stats.capacity / 4) {
+        count = stats.capacity / 4;
+    }
+    uint32_t issued = readahead_issue(dev, block, count);
+    if (issued) {
+        blk_run_queue(dev);
+    }
+    return issued;
+}
+
+void bcache_release(bcache_buf_t *buf) {
+    if (buf && buf->refcount > 0) {
+        buf->refcount--;
+    }
+}
+
+void bcache_mark_dirty(bcache_buf_t *buf) {
+    if (!(buf->flags & BCACHE_DIRTY)) {
+        buf->flags |= BCACHE_DIRTY;
+        buf->dirty_since_us = timer_get_us();
+        stats.dirty++;
+    }
+    buf->flags |= BCACHE_VALID;
+}
+
+int bcache_pin(bcache_buf_t *buf) {
+    if (buf->flags & BCACHE_PINNED) {
+        return 0;
+    }
+    buf->flags |= BCACHE_PINNED;
+    return 1;
+}
+
+void bcache_unpin(bcache_buf_t *buf) {
+    buf->flags &= ~BCACHE_PINNED;
+}
+
+void bcache_mark_checked(bcache_buf_t *buf) {
+    buf->flags |= BCACHE_CHECKED;
+}
+
+// Все грязные буферы ставятся в очередь разом: лифт склеит соседние блоки
+int bcache_sync_dev(blkdev_t *dev) {
+    uint32_t errors_before = stats.io_errors;
+
+    for (bcache_buf_t *b = lru_tail; b; b = b->lru_prev) {
+        if ((b->flags & (BCACHE_DIRTY | BCACHE_PINNED)) == BCACHE_DIRTY &&
+            (!dev || b->dev == dev)) {
+            buffer_start_write(b);
+        }
+    }
+
+    if (dev) {
+        blk_drain(dev);
+        blkdev_discard_flush(dev);
+    } else {
+        drain_all_devices();
+    }
+
+    return stats.io_errors == errors_before ? 0 : -1;
+}
+
+int bcache_sync(void) {
+    return bcache_sync_dev(NULL);
+}
+
+void bcache_invalidate_dev(blkdev_t *dev) {
+    bcache_sync_dev(dev);
+
+    bcache_buf_t *b = lru_tail;
+    while (b) {
+        bcache_buf_t *prev = b->lru_prev;
+        if (b->dev == dev && b->refcount == 0 && !(b->flags & BCACHE_DIRTY)) {
+            buffer_free(b);
+        }
+        b = prev;
+    }
+}
+
+int bcache_discard(blkdev_t *dev, uint32_t block, uint32_t count) {
+    if (!dev || count == 0) {
+        return BLK_ERR_RANGE;
+    }
+
+    if (initialized) {
+        if (count <= stats.buffers) {
+            for (uint32_t i = 0; i < count; i++) {
+                bcache_buf_t *b = hash_lookup(dev, block + i);
+                if (b) {
+                    buffer_drop(b);
+                }
+            }
+        } else {
+            // Диапазон больше кэша — дешевле пройти по всем буферам
+            bcache_buf_t *b = lru_tail;
+            while (b) {
+                bcache_buf_t *prev = b->lru_prev;
+                if (b->dev == dev && b->block >= block && b->block - block < count) {
+                    buffer_drop(b);
+                }
+                b = prev;
+            }
+        }
+    }
+
+    return blkdev_discard(dev, block, count);
+}
+
+// Фоновая запись: старые грязные блоки или все, если их слишком много
+void bcache_flusher(void) {
+    uint64_t now = timer_get_us();
+
+    if (!initialized || now - last_flush_us < BCACHE_FLUSH_INTERVAL_US) {
+        return;
+    }
+    last_flush_us = now;
+    stats.flusher_runs++;
+
+    // Память снова есть — возвращаем кэшу исходный размер
+    if (stats.capacity < target_capacity && !memory_low()) {
+        stats.capacity = target_capacity;
+    }
+
+    if (stats.dirty == 0) {
+        return;
+    }
+
+    int flush_all = stats.buffers > 0 &&
+                    stats.dirty * 100 / stats.buffers >= BCACHE_DIRTY_RATIO;
+    int started = 0;
+
+    for (bcache_buf_t *b = lru_tail; b; b = b->lru_prev) {
+        if ((b->flags & (BCACHE_DIRTY | BCACHE_PINNED)) == BCACHE_DIRTY &&
+            (flush_all || now - b->dirty_since_us >= BCACHE_DIRTY_EXPIRE_US)) {
+            buffer_start_write(b);
+            started++;
+        }
+    }
+
+    if (started) {
+        drain_all_devices();
+    }
+}
+
+// Shrinker для PMM: освобождаем чистые холодные буферы, пока не опустеют страницы
+uint32_t bcache_shrink(uint32_t pages_wanted) {
+    uint32_t freed = 0;
+
+    bcache_buf_t *b = lru_tail;
+    while (b && freed < pages_wanted) {
+        bcache_buf_t *prev = b->lru_prev;
+
+        if (b->refcount == 0 &&
+            !(b->flags & (BCACHE_DIRTY | BCACHE_WRITEBACK | BCACHE_READING))) {
+            uint16_t page = b->page;
+            buffer_free(b);
+
+            if (page_used[page] == 0) {
+                pmm_free_block(pages[page]);
+                pages[page] = NULL;
+                stats.pages--;
+                stats.shrunk_pages++;
+                freed++;
+            }
+        }
+        b = prev;
+    }
+
+    // Не даем кэшу сразу вырасти обратно
+    if (freed > 0) {
+        uint32_t new_capacity = stats.pages * BCACHE_BUFS_PER_PAGE;
+        stats.capacity = new_capacity < BCACHE_MIN_BUFFERS ? BCACHE_MIN_BUFFERS
+                                                           : new_capacity;
+    }
+
+    return freed;
+}
+
+void bcache_init(void) {
+    if (initialized) {
+        return;
+    }
+
+    memset(buffers, 0, sizeof(buffers));
+    memset(hash_table, 0, sizeof(hash_table));
+    memset(pages, 0, sizeof(pages));
+    memset(page_used, 0, sizeof(page_used));
+    memset(&stats, 0, sizeof(stats));
+    memset(streams, 0, sizeof(streams));
+
+    for (int i = BCACHE_MAX_BUFFERS - 1; i >= 0; i--) {
+        buffers[i].hash_next = free_headers;
+        free_headers = &buffers[i];
+    }
+
+    // Размер — доля свободной физической памяти
+    uint32_t capacity = pmm_get_free_memory() / BCACHE_MEM_FRACTION / BCACHE_BLOCK_SIZE;
+    if (capacity < BCACHE_MIN_BUFFERS) {
+        capacity = BCACHE_MIN_BUFFERS;
+    }
+    if (capacity > BCACHE_MAX_BUFFERS) {
+        capacity = BCACHE_MAX_BUFFERS;
+    }
+    stats.capacity = capacity;
+    target_capacity = capacity;
+
+    pmm_register_shrinker(bcache_shrink);
+    idle_register_task("bcache_flush", bcache_flusher);
+    initialized = 1;
+}
+
+bcache_stats_t bcache_get_stats(void) {
+    return stats;
+}
+
+static void print_stat(const char *label, uint32_t value) {
+    char buf[16];
+    video_print(label);
+    itoa(value, buf, 10);
+    video_print(buf);
+    video_print("\n");
+}
+
+void bcache_print_stats(void) {
+    video_print("Buffer cache:\n");
+    video_print("=============\n");
+    print_stat("Capacity:    ", stats.capacity);
+    print_stat("Buffers:     ", stats.buffers);
+    print_stat("Pages:       ", stats.pages);
+    print_stat("Dirty:       ", stats.dirty);
+    print_stat("Hits:        ", stats.hits);
+    print_stat("Misses:      ", stats.misses);
+    print_stat("Evictions:   ", stats.evictions);
+    print_stat("Writebacks:  ", stats.writebacks);
+    print_stat("Flusher runs:", stats.flusher_runs);
+    print_stat("Shrunk pages:", stats.shrunk_pages);
+    print_stat("I/O errors:  ", stats.io_errors);
+    print_stat("RA blocks:   ", stats.ra_blocks);
+    print_stat("RA hits:     ", stats.ra_hits);
+    print_stat("RA window:   ", stats.ra_window);
+}
@@ -0,0 +1,102 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+#include "blkdev.h"
+
+// Общий буферный кэш блочных устройств: ключ (устройство, блок),
+// хэш-поиск, LRU-вытеснение, отложенная запись грязных блоков.
+
+#define BCACHE_BLOCK_SIZE     BLK_SECTOR_SIZE
+#define BCACHE_MAX_BUFFERS    4096        // Жесткий предел (2 MB данных)
+#define BCACHE_MIN_BUFFERS    64
+#define BCACHE_HASH_SIZE      1024
+#define BCACHE_BUFS_PER_PAGE  (4096 / BCACHE_BLOCK_SIZE)
+#define BCACHE_MAX_PAGES      (BCACHE_MAX_BUFFERS / BCACHE_BUFS_PER_PAGE)
+#define BCACHE_MEM_FRACTION   8           // Кэш занимает не более 1/8 свободной памяти
+#define BCACHE_LOW_WATERMARK  16          // Не растем, если свободно < 1/16 памяти
+
+// Параметры фоновой записи
+#define BCACHE_FLUSH_INTERVAL_US  1000000 // Как часто просыпается flusher
+#define BCACHE_DIRTY_EXPIRE_US    5000000 // Возраст грязного блока до записи
+#define BCACHE_DIRTY_RATIO        20      // % грязных, после которого пишем сразу
+
+// Упреждающее чтение (в блоках): окно растет вдвое на каждом
+// последовательном шаге и сжимается при случайном доступе
+#define BCACHE_RA_MIN_BLOCKS  32          // 16 KB
+#define BCACHE_RA_MAX_BLOCKS  1024        // 512 KB
+#define BCACHE_RA_STREAMS     8           // Одновременно отслеживаемых потоков
+
+// Флаги буфера
+#define BCACHE_VALID      0x01
+#define BCACHE_DIRTY      0x02
+#define BCACHE_WRITEBACK  0x04
+#define BCACHE_READING    0x08            // Чтение в полете
+#define BCACHE_READAHEAD  0x10            // Прочитан упреждением, еще не использован
+#define BCACHE_PINNED     0x20            // Грязный, но писать на место нельзя (журнал ФС)
+#define BCACHE_CHECKED    0x40            // ФС проверила содержимое после чтения с диска
+#define BCACHE_DROPPED    0x80            // Выброшен discard'ом в полете: освободить по завершении
+
+typedef struct bcache_buf {
+    blkdev_t *dev;
+    uint32_t block;
+    uint8_t *data;
+    uint16_t page;
+    uint8_t slot;
+    uint8_t flags;
+    uint16_t refcount;
+    uint64_t dirty_since_us;
+    struct bcache_buf *hash_next;
+    struct bcache_buf *lru_prev;     // lru_prev ближе к голове (горячее)
+    struct bcache_buf *lru_next;
+    blk_bio_t bio;                   // Для асинхронной записи/чтения
+} bcache_buf_t;
+
+typedef struct {
+    uint32_t capacity;               // Текущий предел числа буферов
+    uint32_t buffers;                // Занято буферов
+    uint32_t pages;                  // Выделено страниц PMM
+    uint32_t dirty;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t writebacks;
+    uint32_t flusher_runs;
+    uint32_t shrunk_pages;
+    uint32_t io_errors;
+    uint32_t ra_blocks;              // Блоков запрошено упреждением
+    uint32_t ra_hits;                // Из них реально пригодилось
+    uint32_t ra_window;              // Последнее окно упреждения
+} bcache_stats_t;
+
+void bcache_init(void);
+
+// Получить блок с данными (чтение с диска при промахе). NULL при ошибке.
+bcache_buf_t *bcache_read(blkdev_t *dev, uint32_t block);
+// Получить буфер без чтения — для полной перезаписи блока
+bcache_buf_t *bcache_get(blkdev_t *dev, uint32_t block);
+void bcache_release(bcache_buf_t *buf);
+// Заранее запросить блоки [block, block + count), которых нет в кэше:
+// ФС знает границы экстента и читает его крупными запросами
+uint32_t bcache_prefetch(blkdev_t *dev, uint32_t block, uint32_t count);
+void bcache_mark_dirty(bcache_buf_t *buf);
+// Закрепленный грязный буфер не пишется и не вытесняется до открепления.
+// bcache_pin возвращает 1, если буфер не был закреплен раньше.
+int bcache_pin(bcache_buf_t *buf);
+void bcache_unpin(bcache_buf_t *buf);
+// Содержимое проверено ФС: пока буфер держит этот блок, проверка не нужна
+void bcache_mark_checked(bcache_buf_t *buf);
+
+// Запись грязных блоков
+int bcache_sync_dev(blkdev_t *dev);
+int bcache_sync(void);
+void bcache_invalidate_dev(blkdev_t *dev);
+// Блоки освобождены ФС: выбросить их из кэша (без записи) и передать discard
+int bcache_discard(blkdev_t *dev, uint32_t block, uint32_t count);
+void bcache_flusher(void);
+uint32_t bcache_shrink(uint32_t pages_wanted);
+
+bcache_stats_t bcache_get_stats(void);
+void bcache_print_stats(void);
+
+#endif
@@ -0,0 +1,954 @@
+#include "blkdev.h"
+#include "iosched.h"
+#include "string.h"
+#include "video.h"
+#include "timer.h"
+#include "idle.h"
+
+static blkdev_t devices[BLK_MAX_DEVICES];
+static int device_count = 0;
+
+// Снимок счетчиков для iostat с интервалом
+static blk_queue_stats_t iostat_prev[BLK_MAX_DEVICES];
+static uint64_t iostat_prev_us = 0;
+
+// Сколько bio синхронный вызов держит в очереди одновременно
+#define BLK_SYNC_BATCH 8
+
+// ===== Реестр устройств =====
+
+blkdev_t *blkdev_register(const char *name, uint32_t total_sectors,
+                          const blkdev_ops_t *ops, void *driver_data) {
+    blkdev_t *dev = blkdev_find(name);
+
+    if (!dev) {
+        if (device_count >= BLK_MAX_DEVICES) {
+            return NULL;
+        }
+        dev = &devices[device_count++];
+        memset(dev, 0, sizeof(blkdev_t));
+        strncpy(dev->name, name, BLK_NAME_LEN - 1);
+        dev->queue.sched = iosched_default();
+        dev->queue.sched->init(&dev->queue);
+        dev->queue.max_sectors = BLK_DEFAULT_MAX_SECTORS;
+        dev->queue.max_hw_sectors = BLK_HARD_MAX_SECTORS;
+        dev->queue.max_segments = BLK_MAX_BIOS_PER_RQ;
+        dev->queue.queue_depth = 1;
+    }
+
+    dev->total_sectors = total_sectors;
+    dev->ops = ops;
+    dev->driver_data = driver_data;
+    dev->registered = 1;
+    return dev;
+}
+
+blkdev_t *blkdev_find(const char *name) {
+    for (int i = 0; i < device_count; i++) {
+        if (devices[i].registered && strcmp(devices[i].name, name) == 0) {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+blkdev_t *blkdev_get(int index) {
+    if (index < 0 || index >= device_count || !devices[index].registered) {
+        return NULL;
+    }
+    return &devices[index];
+}
+
+int blkdev_count(void) {
+    return device_count;
+}
+
+// ===== Очередь =====
+
+static void queue_unlink(blk_queue_t *q, blk_request_t *rq) {
+    if (rq->prev) {
+        rq->prev->next = rq->next;
+    } else {
+        q->head = rq->next;
+    }
+    if (rq->next) {
+        rq->next->prev = rq->prev;
+    } else {
+        q->tail = rq->prev;
+    }
+    rq->prev = rq->next = NULL;
+    q->stats.queue_depth--;
+}
+
+static void queue_append(blk_queue_t *q, blk_request_t *rq) {
+    rq->next = NULL;
+    rq->prev = q->tail;
+    if (q->tail) {
+        q->tail->next = rq;
+    } else {
+        q->head = rq;
+    }
+    q->tail = rq;
+    q->stats.queue_depth++;
+    if (q->stats.queue_depth > q->stats.max_queue_depth) {
+        q->stats.max_queue_depth = q->stats.queue_depth;
+    }
+}
+
+static void queue_prepend(blk_queue_t *q, blk_request_t *rq) {
+    rq->prev = NULL;
+    rq->next = q->head;
+    if (q->head) {
+        q->head->prev = rq;
+    } else {
+        q->tail = rq;
+    }
+    q->head = rq;
+    q->stats.queue_depth++;
+}
+
+static blk_request_t *request_alloc(blkdev_t *dev) {
+    blk_queue_t *q = &dev->queue;
+
+    while (1) {
+        for (int i = 0; i < BLK_REQUEST_POOL; i++) {
+            if (!q->pool[i].in_use) {
+                memset(&q->pool[i], 0, sizeof(blk_request_t));
+                q->pool[i].in_use = 1;
+                q->pool[i].dev = dev;
+                return &q->pool[i];
+            }
+        }
+        // Пул исчерпан — продвигаем очередь, пока что-нибудь не освободится
+        blk_poll(dev);
+    }
+}
+
+static int can_merge(blk_queue_t *q, blk_request_t *rq, uint8_t op,
+                     uint32_t count, uint32_t nr_bios) {
+    return rq->op == op &&
+           rq->count + count <= q->max_sectors &&
+           rq->nr_bios + nr_bios <= q->max_segments;
+}
+
+// Склейка двух соседних запросов очереди: next следует сразу за rq
+static void request_absorb(blk_queue_t *q, blk_request_t *rq, blk_request_t *next) {
+    rq->bio_tail->next = next->bio_head;
+    rq->bio_tail = next->bio_tail;
+    rq->count += next->count;
+    rq->nr_bios += next->nr_bios;
+    if (next->queued_us < rq->queued_us) {
+        rq->queued_us = next->queued_us;
+    }
+    queue_unlink(q, next);
+    next->in_use = 0;
+    q->stats.rq_merges++;
+}
+
+// Попытка добавить bio к уже стоящему в очереди запросу
+static int attempt_merge(blk_queue_t *q, blk_bio_t *bio) {
+    for (blk_request_t *rq = q->tail; rq; rq = rq->prev) {
+        if (!can_merge(q, rq, bio->op, bio->count, 1)) {
+            continue;
+        }
+
+        if (rq->lba + rq->count == bio->lba) {
+            rq->bio_tail->next = bio;
+            rq->bio_tail = bio;
+            rq->count += bio->count;
+            rq->nr_bios++;
+            q->stats.back_merges++;
+
+            // bio мог заполнить промежуток до следующего запроса
+            for (blk_request_t *n = q->head; n; n = n->next) {
+                if (n != rq && n->lba == rq->lba + rq->count &&
+                    can_merge(q, rq, n->op, n->count, n->nr_bios)) {
+                    request_absorb(q, rq, n);
+                    break;
+                }
+            }
+            return 1;
+        }
+
+        if (bio->lba + bio->count == rq->lba) {
+            bio->next = rq->bio_head;
+            rq->bio_head = bio;
+            rq->lba = bio->lba;
+            rq->count += bio->count;
+            rq->nr_bios++;
+            q->stats.front_merges++;
+
+            for (blk_request_t *p = q->head; p; p = p->next) {
+                if (p != rq && p->lba + p->count == rq->lba &&
+                    can_merge(q, p, rq->op, rq->count, rq->nr_bios)) {
+                    request_absorb(q, p, rq);
+                    break;
+                }
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ===== Discard =====
+//
+// Запросы discard идут отдельным списком мимо планировщика. Для ATA это
+// команда без очереди (не NCQ), поэтому она отправляется, только когда
+// в драйвере ничего нет, и до ее завершения ничего больше не отправляется.
+// Так и запись, поставленная после discard, гарантированно ляжет после него.
+
+// Снять с пачки секторы, в которые снова пишут: их нельзя стирать
+static void discard_batch_cancel(blk_queue_t *q, uint32_t lba, uint32_t count) {
+    blk_extent_t *e = q->discard_batch;
+    uint32_t end = lba + count;
+    uint32_t i = 0;
+
+    while (i < q->discard_pending) {
+        uint32_t start = e[i].lba;
+        uint32_t stop = start + e[i].count;
+
+        if (stop <= lba || start >= end) {
+            i++;
+            continue;
+        }
+
+        if (start < lba && stop > end) {
+            // Запись внутри диапазона: делим его на два. Если места нет,
+            // хвост просто теряется — discard лишь подсказка устройству.
+            if (q->discard_pending < BLK_DISCARD_BATCH) {
+                for (uint32_t j = q->discard_pending; j > i + 1; j--) {
+                    e[j] = e[j - 1];
+                }
+                e[i + 1].lba = end;
+                e[i + 1].count = stop - end;
+                q->discard_pending++;
+            }
+            e[i].count = lba - start;
+            q->stats.discard_cancelled += count;
+            return;
+        }
+
+        if (start < lba) {
+            q->stats.discard_cancelled += stop - lba;
+            e[i++].count = lba - start;
+        } else if (stop > end) {
+            q->stats.discard_cancelled += end - start;
+            e[i].lba = end;
+            e[i++].count = stop - end;
+        } else {
+            q->stats.discard_cancelled += e[i].count;
+            for (uint32_t j = i + 1; j < q->discard_pending; j++) {
+                e[j - 1] = e[j];
+            }
+            q->discard_pending--;
+        }
+    }
+}
+
+// Добавить диапазон в пачку, склеив его с перекрывающимися и смежными.
+// В пачке должно быть свободное место.
+static void discard_batch_insert(blk_queue_t *q, uint32_t lba, uint32_t count) {
+    blk_extent_t *e = q->discard_batch;
+    uint32_t n = q->discard_pending;
+    uint32_t end = lba + count;
+    uint32_t first = 0;
+
+    while (first < n && e[first].lba + e[first].count < lba) {
+        first++;
+    }
+
+    // e[first..last) касаются нового диапазона и поглощаются им
+    uint32_t last = first;
+    while (last < n && e[last].lba <= end) {
+        if (e[last].lba < lba) {
+            lba = e[last].lba;
+        }
+        if (e[last].lba + e[last].count > end) {
+            end = e[last].lba + e[last].count;
+        }
+        last++;
+    }
+
+    if (last == first) {
+        for (uint32_t j = n; j > first; j--) {
+            e[j] = e[j - 1];
+        }
+        n++;
+    } else {
+        uint32_t removed = last - first - 1;
+        for (uint32_t j = last; j < n; j++) {
+            e[j - removed] = e[j];
+        }
+        n -= removed;
+    }
+
+    e[first].lba = lba;
+    e[first].count = end - lba;
+    if (q->discard_pending == 0) {
+        q->discard_since_us = timer_get_us();
+    }
+    q->discard_pending = n;
+}
+
+// Запросы discard склеиваются без учета смежности: каждый bio — диапазон
+static int discard_merge(blk_queue_t *q, blk_bio_t *bio) {
+    blk_request_t *rq = q->discard_tail;
+
+    if (!rq || rq->op != BLK_OP_DISCARD || rq->nr_bios >= q->max_discard_segments) {
+        return 0;
+    }
+
+    rq->bio_tail->next = bio;
+    rq->bio_tail = bio;
+    rq->count += bio->count;
+    rq->nr_bios++;
+    if (bio->lba < rq->lba) {
+        rq->lba = bio->lba;
+    }
+    q->stats.back_merges++;
+    return 1;
+}
+
+static void discard_append(blk_queue_t *q, blk_request_t *rq) {
+    rq->prev = NULL;
+    rq->next = NULL;
+    if (q->discard_tail) {
+        q->discard_tail->next = rq;
+    } else {
+        q->discard_head = rq;
+    }
+    q->discard_tail = rq;
+}
+
+// Поставить bio в очередь. Запрос не отправляется в драйвер сразу:
+// соседние bio успевают склеиться до blk_run_queue()/blk_wait_bio().
+int blk_submit_bio(blkdev_t *dev, blk_bio_t *bio) {
+    if (!dev || !dev->registered) {
+        return BLK_ERR_NODEV;
+    }
+
+    blk_queue_t *q = &dev->queue;
+    int discard = bio->op == BLK_OP_DISCARD;
+    int flush = bio->op == BLK_OP_FLUSH;
+    uint32_t limit = discard ? q->max_discard_sectors : q->max_sectors;
+
+    if (flush) {
+        bio->lba = 0;
+        bio->count = 0;
+    } else if (bio->count == 0 || (limit && bio->count > limit) ||
+               bio->lba + bio->count > dev->total_sectors ||
+               bio->lba + bio->count < bio->lba) {
+        return BLK_ERR_RANGE;
+    }
+
+    bio->done = 0;
+    bio->error = BLK_OK;
+    bio->next = NULL;
+    q->stats.bios++;
+
+    // Устройство не умеет discard: данные просто остаются на месте.
+    // Без кэша записи завершенные записи уже на носителе.
+    if ((discard && !limit) || (flush && !q->write_cache)) {
+        bio->done = 1;
+        if (bio->end_io) {
+            bio->end_io(bio);
+        }
+        return BLK_OK;
+    }
+
+    if (bio->op == BLK_OP_WRITE && q->discard_pending) {
+        discard_batch_cancel(q, bio->lba, bio->count);
+    }
+
+    if (discard ? discard_merge(q, bio) : !flush && attempt_merge(q, bio)) {
+        return BLK_OK;
+    }
+
+    blk_request_t *rq = request_alloc(dev);
+    rq->op = bio->op;
+    rq->lba = bio->lba;
+    rq->count = bio->count;
+    rq->nr_bios = 1;
+    rq->bio_head = rq->bio_tail = bio;
+    rq->queued_us = timer_get_us();
+    if (discard || flush) {
+        discard_append(q, rq);
+    } else {
+        queue_append(q, rq);
+    }
+
+    return BLK_OK;
+}
+
+// Отправить в драйвер столько запросов, сколько он принимает
+void blk_run_queue(blkdev_t *dev) {
+    blk_queue_t *q = &dev->queue;
+
+    while (q->stats.in_flight < q->queue_depth && !q->discard_in_flight) {
+        blk_request_t *rq;
+
+        if (q->discard_head) {
+            // discard и flush ждут, пока устройство опустеет, и идут одни
+            if (q->stats.in_flight) {
+                break;
+            }
+            rq = q->discard_head;
+            q->discard_head = rq->next;
+            if (!q->discard_head) {
+                q->discard_tail = NULL;
+            }
+            rq->next = NULL;
+            q->discard_in_flight = 1;
+        } else {
+            if (!q->head) {
+                break;
+            }
+            rq = q->sched->next_request(q);
+            if (!rq) {
+                break;
+            }
+            queue_unlink(q, rq);
+        }
+
+        rq->dispatched_us = timer_get_us();
+        if (q->stats.in_flight++ == 0) {
+            q->stats.busy_since_us = rq->dispatched_us;
+        }
+
+        if (dev->ops->submit(dev, rq) != 0) {
+            // Драйвер занят — вернем запрос в голову очереди
+            q->stats.in_flight--;
+            if (rq->op == BLK_OP_DISCARD || rq->op == BLK_OP_FLUSH) {
+                q->discard_in_flight = 0;
+                rq->next = q->discard_head;
+                q->discard_head = rq;
+                if (!q->discard_tail) {
+                    q->discard_tail = rq;
+                }
+            } else {
+                queue_prepend(q, rq);
+            }
+            break;
+        }
+
+        q->stats.requests++;
+        if (rq->op != BLK_OP_DISCARD && rq->op != BLK_OP_FLUSH) {
+            q->sched->dispatched(q, rq);
+        }
+    }
+}
+
+void blk_poll(blkdev_t *dev) {
+    if (dev->ops->poll) {
+        dev->ops->poll(dev);
+    }
+    blk_run_queue(dev);
+}
+
+void blk_wait_bio(blkdev_t *dev, blk_bio_t *bio) {
+    blk_run_queue(dev);
+    while (!bio->done) {
+        blk_poll(dev);
+    }
+}
+
+void blk_drain(blkdev_t *dev) {
+    blk_run_queue(dev);
+    while (dev->queue.head || dev->queue.discard_head ||
+           dev->queue.stats.in_flight) {
+        blk_poll(dev);
+    }
+}
+
+static uint32_t lat_bucket(uint64_t us) {
+    uint32_t bucket = 0;
+    while (us > 1 && bucket < BLK_LAT_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// Учет завершенного запроса: время в очереди и в драйвере
+static void account_done(blk_queue_t *q, blk_request_t *rq, int error) {
+    blk_queue_stats_t *s = &q->stats;
+    uint64_t now = timer_get_us();
+    uint64_t wait = rq->dispatched_us - rq->queued_us;
+    uint64_t service = now - rq->dispatched_us;
+
+    if (rq->op == BLK_OP_READ) {
+        s->sectors_read += rq->count;
+        s->reads++;
+    } else if (rq->op == BLK_OP_DISCARD) {
+        s->sectors_discarded += rq->count;
+        s->discards++;
+    } else if (rq->op == BLK_OP_FLUSH) {
+        s->flushes++;
+    } else {
+        s->sectors_written += rq->count;
+        s->writes++;
+    }
+    if (error != BLK_OK) {
+        s->errors++;
+    }
+
+    s->queue_us += wait;
+    s->service_us += service;
+    s->queue_hist[lat_bucket(wait)]++;
+    s->service_hist[lat_bucket(service)]++;
+
+    if (--s->in_flight == 0) {
+        s->busy_us += now - s->busy_since_us;
+    }
+}
+
+// Завершение запроса драйвером: уведомляем каждого из склеенных вызывающих
+void blk_end_request(blk_request_t *rq, int error) {
+    blkdev_t *dev = rq->dev;
+    blk_queue_t *q = &dev->queue;
+    blk_bio_t *bio = rq->bio_head;
+
+    account_done(q, rq, error);
+    if (rq->op == BLK_OP_DISCARD || rq->op == BLK_OP_FLUSH) {
+        q->discard_in_flight = 0;
+    }
+    rq->in_use = 0;
+
+    while (bio) {
+        blk_bio_t *next = bio->next;
+        bio->error = (int8_t)error;
+        bio->done = 1;
+        if (bio->end_io) {
+            bio->end_io(bio);
+        }
+        bio = next;
+    }
+}
+
+// Драйвер повторил команду запроса после ошибки
+void blk_account_retry(blk_request_t *rq) {
+    rq->dev->queue.stats.retries++;
+}
+
+void blk_account_csum_error(blkdev_t *dev) {
+    dev->queue.stats.csum_errors++;
+}
+
+void blk_rq_iter_init(blk_rq_iter_t *it, blk_request_t *rq) {
+    it->bio = rq->bio_head;
+    it->sector = 0;
+}
+
+// Адрес данных очередного сектора запроса
+void *blk_rq_iter_next(blk_rq_iter_t *it) {
+    while (it->bio && it->sector >= it->bio->count) {
+        it->bio = it->bio->next;
+        it->sector = 0;
+    }
+    if (!it->bio) {
+        return NULL;
+    }
+    return (uint8_t *)it->bio->buffer + (it->sector++) * BLK_SECTOR_SIZE;
+}
+
+// ===== Синхронный интерфейс =====
+
+// Дождаться пачки bio; result — первая ошибка (или BLK_OK)
+static int wait_bios(blkdev_t *dev, blk_bio_t *bios, int n, int result) {
+    for (int i = 0; i < n; i++) {
+        blk_wait_bio(dev, &bios[i]);
+        if (bios[i].error != BLK_OK && result == BLK_OK) {
+            result = bios[i].error;
+        }
+    }
+    return result;
+}
+
+static int blkdev_rw(blkdev_t *dev, uint8_t op, uint32_t lba,
+                     uint32_t count, void *buffer) {
+    blk_bio_t bios[BLK_SYNC_BATCH];
+    uint8_t *ptr = (uint8_t *)buffer;
+    int result = BLK_OK;
+
+    if (!dev || !dev->registered) {
+        return BLK_ERR_NODEV;
+    }
+
+    while (count > 0) {
+        int n = 0;
+
+        // Ставим в очередь пачку кусков, затем ждем их все
+        while (count > 0 && n < BLK_SYNC_BATCH) {
+            uint32_t chunk = count > dev->queue.max_sectors ?
+                             dev->queue.max_sectors : count;
+            blk_bio_t *bio = &bios[n];
+
+            memset(bio, 0, sizeof(blk_bio_t));
+            bio->lba = lba;
+            bio->count = chunk;
+            bio->buffer = ptr;
+            bio->op = op;
+
+            int rc = blk_submit_bio(dev, bio);
+            if (rc != BLK_OK) {
+                result = rc;
+                count = 0;
+                break;
+            }
+
+            n++;
+            lba += chunk;
+            count -= chunk;
+            ptr += chunk * BLK_SECTOR_SIZE;
+        }
+
+        result = wait_bios(dev, bios, n, result);
+    }
+
+    return result;
+}
+
+int blkdev_read(blkdev_t *dev, uint32_t lba, uint32_t count, void *buffer) {
+    return blkdev_rw(dev, BLK_OP_READ, lba, count, buffer);
+}
+
+int blkdev_write(blkdev_t *dev, uint32_t lba, uint32_t count, const void *buffer) {
+    return blkdev_rw(dev, BLK_OP_WRITE, lba, count, (void *)buffer);
+}
+
+int blkdev_discard(blkdev_t *dev, uint32_t lba, uint32_t count) {
+    static uint8_t timer_registered = 0;
+
+    if (!dev || !dev->registered) {
+        return BLK_ERR_NODEV;
+    }
+    if (count == 0 || lba + count > dev->total_sectors || lba + count < lba) {
+        return BLK_ERR_RANGE;
+    }
+
+    blk_queue_t *q = &dev->queue;
+    if (!q->max_discard_sectors) {
+        return BLK_OK;
+    }
+
+    if (!timer_registered) {
+        idle_register_task("blk_discard", blkdev_discard_timer);
+        timer_registered = 1;
+    }
+
+    int result = BLK_OK;
+    if (q->discard_pending == BLK_DISCARD_BATCH) {
+        result = blkdev_discard_flush(dev);
+    }
+    discard_batch_insert(q, lba, count);
+    return result;
+}
+
+// Отправить всю пачку и дождаться ее. Диапазоны склеиваются в запросы
+// по max_discard_segments — обычно вся пачка уходит одной командой.
+int blkdev_discard_flush(blkdev_t *dev) {
+    blk_extent_t batch[BLK_DISCARD_BATCH];
+    blk_bio_t bios[BLK_DISCARD_BATCH];
+    int result = BLK_OK;
+    int n = 0;
+
+    if (!dev || !dev->registered) {
+        return BLK_ERR_NODEV;
+    }
+
+    blk_queue_t *q = &dev->queue;
+    uint32_t pending = q->discard_pending;
+    if (pending == 0) {
+        return BLK_OK;
+    }
+    memcpy(batch, q->discard_batch, pending * sizeof(blk_extent_t));
+    q->discard_pending = 0;
+
+    for (uint32_t i = 0; i < pending; i++) {
+        uint32_t lba = batch[i].lba;
+        uint32_t count = batch[i].count;
+
+        while (count > 0) {
+            uint32_t chunk = count > q->max_discard_sectors ?
+                             q->max_discard_sectors : count;
+
+            if (n == BLK_DISCARD_BATCH) {
+                result = wait_bios(dev, bios, n, result);
+                n = 0;
+            }
+
+            blk_bio_t *bio = &bios[n];
+            memset(bio, 0, sizeof(blk_bio_t));
+            bio->lba = lba;
+            bio->count = chunk;
+            bio->op = BLK_OP_DISCARD;
+            if (blk_submit_bio(dev, bio) == BLK_OK) {
+                n++;
+            }
+
+            lba += chunk;
+            count -= chunk;
+        }
+    }
+
+    return wait_bios(dev, bios, n, result);
+}
+
+int blkdev_flush(blkdev_t *dev) {
+    blk_bio_t bio;
+
+    if (!dev || !dev->registered) {
+        return BLK_ERR_NODEV;
+    }
+
+    memset(&bio, 0, sizeof(blk_bio_t));
+    bio.op = BLK_OP_FLUSH;
+    int result = blk_submit_bio(dev, &bio);
+    if (result != BLK_OK) {
+        return result;
+    }
+    return wait_bios(dev, &bio, 1, BLK_OK);
+}
+
+// Фоновая задача: пачки, копившиеся дольше BLK_DISCARD_DELAY_US
+void blkdev_discard_timer(void) {
+    uint64_t now = timer_get_us();
+
+    for (int i = 0; i < device_count; i++) {
+        blk_queue_t *q = &devices[i].queue;
+        if (devices[i].registered && q->discard_pending &&
+            now - q->discard_since_us >= BLK_DISCARD_DELAY_US) {
+            blkdev_discard_flush(&devices[i]);
+        }
+    }
+}
+
+// ===== Настройка =====
+
+int blkdev_set_scheduler(blkdev_t *dev, const char *name) {
+    const iosched_ops_t *sched = iosched_find(name);
+    if (!dev || !sched) {
+        return -1;
+    }
+
+    // Очередь должна быть пустой при смене политики
+    blk_drain(dev);
+    dev->queue.sched = sched;
+    sched->init(&dev->queue);
+    return 0;
+}
+
+void blkdev_set_max_sectors(blkdev_t *dev, uint32_t max_sectors) {
+    if (max_sectors == 0) {
+        max_sectors = 1;
+    }
+    if (max_sectors > dev->queue.max_hw_sectors) {
+        max_sectors = dev->queue.max_hw_sectors;
+    }
+    dev->queue.max_sectors = max_sectors;
+}
+
+// Пределы драйвера: размер запроса и число bio (например, записей PRDT)
+void blkdev_set_hw_limits(blkdev_t *dev, uint32_t max_hw_sectors, uint32_t max_segments) {
+    dev->queue.max_hw_sectors = max_hw_sectors ? max_hw_sectors : 1;
+    dev->queue.max_segments = max_segments ? max_segments : 1;
+    if (dev->queue.max_sectors > dev->queue.max_hw_sectors) {
+        dev->queue.max_sectors = dev->queue.max_hw_sectors;
+    }
+}
+
+void blkdev_set_queue_depth(blkdev_t *dev, uint32_t depth) {
+    dev->queue.queue_depth = depth ? depth : 1;
+}
+
+// Драйвер умеет discard: предел одного диапазона и диапазонов в команде
+void blkdev_set_discard(blkdev_t *dev, uint32_t max_sectors, uint32_t max_segments) {
+    dev->queue.max_discard_sectors = max_sectors;
+    dev->queue.max_discard_segments = max_segments ? max_segments : 1;
+}
+
+// У устройства кэш записи: FS просит сбросить его командой flush
+void blkdev_set_write_cache(blkdev_t *dev, int enabled) {
+    dev->queue.write_cache = enabled ? 1 : 0;
+}
+
+static void print_num(const char *label, uint32_t value) {
+    char buf[16];
+    video_print(label);
+    itoa(value, buf, 10);
+    video_print(buf);
+}
+
+void blkdev_print_stats(void) {
+    if (device_count == 0) {
+        video_print("No block devices registered\n");
+        return;
+    }
+
+    video_print("Block devices:\n");
+    video_print("==============\n");
+
+    for (int i = 0; i < device_count; i++) {
+        blkdev_t *dev = &devices[i];
+        blk_queue_stats_t *s = &dev->queue.stats;
+
+        if (!dev->registered) {
+            continue;
+        }
+
+        video_print(dev->name);
+        print_num(": ", dev->total_sectors / 2048);
+        video_print(" MB  sched=");
+        video_print(dev->queue.sched->name);
+        print_num("  max_req=", dev->queue.max_sectors / 2);
+        video_print(" KB");
+        print_num("  qd=", dev->queue.queue_depth);
+        video_print("\n");
+
+        print_num("  bios=", s->bios);
+        print_num(" requests=", s->requests);
+        print_num(" merges: back=", s->back_merges);
+        print_num(" front=", s->front_merges);
+        print_num(" rq=", s->rq_merges);
+        video_print("\n");
+
+        print_num("  queue depth=", s->queue_depth);
+        print_num(" max=", s->max_queue_depth);
+        print_num(" in_flight=", s->in_flight);
+        print_num(" read=", (uint32_t)(s->sectors_read / 2));
+        print_num(" KB written=", (uint32_t)(s->sectors_written / 2));
+        video_print(" KB\n");
+
+        if (dev->queue.max_discard_sectors) {
+            print_num("  discards=", s->discards);
+            print_num(" trimmed=", (uint32_t)(s->sectors_discarded / 2));
+            print_num(" KB pending=", dev->queue.discard_pending);
+            print_num(" cancelled=", s->discard_cancelled / 2);
+            video_print(" KB\n");
+        }
+        if (dev->queue.write_cache) {
+            print_num("  flushes=", s->flushes);
+            video_print("\n");
+        }
+    }
+}
+
+// ===== iostat =====
+
+static void print_col(uint32_t value, int width) {
+    char buf[16];
+    itoa(value, buf, 10);
+    for (int pad = width - (int)strlen(buf); pad > 0; pad--) {
+        video_print(" ");
+    }
+    video_print(buf);
+}
+
+static uint32_t per_sec(uint64_t count, uint64_t elapsed_us) {
+    return elapsed_us ? (uint32_t)(count * 1000000 / elapsed_us) : 0;
+}
+
+static uint32_t average(uint64_t total, uint32_t count) {
+    return count ? (uint32_t)(total / count) : 0;
+}
+
+void blkdev_print_iostat(int since_boot) {
+    uint64_t now = timer_get_us();
+
+    if (since_boot) {
+        memset(iostat_prev, 0, sizeof(iostat_prev));
+        iostat_prev_us = 0;
+    }
+    uint64_t elapsed = now - iostat_prev_us;
+
+    video_print("Device   r/s   w/s  rKB/s  wKB/s  merges  wait_us  svc_us  util%  err  retry  csum\n");
+
+    for (int i = 0; i < device_count; i++) {
+        blkdev_t *dev = &devices[i];
+        blk_queue_stats_t cur = dev->queue.stats;
+        blk_queue_stats_t *prev = &iostat_prev[i];
+
+        if (!dev->registered) {
+            continue;
+        }
+
+        // Незавершенный интервал занятости тоже учитываем
+        if (cur.in_flight) {
+            cur.busy_us += now - cur.busy_since_us;
+        }
+
+        uint32_t reads = cur.reads - prev->reads;
+        uint32_t writes = cur.writes - prev->writes;
+        uint32_t done = reads + writes + (cur.discards - prev->discards);
+        uint32_t merges = (cur.back_merges - prev->back_merges) +
+                          (cur.front_merges - prev->front_merges) +
+                          (cur.rq_merges - prev->rq_merges);
+        uint64_t busy = cur.busy_us - prev->busy_us;
+
+        video_print(dev->name);
+        for (int pad = BLK_NAME_LEN - (int)strlen(dev->name); pad > 0; pad--) {
+            video_print(" ");
+        }
+        print_col(per_sec(reads, elapsed), 5);
+        print_col(per_sec(writes, elapsed), 6);
+        print_col(per_sec((cur.sectors_read - prev->sectors_read) / 2, elapsed), 7);
+        print_col(per_sec((cur.sectors_written - prev->sectors_written) / 2, elapsed), 7);
+        print_col(merges, 8);
+        print_col(average(cur.queue_us - prev->queue_us, done), 9);
+        print_col(average(cur.service_us - prev->service_us, done), 8);
+        print_col(elapsed ? (uint32_t)(busy * 100 / elapsed) : 0, 7);
+        print_col(cur.errors - prev->errors, 5);
+        print_col(cur.retries - prev->retries, 7);
+        print_col(cur.csum_errors - prev->csum_errors, 6);
+        video_print("\n");
+
+        *prev = cur;
+    }
+
+    iostat_prev_us = now;
+}
+
+static void print_hist(const char *label, const uint32_t *hist) {
+    uint32_t total = 0;
+    for (int i = 0; i < BLK_LAT_BUCKETS; i++) {
+        total += hist[i];
+    }
+
+    video_print(label);
+    if (total == 0) {
+        video_print("  (no requests)\n");
+        return;
+    }
+
+    for (int i = 0; i < BLK_LAT_BUCKETS; i++) {
+        if (hist[i] == 0) {
+            continue;
+        }
+        video_print("  <");
+        print_col(2u << i, 9);
+        video_print(" us");
+        print_col(hist[i], 8);
+        video_print("  ");
+        // Полоска до 40 символов пропорционально доле корзины
+        for (uint32_t n = hist[i] * 40 / total; n > 0; n--) {
+            video_print("#");
+        }
+        video_print("\n");
+    }
+}
+
+void blkdev_print_latency(blkdev_t *dev) {
+    blk_queue_stats_t *s = &dev->queue.stats;
+
+    video_print(dev->name);
+    print_num(": reads=", s->reads);
+    print_num(" writes=", s->writes);
+    print_num(" errors=", s->errors);
+    print_num(" retries=", s->retries);
+    print_num(" csum_errors=", s->csum_errors);
+    video_print("\n");
+
+    print_hist("Queue time:\n", s->queue_hist);
+    print_hist("Service time:\n", s->service_hist);
+}
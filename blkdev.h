@@ -0,0 +1,201 @@
+#ifndef BLKDEV_H
+#define BLKDEV_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Общий блочный уровень: реестр устройств, очередь запросов и планировщик
+
+#define BLK_SECTOR_SIZE        512
+#define BLK_MAX_DEVICES        16
+#define BLK_NAME_LEN           8
+#define BLK_MAX_BIOS_PER_RQ    256     // Сколько вызовов можно склеить в один запрос (по умолчанию)
+#define BLK_REQUEST_POOL       64      // Запросов на одно устройство
+#define BLK_DEFAULT_MAX_SECTORS 128    // 64 KB на запрос по умолчанию
+#define BLK_HARD_MAX_SECTORS   255     // Ограничение счетчика секторов ATA (LBA28), по умолчанию
+#define BLK_LAT_BUCKETS        24      // Гистограмма задержек: корзина i — [2^i, 2^(i+1)) мкс
+#define BLK_DISCARD_BATCH      32      // Отложенных диапазонов discard на устройство
+#define BLK_DISCARD_DELAY_US   1000000 // Сколько копить освобожденные диапазоны
+
+// Операции
+#define BLK_OP_READ   0
+#define BLK_OP_WRITE  1
+#define BLK_OP_DISCARD 2               // Диапазон больше не нужен ФС (buffer == NULL)
+#define BLK_OP_FLUSH  3                // Кэш записи устройства — на носитель (count == 0)
+
+// Коды ошибок блочного уровня
+#define BLK_OK             0
+#define BLK_ERR_IO        -1
+#define BLK_ERR_RANGE     -2
+#define BLK_ERR_NODEV     -3
+#define BLK_ERR_BUSY      -4
+
+typedef struct blkdev blkdev_t;
+typedef struct blk_bio blk_bio_t;
+typedef struct blk_request blk_request_t;
+
+// Непрерывный диапазон секторов
+typedef struct {
+    uint32_t lba;
+    uint32_t count;
+} blk_extent_t;
+
+// Один вызов ввода-вывода (непрерывный диапазон секторов и буфер вызывающего)
+struct blk_bio {
+    uint32_t lba;
+    uint32_t count;                 // В секторах
+    void *buffer;
+    uint8_t op;
+    volatile uint8_t done;
+    int8_t error;
+    void (*end_io)(blk_bio_t *bio); // Необязательный обработчик завершения
+    void *private_data;
+    blk_bio_t *next;                // Следующий bio внутри запроса
+};
+
+// Запрос к устройству: один или несколько склеенных bio с подряд идущими LBA.
+// В запросе discard bio не обязаны быть смежными: каждый — отдельный диапазон.
+struct blk_request {
+    uint8_t in_use;
+    uint8_t op;
+    uint32_t lba;
+    uint32_t count;
+    uint32_t nr_bios;
+    blk_bio_t *bio_head;
+    blk_bio_t *bio_tail;
+    uint64_t queued_us;             // Время постановки в очередь (для deadline)
+    uint64_t dispatched_us;         // Время отправки в драйвер
+    blk_request_t *prev;            // Очередь в порядке поступления
+    blk_request_t *next;
+    blkdev_t *dev;
+    void *driver_data;              // Состояние драйвера для запроса в полете
+};
+
+// Итератор по секторам запроса (для драйверов с PIO)
+typedef struct {
+    blk_bio_t *bio;
+    uint32_t sector;
+} blk_rq_iter_t;
+
+// Операции драйвера
+typedef struct {
+    // Запустить запрос. Драйвер обязан вызвать blk_end_request()
+    // сразу или позже (из poll/IRQ). Возврат != 0 — устройство занято.
+    int (*submit)(blkdev_t *dev, blk_request_t *rq);
+    // Продвинуть выполняющиеся запросы (может быть NULL)
+    void (*poll)(blkdev_t *dev);
+} blkdev_ops_t;
+
+struct iosched_ops;
+
+// Статистика очереди
+typedef struct {
+    uint32_t bios;                  // Поступило bio
+    uint32_t requests;              // Отправлено запросов в драйвер
+    uint32_t back_merges;
+    uint32_t front_merges;
+    uint32_t rq_merges;             // Склейки двух запросов в очереди
+    uint32_t queue_depth;           // Текущее число запросов в очереди
+    uint32_t max_queue_depth;
+    uint32_t in_flight;
+    uint64_t sectors_read;
+    uint64_t sectors_written;
+    uint32_t reads;                 // Завершено запросов чтения
+    uint32_t writes;
+    uint32_t discards;              // Завершено запросов discard
+    uint32_t flushes;               // Завершено запросов flush
+    uint64_t sectors_discarded;
+    uint32_t discard_cancelled;     // Секторов, снятых с discard повторной записью
+    uint32_t errors;                // Запросы, завершенные с ошибкой
+    uint32_t retries;               // Повторы команд в драйвере
+    uint32_t csum_errors;           // Блоки, не сошедшиеся с контрольной суммой ФС
+    uint64_t queue_us;              // Суммарное ожидание в очереди
+    uint64_t service_us;            // Суммарное выполнение в драйвере
+    uint64_t busy_us;               // Время, когда в драйвере был хоть один запрос
+    uint64_t busy_since_us;
+    uint32_t queue_hist[BLK_LAT_BUCKETS];
+    uint32_t service_hist[BLK_LAT_BUCKETS];
+} blk_queue_stats_t;
+
+// Очередь запросов устройства
+typedef struct {
+    blk_request_t pool[BLK_REQUEST_POOL];
+    blk_request_t *head;            // Все ожидающие запросы в порядке поступления
+    blk_request_t *tail;
+    const struct iosched_ops *sched;
+    uint32_t sched_data[8];         // Состояние планировщика
+    uint32_t max_sectors;           // Максимальный размер запроса
+    uint32_t max_hw_sectors;        // Предел, который принимает драйвер
+    uint32_t max_segments;          // Сколько bio драйвер принимает в одном запросе
+    uint32_t queue_depth;           // Сколько запросов драйвер принимает одновременно
+    uint32_t max_discard_sectors;   // Предел одного диапазона discard (0 — не поддерживается)
+    uint32_t max_discard_segments;  // Диапазонов в одной команде discard
+    uint8_t write_cache;            // У устройства кэш записи, flush нужен
+    blk_request_t *discard_head;    // Запросы discard и flush — мимо планировщика
+    blk_request_t *discard_tail;
+    uint8_t discard_in_flight;      // Такой запрос в драйвере, он идет один
+    blk_extent_t discard_batch[BLK_DISCARD_BATCH]; // Еще не отправленные, по возрастанию LBA
+    uint32_t discard_pending;
+    uint64_t discard_since_us;      // Когда в пачку попал первый диапазон
+    blk_queue_stats_t stats;
+} blk_queue_t;
+
+struct blkdev {
+    char name[BLK_NAME_LEN];
+    uint8_t registered;
+    uint32_t total_sectors;
+    const blkdev_ops_t *ops;
+    void *driver_data;
+    blk_queue_t queue;
+};
+
+// Реестр устройств
+blkdev_t *blkdev_register(const char *name, uint32_t total_sectors,
+                          const blkdev_ops_t *ops, void *driver_data);
+blkdev_t *blkdev_find(const char *name);
+blkdev_t *blkdev_get(int index);
+int blkdev_count(void);
+
+// Асинхронный интерфейс
+int blk_submit_bio(blkdev_t *dev, blk_bio_t *bio);
+void blk_run_queue(blkdev_t *dev);
+void blk_poll(blkdev_t *dev);
+void blk_wait_bio(blkdev_t *dev, blk_bio_t *bio);
+void blk_drain(blkdev_t *dev);
+
+// Синхронный интерфейс
+int blkdev_read(blkdev_t *dev, uint32_t lba, uint32_t count, void *buffer);
+int blkdev_write(blkdev_t *dev, uint32_t lba, uint32_t count, const void *buffer);
+
+// Освобожденные диапазоны копятся и склеиваются в пачке устройства и уходят
+// одной командой (TRIM) при заполнении пачки, по таймеру или при flush.
+// Запись в еще не отправленный диапазон снимает его с discard.
+int blkdev_discard(blkdev_t *dev, uint32_t lba, uint32_t count);
+int blkdev_discard_flush(blkdev_t *dev);
+void blkdev_discard_timer(void);
+
+// Записи, завершенные до вызова, переживут отключение питания. Устройство
+// без кэша записи (blkdev_set_write_cache не вызван) отвечает сразу.
+int blkdev_flush(blkdev_t *dev);
+
+// Для драйверов
+void blk_end_request(blk_request_t *rq, int error);
+void blk_rq_iter_init(blk_rq_iter_t *it, blk_request_t *rq);
+void *blk_rq_iter_next(blk_rq_iter_t *it);
+void blk_account_retry(blk_request_t *rq);
+// Для ФС: прочитанный блок не сошелся с контрольной суммой
+void blk_account_csum_error(blkdev_t *dev);
+
+// Настройка очереди
+int blkdev_set_scheduler(blkdev_t *dev, const char *name);
+void blkdev_set_max_sectors(blkdev_t *dev, uint32_t max_sectors);
+void blkdev_set_hw_limits(blkdev_t *dev, uint32_t max_hw_sectors, uint32_t max_segments);
+void blkdev_set_queue_depth(blkdev_t *dev, uint32_t depth);
+void blkdev_set_discard(blkdev_t *dev, uint32_t max_sectors, uint32_t max_segments);
+void blkdev_set_write_cache(blkdev_t *dev, int enabled);
+void blkdev_print_stats(void);
+// iostat: since_boot — счетчики с начала работы, иначе — прирост с прошлого вызова
+void blkdev_print_iostat(int since_boot);
+void blkdev_print_latency(blkdev_t *dev);
+
+#endif
@@ -0,0 +1,104 @@
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82F63B78u   // Отраженный полином Castagnoli
+
+#if defined(__i386__) || defined(__x86_64__)
+#define CRC32C_X86 1
+#endif
+
+// Невыровненный доступ к слову (x86 это позволяет)
+typedef struct {
+    uint32_t v;
+} __attribute__((packed)) crc32c_word_t;
+
+static uint32_t crc32c_table[8][256];
+static int crc32c_mode = -1;      // -1 — не определен, 0 — таблицы, 1 — SSE4.2
+
+static uint32_t crc32c_read32(const uint8_t *p) {
+    return ((const crc32c_word_t*)p)->v;
+}
+
+// Таблица k сдвигает вклад байта еще на k байт вперед
+static void crc32c_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+        }
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t prev = crc32c_table[k - 1][i];
+            crc32c_table[k][i] = (prev >> 8) ^ crc32c_table[0][prev & 0xFF];
+        }
+    }
+
+    crc32c_mode = 0;
+#ifdef CRC32C_X86
+    // CPUID.1:ECX бит 20 — SSE4.2
+    uint32_t eax = 1, ebx, ecx = 0, edx;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    if (ecx & (1u << 20)) {
+        crc32c_mode = 1;
+    }
+#endif
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, uint32_t len) {
+    while (len >= 8) {
+        uint32_t lo = crc32c_read32(p) ^ crc;
+        uint32_t hi = crc32c_read32(p + 4);
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^
+              crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef CRC32C_X86
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, uint32_t len) {
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t word = crc32c_read32(p) | (uint64_t)crc32c_read32(p + 4) << 32;
+        __asm__("crc32q %1, %0" : "+r"(crc64) : "rm"(word));
+    }
+    crc = (uint32_t)crc64;
+#endif
+    for (; len >= 4; p += 4, len -= 4) {
+        uint32_t word = crc32c_read32(p);
+        __asm__("crc32l %1, %0" : "+r"(crc) : "rm"(word));
+    }
+    for (; len > 0; p++, len--) {
+        __asm__("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+    }
+    return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, uint32_t len) {
+    if (crc32c_mode < 0) {
+        crc32c_init();
+    }
+    crc = ~crc;
+#ifdef CRC32C_X86
+    if (crc32c_mode == 1) {
+        return ~crc32c_sse42(crc, (const uint8_t*)data, len);
+    }
+#endif
+    return ~crc32c_sw(crc, (const uint8_t*)data, len);
+}
+
+int crc32c_hw(void) {
+    if (crc32c_mode < 0) {
+        crc32c_init();
+    }
+    return crc32c_mode;
+}
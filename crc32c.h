@@ -0,0 +1,13 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdint.h>
+
+// CRC32C (Castagnoli). Продолжаемая: crc32c(crc32c(seed, a), b) — то же,
+// что crc32c(seed, a и b подряд). Инструкцией crc32 из SSE4.2, если CPUID
+// о ней сообщает, иначе таблицами по 8 байт за шаг (slice-by-8).
+uint32_t crc32c(uint32_t crc, const void *data, uint32_t len);
+// 1 — считается инструкцией процессора
+int crc32c_hw(void);
+
+#endif
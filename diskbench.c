@@ -0,0 +1,249 @@
+#include "diskbench.h"
+#include "bcache.h"
+#include "pmm.h"
+#include "timer.h"
+#include "serial.h"
+#include "string.h"
+#include "video.h"
+
+// Вызов в полете: свой bio и метка времени отправки
+typedef struct {
+    blk_bio_t bio;
+    uint64_t start_tsc;
+    uint8_t busy;
+} bench_slot_t;
+
+static bench_slot_t slots[DISKBENCH_MAX_QD];
+static uint32_t *latencies;         // Задержка каждого вызова, мкс
+static uint32_t completed;
+static uint32_t failed;
+
+static void bench_end_io(blk_bio_t *bio) {
+    bench_slot_t *slot = (bench_slot_t*)bio->private_data;
+    uint64_t us = timer_tsc_to_us(timer_read_tsc() - slot->start_tsc);
+
+    latencies[completed++] = (uint32_t)us;
+    if (bio->error != BLK_OK) {
+        failed++;
+    }
+    slot->busy = 0;
+}
+
+// xorshift32: равномерные смещения для случайных тестов
+static uint32_t rand_state;
+
+static uint32_t bench_rand(void) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+// Сортировка Шелла: замеров до DISKBENCH_MAX_OPS, стек не нужен
+static void sort_latencies(uint32_t *a, uint32_t n) {
+    uint32_t gap = 1;
+    while (gap < n / 3) {
+        gap = gap * 3 + 1;
+    }
+    for (; gap > 0; gap /= 3) {
+        for (uint32_t i = gap; i < n; i++) {
+            uint32_t v = a[i];
+            uint32_t j = i;
+            while (j >= gap && a[j - gap] > v) {
+                a[j] = a[j - gap];
+                j -= gap;
+            }
+            a[j] = v;
+        }
+    }
+}
+
+static uint32_t percentile(uint32_t *sorted, uint32_t n, uint32_t per_mille) {
+    uint32_t idx = (uint32_t)((uint64_t)n * per_mille / 1000);
+    return sorted[idx < n ? idx : n - 1];
+}
+
+int diskbench_run_test(blkdev_t *dev, const diskbench_params_t *params,
+                       uint32_t test, diskbench_result_t *result) {
+    uint32_t bs = params->block_sectors;
+    uint32_t qd = params->queue_depth;
+    uint8_t op = (test & DISKBENCH_WRITES) ? BLK_OP_WRITE : BLK_OP_READ;
+    uint8_t random = (test & (DISKBENCH_RAND_READ | DISKBENCH_RAND_WRITE)) != 0;
+
+    memset(result, 0, sizeof(diskbench_result_t));
+
+    if (!dev || bs == 0 || bs > dev->queue.max_sectors ||
+        qd == 0 || qd > DISKBENCH_MAX_QD ||
+        params->range_sectors < bs ||
+        params->start_lba + params->range_sectors > dev->total_sectors) {
+        return -1;
+    }
+
+    uint32_t slots_in_range = params->range_sectors / bs;
+    uint32_t ops = slots_in_range < DISKBENCH_MAX_OPS ? slots_in_range
+                                                      : DISKBENCH_MAX_OPS;
+    uint32_t buf_pages = (qd * bs * BLK_SECTOR_SIZE + 4095) / 4096;
+    uint32_t lat_pages = (ops * sizeof(uint32_t) + 4095) / 4096;
+
+    uint8_t *buffers = (uint8_t*)pmm_alloc_blocks(buf_pages);
+    latencies = (uint32_t*)pmm_alloc_blocks(lat_pages);
+    if (!buffers || !latencies) {
+        if (buffers) {
+            pmm_free_blocks(buffers, buf_pages);
+        }
+        if (latencies) {
+            pmm_free_blocks(latencies, lat_pages);
+        }
+        return -1;
+    }
+
+    // Узнаваемый шаблон вместо нулей, чтобы не попасть на сжатие/дедупликацию
+    for (uint32_t i = 0; i < buf_pages * 4096; i++) {
+        buffers[i] = (uint8_t)(i * 31 + 7);
+    }
+
+    memset(slots, 0, sizeof(slots));
+    completed = 0;
+    failed = 0;
+    rand_state = 0x9E3779B9;
+
+    uint32_t issued = 0;
+    uint64_t start = timer_read_tsc();
+
+    while (completed < ops) {
+        for (uint32_t s = 0; s < qd && issued < ops; s++) {
+            bench_slot_t *slot = &slots[s];
+            if (slot->busy) {
+                continue;
+            }
+
+            uint32_t index = random ? bench_rand() % slots_in_range : issued;
+
+            memset(&slot->bio, 0, sizeof(blk_bio_t));
+            slot->bio.lba = params->start_lba + index * bs;
+            slot->bio.count = bs;
+            slot->bio.buffer = buffers + s * bs * BLK_SECTOR_SIZE;
+            slot->bio.op = op;
+            slot->bio.end_io = bench_end_io;
+            slot->bio.private_data = slot;
+            slot->busy = 1;
+            slot->start_tsc = timer_read_tsc();
+            issued++;
+
+            if (blk_submit_bio(dev, &slot->bio) != BLK_OK) {
+                slot->bio.error = BLK_ERR_IO;
+                bench_end_io(&slot->bio);
+            }
+        }
+        blk_poll(dev);
+    }
+
+    uint64_t elapsed = timer_tsc_to_us(timer_read_tsc() - start);
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+
+    sort_latencies(latencies, ops);
+
+    result->ops = ops;
+    result->errors = failed;
+    result->elapsed_us = elapsed;
+    result->kb_per_sec = (uint32_t)((uint64_t)ops * bs / 2 * 1000000 / elapsed);
+    result->iops = (uint32_t)((uint64_t)ops * 1000000 / elapsed);
+    result->p50_us = percentile(latencies, ops, 500);
+    result->p99_us = percentile(latencies, ops, 990);
+    result->p999_us = percentile(latencies, ops, 999);
+    result->max_us = latencies[ops - 1];
+
+    pmm_free_blocks(latencies, lat_pages);
+    pmm_free_blocks(buffers, buf_pages);
+    latencies = NULL;
+    return 0;
+}
+
+// ===== Вывод: экран и последовательный порт (для захвата из QEMU) =====
+
+static void bench_print(const char *s) {
+    video_print(s);
+    serial_write(s);
+}
+
+static void bench_print_num(const char *label, uint32_t value) {
+    char buf[16];
+    bench_print(label);
+    itoa(value, buf, 10);
+    bench_print(buf);
+}
+
+static const char *test_name(uint32_t test) {
+    switch (test) {
+        case DISKBENCH_SEQ_READ:   return "seq read  ";
+        case DISKBENCH_SEQ_WRITE:  return "seq write ";
+        case DISKBENCH_RAND_READ:  return "rand read ";
+        case DISKBENCH_RAND_WRITE: return "rand write";
+        default:                   return "?";
+    }
+}
+
+static void print_result(uint32_t test, const diskbench_result_t *r) {
+    char buf[16];
+
+    bench_print(test_name(test));
+    bench_print_num(": ", r->kb_per_sec / 1024);
+    bench_print(".");
+    uint32_t frac = (r->kb_per_sec % 1024) * 100 / 1024;
+    if (frac < 10) {
+        bench_print("0");
+    }
+    itoa(frac, buf, 10);
+    bench_print(buf);
+    bench_print_num(" MB/s  ", r->iops);
+    bench_print_num(" IOPS  p50=", r->p50_us);
+    bench_print_num(" p99=", r->p99_us);
+    bench_print_num(" p999=", r->p999_us);
+    bench_print_num(" max=", r->max_us);
+    bench_print(" us");
+    if (r->errors) {
+        bench_print_num("  errors=", r->errors);
+    }
+    bench_print("\n");
+}
+
+int diskbench_run(blkdev_t *dev, const diskbench_params_t *params) {
+    static const uint32_t order[] = {
+        DISKBENCH_SEQ_READ, DISKBENCH_SEQ_WRITE,
+        DISKBENCH_RAND_READ, DISKBENCH_RAND_WRITE
+    };
+    int result = 0;
+
+    bench_print("diskbench ");
+    bench_print(dev->name);
+    bench_print_num(": bs=", params->block_sectors / 2);
+    bench_print_num(" KB qd=", params->queue_depth);
+    bench_print_num(" range=", params->start_lba);
+    bench_print_num("+", params->range_sectors);
+    bench_print(" sectors\n");
+
+    // Кэш не должен ни отдавать данные вместо диска, ни затереть их потом
+    bcache_sync_dev(dev);
+
+    for (uint32_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        diskbench_result_t r;
+
+        if (!(params->tests & order[i])) {
+            continue;
+        }
+        if (diskbench_run_test(dev, params, order[i], &r) != 0) {
+            bench_print(test_name(order[i]));
+            bench_print(": failed to start (bad parameters or out of memory)\n");
+            result = -1;
+            continue;
+        }
+        print_result(order[i], &r);
+    }
+
+    if (params->tests & DISKBENCH_WRITES) {
+        bcache_invalidate_dev(dev);
+    }
+    return result;
+}
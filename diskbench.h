@@ -0,0 +1,47 @@
+#ifndef DISKBENCH_H
+#define DISKBENCH_H
+
+#include <stdint.h>
+#include "blkdev.h"
+
+// Измерение производительности блочного устройства в рабочей области LBA.
+// Вызовы идут напрямую в блочный уровень, минуя буферный кэш.
+
+#define DISKBENCH_SEQ_READ    0x01
+#define DISKBENCH_SEQ_WRITE   0x02
+#define DISKBENCH_RAND_READ   0x04
+#define DISKBENCH_RAND_WRITE  0x08
+#define DISKBENCH_READS       (DISKBENCH_SEQ_READ | DISKBENCH_RAND_READ)
+#define DISKBENCH_WRITES      (DISKBENCH_SEQ_WRITE | DISKBENCH_RAND_WRITE)
+#define DISKBENCH_ALL         0x0F
+
+#define DISKBENCH_MAX_QD      32
+#define DISKBENCH_MAX_OPS     16384     // Предел числа вызовов (и замеров) на тест
+
+typedef struct {
+    uint32_t block_sectors;   // Размер одного вызова
+    uint32_t queue_depth;     // Сколько вызовов держать в полете
+    uint32_t start_lba;       // Начало рабочей области
+    uint32_t range_sectors;   // Размер рабочей области
+    uint32_t tests;           // Набор DISKBENCH_*
+} diskbench_params_t;
+
+typedef struct {
+    uint32_t ops;
+    uint32_t errors;
+    uint64_t elapsed_us;
+    uint32_t kb_per_sec;
+    uint32_t iops;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t p999_us;
+    uint32_t max_us;
+} diskbench_result_t;
+
+// Один тест (test — ровно один бит DISKBENCH_*). 0 — успех.
+int diskbench_run_test(blkdev_t *dev, const diskbench_params_t *params,
+                       uint32_t test, diskbench_result_t *result);
+// Все выбранные тесты с выводом на экран и в последовательный порт
+int diskbench_run(blkdev_t *dev, const diskbench_params_t *params);
+
+#endif
@@ -3,6 +3,8 @@
 #include "string.h"
 #include "video.h"
 #include "timer.h"
+#include "blkdev.h"
+#include "idle.h"
 
 // Глобальный IDE контроллер
 ide_controller_t ide_ctrl = {0};
@@ -297,6 +299,9 @@ uint8_t ide_identify_drive(ide_drive_t *drive, uint16_t base, uint8_t master) {
         // Проверяем поддержку DMA
         drive->dma_supported = (identify_data[49] & (1 << 8)) ? 1 : 0;
         
+        // Кэш записи включен: без FLUSH CACHE запись не прочна
+        drive->write_cache = (identify_data[85] & (1 << 5)) ? 1 : 0;
+        
         // Получаем наборы команд
         drive->command_sets = (identify_data[83] << 16) | identify_data[82];
         
@@ -450,6 +455,7 @@ void ide_detect_all(void) {
     }
     
     ide_ctrl.initialized = 1;
+    ide_register_block_devices();
 }
 
 // Вывод информации об устройствах IDE
@@ -517,6 +523,15 @@ void ide_print_devices(void) {
                     }
                 }
                 
+                if (drive->errors) {
+                    char buffer[16];
+                    itoa(drive->errors, buffer, 10);
+                    video_print(" errors=");
+                    video_print(buffer);
+                    video_print(" last=");
+                    video_print(ide_get_error_string(drive->last_error));
+                }
+                
                 video_print("\n");
             }
         }
@@ -581,65 +596,83 @@ uint8_t ide_check_disk_presence(uint8_t channel, uint8_t drive) {
     return ide_ctrl.channels[channel].drives[drive].present;
 }
 
-// Чтение секторов с диска
-uint8_t ide_read_sectors(uint8_t channel, uint8_t drive, uint32_t lba, 
-                        uint8_t num_sectors, uint16_t *buffer) {
-    if (channel > 1 || drive > 1) {
-        return 0;
+// Пауза ~400 нс: статус становится достоверным только после нее
+static void ide_settle(ide_channel_t *ch) {
+    for (int i = 0; i < 4; i++) {
+        inb(ch->ctrl);
     }
-    
-    if (!ide_check_disk_presence(channel, drive)) {
-        ide_ctrl.last_error = IDE_ERROR_NOT_FOUND;
-        return 0;
+}
+
+// Выбор диска и запись регистров задачи. Для LBA48 старшие байты
+// пишутся первыми (регистры работают как двухуровневый FIFO).
+static uint8_t ide_issue_command(ide_channel_t *ch, uint8_t drive, uint32_t lba,
+                                 uint32_t num_sectors, int write) {
+    ide_drive_t *drive_info = &ch->drives[drive];
+    uint16_t base = ch->base;
+    uint8_t lba48 = drive_info->lba48_supported && lba + num_sectors > 0x0FFFFFFF;
+    uint8_t device_reg = (drive ? IDE_DEVICE_MASTER : IDE_DEVICE_SLAVE) |
+                         IDE_DEVICE_LBA;
+    
+    if (!lba48) {
+        device_reg |= (lba >> 24) & 0x0F;
     }
-    
-    ide_drive_t *drive_info = &ide_ctrl.channels[channel].drives[drive];
-    uint16_t base = ide_ctrl.channels[channel].base;
+    outb(device_reg, base + IDE_REG_DEVICE);
+    ide_settle(ch);
     
     // Ждем готовности
     if (!ide_wait_ready(base)) {
         return 0;
     }
     
-    // Устанавливаем количество секторов
-    outb(num_sectors, base + IDE_REG_SECTOR_COUNT);
+    if (lba48) {
+        outb((uint8_t)(num_sectors >> 8), base + IDE_REG_SECTOR_COUNT);
+        outb((lba >> 24) & 0xFF, base + IDE_REG_LBA_LOW);
+        outb(0, base + IDE_REG_LBA_MID);
+        outb(0, base + IDE_REG_LBA_HIGH);
+    }
+    
+    // Устанавливаем количество секторов (0 означает 256)
+    outb((uint8_t)num_sectors, base + IDE_REG_SECTOR_COUNT);
     
     // Устанавливаем LBA адрес
     outb((lba >> 0) & 0xFF, base + IDE_REG_LBA_LOW);
     outb((lba >> 8) & 0xFF, base + IDE_REG_LBA_MID);
     outb((lba >> 16) & 0xFF, base + IDE_REG_LBA_HIGH);
     
-    // Выбираем устройство и режим LBA
-    uint8_t device_reg = (drive ? IDE_DEVICE_MASTER : IDE_DEVICE_SLAVE) | 
-                        IDE_DEVICE_LBA | ((lba >> 24) & 0x0F);
-    outb(device_reg, base + IDE_REG_DEVICE);
-    
-    // Отправляем команду чтения
-    uint8_t command = IDE_CMD_READ_SECTORS;
-    if (drive_info->lba48_supported && (lba >> 28) > 0) {
-        command = IDE_CMD_READ_SECTORS_EXT;
-        // Для LBA48 нужна дополнительная настройка
+    // Отправляем команду
+    uint8_t command;
+    if (lba48) {
+        command = write ? IDE_CMD_WRITE_SECTORS_EXT : IDE_CMD_READ_SECTORS_EXT;
+    } else {
+        command = write ? IDE_CMD_WRITE_SECTORS : IDE_CMD_READ_SECTORS;
     }
     
     outb(command, base + IDE_REG_COMMAND);
+    ide_settle(ch);
+    return 1;
+}
+
+// FLUSH CACHE: команда без данных, диск снимает BSY, когда кэш записан
+static uint8_t ide_issue_flush(ide_channel_t *ch, uint8_t drive) {
+    uint16_t base = ch->base;
     
-    // Читаем данные
-    for (int sector = 0; sector < num_sectors; sector++) {
-        if (!ide_wait_drq(base)) {
-            return 0;
-        }
-        
-        for (int i = 0; i < 256; i++) {
-            buffer[sector * 256 + i] = inw(base + IDE_REG_DATA);
-        }
+    outb((drive ? IDE_DEVICE_MASTER : IDE_DEVICE_SLAVE) | IDE_DEVICE_LBA,
+         base + IDE_REG_DEVICE);
+    ide_settle(ch);
+    if (!ide_wait_ready(base)) {
+        return 0;
     }
     
+    outb(ch->drives[drive].lba48_supported ? IDE_CMD_FLUSH_CACHE_EXT : IDE_CMD_FLUSH_CACHE,
+         base + IDE_REG_COMMAND);
+    ide_settle(ch);
     return 1;
 }
 
-// Запись секторов на диск
-uint8_t ide_write_sectors(uint8_t channel, uint8_t drive, uint32_t lba,
-                         uint8_t num_sectors, uint16_t *buffer) {
+// Синхронный PIO-цикл чтения/записи плоского буфера
+static uint8_t ide_pio_transfer(uint8_t channel, uint8_t drive, uint32_t lba,
+                                uint32_t num_sectors, int write,
+                                uint16_t *buffer) {
     if (channel > 1 || drive > 1) {
         return 0;
     }
@@ -649,51 +682,272 @@ uint8_t ide_write_sectors(uint8_t channel, uint8_t drive, uint32_t lba,
         return 0;
     }
     
-    ide_drive_t *drive_info = &ide_ctrl.channels[channel].drives[drive];
-    uint16_t base = ide_ctrl.channels[channel].base;
+    if (num_sectors == 0 || num_sectors > 256) {
+        return 0;
+    }
     
-    // Ждем готовности
-    if (!ide_wait_ready(base)) {
+    ide_channel_t *ch = &ide_ctrl.channels[channel];
+    uint16_t base = ch->base;
+    uint8_t ok = 1;
+    
+    // Канал может быть занят асинхронной командой блочного уровня
+    while (1) {
+        spin_lock(&ch->lock);
+        if (!ch->cmd.rq) {
+            break;
+        }
+        spin_unlock(&ch->lock);
+        ide_poll();
+    }
+    
+    if (!ide_issue_command(ch, drive, lba, num_sectors, write)) {
+        spin_unlock(&ch->lock);
         return 0;
     }
     
-    // Устанавливаем количество секторов
-    outb(num_sectors, base + IDE_REG_SECTOR_COUNT);
+    for (uint32_t sector = 0; sector < num_sectors && ok; sector++) {
+        uint16_t *data = buffer + sector * 256;
+        
+        if (!ide_wait_drq(base)) {
+            ok = 0;
+            break;
+        }
+        
+        if (write) {
+            for (int i = 0; i < 256; i++) {
+                outw(data[i], base + IDE_REG_DATA);
+            }
+            
+            // Ждем завершения записи
+            ide_settle(ch);
+            if (!ide_wait_ready(base)) {
+                ok = 0;
+            }
+        } else {
+            for (int i = 0; i < 256; i++) {
+                data[i] = inw(base + IDE_REG_DATA);
+            }
+        }
+    }
     
-    // Устанавливаем LBA адрес
-    outb((lba >> 0) & 0xFF, base + IDE_REG_LBA_LOW);
-    outb((lba >> 8) & 0xFF, base + IDE_REG_LBA_MID);
-    outb((lba >> 16) & 0xFF, base + IDE_REG_LBA_HIGH);
+    spin_unlock(&ch->lock);
+    return ok;
+}
+
+// Чтение секторов с диска
+uint8_t ide_read_sectors(uint8_t channel, uint8_t drive, uint32_t lba, 
+                        uint8_t num_sectors, uint16_t *buffer) {
+    return ide_pio_transfer(channel, drive, lba, num_sectors, 0, buffer);
+}
+
+// Запись секторов на диск
+uint8_t ide_write_sectors(uint8_t channel, uint8_t drive, uint32_t lba,
+                         uint8_t num_sectors, uint16_t *buffer) {
+    return ide_pio_transfer(channel, drive, lba, num_sectors, 1, buffer);
+}
+
+// ===== Блочный уровень =====
+//
+// Каналы независимы: на каждом выполняется не более одной команды,
+// состояние которой лежит в ide_channel_t.cmd под блокировкой канала.
+// Команда продвигается опросом (ide_poll) — за один проход передаются
+// все готовые секторы, пока диск занят, обслуживается другой канал.
+
+// Запуск (или перезапуск после ошибки) команды канала. Под блокировкой.
+static uint8_t ide_cmd_start(ide_channel_t *ch) {
+    ide_cmd_t *cmd = &ch->cmd;
     
-    // Выбираем устройство и режим LBA
-    uint8_t device_reg = (drive ? IDE_DEVICE_MASTER : IDE_DEVICE_SLAVE) | 
-                        IDE_DEVICE_LBA | ((lba >> 24) & 0x0F);
-    outb(device_reg, base + IDE_REG_DEVICE);
+    blk_rq_iter_init(&cmd->iter, cmd->rq);
+    cmd->done_sectors = 0;
+    cmd->start_us = timer_get_us();
     
-    // Отправляем команду записи
-    uint8_t command = IDE_CMD_WRITE_SECTORS;
-    if (drive_info->lba48_supported && (lba >> 28) > 0) {
-        command = IDE_CMD_WRITE_SECTORS_EXT;
-        // Для LBA48 нужна дополнительная настройка
+    // Секторов у flush нет: запрос завершится, как только уйдет BSY
+    if (cmd->rq->op == BLK_OP_FLUSH) {
+        return ide_issue_flush(ch, cmd->drive);
+    }
+    return ide_issue_command(ch, cmd->drive, cmd->rq->lba, cmd->rq->count,
+                             cmd->write);
+}
+
+// Ошибка команды: повтор или завершение запроса
+static blk_request_t *ide_cmd_fail(ide_channel_t *ch, uint32_t error, int *result) {
+    ide_cmd_t *cmd = &ch->cmd;
+    ide_drive_t *drive = &ch->drives[cmd->drive];
+    
+    ide_ctrl.last_error = error;
+    drive->last_error = error;
+    drive->errors++;
+    
+    while (cmd->retries < IDE_MAX_RETRIES) {
+        cmd->retries++;
+        blk_account_retry(cmd->rq);
+        if (error == IDE_ERROR_TIMEOUT) {
+            ide_reset_channel(ch->base, ch->ctrl);
+        }
+        if (ide_cmd_start(ch)) {
+            return NULL;
+        }
     }
     
-    outb(command, base + IDE_REG_COMMAND);
+    blk_request_t *rq = cmd->rq;
+    cmd->rq = NULL;
+    *result = BLK_ERR_IO;
+    return rq;
+}
+
+// Продвинуть команду канала. Вызывается под блокировкой; завершенный
+// запрос возвращается, чтобы закончить его уже без блокировки.
+static blk_request_t *ide_channel_service(ide_channel_t *ch, int *result) {
+    ide_cmd_t *cmd = &ch->cmd;
+    uint16_t base = ch->base;
     
-    // Записываем данные
-    for (int sector = 0; sector < num_sectors; sector++) {
-        if (!ide_wait_drq(base)) {
-            return 0;
+    while (cmd->rq) {
+        uint8_t status = inb(base + IDE_REG_STATUS);
+        
+        if (status & IDE_STATUS_BSY) {
+            break;
         }
         
-        for (int i = 0; i < 256; i++) {
-            outw(buffer[sector * 256 + i], base + IDE_REG_DATA);
+        if (status & (IDE_STATUS_ERR | IDE_STATUS_DF)) {
+            inb(base + IDE_REG_ERROR);
+            return ide_cmd_fail(ch, IDE_ERROR_DRIVE_FAULT, result);
         }
         
-        // Ждем завершения записи
-        if (!ide_wait_ready(base)) {
-            return 0;
+        if (cmd->done_sectors == cmd->rq->count) {
+            blk_request_t *rq = cmd->rq;
+            cmd->rq = NULL;
+            *result = BLK_OK;
+            return rq;
+        }
+        
+        if (!(status & IDE_STATUS_DRQ)) {
+            break;
         }
+        
+        uint16_t *data = (uint16_t*)blk_rq_iter_next(&cmd->iter);
+        if (cmd->write) {
+            for (int i = 0; i < 256; i++) {
+                outw(data[i], base + IDE_REG_DATA);
+            }
+        } else {
+            for (int i = 0; i < 256; i++) {
+                data[i] = inw(base + IDE_REG_DATA);
+            }
+        }
+        cmd->done_sectors++;
+        ide_settle(ch);
     }
     
-    return 1;
-}
\ No newline at end of file
+    if (cmd->rq && timer_get_us() - cmd->start_us > IDE_CMD_TIMEOUT_US) {
+        return ide_cmd_fail(ch, IDE_ERROR_TIMEOUT, result);
+    }
+    
+    return NULL;
+}
+
+// Обслуживание обоих каналов. Освободившийся канал сразу получает
+// следующий запрос одного из своих дисков (по очереди).
+void ide_poll(void) {
+    for (int channel = 0; channel < 2; channel++) {
+        ide_channel_t *ch = &ide_ctrl.channels[channel];
+        blk_request_t *rq;
+        int result = BLK_OK;
+        
+        if (!spin_trylock(&ch->lock)) {
+            continue;
+        }
+        rq = ide_channel_service(ch, &result);
+        spin_unlock(&ch->lock);
+        
+        if (!rq) {
+            continue;
+        }
+        
+        blk_end_request(rq, result);
+        
+        ch->next_drive ^= 1;
+        for (int i = 0; i < 2; i++) {
+            blkdev_t *dev = ch->blk[ch->next_drive ^ i];
+            if (dev) {
+                blk_run_queue(dev);
+            }
+        }
+    }
+}
+
+static int ide_blk_submit(blkdev_t *dev, blk_request_t *rq) {
+    ide_drive_t *drive = (ide_drive_t*)dev->driver_data;
+    ide_channel_t *ch = &ide_ctrl.channels[drive->primary ? 0 : 1];
+    
+    if (!spin_trylock(&ch->lock)) {
+        return 1;
+    }
+    if (ch->cmd.rq) {
+        // Канал занят другим диском — запрос подождет в очереди
+        spin_unlock(&ch->lock);
+        return 1;
+    }
+    
+    ch->cmd.rq = rq;
+    ch->cmd.drive = drive->master;
+    ch->cmd.write = (rq->op == BLK_OP_WRITE);
+    ch->cmd.retries = 0;
+    
+    int result = BLK_OK;
+    if (!ide_cmd_start(ch)) {
+        rq = ide_cmd_fail(ch, ide_ctrl.last_error, &result);
+    } else {
+        rq = NULL;
+    }
+    spin_unlock(&ch->lock);
+    
+    if (rq) {
+        blk_end_request(rq, result);
+    }
+    return 0;
+}
+
+static void ide_blk_poll(blkdev_t *dev) {
+    (void)dev;
+    ide_poll();
+}
+
+static const blkdev_ops_t ide_blk_ops = {
+    ide_blk_submit,
+    ide_blk_poll
+};
+
+// Регистрация жестких дисков как hda/hdb (primary) и hdc/hdd (secondary)
+void ide_register_block_devices(void) {
+    static uint8_t idle_registered = 0;
+    
+    for (int channel = 0; channel < 2; channel++) {
+        ide_ctrl.channels[channel].blk[0] = NULL;
+        ide_ctrl.channels[channel].blk[1] = NULL;
+        
+        for (int master = 1; master >= 0; master--) {
+            ide_drive_t *drive = &ide_ctrl.channels[channel].drives[master];
+            
+            if (!drive->present || drive->type != IDE_DRIVE_HDD ||
+                drive->total_sectors == 0) {
+                continue;
+            }
+            
+            char name[4] = "hd?";
+            name[2] = 'a' + channel * 2 + (master ? 0 : 1);
+            blkdev_t *dev = blkdev_register(name, drive->total_sectors,
+                                            &ide_blk_ops, drive);
+            if (dev) {
+                blkdev_set_max_sectors(dev, BLK_HARD_MAX_SECTORS);
+                blkdev_set_write_cache(dev, drive->write_cache);
+                ide_ctrl.channels[channel].blk[master] = dev;
+            }
+        }
+    }
+    
+    // Асинхронное упреждение и запись завершаются и без ожидающего
+    if (!idle_registered) {
+        idle_register_task("ide", ide_poll);
+        idle_registered = 1;
+    }
+}
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "blkdev.h"
+#include "spinlock.h"
 
 // IDE Channel Bases
 #define IDE_PRIMARY_BASE   0x1F0
@@ -60,6 +62,7 @@
 #define IDE_TIMEOUT_READY 10000000   // 10 миллионов циклов
 #define IDE_TIMEOUT_DRQ   10000000
 #define IDE_DELAY_COUNT   4000       // Количество циклов для задержки
+#define IDE_CMD_TIMEOUT_US 5000000   // Предел для асинхронной команды
 
 // Error codes
 #define IDE_ERROR_NONE         0
@@ -89,15 +92,33 @@ typedef struct {
     uint32_t command_sets;     // Поддерживаемые команды
     uint8_t lba48_supported;   // Поддержка LBA48
     uint8_t dma_supported;     // Поддержка DMA
+    uint8_t write_cache;       // Кэш записи включен
     uint8_t atapi;             // ATAPI устройство
+    uint32_t last_error;       // Последняя ошибка команд этого диска
+    uint32_t errors;           // Неудачных попыток команд
 } ide_drive_t;
 
+// Команда блочного уровня, выполняющаяся на канале (одна на канал)
+typedef struct {
+    blk_request_t *rq;        // NULL — канал свободен
+    uint8_t drive;            // Master (1) или Slave (0)
+    uint8_t write;
+    uint8_t retries;
+    uint32_t done_sectors;    // Уже передано секторов
+    blk_rq_iter_t iter;
+    uint64_t start_us;        // Время отправки (для таймаута)
+} ide_cmd_t;
+
 // Структура IDE канала
 typedef struct {
     uint16_t base;            // Базовый порт
     uint16_t ctrl;            // Контрольный порт
     uint8_t irq;              // IRQ линии
     ide_drive_t drives[2];    // Master (0) и Slave (1)
+    spinlock_t lock;          // Защищает регистры канала и cmd
+    ide_cmd_t cmd;
+    blkdev_t *blk[2];         // Блочные устройства дисков канала
+    uint8_t next_drive;       // Чей запрос запускать первым (по очереди)
 } ide_channel_t;
 
 // Глобальная структура IDE контроллера
@@ -130,6 +151,8 @@ uint32_t ide_get_last_error(void);
 void ide_reset_last_error(void);
 uint8_t ide_is_initialized(void);
 uint8_t ide_test_port(uint16_t port);
+void ide_register_block_devices(void);
+void ide_poll(void);
 
 // Глобальный экземпляр контроллера
 extern ide_controller_t ide_ctrl;
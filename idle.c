@@ -0,0 +1,32 @@
+#include "idle.h"
+
+typedef struct {
+    const char* name;
+    idle_task_t task;
+} idle_entry_t;
+
+static idle_entry_t tasks[IDLE_MAX_TASKS];
+static int task_count = 0;
+static int running = 0;
+
+int idle_register_task(const char* name, idle_task_t task) {
+    if (task_count >= IDLE_MAX_TASKS) {
+        return -1;
+    }
+    tasks[task_count].name = name;
+    tasks[task_count].task = task;
+    task_count++;
+    return 0;
+}
+
+void idle_run(void) {
+    // Задача может сама ждать клавиатуру — не входим повторно
+    if (running) {
+        return;
+    }
+    running = 1;
+    for (int i = 0; i < task_count; i++) {
+        tasks[i].task();
+    }
+    running = 0;
+}
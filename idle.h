@@ -0,0 +1,16 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdint.h>
+
+// Фоновые задачи ядра. Планировщика потоков нет, поэтому задачи
+// выполняются кооперативно, пока ядро ждет ввода (keyboard_getkey).
+
+#define IDLE_MAX_TASKS 8
+
+typedef void (*idle_task_t)(void);
+
+int idle_register_task(const char* name, idle_task_t task);
+void idle_run(void);
+
+#endif
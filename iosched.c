@@ -0,0 +1,151 @@
+#include "iosched.h"
+#include "string.h"
+#include "timer.h"
+
+// Индексы в q->sched_data
+#define SD_HEAD_POS       0   // LBA сразу за последним отправленным запросом
+#define SD_BATCH          1   // Сколько запросов подряд ушло в текущем направлении
+#define SD_STARVED        2   // Сколько раз подряд чтения обошли записи
+#define SD_LAST_OP        3
+
+// ===== noop: строго в порядке поступления =====
+
+static void noop_init(blk_queue_t *q) {
+    (void)q;
+}
+
+static blk_request_t *noop_next(blk_queue_t *q) {
+    return q->head;
+}
+
+static void noop_dispatched(blk_queue_t *q, blk_request_t *rq) {
+    q->sched_data[SD_HEAD_POS] = rq->lba + rq->count;
+}
+
+const iosched_ops_t iosched_noop = {
+    "noop", noop_init, noop_next, noop_dispatched
+};
+
+// ===== C-LOOK: однонаправленный лифт по LBA =====
+
+// Ближайший запрос не ниже head; если таких нет — самый младший LBA.
+// op < 0 — любое направление.
+static blk_request_t *clook_pick(blk_queue_t *q, int op) {
+    uint32_t head = q->sched_data[SD_HEAD_POS];
+    blk_request_t *ahead = NULL;
+    blk_request_t *lowest = NULL;
+
+    for (blk_request_t *rq = q->head; rq; rq = rq->next) {
+        if (op >= 0 && rq->op != op) {
+            continue;
+        }
+        if (rq->lba >= head && (!ahead || rq->lba < ahead->lba)) {
+            ahead = rq;
+        }
+        if (!lowest || rq->lba < lowest->lba) {
+            lowest = rq;
+        }
+    }
+
+    return ahead ? ahead : lowest;
+}
+
+static void clook_init(blk_queue_t *q) {
+    q->sched_data[SD_HEAD_POS] = 0;
+}
+
+static blk_request_t *clook_next(blk_queue_t *q) {
+    return clook_pick(q, -1);
+}
+
+const iosched_ops_t iosched_clook = {
+    "clook", clook_init, clook_next, noop_dispatched
+};
+
+// ===== deadline: сортировка по LBA + сроки истечения для каждого направления =====
+
+static blk_request_t *deadline_oldest(blk_queue_t *q, int op) {
+    for (blk_request_t *rq = q->head; rq; rq = rq->next) {
+        if (rq->op == op) {
+            return rq;
+        }
+    }
+    return NULL;
+}
+
+static void deadline_init(blk_queue_t *q) {
+    memset(q->sched_data, 0, sizeof(q->sched_data));
+}
+
+static blk_request_t *deadline_next(blk_queue_t *q) {
+    blk_request_t *oldest_read = deadline_oldest(q, BLK_OP_READ);
+    blk_request_t *oldest_write = deadline_oldest(q, BLK_OP_WRITE);
+    int op;
+
+    if (!oldest_read && !oldest_write) {
+        return NULL;
+    }
+
+    // Продолжаем текущую пачку, если в этом направлении еще есть запросы впереди
+    op = (int)q->sched_data[SD_LAST_OP];
+    if (q->sched_data[SD_BATCH] < IOSCHED_FIFO_BATCH) {
+        blk_request_t *rq = clook_pick(q, op);
+        if (rq && rq->lba >= q->sched_data[SD_HEAD_POS]) {
+            return rq;
+        }
+    }
+
+    // Выбор направления: чтения в приоритете, но записи не голодают бесконечно
+    if (oldest_read && (!oldest_write ||
+                        q->sched_data[SD_STARVED] < IOSCHED_WRITES_STARVED)) {
+        op = BLK_OP_READ;
+        if (oldest_write) {
+            q->sched_data[SD_STARVED]++;
+        }
+    } else {
+        op = BLK_OP_WRITE;
+        q->sched_data[SD_STARVED] = 0;
+    }
+
+    q->sched_data[SD_BATCH] = 0;
+
+    // Просроченный запрос обслуживается первым
+    blk_request_t *oldest = (op == BLK_OP_READ) ? oldest_read : oldest_write;
+    uint64_t expire = (op == BLK_OP_READ) ? IOSCHED_READ_EXPIRE_US
+                                          : IOSCHED_WRITE_EXPIRE_US;
+    if (timer_get_us() - oldest->queued_us >= expire) {
+        return oldest;
+    }
+
+    return clook_pick(q, op);
+}
+
+static void deadline_dispatched(blk_queue_t *q, blk_request_t *rq) {
+    if (q->sched_data[SD_LAST_OP] != rq->op) {
+        q->sched_data[SD_BATCH] = 0;
+    }
+    q->sched_data[SD_LAST_OP] = rq->op;
+    q->sched_data[SD_BATCH]++;
+    q->sched_data[SD_HEAD_POS] = rq->lba + rq->count;
+}
+
+const iosched_ops_t iosched_deadline = {
+    "deadline", deadline_init, deadline_next, deadline_dispatched
+};
+
+static const iosched_ops_t *schedulers[] = {
+    &iosched_noop, &iosched_deadline, &iosched_clook
+};
+
+const iosched_ops_t *iosched_find(const char *name) {
+    for (uint32_t i = 0; i < sizeof(schedulers) / sizeof(schedulers[0]); i++) {
+        if (strcmp(schedulers[i]->name, name) == 0) {
+            return schedulers[i];
+        }
+    }
+    return NULL;
+}
+
+const iosched_ops_t *iosched_default(void) {
+    return &iosched_deadline;
+}
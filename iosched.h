@@ -0,0 +1,28 @@
+#ifndef IOSCHED_H
+#define IOSCHED_H
+
+#include "blkdev.h"
+
+// Параметры deadline (в микросекундах и запросах)
+#define IOSCHED_READ_EXPIRE_US    500000
+#define IOSCHED_WRITE_EXPIRE_US   5000000
+#define IOSCHED_FIFO_BATCH        16
+#define IOSCHED_WRITES_STARVED    2
+
+// Планировщик выбирает следующий запрос из очереди q->head..q->tail.
+// Склейка запросов выполняется блочным уровнем и не зависит от политики.
+typedef struct iosched_ops {
+    const char *name;
+    void (*init)(blk_queue_t *q);
+    blk_request_t *(*next_request)(blk_queue_t *q);
+    void (*dispatched)(blk_queue_t *q, blk_request_t *rq);
+} iosched_ops_t;
+
+extern const iosched_ops_t iosched_noop;
+extern const iosched_ops_t iosched_deadline;
+extern const iosched_ops_t iosched_clook;
+
+const iosched_ops_t *iosched_find(const char *name);
+const iosched_ops_t *iosched_default(void);
+
+#endif
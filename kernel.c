@@ -14,6 +14,10 @@
 #include "ide.h" 
 #include "vixfs.h"
 #include "ahci.h"
+#include "bcache.h"
+#include "msi.h"
+#include "pci.h"
+#include "virtio_blk.h"
 __attribute__((section(".multiboot")))
 const unsigned int multiboot_header[] = {
     0x1BADB002,
@@ -34,11 +38,15 @@ void kernel_main() {
     idt_install();
     isr_install();
     irq_install();
+    msi_init();
     timer_install();    
     pmm_init();
+    pci_init();         // Один обход шин; драйверы ищут устройства в таблице
+    bcache_init();
     ide_init();  
     //vixfs_init();
-    //ahci_init();  // Инициализируем AHCI
+    ahci_init();  // Инициализируем AHCI
+    virtio_blk_init();  // Диски virtio (vda, vdb, ...)
     //fat_init();
     //fat_list_root_directory();
     display_welcome_menu();
@@ -1,5 +1,6 @@
 #include "keyboard.h"
 #include "port_io.h"
+#include "idle.h"
 
 static int shift_pressed = 0;
 static int ctrl_pressed = 0;
@@ -217,7 +218,8 @@ int keyboard_getkey(void) {
     while (buffer_count == 0) {
         // Ждем данные от клавиатуры
         while (!(inb(0x64) & 0x01)) {
-            // Пустая петля ожидания
+            // Пока ждем — даем поработать фоновым задачам
+            idle_run();
         }
         
         uint8_t scancode = inb(0x60);
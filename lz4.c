@@ -0,0 +1,204 @@
+#include "lz4.h"
+#include "string.h"
+
+#define LZ4_HASH_BITS     12
+#define LZ4_MIN_MATCH     4
+#define LZ4_LAST_LITERALS 5    // Последние байты входа всегда литералы
+#define LZ4_MFLIMIT       12   // Совпадение не начинается ближе к концу
+#define LZ4_MAX_OFFSET    65535
+
+// Невыровненный доступ к слову (x86 это позволяет)
+typedef struct {
+    uint32_t v;
+} __attribute__((packed)) lz4_word_t;
+
+static uint16_t lz4_table[1 << LZ4_HASH_BITS]; // Позиция последней четверки с этим хэшем
+
+static uint32_t lz4_read32(const uint8_t *p) {
+    return ((const lz4_word_t*)p)->v;
+}
+
+static void lz4_write32(uint8_t *p, uint32_t v) {
+    ((lz4_word_t*)p)->v = v;
+}
+
+static uint32_t lz4_hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// Продолжение длины сверх 15: байты по 255 и остаток
+static uint8_t *lz4_write_length(uint8_t *op, uint32_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+// Последовательность: токен, литералы [anchor, anchor + literals) и,
+// если match_length != 0, ссылка на offset байт назад
+static uint8_t *lz4_emit(uint8_t *op, uint8_t *op_end, const uint8_t *anchor,
+                         uint32_t literals, uint32_t offset, uint32_t match_length) {
+    // С запасом: токен, продолжения длин, смещение
+    if ((uint32_t)(op_end - op) < 1 + literals + literals / 255 + 1 + 2 + match_length / 255 + 1) {
+        return NULL;
+    }
+
+    uint8_t *token = op++;
+    *token = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+    if (literals >= 15) {
+        op = lz4_write_length(op, literals - 15);
+    }
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    if (match_length) {
+        uint32_t extra = match_length - LZ4_MIN_MATCH;
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        *token |= extra >= 15 ? 15 : extra;
+        if (extra >= 15) {
+            op = lz4_write_length(op, extra - 15);
+        }
+    }
+    return op;
+}
+
+uint32_t lz4_compress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t dst_cap) {
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + len;
+    uint8_t *op = dst;
+    uint8_t *op_end = dst + dst_cap;
+
+    if (len > LZ4_MAX_INPUT) {
+        return 0;
+    }
+
+    if (len > LZ4_MFLIMIT) {
+        const uint8_t *match_limit = end - LZ4_MFLIMIT;
+        const uint8_t *copy_limit = end - LZ4_LAST_LITERALS;
+
+        memset(lz4_table, 0, sizeof(lz4_table));
+        ip++;
+        while (ip < match_limit) {
+            uint32_t sequence = lz4_read32(ip);
+            uint32_t h = lz4_hash(sequence);
+            const uint8_t *ref = src + lz4_table[h];
+            lz4_table[h] = (uint16_t)(ip - src);
+
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || lz4_read32(ref) != sequence) {
+                // Чем дольше нет совпадений, тем крупнее шаг: несжимаемые
+                // данные проходятся быстро
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            // Совпадение растет назад в еще не выведенные литералы
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            const uint8_t *mp = ip + LZ4_MIN_MATCH;
+            const uint8_t *rp = ref + LZ4_MIN_MATCH;
+            while (mp + 4 <= copy_limit && lz4_read32(mp) == lz4_read32(rp)) {
+                mp += 4;
+                rp += 4;
+            }
+            while (mp < copy_limit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+
+            op = lz4_emit(op, op_end, anchor, ip - anchor, ip - ref, mp - ip);
+            if (!op) {
+                return 0;
+            }
+            ip = mp;
+            anchor = ip;
+            if (ip - 2 >= src && ip < match_limit) {
+                lz4_table[lz4_hash(lz4_read32(ip - 2))] = (uint16_t)(ip - 2 - src);
+            }
+        }
+    }
+
+    op = lz4_emit(op, op_end, anchor, end - anchor, 0, 0);
+    return op ? (uint32_t)(op - dst) : 0;
+}
+
+// Длина из токена и байтов продолжения; -1 — вход кончился
+static int lz4_read_length(const uint8_t **ip, const uint8_t *end, uint32_t *length) {
+    uint8_t b;
+
+    do {
+        if (*ip >= end) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lz4_decompress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t dst_cap) {
+    const uint8_t *ip = src;
+    const uint8_t *end = src + len;
+    uint8_t *op = dst;
+    uint8_t *op_end = dst + dst_cap;
+
+    while (ip < end) {
+        uint32_t token = *ip++;
+        uint32_t literals = token >> 4;
+        if (literals == 15 && lz4_read_length(&ip, end, &literals) != 0) {
+            return -1;
+        }
+        if (literals > (uint32_t)(end - ip) || literals > (uint32_t)(op_end - op)) {
+            return -1;
+        }
+        uint32_t i = 0;
+        for (; i + 4 <= literals; i += 4) {
+            lz4_write32(op + i, lz4_read32(ip + i));
+        }
+        for (; i < literals; i++) {
+            op[i] = ip[i];
+        }
+        op += literals;
+        ip += literals;
+
+        // Последняя последовательность состоит только из литералов
+        if (ip == end) {
+            break;
+        }
+        if (end - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        uint32_t match_length = token & 15;
+        if (match_length == 15 && lz4_read_length(&ip, end, &match_length) != 0) {
+            return -1;
+        }
+        match_length += LZ4_MIN_MATCH;
+        if (offset == 0 || offset > (uint32_t)(op - dst) ||
+            match_length > (uint32_t)(op_end - op)) {
+            return -1;
+        }
+
+        // Ссылка может перекрывать сама себя (повтор короткого куска):
+        // словами копируем, только когда источник на слово позади
+        const uint8_t *ref = op - offset;
+        i = 0;
+        if (offset >= 4) {
+            for (; i + 4 <= match_length; i += 4) {
+                lz4_write32(op + i, lz4_read32(ref + i));
+            }
+        }
+        for (; i < match_length; i++) {
+            op[i] = ref[i];
+        }
+        op += match_length;
+    }
+    return op - dst;
+}
@@ -0,0 +1,17 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stdint.h>
+
+// Блочный формат LZ4 (без кадра и контрольных сумм): последовательности
+// "литералы + ссылка назад", смещение до 64 KB. Сжатие жадное с хэш-таблицей
+// на 4 KB позиций, распаковка проверяет все границы.
+
+#define LZ4_MAX_INPUT 65536
+
+// Сжатый размер; 0 — вход больше LZ4_MAX_INPUT или не уложился в dst_cap
+uint32_t lz4_compress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t dst_cap);
+// Распакованный размер; -1 — данные испорчены или не помещаются в dst_cap
+int lz4_decompress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t dst_cap);
+
+#endif
@@ -0,0 +1,1204 @@
+// mkvixfs — образы ViXFS на хост-машине, без загрузки ядра.
+// Структуры на диске берутся из vixfs.h, раскладка повторяет
+// vixfs_format, так что ядро монтирует образ как отформатированный сам.
+//
+//   mkvixfs format <образ> <MB>
+//   mkvixfs build  <образ> <MB> <каталог>   MB = 0 — наименьший подходящий
+//   mkvixfs fsck   <образ> [-r]             -r — исправить найденное
+//
+// Образ отображается в память целиком: сборка — одно копирование данных
+// файлов прямо на их место, каждый файл и каталог — один экстент.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "vixfs.h"
+#include "crc32c.h"
+
+#define BLOCK(n) (image + (uint64_t)(n) * VIXFS_BLOCK_SIZE)
+
+static uint8_t *image = NULL;
+static uint64_t image_bytes = 0;
+static vixfs_superblock_t *sb;
+static uint8_t *inode_bitmap;
+static uint8_t *block_bitmap;
+static vixfs_inode_t *inodes;
+
+// ===== Образ =====
+
+// create — новый файл размером bytes; shared == 0 — изменения остаются
+// в памяти процесса (проверка без записи)
+static int image_open(const char *path, uint64_t bytes, int create, int shared) {
+    int fd = create ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) :
+                      open(path, shared ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (create) {
+        // Пустой файл нужной длины: нули без записи на диск
+        if (ftruncate(fd, bytes) != 0) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    } else if (fstat(fd, &st) == 0) {
+        bytes = st.st_size;
+    }
+    if (bytes < VIXFS_BLOCK_SIZE) {
+        fprintf(stderr, "%s: image too small\n", path);
+        close(fd);
+        return -1;
+    }
+
+    // Частная копия многогигабайтного образа не должна резервировать
+    // память целиком: копируются только исправленные страницы
+    void *map = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                     shared ? MAP_SHARED : MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    image = (uint8_t*)map;
+    image_bytes = bytes;
+    sb = (vixfs_superblock_t*)image;
+    return 0;
+}
+
+static void image_close(void) {
+    munmap(image, image_bytes);
+    image = NULL;
+}
+
+// Указатели на битовые карты и таблицу инодов по суперблоку
+static void image_attach(void) {
+    inode_bitmap = BLOCK(sb->inode_bitmap_start);
+    block_bitmap = BLOCK(sb->block_bitmap_start);
+    inodes = (vixfs_inode_t*)BLOCK(sb->inode_table_start);
+}
+
+static int bit_test(const uint8_t *map, uint32_t n) {
+    return map[n / 8] & (1 << (n % 8));
+}
+
+static void bit_set(uint8_t *map, uint32_t n) {
+    map[n / 8] |= (1 << (n % 8));
+}
+
+static void bit_clear(uint8_t *map, uint32_t n) {
+    map[n / 8] &= ~(1 << (n % 8));
+}
+
+// CRC32C, как в ядре: номер блока или инода входит в начальное значение
+static uint32_t *block_csum(uint32_t block) {
+    return (uint32_t*)(BLOCK(block) + VIXFS_BLOCK_CSUM);
+}
+
+static int block_csum_ok(uint32_t block) {
+    return *block_csum(block) == crc32c(block, BLOCK(block), VIXFS_BLOCK_CSUM);
+}
+
+static void block_stamp(uint32_t block) {
+    *block_csum(block) = crc32c(block, BLOCK(block), VIXFS_BLOCK_CSUM);
+}
+
+static uint32_t inode_csum(uint32_t ino) {
+    return crc32c(ino, &inodes[ino], offsetof(vixfs_inode_t, checksum));
+}
+
+static uint32_t super_csum(void) {
+    return crc32c(0, sb, offsetof(vixfs_superblock_t, checksum));
+}
+
+// Суммы всех инодов и суперблока — последним, после счетчиков
+static void meta_stamp(void) {
+    for (uint32_t ino = 0; ino < VIXFS_MAX_FILES; ino++) {
+        inodes[ino].checksum = inode_csum(ino);
+    }
+    sb->checksum = super_csum();
+}
+
+// Суперблок ФС из total блоков — как в vixfs_format; 0, если места нет
+static uint32_t layout(vixfs_superblock_t *s, uint32_t total) {
+    memset(s, 0, sizeof(*s));
+    s->magic = VIXFS_MAGIC;
+    s->version = VIXFS_VERSION;
+    s->block_size = VIXFS_BLOCK_SIZE;
+    s->total_blocks = total;
+    s->inode_count = VIXFS_MAX_FILES;
+    s->root_inode = 0;
+    s->inode_bitmap_start = 1;
+    s->block_bitmap_start = 2;
+    s->block_bitmap_blocks = (total + VIXFS_BITS_PER_BLOCK - 1) / VIXFS_BITS_PER_BLOCK;
+    s->inode_table_start = s->block_bitmap_start + s->block_bitmap_blocks;
+    s->inode_table_blocks = VIXFS_MAX_FILES / VIXFS_INODES_PER_BLOCK;
+    s->journal_start = s->inode_table_start + s->inode_table_blocks;
+    s->journal_blocks = total / 64;
+    if (s->journal_blocks < VIXFS_JOURNAL_MIN_BLOCKS) {
+        s->journal_blocks = VIXFS_JOURNAL_MIN_BLOCKS;
+    }
+    if (s->journal_blocks > VIXFS_JOURNAL_MAX_BLOCKS) {
+        s->journal_blocks = VIXFS_JOURNAL_MAX_BLOCKS;
+    }
+    s->data_start = s->journal_start + s->journal_blocks;
+    return s->data_start < total ? s->data_start : 0;
+}
+
+// Пустой журнал: новая последовательность, следующий блок не похож на
+// транзакцию
+static void journal_reset(uint32_t seq, int clear_next) {
+    vixfs_journal_header_t *hdr = (vixfs_journal_header_t*)BLOCK(sb->journal_start);
+
+    memset(hdr, 0, VIXFS_BLOCK_SIZE);
+    hdr->magic = VIXFS_JOURNAL_HEADER;
+    hdr->seq = seq;
+    hdr->start = 1;
+    if (clear_next) {
+        memset(BLOCK(sb->journal_start + 1), 0, VIXFS_BLOCK_SIZE);
+    }
+}
+
+// FNV-1a, как в ядре
+static uint32_t name_hash(const char *name, uint32_t len) {
+    uint32_t hash = 2166136261u;
+
+    for (uint32_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// ===== Сборка образа =====
+
+// Файл или каталог будущего образа; номер в nodes — номер инода
+typedef struct {
+    char *path;             // Путь на хост-машине
+    uint32_t first_child;   // Дети каталога лежат в nodes подряд
+    uint32_t child_count;
+    uint32_t size;
+    uint32_t blocks;        // Блоков данных (у каталога — блоков индекса и листьев)
+    uint32_t hash;
+    uint8_t is_dir;
+    uint8_t name_len;
+    char name[VIXFS_MAX_FILENAME];
+} node_t;
+
+static node_t nodes[VIXFS_MAX_FILES];
+static uint32_t node_count = 0;
+static uint32_t next_block = 0;     // Выделение подряд от начала данных
+
+static int name_cmp(const void *a, const void *b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Дети каталога в порядке имен: одинаковое дерево — одинаковый образ
+static int scan_dir(uint32_t index) {
+    DIR *d = opendir(nodes[index].path);
+    if (!d) {
+        fprintf(stderr, "%s: %s\n", nodes[index].path, strerror(errno));
+        return -1;
+    }
+
+    char **names = NULL;
+    size_t count = 0, cap = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+            continue;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            names = realloc(names, cap * sizeof(char*));
+        }
+        names[count++] = strdup(de->d_name);
+    }
+    closedir(d);
+    qsort(names, count, sizeof(char*), name_cmp);
+
+    int result = 0;
+    nodes[index].first_child = node_count;
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(names[i]);
+        char *path = malloc(strlen(nodes[index].path) + len + 2);
+        struct stat st;
+
+        sprintf(path, "%s/%s", nodes[index].path, names[i]);
+        if (result != 0) {
+            // Ошибка уже есть: остальные имена только освобождаем
+        } else if (lstat(path, &st) != 0 || (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode))) {
+            fprintf(stderr, "%s: skipped (not a regular file or directory)\n", path);
+        } else if (len >= VIXFS_MAX_FILENAME) {
+            fprintf(stderr, "%s: name too long\n", path);
+            result = -1;
+        } else if (node_count == VIXFS_MAX_FILES) {
+            fprintf(stderr, "%s: too many files (ViXFS has %d inodes)\n", path, VIXFS_MAX_FILES);
+            result = -1;
+        } else if (S_ISREG(st.st_mode) && (uint64_t)st.st_size > UINT32_MAX) {
+            fprintf(stderr, "%s: file too large\n", path);
+            result = -1;
+        } else {
+            node_t *n = &nodes[node_count++];
+            memset(n, 0, sizeof(*n));
+            n->path = path;
+            n->is_dir = S_ISDIR(st.st_mode);
+            n->size = n->is_dir ? 0 : (uint32_t)st.st_size;
+            n->name_len = len;
+            memcpy(n->name, names[i], len);
+            n->hash = name_hash(n->name, len);
+            nodes[index].child_count++;
+            path = NULL;
+        }
+        free(path);
+        free(names[i]);
+    }
+    free(names);
+    return result;
+}
+
+// Порядок записей каталога по хэшу
+static int hash_cmp(const void *a, const void *b) {
+    const node_t *x = &nodes[*(const uint32_t*)a];
+    const node_t *y = &nodes[*(const uint32_t*)b];
+
+    if (x->hash != y->hash) {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+// Записи по возрастанию хэша заполняют листья подряд; имена с одинаковым
+// хэшем не разрываются между листьями, иначе поиск их не найдет.
+// В order — номера детей, first[i] — первая запись листа i. Число листьев
+// или 0, если не уложиться.
+static uint32_t dir_leaves(uint32_t index, uint32_t *order, uint32_t *first) {
+    node_t *dir = &nodes[index];
+    uint32_t leaves = 1;
+    uint32_t used = 0;
+
+    for (uint32_t i = 0; i < dir->child_count; i++) {
+        order[i] = dir->first_child + i;
+    }
+    qsort(order, dir->child_count, sizeof(uint32_t), hash_cmp);
+
+    first[0] = 0;
+    for (uint32_t i = 0; i < dir->child_count; i++) {
+        uint32_t size = VIXFS_DIRENT_SIZE(nodes[order[i]].name_len);
+        if (used + size > VIXFS_DIRLEAF_SPACE) {
+            uint32_t group = i;
+            while (group > first[leaves - 1] &&
+                   nodes[order[group - 1]].hash == nodes[order[i]].hash) {
+                group--;
+            }
+            if (group == first[leaves - 1]) {
+                fprintf(stderr, "%s: too many names with the same hash\n", dir->path);
+                return 0;
+            }
+            first[leaves++] = group;
+            used = 0;
+            for (uint32_t j = group; j < i; j++) {
+                used += VIXFS_DIRENT_SIZE(nodes[order[j]].name_len);
+            }
+        }
+        used += size;
+    }
+    first[leaves] = dir->child_count;
+    return leaves;
+}
+
+// Узлов индекса между корнем и листьями
+static uint32_t dir_index_nodes(uint32_t leaves) {
+    return leaves > VIXFS_DX_ENTRIES ? (leaves + VIXFS_DX_ENTRIES - 1) / VIXFS_DX_ENTRIES : 0;
+}
+
+static void dx_entry(uint8_t *node, uint32_t slot, uint32_t hash, uint32_t lblock) {
+    vixfs_dx_entry_t *entries = (vixfs_dx_entry_t*)(node + sizeof(vixfs_dx_header_t));
+
+    entries[slot].hash = hash;
+    entries[slot].block = lblock;
+    ((vixfs_dx_header_t*)node)->count++;
+}
+
+// Каталог в блоках start...: корень индекса, узлы индекса, листья
+static void dir_write(uint32_t index, uint32_t start) {
+    uint32_t order[VIXFS_MAX_FILES];
+    uint32_t first[VIXFS_MAX_FILES + 1];
+    uint32_t leaves = dir_leaves(index, order, first);
+    uint32_t index_nodes = dir_index_nodes(leaves);
+    uint32_t leaf_base = 1 + index_nodes;
+    uint8_t *root = BLOCK(start);
+
+    ((vixfs_dx_header_t*)root)->magic = VIXFS_DX_MAGIC;
+    ((vixfs_dx_header_t*)root)->depth = index_nodes ? 1 : 0;
+
+    for (uint32_t leaf = 0; leaf < leaves; leaf++) {
+        uint8_t *block = BLOCK(start + leaf_base + leaf);
+        vixfs_dirleaf_header_t *hdr = (vixfs_dirleaf_header_t*)block;
+        uint32_t hash = leaf ? nodes[order[first[leaf]]].hash : 0;
+
+        hdr->magic = VIXFS_DL_MAGIC;
+        for (uint32_t i = first[leaf]; i < first[leaf + 1]; i++) {
+            node_t *n = &nodes[order[i]];
+            vixfs_direntry_t *e = (vixfs_direntry_t*)(block + sizeof(*hdr) + hdr->used);
+            e->hash = n->hash;
+            e->inode = order[i];
+            e->name_len = n->name_len;
+            memcpy(e->name, n->name, n->name_len);
+            hdr->used += VIXFS_DIRENT_SIZE(n->name_len);
+            hdr->count++;
+        }
+
+        if (!index_nodes) {
+            dx_entry(root, leaf, hash, leaf_base + leaf);
+            continue;
+        }
+        uint32_t node = leaf / VIXFS_DX_ENTRIES;
+        uint8_t *dx = BLOCK(start + 1 + node);
+        if (leaf % VIXFS_DX_ENTRIES == 0) {
+            ((vixfs_dx_header_t*)dx)->magic = VIXFS_DX_MAGIC;
+            dx_entry(root, node, hash, 1 + node);
+        }
+        dx_entry(dx, leaf % VIXFS_DX_ENTRIES, hash, leaf_base + leaf);
+    }
+}
+
+// Один экстент на весь файл
+static void inode_init(uint32_t ino, uint32_t mode, uint32_t start, uint32_t blocks) {
+    vixfs_inode_t *inode = &inodes[ino];
+
+    inode->mode = mode;
+    inode->blocks = blocks;
+    inode->extent_header.magic = VIXFS_EXTENT_MAGIC;
+    inode->extent_header.max = VIXFS_INODE_EXTENTS;
+    if (blocks) {
+        inode->extent_header.count = 1;
+        inode->extents[0].file_block = 0;
+        inode->extents[0].start = start;
+        inode->extents[0].length = blocks;
+    }
+    bit_set(inode_bitmap, ino);
+}
+
+// Данные прямо на место в образе; маленький файл — в инод
+static int file_import(uint32_t ino) {
+    node_t *n = &nodes[ino];
+    uint32_t start = next_block;
+
+    next_block += n->blocks;
+    inode_init(ino, VIXFS_MODE_FILE, start, n->blocks);
+    inodes[ino].size = n->size;
+    if (n->size == 0) {
+        return 0;
+    }
+
+    uint8_t *dst = BLOCK(start);
+    if (!n->blocks) {
+        inodes[ino].flags = VIXFS_INODE_INLINE;
+        dst = inodes[ino].inline_data;
+    }
+    int fd = open(n->path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", n->path, strerror(errno));
+        return -1;
+    }
+    uint32_t done = 0;
+    while (done < n->size) {
+        ssize_t got = read(fd, dst + done, n->size - done);
+        if (got <= 0) {
+            break;
+        }
+        done += got;
+    }
+    close(fd);
+    if (done != n->size) {
+        fprintf(stderr, "%s: file changed while reading\n", n->path);
+        return -1;
+    }
+    return 0;
+}
+
+static int build(const char *path, uint32_t size_mb, const char *source) {
+    uint32_t order[VIXFS_MAX_FILES];
+    uint32_t first[VIXFS_MAX_FILES + 1];
+    uint64_t needed = 0;
+    vixfs_superblock_t s;
+
+    memset(&nodes[0], 0, sizeof(node_t));
+    nodes[0].path = (char*)source;
+    nodes[0].is_dir = 1;
+    node_count = 1;
+    if (source) {
+        struct stat st;
+        if (stat(source, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            fprintf(stderr, "%s: not a directory\n", source);
+            return 1;
+        }
+        // Обход в ширину: дети каждого каталога получают иноды подряд
+        for (uint32_t i = 0; i < node_count; i++) {
+            if (nodes[i].is_dir && scan_dir(i) != 0) {
+                return 1;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < node_count; i++) {
+        node_t *n = &nodes[i];
+        if (n->is_dir) {
+            uint32_t leaves = dir_leaves(i, order, first);
+            if (leaves == 0) {
+                return 1;
+            }
+            n->blocks = 1 + dir_index_nodes(leaves) + leaves;
+        } else if (n->size > VIXFS_INLINE_SIZE) {
+            n->blocks = (n->size + VIXFS_BLOCK_SIZE - 1) / VIXFS_BLOCK_SIZE;
+        }
+        needed += n->blocks;
+    }
+
+    // Наименьший размер в целых мегабайтах, в который все помещается
+    uint32_t max_mb = VIXFS_MAX_BLOCKS / 2048;
+    if (size_mb > max_mb) {
+        fprintf(stderr, "ViXFS supports images up to %u MB\n", max_mb);
+        return 1;
+    }
+    uint32_t mb = size_mb ? size_mb : 1;
+    for (;;) {
+        uint32_t data_start = layout(&s, mb * 2048);
+        if (data_start && mb * 2048 - data_start >= needed) {
+            break;
+        }
+        if (size_mb || mb == max_mb) {
+            fprintf(stderr, "Image too small: %llu data blocks needed\n",
+                    (unsigned long long)needed);
+            return 1;
+        }
+        mb++;
+    }
+
+    if (image_open(path, (uint64_t)mb * 2048 * VIXFS_BLOCK_SIZE, 1, 1) != 0) {
+        return 1;
+    }
+    *sb = s;
+    image_attach();
+
+    int result = 0;
+    next_block = sb->data_start;
+    for (uint32_t i = 0; i < node_count && result == 0; i++) {
+        node_t *dir = &nodes[i];
+        if (!dir->is_dir) {
+            continue;
+        }
+        // Каталог, а сразу за ним данные его файлов
+        inode_init(i, VIXFS_MODE_DIR, next_block, dir->blocks);
+        inodes[i].size = dir->blocks * VIXFS_BLOCK_SIZE;
+        dir_write(i, next_block);
+        for (uint32_t b = 0; b < dir->blocks; b++) {
+            block_stamp(next_block + b);
+        }
+        next_block += dir->blocks;
+        for (uint32_t c = dir->first_child; c < dir->first_child + dir->child_count; c++) {
+            if (!nodes[c].is_dir && file_import(c) != 0) {
+                result = -1;
+                break;
+            }
+        }
+    }
+
+    for (uint32_t b = 0; b < next_block; b++) {
+        bit_set(block_bitmap, b);
+    }
+    sb->free_blocks = sb->total_blocks - next_block;
+    sb->free_inodes = VIXFS_MAX_FILES - node_count;
+    meta_stamp();
+    journal_reset((uint32_t)time(NULL) | 1, 1);
+    image_close();
+    if (result != 0) {
+        unlink(path);
+        return 1;
+    }
+
+    uint32_t dirs = 0;
+    for (uint32_t i = 0; i < node_count; i++) {
+        dirs += nodes[i].is_dir;
+    }
+    printf("%s: %u MB, %u files, %u directories, %u of %u blocks used\n",
+           path, mb, node_count - dirs, dirs, next_block, s.total_blocks);
+    return 0;
+}
+
+// ===== Проверка =====
+
+static int repair = 0;
+static uint32_t fixed = 0;
+static uint32_t unfixed = 0;
+static uint16_t *owner = NULL;      // Инод + 1, которому принадлежит блок
+static uint8_t *meta = NULL;        // Узлы деревьев и блоки каталогов
+static uint8_t seen[VIXFS_MAX_FILES];
+static const char *damage;          // Причина, по которой инод отвергнут
+static uint32_t file_total = 0;
+static uint32_t dir_total = 0;
+
+// Найденная ошибка. Возвращает 1, если ее надо исправить: без -r
+// исправления остаются в частной копии образа, чтобы проверка дальше
+// видела согласованную картину.
+static int problem(int fixable, const char *fmt, ...) {
+    va_list ap;
+
+    printf(fixable && repair ? "fixed: " : "error: ");
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\n");
+    if (fixable && repair) {
+        fixed++;
+    } else {
+        unfixed++;
+    }
+    return fixable;
+}
+
+static int check_super(void) {
+    if (sb->magic != VIXFS_MAGIC ||
+        sb->version != VIXFS_VERSION ||
+        sb->block_size != VIXFS_BLOCK_SIZE ||
+        sb->inode_count != VIXFS_MAX_FILES ||
+        (uint64_t)sb->total_blocks * VIXFS_BLOCK_SIZE > image_bytes ||
+        sb->total_blocks > VIXFS_MAX_BLOCKS ||
+        sb->inode_bitmap_start != 1 ||
+        sb->block_bitmap_start != 2 ||
+        sb->block_bitmap_blocks * VIXFS_BITS_PER_BLOCK < sb->total_blocks ||
+        sb->inode_table_start != sb->block_bitmap_start + sb->block_bitmap_blocks ||
+        sb->inode_table_blocks != VIXFS_MAX_FILES / VIXFS_INODES_PER_BLOCK ||
+        sb->journal_start != sb->inode_table_start + sb->inode_table_blocks ||
+        sb->journal_start > VIXFS_MAX_META_BLOCKS ||
+        sb->journal_blocks < VIXFS_JOURNAL_MIN_BLOCKS ||
+        sb->journal_blocks > VIXFS_JOURNAL_MAX_BLOCKS ||
+        sb->data_start != sb->journal_start + sb->journal_blocks ||
+        sb->data_start >= sb->total_blocks ||
+        sb->root_inode != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// ----- Журнал: то же воспроизведение, что при монтировании -----
+
+static uint8_t *journal_block(uint32_t pos) {
+    return BLOCK(sb->journal_start + pos);
+}
+
+static uint32_t journal_kind(uint32_t pos, uint32_t seq) {
+    vixfs_journal_desc_t *desc = (vixfs_journal_desc_t*)journal_block(pos);
+
+    if (pos >= sb->journal_blocks || desc->seq != seq) {
+        return 0;
+    }
+    if (desc->magic == VIXFS_JOURNAL_DESC) {
+        if (desc->revokes * 2 + desc->images > VIXFS_JOURNAL_TAGS ||
+            pos + 1 + desc->images > sb->journal_blocks) {
+            return 0;
+        }
+        return VIXFS_JOURNAL_DESC;
+    }
+    return desc->magic == VIXFS_JOURNAL_COMMIT ? VIXFS_JOURNAL_COMMIT : 0;
+}
+
+// Число целых транзакций подряд с номера seq в блоке pos
+static uint32_t journal_scan(uint32_t seq, uint32_t pos) {
+    uint32_t count = 0;
+
+    for (;;) {
+        uint32_t start = pos;
+        uint32_t checksum = 0;
+        uint32_t kind;
+
+        while ((kind = journal_kind(pos, seq)) == VIXFS_JOURNAL_DESC) {
+            vixfs_journal_desc_t *desc = (vixfs_journal_desc_t*)journal_block(pos);
+            checksum = crc32c(checksum, journal_block(pos), (1 + desc->images) * VIXFS_BLOCK_SIZE);
+            pos += 1 + desc->images;
+        }
+
+        vixfs_journal_commit_t *commit = (vixfs_journal_commit_t*)journal_block(pos);
+        if (kind != VIXFS_JOURNAL_COMMIT || pos == start ||
+            commit->blocks != pos + 1 - start || commit->checksum != checksum) {
+            return count;
+        }
+        pos++;
+        seq++;
+        count++;
+    }
+}
+
+// Блок освобожден в транзакции seq или позже — старый образ не нужен
+static int journal_revoked(uint32_t seq, uint32_t start, uint32_t count, uint32_t block,
+                           uint32_t block_seq) {
+    uint32_t pos = start;
+
+    while (count > 0) {
+        vixfs_journal_desc_t *desc = (vixfs_journal_desc_t*)journal_block(pos);
+        if (desc->magic == VIXFS_JOURNAL_COMMIT) {
+            pos++;
+            seq++;
+            count--;
+            continue;
+        }
+        for (uint32_t i = 0; i < desc->revokes; i++) {
+            uint32_t first = desc->tags[i * 2];
+            if (block >= first && block - first < desc->tags[i * 2 + 1] &&
+                seq - block_seq < 0x80000000u) {
+                return 1;
+            }
+        }
+        pos += 1 + desc->images;
+    }
+    return 0;
+}
+
+static void check_journal(void) {
+    vixfs_journal_header_t *hdr = (vixfs_journal_header_t*)journal_block(0);
+
+    if (hdr->magic != VIXFS_JOURNAL_HEADER || hdr->start == 0 ||
+        hdr->start >= sb->journal_blocks) {
+        if (problem(1, "journal header is damaged")) {
+            journal_reset((uint32_t)time(NULL) | 1, 1);
+        }
+        return;
+    }
+
+    uint32_t seq = hdr->seq;
+    uint32_t start = hdr->start;
+    uint32_t count = journal_scan(seq, start);
+    if (count == 0) {
+        return;
+    }
+
+    printf("journal: %u transactions %s\n", count, repair ? "replayed" : "pending replay");
+    uint32_t pos = start;
+    for (uint32_t txn = 0; txn < count; ) {
+        vixfs_journal_desc_t *desc = (vixfs_journal_desc_t*)journal_block(pos);
+        if (desc->magic == VIXFS_JOURNAL_COMMIT) {
+            pos++;
+            txn++;
+            continue;
+        }
+        for (uint32_t i = 0; i < desc->images; i++) {
+            uint32_t block = desc->tags[desc->revokes * 2 + i];
+            if (block < sb->total_blocks &&
+                !journal_revoked(seq, start, count, block, desc->seq)) {
+                memcpy(BLOCK(block), journal_block(pos + 1 + i), VIXFS_BLOCK_SIZE);
+            }
+        }
+        pos += 1 + desc->images;
+    }
+    journal_reset(seq + count, 0);
+}
+
+// ----- Файлы и каталоги -----
+
+// Блоки [start, start + count) достаются иноду ino
+static int claim(uint32_t ino, uint32_t start, uint32_t count) {
+    if (count == 0 || start < sb->data_start || start >= sb->total_blocks ||
+        count > sb->total_blocks - start) {
+        damage = "maps blocks outside the data area";
+        return -1;
+    }
+    for (uint32_t b = start; b < start + count; b++) {
+        if (owner[b]) {
+            damage = owner[b] == ino + 1 ? "maps a block twice" : "shares blocks with another inode";
+            return -1;
+        }
+        owner[b] = ino + 1;
+    }
+    return 0;
+}
+
+// Инод отвергнут: его блоки снова ничьи
+static void release(uint32_t ino) {
+    for (uint32_t b = sb->data_start; b < sb->total_blocks; b++) {
+        if (owner[b] == ino + 1) {
+            owner[b] = 0;
+            meta[b] = 0;
+        }
+    }
+}
+
+// Сумма узла или блока каталога. Испорченное содержимое ловят проверки
+// структуры, а у целого блока сумма просто пересчитывается.
+static void check_block_csum(uint32_t ino, uint32_t block, const char *what) {
+    meta[block] = 1;
+    if (!block_csum_ok(block)) {
+        problem(1, "inode %u: %s %u checksum mismatch", ino, what, block);
+    }
+}
+
+// Узел дерева экстентов; *next — следующий ожидаемый блок файла
+static int check_node(uint32_t ino, vixfs_extent_header_t *hdr, uint16_t max,
+                      uint16_t depth, uint32_t *next) {
+    vixfs_extent_t *ext = (vixfs_extent_t*)(hdr + 1);
+
+    if (hdr->magic != VIXFS_EXTENT_MAGIC || hdr->max != max || hdr->count > max ||
+        hdr->depth != depth || (max == VIXFS_NODE_EXTENTS && hdr->count == 0)) {
+        damage = "has a damaged extent tree node";
+        return -1;
+    }
+    for (uint16_t i = 0; i < hdr->count; i++) {
+        if (ext[i].file_block != *next) {
+            damage = "has extents out of order";
+            return -1;
+        }
+        if (depth == 0) {
+            uint32_t length = VIXFS_EXTENT_LENGTH(ext[i].length);
+            if (claim(ino, ext[i].start, length) != 0) {
+                return -1;
+            }
+            if (!(ext[i].length & VIXFS_EXTENT_COMPRESSED)) {
+                *next += length;
+                continue;
+            }
+            // Сжатый кластер: свое окно целиком, заголовок внутри экстента
+            vixfs_cluster_header_t *cluster = (vixfs_cluster_header_t*)BLOCK(ext[i].start);
+            if (inodes[ino].mode != VIXFS_MODE_FILE ||
+                !(inodes[ino].flags & VIXFS_INODE_COMPRESSED) ||
+                *next % VIXFS_CLUSTER_BLOCKS != 0 || length >= VIXFS_CLUSTER_BLOCKS ||
+                cluster->comp_len > length * VIXFS_BLOCK_SIZE - sizeof(*cluster) ||
+                cluster->raw_len > VIXFS_CLUSTER_SIZE) {
+                damage = "has a damaged compressed cluster";
+                return -1;
+            }
+            // Данные не восстановить: файл остается, ошибка — нет
+            uint32_t index = *next / VIXFS_CLUSTER_BLOCKS;
+            uint32_t sum = crc32c(crc32c(ino, &index, sizeof(index)),
+                                  (uint8_t*)(cluster + 1), cluster->comp_len);
+            if (cluster->checksum != sum) {
+                problem(0, "inode %u: compressed cluster %u checksum mismatch", ino, index);
+            }
+            *next += VIXFS_CLUSTER_BLOCKS;
+            continue;
+        }
+        if (claim(ino, ext[i].start, 1) != 0) {
+            return -1;
+        }
+        check_block_csum(ino, ext[i].start, "extent tree node");
+        if (check_node(ino, (vixfs_extent_header_t*)BLOCK(ext[i].start),
+                       VIXFS_NODE_EXTENTS, depth - 1, next) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Физический блок для блока файла (дерево уже проверено)
+static uint32_t map_block(vixfs_inode_t *inode, uint32_t file_block) {
+    vixfs_extent_header_t *hdr = &inode->extent_header;
+
+    for (;;) {
+        vixfs_extent_t *ext = (vixfs_extent_t*)(hdr + 1);
+        int found = 0;
+        while (found + 1 < hdr->count && ext[found + 1].file_block <= file_block) {
+            found++;
+        }
+        if (hdr->depth == 0) {
+            return ext[found].start + (file_block - ext[found].file_block);
+        }
+        hdr = (vixfs_extent_header_t*)BLOCK(ext[found].start);
+    }
+}
+
+static int check_inode(uint32_t ino, const char *path) {
+    vixfs_inode_t *inode = &inodes[ino];
+    vixfs_extent_header_t *hdr = &inode->extent_header;
+
+    if (inode->mode != VIXFS_MODE_FILE && inode->mode != VIXFS_MODE_DIR) {
+        damage = "is not a file or directory";
+        return -1;
+    }
+    if (inode->checksum != inode_csum(ino)) {
+        problem(1, "%s: inode %u checksum mismatch", path, ino);
+    }
+    if (!bit_test(inode_bitmap, ino) &&
+        problem(1, "%s: inode %u is in use but marked free", path, ino)) {
+        bit_set(inode_bitmap, ino);
+    }
+
+    if (inode->flags & VIXFS_INODE_INLINE) {
+        if (inode->mode != VIXFS_MODE_FILE || inode->size > VIXFS_INLINE_SIZE ||
+            inode->blocks != 0 || hdr->count != 0) {
+            damage = "has damaged inline data";
+            return -1;
+        }
+        return 0;
+    }
+
+    uint32_t mapped = 0;
+    if (hdr->depth > VIXFS_MAX_DEPTH ||
+        check_node(ino, hdr, VIXFS_INODE_EXTENTS, hdr->depth, &mapped) != 0) {
+        release(ino);
+        return -1;
+    }
+    // У сжатого файла место под кластер — окно целиком (каталоги не сжимаются,
+    // флаг у них только наследуется)
+    uint32_t window = VIXFS_CLUSTER_BLOCKS;
+    if (inode->mode == VIXFS_MODE_FILE && (inode->flags & VIXFS_INODE_COMPRESSED)) {
+        mapped = (mapped + window - 1) / window * window;
+    }
+    if (mapped != inode->blocks &&
+        problem(1, "%s: inode %u block count %u, extents map %u", path, ino,
+                inode->blocks, mapped)) {
+        inode->blocks = mapped;
+    }
+
+    uint32_t size = inode->blocks * VIXFS_BLOCK_SIZE;
+    if (inode->mode == VIXFS_MODE_DIR) {
+        if (inode->blocks < 2) {
+            release(ino);
+            damage = "is a directory without index";
+            return -1;
+        }
+        if (inode->size != size && problem(1, "%s: directory size %u, expected %u", path,
+                                           inode->size, size)) {
+            inode->size = size;
+        }
+    } else if (inode->flags & VIXFS_INODE_COMPRESSED) {
+        // Размер по последнему кластеру не восстановить
+        if ((inode->size + VIXFS_CLUSTER_SIZE - 1) / VIXFS_CLUSTER_SIZE * window != inode->blocks) {
+            problem(0, "%s: size %u does not match %u compressed blocks", path, inode->size,
+                    inode->blocks);
+        }
+    } else if ((inode->size + VIXFS_BLOCK_SIZE - 1) / VIXFS_BLOCK_SIZE != inode->blocks &&
+               problem(1, "%s: size %u does not match %u blocks", path, inode->size,
+                       inode->blocks)) {
+        inode->size = size;
+    }
+    return 0;
+}
+
+// Лист каталога и диапазон хэшей, которые приводит к нему индекс
+typedef struct {
+    uint32_t lblock;
+    uint64_t lo;
+    uint64_t hi;
+} leaf_ref_t;
+
+typedef struct {
+    vixfs_inode_t *inode;
+    uint8_t *visited;        // Блоки каталога, уже встреченные в индексе
+    leaf_ref_t *leaves;
+    uint32_t leaf_count;
+} dir_check_t;
+
+static uint8_t *dir_block(dir_check_t *d, uint32_t lblock) {
+    return BLOCK(map_block(d->inode, lblock));
+}
+
+static int dir_visit(dir_check_t *d, uint32_t lblock) {
+    if (lblock >= d->inode->blocks || d->visited[lblock]) {
+        damage = "has a looped directory index";
+        return -1;
+    }
+    d->visited[lblock] = 1;
+    check_block_csum(d->inode - inodes, map_block(d->inode, lblock), "directory block");
+    return 0;
+}
+
+static int check_leaf(dir_check_t *d, uint32_t lblock, uint64_t lo, uint64_t hi) {
+    if (dir_visit(d, lblock) != 0) {
+        return -1;
+    }
+    uint8_t *block = dir_block(d, lblock);
+    vixfs_dirleaf_header_t *hdr = (vixfs_dirleaf_header_t*)block;
+    if (hdr->magic != VIXFS_DL_MAGIC || hdr->used > VIXFS_DIRLEAF_SPACE) {
+        damage = "has a damaged directory leaf";
+        return -1;
+    }
+
+    uint32_t offset = 0;
+    for (uint16_t i = 0; i < hdr->count; i++) {
+        vixfs_direntry_t *e = (vixfs_direntry_t*)(block + sizeof(*hdr) + offset);
+        if (offset + 9 > hdr->used || e->name_len == 0 || e->name_len >= VIXFS_MAX_FILENAME ||
+            offset + VIXFS_DIRENT_SIZE(e->name_len) > hdr->used) {
+            damage = "has a damaged directory entry";
+            return -1;
+        }
+        offset += VIXFS_DIRENT_SIZE(e->name_len);
+    }
+    if (offset != hdr->used) {
+        damage = "has a damaged directory leaf";
+        return -1;
+    }
+
+    leaf_ref_t *ref = &d->leaves[d->leaf_count++];
+    ref->lblock = lblock;
+    ref->lo = lo;
+    ref->hi = hi;
+    return 0;
+}
+
+// Узел индекса; хэши под ним лежат в [lo, hi)
+static int check_dx(dir_check_t *d, uint32_t lblock, int depth, uint64_t lo, uint64_t hi) {
+    if (dir_visit(d, lblock) != 0) {
+        return -1;
+    }
+    uint8_t *block = dir_block(d, lblock);
+    vixfs_dx_header_t *hdr = (vixfs_dx_header_t*)block;
+    vixfs_dx_entry_t *entries = (vixfs_dx_entry_t*)(block + sizeof(*hdr));
+    if (hdr->magic != VIXFS_DX_MAGIC || hdr->count == 0 || hdr->count > VIXFS_DX_ENTRIES ||
+        hdr->depth > VIXFS_DX_MAX_DEPTH || (depth >= 0 && hdr->depth != depth)) {
+        damage = "has a damaged directory index";
+        return -1;
+    }
+
+    // У первой записи хэш не смотрится: под нее попадает все с lo
+    for (uint16_t i = 0; i < hdr->count; i++) {
+        uint64_t from = i ? entries[i].hash : lo;
+        uint64_t to = i + 1 < hdr->count ? entries[i + 1].hash : hi;
+        if (from < lo || from > to || to > hi) {
+            damage = "has a directory index out of order";
+            return -1;
+        }
+        int result = hdr->depth == 0 ? check_leaf(d, entries[i].block, from, to) :
+                     check_dx(d, entries[i].block, hdr->depth - 1, from, to);
+        if (result != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void leaf_remove(vixfs_dirleaf_header_t *hdr, uint32_t offset) {
+    uint8_t *entry = (uint8_t*)(hdr + 1) + offset;
+    uint32_t size = VIXFS_DIRENT_SIZE(((vixfs_direntry_t*)entry)->name_len);
+
+    memmove(entry, entry + size, hdr->used - offset - size);
+    hdr->used -= size;
+    hdr->count--;
+}
+
+static int check_dir(uint32_t ino, char *path, size_t path_len);
+
+// Записи листа: каждая приводит к целому иноду, иначе удаляется
+static void check_entries(dir_check_t *d, leaf_ref_t *ref, char *path, size_t path_len) {
+    vixfs_dirleaf_header_t *hdr = (vixfs_dirleaf_header_t*)dir_block(d, ref->lblock);
+    uint32_t offset = 0;
+
+    for (uint16_t i = 0; i < hdr->count; ) {
+        vixfs_direntry_t *e = (vixfs_direntry_t*)((uint8_t*)(hdr + 1) + offset);
+        const char *bad = NULL;
+
+        snprintf(path + path_len, 4096 - path_len, "/%.*s", e->name_len, (const char*)e->name);
+        uint32_t hash = name_hash((const char*)e->name, e->name_len);
+        if (e->hash != hash && hash >= ref->lo && hash < ref->hi &&
+            problem(1, "%s: stale name hash, updated", path)) {
+            e->hash = hash;
+        }
+        if (e->hash != hash) {
+            bad = "name hash does not match";
+        } else if (e->hash < ref->lo || e->hash >= ref->hi) {
+            bad = "entry is not reachable through the index";
+        } else if (e->inode >= VIXFS_MAX_FILES || e->inode == sb->root_inode) {
+            bad = "bad inode number";
+        } else if (seen[e->inode]) {
+            bad = "inode is linked twice";
+        } else {
+            seen[e->inode] = 1;
+            if (check_inode(e->inode, path) != 0 ||
+                (inodes[e->inode].mode == VIXFS_MODE_DIR &&
+                 check_dir(e->inode, path, strlen(path)) != 0)) {
+                seen[e->inode] = 0;
+                bad = damage;
+            }
+        }
+
+        if (bad && problem(1, "%s: inode %u %s, entry removed", path, e->inode, bad)) {
+            leaf_remove(hdr, offset);
+            continue;
+        }
+        if (!bad) {
+            if (inodes[e->inode].mode == VIXFS_MODE_DIR) {
+                dir_total++;
+            } else {
+                file_total++;
+            }
+        }
+        offset += VIXFS_DIRENT_SIZE(e->name_len);
+        i++;
+    }
+    path[path_len] = '\0';
+}
+
+// Сначала весь индекс и листья каталога, потом его записи: испорченный
+// каталог отвергается целиком, пока под ним еще ничего не помечено
+static int check_dir(uint32_t ino, char *path, size_t path_len) {
+    dir_check_t d;
+
+    d.inode = &inodes[ino];
+    d.visited = calloc(d.inode->blocks, 1);
+    d.leaves = calloc(d.inode->blocks, sizeof(leaf_ref_t));
+    d.leaf_count = 0;
+    if (check_dx(&d, 0, -1, 0, 0x100000000ull) != 0) {
+        free(d.visited);
+        free(d.leaves);
+        release(ino);
+        return -1;
+    }
+
+    // Лист вне индекса показал бы в списке файлы, которых не найти
+    for (uint32_t lblock = 1; lblock < d.inode->blocks; lblock++) {
+        vixfs_dirleaf_header_t *hdr = (vixfs_dirleaf_header_t*)dir_block(&d, lblock);
+        meta[map_block(d.inode, lblock)] = 1;
+        if (!d.visited[lblock] && hdr->magic == VIXFS_DL_MAGIC && hdr->count &&
+            problem(1, "%s: directory block %u is not in the index, cleared", path, lblock)) {
+            hdr->count = 0;
+            hdr->used = 0;
+        }
+    }
+
+    for (uint32_t i = 0; i < d.leaf_count; i++) {
+        check_entries(&d, &d.leaves[i], path, path_len);
+    }
+    free(d.visited);
+    free(d.leaves);
+    return 0;
+}
+
+// Битовые карты и счетчики суперблока по тому, что реально занято
+static void check_bitmaps(void) {
+    uint32_t inodes_used = 0;
+
+    for (uint32_t ino = 0; ino < VIXFS_MAX_FILES; ino++) {
+        if (seen[ino]) {
+            inodes_used++;
+        } else if (bit_test(inode_bitmap, ino) &&
+                   problem(1, "inode %u is not linked anywhere, released", ino)) {
+            bit_clear(inode_bitmap, ino);
+            memset(&inodes[ino], 0, sizeof(vixfs_inode_t));
+        }
+    }
+
+    uint32_t lost = 0, leaked = 0, used = 0;
+    for (uint32_t b = 0; b < sb->total_blocks; b++) {
+        int in_use = b < sb->data_start || owner[b];
+        used += in_use;
+        if (in_use && !bit_test(block_bitmap, b)) {
+            lost++;
+        } else if (!in_use && bit_test(block_bitmap, b)) {
+            leaked++;
+        }
+    }
+    int fix = 0;
+    if (lost) {
+        fix |= problem(1, "%u blocks in use are marked free", lost);
+    }
+    if (leaked) {
+        fix |= problem(1, "%u unused blocks are marked in use", leaked);
+    }
+    if (fix) {
+        for (uint32_t b = 0; b < sb->total_blocks; b++) {
+            if (b < sb->data_start || owner[b]) {
+                bit_set(block_bitmap, b);
+            } else {
+                bit_clear(block_bitmap, b);
+            }
+        }
+    }
+
+    if (sb->free_blocks != sb->total_blocks - used &&
+        problem(1, "free block count %u, expected %u", sb->free_blocks,
+                sb->total_blocks - used)) {
+        sb->free_blocks = sb->total_blocks - used;
+    }
+    if (sb->free_inodes != VIXFS_MAX_FILES - inodes_used &&
+        problem(1, "free inode count %u, expected %u", sb->free_inodes,
+                VIXFS_MAX_FILES - inodes_used)) {
+        sb->free_inodes = VIXFS_MAX_FILES - inodes_used;
+    }
+    printf("%u files, %u directories, %u of %u blocks used\n",
+           file_total, dir_total, used, sb->total_blocks);
+}
+
+// Коды выхода как у e2fsck: 0 — чисто, 1 — исправлено, 4 — ошибки
+// остались, 8 — проверить не удалось
+static int fsck(const char *path) {
+    static char name[4096];
+
+    if (image_open(path, 0, 0, repair) != 0) {
+        return 8;
+    }
+    if (check_super() != 0) {
+        fprintf(stderr, "%s: no valid ViXFS superblock\n", path);
+        image_close();
+        return 8;
+    }
+    image_attach();
+    owner = calloc(sb->total_blocks, sizeof(uint16_t));
+    meta = calloc(sb->total_blocks, 1);
+    memset(seen, 0, sizeof(seen));
+
+    check_journal();
+    if (sb->checksum != super_csum()) {
+        problem(1, "superblock checksum mismatch");
+    }
+
+    name[0] = '\0';
+    seen[sb->root_inode] = 1;
+    dir_total = 1;
+    if (inodes[sb->root_inode].mode != VIXFS_MODE_DIR ||
+        check_inode(sb->root_inode, "/") != 0 ||
+        check_dir(sb->root_inode, name, 0) != 0) {
+        problem(0, "root directory is damaged");
+    } else {
+        check_bitmaps();
+    }
+
+    // Исправления меняют узлы, каталоги и иноды: суммы заново
+    if (repair) {
+        for (uint32_t b = sb->data_start; b < sb->total_blocks; b++) {
+            if (meta[b]) {
+                block_stamp(b);
+            }
+        }
+        meta_stamp();
+    }
+
+    free(meta);
+    free(owner);
+    image_close();
+    return unfixed ? 4 : fixed ? 1 : 0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: mkvixfs format <image> <MB>\n"
+            "       mkvixfs build <image> <MB> <directory>   (MB = 0: smallest fit)\n"
+            "       mkvixfs fsck <image> [-r]\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 4 && strcmp(argv[1], "format") == 0) {
+        uint32_t mb = strtoul(argv[3], NULL, 10);
+        if (mb == 0) {
+            usage();
+            return 1;
+        }
+        return build(argv[2], mb, NULL);
+    }
+    if (argc >= 5 && strcmp(argv[1], "build") == 0) {
+        return build(argv[2], strtoul(argv[3], NULL, 10), argv[4]);
+    }
+    if (argc >= 3 && strcmp(argv[1], "fsck") == 0) {
+        repair = argc >= 4 && strcmp(argv[3], "-r") == 0;
+        return fsck(argv[2]);
+    }
+    usage();
+    return 1;
+}
@@ -0,0 +1,159 @@
+#include "msi.h"
+#include "idt.h"
+#include "irq.h"
+
+extern void msi_vec0();
+extern void msi_vec1();
+extern void msi_vec2();
+extern void msi_vec3();
+extern void msi_vec4();
+extern void msi_vec5();
+extern void msi_vec6();
+extern void msi_vec7();
+extern void msi_vec8();
+extern void msi_vec9();
+extern void msi_vec10();
+extern void msi_vec11();
+extern void msi_vec12();
+extern void msi_vec13();
+extern void msi_vec14();
+extern void msi_vec15();
+extern void msi_spurious();
+
+#define LAPIC_REG_LVT_LINT0  0x350
+#define LAPIC_REG_LVT_LINT1  0x360
+#define LAPIC_LVT_EXTINT     0x700
+#define LAPIC_LVT_NMI        0x400
+
+static void (*msi_handlers[MSI_MAX_VECTORS])(void);
+static volatile uint32_t *lapic = 0;
+static uint8_t lapic_id = 0;
+
+static void msi_cpuid(uint32_t leaf, uint32_t *eax, uint32_t *edx) {
+    uint32_t ebx, ecx;
+    __asm__ volatile ("cpuid" : "=a"(*eax), "=b"(ebx), "=c"(ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static uint64_t msi_rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static void msi_wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+static void lapic_write(uint32_t reg, uint32_t value) {
+    lapic[reg / 4] = value;
+}
+
+void msi_init(void) {
+    uint32_t eax, edx;
+    
+    msi_cpuid(1, &eax, &edx);
+    if (!(edx & (1 << 9))) {
+        return;                         // Локального APIC нет — остаются только INTx
+    }
+    
+    uint64_t base = msi_rdmsr(IA32_APIC_BASE_MSR);
+    if (!(base & IA32_APIC_BASE_EN)) {
+        base |= IA32_APIC_BASE_EN;
+        msi_wrmsr(IA32_APIC_BASE_MSR, base);
+    }
+    // Страничная адресация выключена: регистры APIC доступны по физическому адресу
+    lapic = (volatile uint32_t*)(uint32_t)(base & 0xFFFFF000);
+    
+    // Режим virtual wire: прерывания PIC по-прежнему приходят через LINT0
+    lapic_write(LAPIC_REG_LVT_LINT0, LAPIC_LVT_EXTINT);
+    lapic_write(LAPIC_REG_LVT_LINT1, LAPIC_LVT_NMI);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | MSI_SPURIOUS_VECTOR);
+    lapic_id = lapic_read(LAPIC_REG_ID) >> 24;
+    
+    idt_set_gate(MSI_VECTOR_BASE + 0, (uint32_t)msi_vec0, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 1, (uint32_t)msi_vec1, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 2, (uint32_t)msi_vec2, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 3, (uint32_t)msi_vec3, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 4, (uint32_t)msi_vec4, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 5, (uint32_t)msi_vec5, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 6, (uint32_t)msi_vec6, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 7, (uint32_t)msi_vec7, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 8, (uint32_t)msi_vec8, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 9, (uint32_t)msi_vec9, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 10, (uint32_t)msi_vec10, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 11, (uint32_t)msi_vec11, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 12, (uint32_t)msi_vec12, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 13, (uint32_t)msi_vec13, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 14, (uint32_t)msi_vec14, 0x08, 0x8E);
+    idt_set_gate(MSI_VECTOR_BASE + 15, (uint32_t)msi_vec15, 0x08, 0x8E);
+    idt_set_gate(MSI_SPURIOUS_VECTOR, (uint32_t)msi_spurious, 0x08, 0x8E);
+}
+
+int msi_available(void) {
+    return lapic != 0;
+}
+
+// Вызывается из msi_stub.s с номером слота
+void msi_dispatch(uint32_t index) {
+    if (index < MSI_MAX_VECTORS && msi_handlers[index]) {
+        msi_handlers[index]();
+    }
+    // Сообщения фронтовые: достаточно EOI в APIC, PIC не участвует
+    lapic_write(LAPIC_REG_EOI, 0);
+}
+
+int msi_alloc_vector(void (*handler)(void)) {
+    if (!lapic || !handler) {
+        return -1;
+    }
+    for (int i = 0; i < MSI_MAX_VECTORS; i++) {
+        if (__sync_bool_compare_and_swap(&msi_handlers[i], 0, handler)) {
+            return MSI_VECTOR_BASE + i;
+        }
+    }
+    return -1;
+}
+
+void msi_free_vector(int vector) {
+    if (vector >= MSI_VECTOR_BASE && vector < MSI_VECTOR_BASE + MSI_MAX_VECTORS) {
+        msi_handlers[vector - MSI_VECTOR_BASE] = 0;
+    }
+}
+
+// Фиксированная доставка, физический адрес назначения, фронт
+void msi_compose_message(int vector, uint32_t *address, uint32_t *data) {
+    *address = LAPIC_DEFAULT_BASE | ((uint32_t)lapic_id << 12);
+    *data = (uint32_t)vector & 0xFF;
+}
+
+int msi_request_irq(pci_device_t dev, void (*handler)(void), uint8_t *vector) {
+    int vec = msi_alloc_vector(handler);
+    
+    if (vec >= 0) {
+        uint32_t address, data;
+        msi_compose_message(vec, &address, &data);
+        
+        if (pci_enable_msix(dev, 0, address, data) == 0) {
+            *vector = (uint8_t)vec;
+            return MSI_IRQ_MSIX;
+        }
+        if (pci_enable_msi(dev, address, data) == 0) {
+            *vector = (uint8_t)vec;
+            return MSI_IRQ_MSI;
+        }
+        msi_free_vector(vec);
+    }
+    
+    // Запасной путь: линия INTx из конфигурационного пространства
+    uint8_t line = pci_read_config(dev.bus, dev.device, dev.function, 0x3C) & 0xFF;
+    if (line < 16) {
+        irq_set_handler(line, handler);
+        *vector = line;
+        return MSI_IRQ_INTX;
+    }
+    return MSI_IRQ_NONE;
+}
@@ -0,0 +1,42 @@
+#ifndef MSI_H
+#define MSI_H
+
+#include <stdint.h>
+#include "pci.h"
+
+// Прерывания по сообщениям (MSI/MSI-X) через локальный APIC.
+// Каждое устройство получает собственный фронтовой вектор в IDT:
+// без разделения линии INTx и без EOI в PIC.
+
+#define MSI_VECTOR_BASE      0x30         // Сразу за векторами PIC (0x20-0x2F)
+#define MSI_MAX_VECTORS      16
+#define MSI_SPURIOUS_VECTOR  0xFF
+
+#define LAPIC_DEFAULT_BASE   0xFEE00000
+#define LAPIC_REG_ID         0x020
+#define LAPIC_REG_EOI        0x0B0
+#define LAPIC_REG_SVR        0x0F0
+#define LAPIC_SVR_ENABLE     (1 << 8)
+#define IA32_APIC_BASE_MSR   0x1B
+#define IA32_APIC_BASE_EN    (1 << 11)
+
+// Как устройство получило прерывание
+#define MSI_IRQ_NONE   0
+#define MSI_IRQ_INTX   1
+#define MSI_IRQ_MSI    2
+#define MSI_IRQ_MSIX   3
+
+void msi_init(void);
+int msi_available(void);
+
+// Вектор IDT для обработчика или -1, если свободных нет
+int msi_alloc_vector(void (*handler)(void));
+void msi_free_vector(int vector);
+// Адрес и данные сообщения, доставляющего вектор на этот процессор
+void msi_compose_message(int vector, uint32_t *address, uint32_t *data);
+
+// Подключить прерывание устройства: MSI-X, затем MSI, иначе линия INTx.
+// Возвращает MSI_IRQ_*; в *vector — вектор IDT или номер IRQ.
+int msi_request_irq(pci_device_t dev, void (*handler)(void), uint8_t *vector);
+
+#endif
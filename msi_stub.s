@@ -0,0 +1,59 @@
+section .text
+
+global msi_vec0, msi_vec1, msi_vec2, msi_vec3, msi_vec4, msi_vec5, msi_vec6, msi_vec7
+global msi_vec8, msi_vec9, msi_vec10, msi_vec11, msi_vec12, msi_vec13, msi_vec14, msi_vec15
+global msi_spurious
+
+%macro MSI_HANDLER 1
+msi_vec%1:
+    push dword %1
+    jmp msi_common_stub
+%endmacro
+
+MSI_HANDLER 0
+MSI_HANDLER 1
+MSI_HANDLER 2
+MSI_HANDLER 3
+MSI_HANDLER 4
+MSI_HANDLER 5
+MSI_HANDLER 6
+MSI_HANDLER 7
+MSI_HANDLER 8
+MSI_HANDLER 9
+MSI_HANDLER 10
+MSI_HANDLER 11
+MSI_HANDLER 12
+MSI_HANDLER 13
+MSI_HANDLER 14
+MSI_HANDLER 15
+
+msi_common_stub:
+    pusha
+    push ds
+    push es
+    push fs
+    push gs
+
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    ; Номер слота лежит над сегментами (16 байт) и pusha (32 байта)
+    push dword [esp + 48]
+    extern msi_dispatch
+    call msi_dispatch
+    add esp, 4
+
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 4
+    iret
+
+; Ложное прерывание APIC не требует EOI
+msi_spurious:
+    iret
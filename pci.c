@@ -1,70 +1,312 @@
 #include "pci.h"
 #include "port_io.h"
 #include "video.h"
+#include "string.h"
+#include "acpi.h"
+
+// ===== Доступ к конфигурационному пространству =====
+//
+// Если ACPI описывает окна ECAM (таблица MCFG), регистры читаются одной
+// операцией с памятью, и доступны все 4 КБ пространства функции.
+// Иначе — через пару портов 0xCF8/0xCFC, только первые 256 байт.
+
+typedef struct {
+    uint32_t base;
+    uint8_t start_bus;
+    uint8_t end_bus;
+} pci_ecam_window_t;
+
+static pci_ecam_window_t pci_ecam[PCI_ECAM_MAX_WINDOWS];
+static int pci_ecam_count = 0;
+
+static volatile uint32_t *pci_ecam_address(uint8_t bus, uint8_t device, uint8_t func,
+                                           uint16_t offset) {
+    for (int i = 0; i < pci_ecam_count; i++) {
+        if (bus >= pci_ecam[i].start_bus && bus <= pci_ecam[i].end_bus) {
+            return (volatile uint32_t*)(pci_ecam[i].base +
+                                        ((uint32_t)(bus - pci_ecam[i].start_bus) << 20) +
+                                        ((uint32_t)device << 15) +
+                                        ((uint32_t)func << 12) +
+                                        (offset & 0xFFC));
+        }
+    }
+    return NULL;
+}
+
+static uint32_t pci_legacy_address(uint8_t bus, uint8_t device, uint8_t func, uint8_t offset) {
+    return (1u << 31) |
+           ((uint32_t)bus << 16) |
+           ((uint32_t)device << 11) |
+           ((uint32_t)func << 8) |
+           (offset & 0xFC);
+}
 
 uint32_t pci_read_config(uint8_t bus, uint8_t device, uint8_t func, uint8_t offset) {
-    uint32_t address = (1 << 31) |
-                      ((uint32_t)bus << 16) |
-                      ((uint32_t)device << 11) |
-                      ((uint32_t)func << 8) |
-                      (offset & 0xFC);
+    volatile uint32_t *reg = pci_ecam_address(bus, device, func & 7, offset);
+    if (reg) {
+        return *reg;
+    }
     
-    outl(address, PCI_CONFIG_ADDRESS);
+    outl(pci_legacy_address(bus, device, func, offset), PCI_CONFIG_ADDRESS);
     return inl(PCI_CONFIG_DATA);
 }
 
 void pci_write_config(uint8_t bus, uint8_t device, uint8_t func, uint8_t offset, uint32_t value) {
-    uint32_t address = (1 << 31) |
-                      ((uint32_t)bus << 16) |
-                      ((uint32_t)device << 11) |
-                      ((uint32_t)func << 8) |
-                      (offset & 0xFC);
+    volatile uint32_t *reg = pci_ecam_address(bus, device, func & 7, offset);
+    if (reg) {
+        *reg = value;
+        return;
+    }
     
-    outl(address, PCI_CONFIG_ADDRESS);
+    outl(pci_legacy_address(bus, device, func, offset), PCI_CONFIG_ADDRESS);
     outl(value, PCI_CONFIG_DATA);
 }
 
+uint32_t pci_read_config_ext(uint8_t bus, uint8_t device, uint8_t func, uint16_t offset) {
+    if (offset < 256) {
+        return pci_read_config(bus, device, func, (uint8_t)offset);
+    }
+    volatile uint32_t *reg = pci_ecam_address(bus, device, func & 7, offset);
+    return reg ? *reg : 0xFFFFFFFF;
+}
+
+int pci_write_config_ext(uint8_t bus, uint8_t device, uint8_t func, uint16_t offset,
+                         uint32_t value) {
+    if (offset < 256) {
+        pci_write_config(bus, device, func, (uint8_t)offset, value);
+        return 0;
+    }
+    volatile uint32_t *reg = pci_ecam_address(bus, device, func & 7, offset);
+    if (!reg) {
+        return -1;
+    }
+    *reg = value;
+    return 0;
+}
+
+int pci_ecam_available(void) {
+    return pci_ecam_count > 0;
+}
+
+// Окна ECAM сегмента 0 из ACPI MCFG. Окно проверяется сверкой
+// идентификатора 0:0.0 с прочитанным через порты.
+static void pci_ecam_init(void) {
+    const acpi_mcfg_t *mcfg = (const acpi_mcfg_t*)acpi_find_table("MCFG");
+    
+    pci_ecam_count = 0;
+    if (!mcfg) {
+        return;
+    }
+    
+    uint32_t entries = (mcfg->header.length - sizeof(acpi_mcfg_t)) / sizeof(acpi_mcfg_entry_t);
+    for (uint32_t i = 0; i < entries && pci_ecam_count < PCI_ECAM_MAX_WINDOWS; i++) {
+        const acpi_mcfg_entry_t *entry = &mcfg->entries[i];
+        uint64_t size = (uint64_t)(entry->end_bus - entry->start_bus + 1) << 20;
+        
+        // Без страничной адресации окна выше 4 GB недоступны
+        if (entry->segment != 0 || entry->end_bus < entry->start_bus ||
+            entry->base_address + size > 0x100000000ULL) {
+            continue;
+        }
+        pci_ecam[pci_ecam_count].base = (uint32_t)entry->base_address;
+        pci_ecam[pci_ecam_count].start_bus = entry->start_bus;
+        pci_ecam[pci_ecam_count].end_bus = entry->end_bus;
+        pci_ecam_count++;
+    }
+    
+    volatile uint32_t *probe = pci_ecam_address(0, 0, 0, 0);
+    if (probe) {
+        outl(pci_legacy_address(0, 0, 0, 0), PCI_CONFIG_ADDRESS);
+        if (*probe != inl(PCI_CONFIG_DATA)) {
+            pci_ecam_count = 0;
+        }
+    }
+}
+
+// ===== Таблица устройств =====
+//
+// Даже через ECAM обращение к конфигурационному пространству — это
+// некэшируемый доступ к устройству, а через порты 0xCF8/0xCFC — две
+// медленные операции ввода-вывода. Поэтому шины обходятся один раз,
+// а поиск драйверами идет по таблице в памяти.
+
+static pci_device_t pci_devices[PCI_MAX_DEVICES];
+static int pci_count = 0;
+static int pci_dropped = 0;               // Не поместилось в таблицу
+static uint8_t pci_enumerated = 0;
+static uint32_t pci_bus_scanned[PCI_MAX_BUSES / 32];
+
+// Индекс по классу: первое устройство класса и цепочка следующих
+static int8_t pci_class_head[256];
+static int8_t pci_class_next[PCI_MAX_DEVICES];
+
+static void pci_scan_bus(uint8_t bus);
+
+static void pci_add_function(uint8_t bus, uint8_t slot, uint8_t func, uint32_t id) {
+    uint32_t class_reg = pci_read_config(bus, slot, func, 0x08);
+    uint8_t header = (pci_read_config(bus, slot, func, 0x0C) >> 16) & PCI_HEADER_TYPE_MASK;
+    uint8_t class_code = class_reg >> 24;
+    uint8_t subclass = (class_reg >> 16) & 0xFF;
+    
+    if (pci_count < PCI_MAX_DEVICES) {
+        pci_device_t *dev = &pci_devices[pci_count];
+        int bars = (header == 0) ? 6 : (header == PCI_HEADER_BRIDGE) ? 2 : 0;
+        
+        memset(dev, 0, sizeof(pci_device_t));
+        dev->vendor_id = id & 0xFFFF;
+        dev->device_id = id >> 16;
+        dev->class_code = class_code;
+        dev->subclass = subclass;
+        dev->prog_if = (class_reg >> 8) & 0xFF;
+        dev->revision = class_reg & 0xFF;
+        dev->bus = bus;
+        dev->device = slot;
+        dev->function = func;
+        dev->header_type = header;
+        for (int i = 0; i < bars; i++) {
+            dev->bar[i] = pci_read_config(bus, slot, func, 0x10 + i * 4);
+        }
+        uint32_t irq = pci_read_config(bus, slot, func, 0x3C);
+        dev->irq_line = irq & 0xFF;
+        dev->irq_pin = (irq >> 8) & 0xFF;
+        
+        // Цепочка класса сохраняет порядок обхода
+        pci_class_next[pci_count] = -1;
+        if (pci_class_head[class_code] < 0) {
+            pci_class_head[class_code] = pci_count;
+        } else {
+            int last = pci_class_head[class_code];
+            while (pci_class_next[last] >= 0) {
+                last = pci_class_next[last];
+            }
+            pci_class_next[last] = pci_count;
+        }
+        pci_count++;
+    } else {
+        pci_dropped++;
+    }
+    
+    // За мостом PCI-PCI — своя вторичная шина
+    if (header == PCI_HEADER_BRIDGE &&
+        class_code == PCI_CLASS_BRIDGE && subclass == PCI_SUBCLASS_PCI_BRIDGE) {
+        uint8_t secondary = (pci_read_config(bus, slot, func, 0x18) >> 8) & 0xFF;
+        if (secondary != 0) {
+            pci_scan_bus(secondary);
+        }
+    }
+}
+
+static void pci_scan_bus(uint8_t bus) {
+    // Защита от повторного обхода при ошибочной настройке мостов
+    if (pci_bus_scanned[bus / 32] & (1u << (bus % 32))) {
+        return;
+    }
+    pci_bus_scanned[bus / 32] |= 1u << (bus % 32);
+    
+    for (uint8_t slot = 0; slot < 32; slot++) {
+        uint32_t id = pci_read_config(bus, slot, 0, 0);
+        if ((id & 0xFFFF) == 0xFFFF) {
+            continue;
+        }
+        pci_add_function(bus, slot, 0, id);
+        
+        uint8_t header = pci_read_config(bus, slot, 0, 0x0C) >> 16;
+        if (!(header & PCI_HEADER_MULTIFUNC)) {
+            continue;
+        }
+        for (uint8_t func = 1; func < 8; func++) {
+            id = pci_read_config(bus, slot, func, 0);
+            if ((id & 0xFFFF) != 0xFFFF) {
+                pci_add_function(bus, slot, func, id);
+            }
+        }
+    }
+}
+
+void pci_init(void) {
+    pci_ecam_init();
+    
+    pci_count = 0;
+    pci_dropped = 0;
+    memset(pci_bus_scanned, 0, sizeof(pci_bus_scanned));
+    memset(pci_class_head, -1, sizeof(pci_class_head));
+    
+    // Многофункциональный хост-мост 0:0.0: функция N обслуживает шину N
+    uint8_t header = pci_read_config(0, 0, 0, 0x0C) >> 16;
+    if (!(header & PCI_HEADER_MULTIFUNC)) {
+        pci_scan_bus(0);
+    } else {
+        for (uint8_t func = 0; func < 8; func++) {
+            if ((pci_read_config(0, 0, func, 0) & 0xFFFF) != 0xFFFF) {
+                pci_scan_bus(func);
+            }
+        }
+    }
+    pci_enumerated = 1;
+}
+
+int pci_device_count(void) {
+    if (!pci_enumerated) {
+        pci_init();
+    }
+    return pci_count;
+}
+
+const pci_device_t *pci_get_device(int index) {
+    if (index < 0 || index >= pci_device_count()) {
+        return NULL;
+    }
+    return &pci_devices[index];
+}
+
+const pci_device_t *pci_find_class(uint8_t class_code, uint8_t subclass, int index) {
+    if (!pci_enumerated) {
+        pci_init();
+    }
+    
+    if (class_code == 0xFF) {
+        for (int i = 0; i < pci_count; i++) {
+            if ((subclass == 0xFF || pci_devices[i].subclass == subclass) && index-- == 0) {
+                return &pci_devices[i];
+            }
+        }
+        return NULL;
+    }
+    
+    for (int i = pci_class_head[class_code]; i >= 0; i = pci_class_next[i]) {
+        if ((subclass == 0xFF || pci_devices[i].subclass == subclass) && index-- == 0) {
+            return &pci_devices[i];
+        }
+    }
+    return NULL;
+}
+
+const pci_device_t *pci_find_vendor(uint16_t vendor_id, uint16_t device_id, int index) {
+    if (!pci_enumerated) {
+        pci_init();
+    }
+    for (int i = 0; i < pci_count; i++) {
+        if ((vendor_id == 0xFFFF || pci_devices[i].vendor_id == vendor_id) &&
+            (device_id == 0xFFFF || pci_devices[i].device_id == device_id) &&
+            index-- == 0) {
+            return &pci_devices[i];
+        }
+    }
+    return NULL;
+}
+
 pci_device_t pci_find_device(uint16_t vendor_id, uint16_t device_id, uint8_t class_code, uint8_t subclass) {
     pci_device_t dev;
     dev.vendor_id = 0xFFFF;
     
-    for (int bus = 0; bus < 256; bus++) {
-        for (int slot = 0; slot < 32; slot++) {
-            for (int func = 0; func < 8; func++) {
-                uint32_t data = pci_read_config(bus, slot, func, 0);
-                uint16_t found_vendor = data & 0xFFFF;
-                uint16_t found_device = data >> 16;
-                
-                if (found_vendor == 0xFFFF) continue;
-                
-                // Проверяем класс и подкласс
-                data = pci_read_config(bus, slot, func, 8);
-                uint8_t found_class = (data >> 24) & 0xFF;
-                uint8_t found_subclass = (data >> 16) & 0xFF;
-                
-                if ((vendor_id == 0xFFFF || found_vendor == vendor_id) &&
-                    (device_id == 0xFFFF || found_device == device_id) &&
-                    (class_code == 0xFF || found_class == class_code) &&
-                    (subclass == 0xFF || found_subclass == subclass)) {
-                    
-                    dev.vendor_id = found_vendor;
-                    dev.device_id = found_device;
-                    dev.class_code = found_class;
-                    dev.subclass = found_subclass;
-                    dev.prog_if = (data >> 8) & 0xFF;
-                    dev.revision = data & 0xFF;
-                    dev.bus = bus;
-                    dev.device = slot;
-                    dev.function = func;
-                    
-                    // Читаем BAR
-                    for (int i = 0; i < 6; i++) {
-                        dev.bar[i] = pci_read_config(bus, slot, func, 0x10 + i * 4);
-                    }
-                    
-                    return dev;
-                }
-            }
+    for (int n = 0; ; n++) {
+        const pci_device_t *found = pci_find_class(class_code, subclass, n);
+        if (!found) {
+            break;
+        }
+        if ((vendor_id == 0xFFFF || found->vendor_id == vendor_id) &&
+            (device_id == 0xFFFF || found->device_id == device_id)) {
+            return *found;
         }
     }
     
@@ -94,4 +336,261 @@ uint32_t pci_get_bar(pci_device_t dev, int bar_num) {
         // Memory Space BAR
         return bar & ~0xF;
     }
-}
\ No newline at end of file
+}
+
+// ===== Capabilities, MSI и MSI-X =====
+
+static uint16_t pci_read_config16(pci_device_t dev, uint8_t offset) {
+    uint32_t value = pci_read_config(dev.bus, dev.device, dev.function, offset);
+    return (uint16_t)(value >> ((offset & 2) * 8));
+}
+
+// Запись 16 бит через чтение-модификацию-запись двойного слова
+static void pci_write_config16(pci_device_t dev, uint8_t offset, uint16_t value) {
+    uint32_t old = pci_read_config(dev.bus, dev.device, dev.function, offset);
+    uint32_t shift = (offset & 2) * 8;
+    old = (old & ~(0xFFFFu << shift)) | ((uint32_t)value << shift);
+    pci_write_config(dev.bus, dev.device, dev.function, offset, old);
+}
+
+uint8_t pci_find_capability(pci_device_t dev, uint8_t cap_id) {
+    return pci_find_next_capability(dev, 0, cap_id);
+}
+
+uint8_t pci_find_next_capability(pci_device_t dev, uint8_t prev, uint8_t cap_id) {
+    uint8_t ptr;
+    
+    if (prev) {
+        ptr = (pci_read_config(dev.bus, dev.device, dev.function, prev) >> 8) & 0xFC;
+    } else {
+        uint32_t status = pci_read_config(dev.bus, dev.device, dev.function, 0x04);
+        if (!(status & PCI_STATUS_CAP_LIST)) {
+            return 0;
+        }
+        ptr = pci_read_config(dev.bus, dev.device, dev.function, PCI_CAP_PTR) & 0xFC;
+    }
+    
+    // Предел шагов защищает от зацикленного списка
+    for (int guard = 0; ptr >= 0x40 && guard < 48; guard++) {
+        uint32_t header = pci_read_config(dev.bus, dev.device, dev.function, ptr);
+        if ((header & 0xFF) == cap_id) {
+            return ptr;
+        }
+        ptr = (header >> 8) & 0xFC;
+    }
+    return 0;
+}
+
+uint16_t pci_find_ext_capability(pci_device_t dev, uint16_t cap_id) {
+    uint16_t ptr = 0x100;
+    
+    if (!pci_ecam_available()) {
+        return 0;
+    }
+    for (int guard = 0; ptr >= 0x100 && guard < 512; guard++) {
+        uint32_t header = pci_read_config_ext(dev.bus, dev.device, dev.function, ptr);
+        if (header == 0 || header == 0xFFFFFFFF) {
+            return 0;
+        }
+        if ((header & 0xFFFF) == cap_id) {
+            return ptr;
+        }
+        ptr = (header >> 20) & 0xFFC;
+    }
+    return 0;
+}
+
+void pci_disable_intx(pci_device_t dev) {
+    uint32_t cmd = pci_read_config(dev.bus, dev.device, dev.function, 0x04);
+    cmd |= PCI_COMMAND_INTX_DISABLE;
+    pci_write_config(dev.bus, dev.device, dev.function, 0x04, cmd & 0xFFFF);
+}
+
+int pci_enable_msi(pci_device_t dev, uint32_t address, uint32_t data) {
+    uint8_t cap = pci_find_capability(dev, PCI_CAP_ID_MSI);
+    if (!cap) {
+        return -1;
+    }
+    
+    uint16_t control = pci_read_config16(dev, cap + 2);
+    
+    // Одно сообщение: MME = 0
+    control &= ~(PCI_MSI_ENABLE | PCI_MSI_MME_MASK);
+    pci_write_config16(dev, cap + 2, control);
+    
+    pci_write_config(dev.bus, dev.device, dev.function, cap + 4, address);
+    if (control & PCI_MSI_64BIT) {
+        pci_write_config(dev.bus, dev.device, dev.function, cap + 8, 0);
+        pci_write_config16(dev, cap + 12, (uint16_t)data);
+        if (control & PCI_MSI_PVM) {
+            pci_write_config(dev.bus, dev.device, dev.function, cap + 16, 0);
+        }
+    } else {
+        pci_write_config16(dev, cap + 8, (uint16_t)data);
+        if (control & PCI_MSI_PVM) {
+            pci_write_config(dev.bus, dev.device, dev.function, cap + 12, 0);
+        }
+    }
+    
+    pci_disable_intx(dev);
+    pci_write_config16(dev, cap + 2, control | PCI_MSI_ENABLE);
+    return 0;
+}
+
+int pci_enable_msix(pci_device_t dev, uint16_t entry, uint32_t address, uint32_t data) {
+    uint8_t cap = pci_find_capability(dev, PCI_CAP_ID_MSIX);
+    if (!cap) {
+        return -1;
+    }
+    
+    uint16_t control = pci_read_config16(dev, cap + 2);
+    if (entry > (control & PCI_MSIX_TABLE_SIZE)) {
+        return -1;
+    }
+    
+    // Таблица векторов лежит в одном из BAR (номер — в младших битах)
+    uint32_t table = pci_read_config(dev.bus, dev.device, dev.function, cap + 4);
+    uint32_t base = pci_get_bar(dev, table & 7);
+    if (!base || (dev.bar[table & 7] & 1)) {
+        return -1;
+    }
+    
+    // Пока таблица заполняется, все векторы функции замаскированы
+    pci_enable_memory_space(dev);
+    pci_write_config16(dev, cap + 2, control | PCI_MSIX_ENABLE | PCI_MSIX_MASKALL);
+    
+    volatile uint32_t *slot = (volatile uint32_t*)(base + (table & ~7u) +
+                                                   entry * PCI_MSIX_ENTRY_SIZE);
+    slot[0] = address;
+    slot[1] = 0;
+    slot[2] = data;
+    slot[3] &= ~PCI_MSIX_ENTRY_MASKED;
+    
+    pci_disable_intx(dev);
+    pci_write_config16(dev, cap + 2, (control | PCI_MSIX_ENABLE) & ~PCI_MSIX_MASKALL);
+    return 0;
+}
+
+void pci_disable_msi(pci_device_t dev) {
+    uint8_t cap = pci_find_capability(dev, PCI_CAP_ID_MSIX);
+    if (cap) {
+        pci_write_config16(dev, cap + 2, pci_read_config16(dev, cap + 2) & ~PCI_MSIX_ENABLE);
+    }
+    cap = pci_find_capability(dev, PCI_CAP_ID_MSI);
+    if (cap) {
+        pci_write_config16(dev, cap + 2, pci_read_config16(dev, cap + 2) & ~PCI_MSI_ENABLE);
+    }
+}
+
+// ===== lspci =====
+
+static const struct {
+    uint8_t class_code;
+    uint8_t subclass;
+    const char *name;
+} pci_class_names[] = {
+    { 0x01, 0x01, "IDE controller" },
+    { 0x01, 0x06, "SATA controller" },
+    { 0x01, 0x08, "NVMe controller" },
+    { 0x01, 0x00, "SCSI controller" },
+    { 0x02, 0x00, "Ethernet controller" },
+    { 0x03, 0x00, "VGA controller" },
+    { 0x04, 0x01, "Audio device" },
+    { 0x04, 0x03, "HD Audio controller" },
+    { 0x06, 0x00, "Host bridge" },
+    { 0x06, 0x01, "ISA bridge" },
+    { 0x06, 0x04, "PCI bridge" },
+    { 0x0C, 0x03, "USB controller" },
+    { 0x0C, 0x05, "SMBus controller" },
+};
+
+static const char *pci_class_fallback[] = {
+    "Unclassified", "Mass storage", "Network", "Display", "Multimedia",
+    "Memory", "Bridge", "Communication", "System", "Input", "Docking",
+    "Processor", "Serial bus", "Wireless", "Intelligent I/O", "Satellite",
+    "Encryption", "Signal processing"
+};
+
+static const char *pci_class_name(const pci_device_t *dev) {
+    for (unsigned i = 0; i < sizeof(pci_class_names) / sizeof(pci_class_names[0]); i++) {
+        if (pci_class_names[i].class_code == dev->class_code &&
+            pci_class_names[i].subclass == dev->subclass) {
+            return pci_class_names[i].name;
+        }
+    }
+    if (dev->class_code < sizeof(pci_class_fallback) / sizeof(pci_class_fallback[0])) {
+        return pci_class_fallback[dev->class_code];
+    }
+    return "Unknown";
+}
+
+static void pci_print_hex(uint32_t value, int digits) {
+    static const char hex[] = "0123456789abcdef";
+    char buf[9];
+    
+    for (int i = digits - 1; i >= 0; i--) {
+        buf[i] = hex[value & 0xF];
+        value >>= 4;
+    }
+    buf[digits] = '\0';
+    video_print(buf);
+}
+
+void pci_print_devices(void) {
+    int count = pci_device_count();
+    char num[12];
+    
+    video_print("\nPCI devices (config access: ");
+    if (pci_ecam_available()) {
+        video_print("ECAM at 0x");
+        pci_print_hex(pci_ecam[0].base, 8);
+        video_print(", buses ");
+        pci_print_hex(pci_ecam[0].start_bus, 2);
+        video_print("-");
+        pci_print_hex(pci_ecam[0].end_bus, 2);
+    } else {
+        video_print("ports 0xCF8/0xCFC");
+    }
+    video_print("):\n");
+    for (int i = 0; i < count; i++) {
+        const pci_device_t *dev = &pci_devices[i];
+        
+        pci_print_hex(dev->bus, 2);
+        video_print(":");
+        pci_print_hex(dev->device, 2);
+        video_print(".");
+        pci_print_hex(dev->function, 1);
+        video_print(" ");
+        pci_print_hex(dev->vendor_id, 4);
+        video_print(":");
+        pci_print_hex(dev->device_id, 4);
+        video_print(" [");
+        pci_print_hex(dev->class_code, 2);
+        pci_print_hex(dev->subclass, 2);
+        pci_print_hex(dev->prog_if, 2);
+        video_print("] ");
+        video_print(pci_class_name(dev));
+        if (dev->irq_pin && dev->irq_line != 0xFF) {
+            video_print(", IRQ ");
+            itoa(dev->irq_line, num, 10);
+            video_print(num);
+        }
+        if (pci_find_capability(*dev, PCI_CAP_ID_MSIX)) {
+            video_print(", MSI-X");
+        } else if (pci_find_capability(*dev, PCI_CAP_ID_MSI)) {
+            video_print(", MSI");
+        }
+        video_print("\n");
+    }
+    
+    itoa(count, num, 10);
+    video_print(num);
+    video_print(" device(s)");
+    if (pci_dropped) {
+        video_print(", ");
+        itoa(pci_dropped, num, 10);
+        video_print(num);
+        video_print(" not listed (table full)");
+    }
+    video_print("\n");
+}
@@ -5,6 +5,8 @@
 
 #define PCI_CONFIG_ADDRESS 0xCF8
 #define PCI_CONFIG_DATA    0xCFC
+#define PCI_ECAM_MAX_WINDOWS 4
+#define PCI_EXT_CONFIG_SIZE  4096
 
 typedef struct {
     uint16_t vendor_id;
@@ -17,8 +19,44 @@ typedef struct {
     uint8_t bus;
     uint8_t device;
     uint8_t function;
+    uint8_t header_type;      // Без бита многофункциональности
+    uint8_t irq_line;         // Линия INTx, назначенная BIOS (0xFF — нет)
+    uint8_t irq_pin;          // 1-4 = INTA-INTD, 0 — не использует INTx
 } pci_device_t;
 
+// Таблица устройств заполняется один раз при pci_init()
+#define PCI_MAX_DEVICES      64
+#define PCI_MAX_BUSES        256
+
+#define PCI_HEADER_TYPE_MASK 0x7F
+#define PCI_HEADER_MULTIFUNC 0x80
+#define PCI_HEADER_BRIDGE    0x01
+#define PCI_CLASS_BRIDGE     0x06
+#define PCI_SUBCLASS_PCI_BRIDGE 0x04
+
+// Регистр команд
+#define PCI_COMMAND_INTX_DISABLE (1 << 10)
+
+// Список возможностей (capabilities)
+#define PCI_STATUS_CAP_LIST  (1 << 20)    // Бит в слове 0x04 (регистр состояния)
+#define PCI_CAP_PTR          0x34
+#define PCI_CAP_ID_MSI       0x05
+#define PCI_CAP_ID_MSIX      0x11
+#define PCI_CAP_ID_VENDOR    0x09
+
+// Управляющее слово MSI (смещение +2 от capability)
+#define PCI_MSI_ENABLE       (1 << 0)
+#define PCI_MSI_MME_MASK     (7 << 4)     // Выделенное число сообщений
+#define PCI_MSI_64BIT        (1 << 7)
+#define PCI_MSI_PVM          (1 << 8)     // Маскирование по векторам
+
+// Управляющее слово MSI-X
+#define PCI_MSIX_TABLE_SIZE  0x07FF
+#define PCI_MSIX_MASKALL     (1 << 14)
+#define PCI_MSIX_ENABLE      (1 << 15)
+#define PCI_MSIX_ENTRY_SIZE  16
+#define PCI_MSIX_ENTRY_MASKED 1
+
 // PCI Class Codes for AHCI
 #define PCI_CLASS_STORAGE    0x01
 #define PCI_SUBCLASS_SATA    0x06
@@ -26,9 +64,36 @@ typedef struct {
 
 uint32_t pci_read_config(uint8_t bus, uint8_t device, uint8_t func, uint8_t offset);
 void pci_write_config(uint8_t bus, uint8_t device, uint8_t func, uint8_t offset, uint32_t value);
+// Расширенное пространство (смещения 256-4095) доступно только через ECAM:
+// без него чтение возвращает 0xFFFFFFFF, запись — -1
+uint32_t pci_read_config_ext(uint8_t bus, uint8_t device, uint8_t func, uint16_t offset);
+int pci_write_config_ext(uint8_t bus, uint8_t device, uint8_t func, uint16_t offset, uint32_t value);
+int pci_ecam_available(void);
+// Перечисление всех шин (с мостами и многофункциональными устройствами)
+void pci_init(void);
+int pci_device_count(void);
+const pci_device_t *pci_get_device(int index);
+// index-е совпадение (с нуля); 0xFF/0xFFFF — любое значение. NULL, если нет.
+const pci_device_t *pci_find_class(uint8_t class_code, uint8_t subclass, int index);
+const pci_device_t *pci_find_vendor(uint16_t vendor_id, uint16_t device_id, int index);
+// Первое подходящее устройство; vendor_id == 0xFFFF в результате — не найдено
 pci_device_t pci_find_device(uint16_t vendor_id, uint16_t device_id, uint8_t class_code, uint8_t subclass);
+void pci_print_devices(void);
 void pci_enable_busmaster(pci_device_t dev);
 void pci_enable_memory_space(pci_device_t dev);
 uint32_t pci_get_bar(pci_device_t dev, int bar_num);
 
+// Поиск возможности в списке capabilities: смещение или 0, если ее нет
+uint8_t pci_find_capability(pci_device_t dev, uint8_t cap_id);
+// Следующая возможность с тем же ID после prev (несколько vendor-specific)
+uint8_t pci_find_next_capability(pci_device_t dev, uint8_t prev, uint8_t cap_id);
+// Расширенные capabilities PCIe (с 0x100), только через ECAM
+uint16_t pci_find_ext_capability(pci_device_t dev, uint16_t cap_id);
+void pci_disable_intx(pci_device_t dev);
+
+// Программирование сообщений (адрес/данные готовит msi.c). 0 — успех.
+int pci_enable_msi(pci_device_t dev, uint32_t address, uint32_t data);
+int pci_enable_msix(pci_device_t dev, uint16_t entry, uint32_t address, uint32_t data);
+void pci_disable_msi(pci_device_t dev);
+
 #endif
\ No newline at end of file
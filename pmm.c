@@ -6,6 +6,11 @@ static uint8_t memory_bitmap[PMM_MAX_BLOCKS / 8];
 static uint32_t total_blocks = 0;
 static uint32_t used_blocks = 0;
 static uint32_t total_memory_kb = 0;
+static pmm_shrinker_t shrinkers[PMM_MAX_SHRINKERS];
+static int shrinker_count = 0;
+
+// Конец образа ядра (linker.ld)
+extern uint8_t _kernel_end[];
 
 // Вспомогательные функции для работы с битовой картой
 static void set_bit(uint32_t bit) {
@@ -99,14 +104,35 @@ void pmm_init_with_memory_map(uint32_t total_memory_kb) {
     memset(memory_bitmap, 0, sizeof(memory_bitmap));
     used_blocks = 0;
     
-    // Помечаем первые 1MB как использованные (для kernel, BIOS и т.д.)
+    // Помечаем первые 1MB (BIOS и т.д.) и сам образ ядра как использованные
     uint32_t reserved_blocks = (1 * 1024 * 1024) / PMM_BLOCK_SIZE;
+    uint32_t kernel_blocks = ((uint32_t)_kernel_end + PMM_BLOCK_SIZE - 1) / PMM_BLOCK_SIZE;
+    if (kernel_blocks > reserved_blocks) {
+        reserved_blocks = kernel_blocks;
+    }
     for (uint32_t i = 0; i < reserved_blocks && i < total_blocks; i++) {
         set_bit(i);
     }
 }
 
-void* pmm_alloc_block(void) {
+int pmm_register_shrinker(pmm_shrinker_t shrinker) {
+    if (shrinker_count >= PMM_MAX_SHRINKERS) {
+        return -1;
+    }
+    shrinkers[shrinker_count++] = shrinker;
+    return 0;
+}
+
+// Просим кэши вернуть память; возвращает число освобожденных блоков
+static uint32_t pmm_shrink(uint32_t blocks_wanted) {
+    uint32_t freed = 0;
+    for (int i = 0; i < shrinker_count && freed < blocks_wanted; i++) {
+        freed += shrinkers[i](blocks_wanted - freed);
+    }
+    return freed;
+}
+
+static void* pmm_try_alloc_block(void) {
     for (uint32_t i = 0; i < total_blocks; i++) {
         if (!test_bit(i)) {
             set_bit(i);
@@ -116,7 +142,10 @@ void* pmm_alloc_block(void) {
     return 0;
 }
 
-void* pmm_alloc_blocks(uint32_t count) {
+static void* pmm_try_alloc_blocks(uint32_t count) {
+    if (count == 0 || count > total_blocks) {
+        return 0;
+    }
     for (uint32_t i = 0; i <= total_blocks - count; i++) {
         uint32_t j;
         for (j = 0; j < count; j++) {
@@ -132,6 +161,22 @@ void* pmm_alloc_blocks(uint32_t count) {
     return 0;
 }
 
+void* pmm_alloc_block(void) {
+    void* block = pmm_try_alloc_block();
+    if (!block && pmm_shrink(1) > 0) {
+        block = pmm_try_alloc_block();
+    }
+    return block;
+}
+
+void* pmm_alloc_blocks(uint32_t count) {
+    void* block = pmm_try_alloc_blocks(count);
+    if (!block && pmm_shrink(count) > 0) {
+        block = pmm_try_alloc_blocks(count);
+    }
+    return block;
+}
+
 void pmm_free_block(void* block) {
     uint32_t index = (uint32_t)block / PMM_BLOCK_SIZE;
     if (index < total_blocks) {
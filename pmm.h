@@ -32,6 +32,11 @@ uint32_t pmm_get_free_memory();
 memory_info_t pmm_get_memory_info();
 const char* pmm_get_memory_type();
 
+// Освобождение памяти под давлением: shrinker возвращает число освобожденных блоков
+#define PMM_MAX_SHRINKERS 4
+typedef uint32_t (*pmm_shrinker_t)(uint32_t blocks_wanted);
+int pmm_register_shrinker(pmm_shrinker_t shrinker);
+
 // Объявление функции обнаружения памяти через BIOS
 uint32_t detect_memory(void);  // Добавлено!
 
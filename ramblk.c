@@ -0,0 +1,244 @@
+#include "ramblk.h"
+#include "idle.h"
+#include "pmm.h"
+#include "string.h"
+#include "timer.h"
+#include "video.h"
+
+static ramblk_t devices[RAMBLK_MAX_DEVICES];
+static int device_count = 0;
+
+// ===== Страницы данных =====
+
+// Страница с сектором lba; при alloc — выделить (с нулями), если ее нет
+static uint8_t *ramblk_page(ramblk_t *rd, uint32_t lba, int alloc) {
+    uint32_t page = lba / RAMBLK_SECTORS_PER_PAGE;
+    uint8_t ***table = &rd->tables[page / RAMBLK_PAGES_PER_TABLE];
+    uint32_t slot = page % RAMBLK_PAGES_PER_TABLE;
+
+    if (!*table) {
+        if (!alloc) {
+            return NULL;
+        }
+        *table = (uint8_t**)pmm_alloc_block();
+        if (!*table) {
+            return NULL;
+        }
+        memset(*table, 0, 4096);
+        rd->tables_used++;
+    }
+
+    if (!(*table)[slot] && alloc) {
+        uint8_t *data = (uint8_t*)pmm_alloc_block();
+        if (!data) {
+            return NULL;
+        }
+        memset(data, 0, 4096);
+        (*table)[slot] = data;
+        rd->pages++;
+    }
+    return (*table)[slot];
+}
+
+static void ramblk_page_free(ramblk_t *rd, uint32_t page) {
+    uint8_t **table = rd->tables[page / RAMBLK_PAGES_PER_TABLE];
+    uint32_t slot = page % RAMBLK_PAGES_PER_TABLE;
+
+    if (table && table[slot]) {
+        pmm_free_block(table[slot]);
+        table[slot] = NULL;
+        rd->pages--;
+    }
+}
+
+// Освобождаем целиком покрытые страницы, остаток обнуляем:
+// чтение после discard всегда дает нули
+static void ramblk_discard(ramblk_t *rd, uint32_t lba, uint32_t count) {
+    while (count > 0) {
+        uint32_t offset = lba % RAMBLK_SECTORS_PER_PAGE;
+        uint32_t chunk = RAMBLK_SECTORS_PER_PAGE - offset;
+        if (chunk > count) {
+            chunk = count;
+        }
+
+        if (chunk == RAMBLK_SECTORS_PER_PAGE) {
+            ramblk_page_free(rd, lba / RAMBLK_SECTORS_PER_PAGE);
+        } else {
+            uint8_t *data = ramblk_page(rd, lba, 0);
+            if (data) {
+                memset(data + offset * BLK_SECTOR_SIZE, 0, chunk * BLK_SECTOR_SIZE);
+            }
+        }
+        lba += chunk;
+        count -= chunk;
+    }
+}
+
+// Копирование bio кусками в пределах страницы
+static int ramblk_transfer(ramblk_t *rd, blk_bio_t *bio, uint8_t op) {
+    uint8_t *buf = (uint8_t*)bio->buffer;
+    uint32_t lba = bio->lba;
+    uint32_t count = bio->count;
+
+    while (count > 0) {
+        uint32_t offset = lba % RAMBLK_SECTORS_PER_PAGE;
+        uint32_t chunk = RAMBLK_SECTORS_PER_PAGE - offset;
+        if (chunk > count) {
+            chunk = count;
+        }
+        uint32_t bytes = chunk * BLK_SECTOR_SIZE;
+
+        uint8_t *data = ramblk_page(rd, lba, op == BLK_OP_WRITE);
+        if (op == BLK_OP_WRITE) {
+            if (!data) {
+                return BLK_ERR_IO;           // PMM исчерпан
+            }
+            memcpy(data + offset * BLK_SECTOR_SIZE, buf, bytes);
+        } else if (data) {
+            memcpy(buf, data + offset * BLK_SECTOR_SIZE, bytes);
+        } else {
+            memset(buf, 0, bytes);
+        }
+
+        buf += bytes;
+        lba += chunk;
+        count -= chunk;
+    }
+    return BLK_OK;
+}
+
+// ===== Блочный уровень =====
+
+// Данные копируются сразу; с задержкой откладывается только завершение
+static int ramblk_submit(blkdev_t *dev, blk_request_t *rq) {
+    ramblk_t *rd = (ramblk_t*)dev->driver_data;
+    ramblk_pending_t *slot = NULL;
+
+    if (rd->latency_us) {
+        for (int i = 0; i < RAMBLK_QUEUE_DEPTH; i++) {
+            if (!rd->pending[i].rq) {
+                slot = &rd->pending[i];
+                break;
+            }
+        }
+        if (!slot) {
+            return 1;
+        }
+    }
+
+    int error = BLK_OK;
+    for (blk_bio_t *bio = rq->bio_head; bio && error == BLK_OK; bio = bio->next) {
+        if (rq->op == BLK_OP_DISCARD) {
+            ramblk_discard(rd, bio->lba, bio->count);
+        } else {
+            error = ramblk_transfer(rd, bio, rq->op);
+        }
+    }
+
+    if (!slot) {
+        blk_end_request(rq, error);
+        return 0;
+    }
+    slot->rq = rq;
+    slot->error = error;
+    slot->due_us = timer_get_us() + rd->latency_us;
+    return 0;
+}
+
+static void ramblk_poll_device(ramblk_t *rd) {
+    uint64_t now = timer_get_us();
+    int done = 0;
+
+    for (int i = 0; i < RAMBLK_QUEUE_DEPTH; i++) {
+        ramblk_pending_t *slot = &rd->pending[i];
+        if (slot->rq && now >= slot->due_us) {
+            blk_request_t *rq = slot->rq;
+            slot->rq = NULL;
+            blk_end_request(rq, slot->error);
+            done++;
+        }
+    }
+    if (done) {
+        blk_run_queue(rd->blk);
+    }
+}
+
+void ramblk_poll(void) {
+    for (int i = 0; i < device_count; i++) {
+        ramblk_poll_device(&devices[i]);
+    }
+}
+
+static void ramblk_blk_poll(blkdev_t *dev) {
+    ramblk_poll_device((ramblk_t*)dev->driver_data);
+}
+
+static const blkdev_ops_t ramblk_ops = {
+    ramblk_submit,
+    ramblk_blk_poll
+};
+
+blkdev_t *ramblk_create(uint32_t size_mb, uint32_t latency_us) {
+    char name[5] = "ram?";
+
+    if (size_mb == 0 || size_mb > RAMBLK_MAX_MB || device_count >= RAMBLK_MAX_DEVICES) {
+        return NULL;
+    }
+
+    ramblk_t *rd = &devices[device_count];
+    memset(rd, 0, sizeof(ramblk_t));
+    rd->latency_us = latency_us;
+
+    name[3] = '0' + device_count;
+    rd->blk = blkdev_register(name, size_mb * 2048, &ramblk_ops, rd);
+    if (!rd->blk) {
+        return NULL;
+    }
+    blkdev_set_hw_limits(rd->blk, RAMBLK_MAX_SECTORS, BLK_MAX_BIOS_PER_RQ);
+    blkdev_set_queue_depth(rd->blk, RAMBLK_QUEUE_DEPTH);
+    // Освобожденные ФС блоки возвращаются в PMM
+    blkdev_set_discard(rd->blk, size_mb * 2048, BLK_DISCARD_BATCH);
+
+    if (device_count++ == 0) {
+        idle_register_task("ramblk", ramblk_poll);
+    }
+    return rd->blk;
+}
+
+int ramblk_set_latency(blkdev_t *dev, uint32_t latency_us) {
+    for (int i = 0; i < device_count; i++) {
+        if (devices[i].blk == dev) {
+            devices[i].latency_us = latency_us;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void ramblk_print_devices(void) {
+    char buf[16];
+
+    if (device_count == 0) {
+        video_print("No RAM block devices\n");
+        return;
+    }
+
+    for (int i = 0; i < device_count; i++) {
+        ramblk_t *rd = &devices[i];
+
+        video_print(rd->blk->name);
+        itoa(rd->blk->total_sectors / 2048, buf, 10);
+        video_print(": ");
+        video_print(buf);
+        itoa(rd->pages * 4, buf, 10);
+        video_print(" MB  allocated=");
+        video_print(buf);
+        video_print(" KB  tables=");
+        itoa(rd->tables_used * 4, buf, 10);
+        video_print(buf);
+        itoa(rd->latency_us, buf, 10);
+        video_print(" KB  latency=");
+        video_print(buf);
+        video_print(" us\n");
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef RAMBLK_H
+#define RAMBLK_H
+
+#include <stdint.h>
+#include "blkdev.h"
+
+// Блочное устройство в памяти (ram0, ram1, ...): страницы PMM выделяются
+// при первой записи, чтение невыделенного дает нули. Задержка ответа
+// задается, чтобы отделить накладные расходы ФС от задержек диска.
+
+#define RAMBLK_MAX_DEVICES      4
+#define RAMBLK_SECTORS_PER_PAGE (4096 / BLK_SECTOR_SIZE)
+#define RAMBLK_PAGES_PER_TABLE  1024      // Таблица указателей — 4 MB данных
+#define RAMBLK_MAX_TABLES       256       // До 1 GB на устройство
+#define RAMBLK_MAX_MB           (RAMBLK_MAX_TABLES * 4)
+#define RAMBLK_QUEUE_DEPTH      32
+#define RAMBLK_MAX_SECTORS      2048      // 1 MB на запрос
+
+// Запрос, ожидающий истечения задержки
+typedef struct {
+    blk_request_t *rq;
+    uint64_t due_us;
+    int error;
+} ramblk_pending_t;
+
+typedef struct {
+    blkdev_t *blk;
+    uint32_t latency_us;
+    uint32_t pages;                          // Выделено страниц данных
+    uint32_t tables_used;                    // Выделено таблиц указателей
+    uint8_t **tables[RAMBLK_MAX_TABLES];     // Страницы данных по номеру
+    ramblk_pending_t pending[RAMBLK_QUEUE_DEPTH];
+} ramblk_t;
+
+// Новое устройство размером size_mb; NULL, если мест/памяти нет
+blkdev_t *ramblk_create(uint32_t size_mb, uint32_t latency_us);
+// Задержка ответа существующего устройства; -1, если это не RAM-диск
+int ramblk_set_latency(blkdev_t *dev, uint32_t latency_us);
+void ramblk_poll(void);
+void ramblk_print_devices(void);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+
+// Простая спин-блокировка на xchg. Защищает состояние, к которому
+// обращаются и основной код, и обработчики прерываний.
+typedef volatile uint32_t spinlock_t;
+
+#define SPINLOCK_INIT 0
+
+static inline int spin_trylock(spinlock_t *lock) {
+    return __sync_lock_test_and_set(lock, 1) == 0;
+}
+
+static inline void spin_lock(spinlock_t *lock) {
+    while (!spin_trylock(lock)) {
+        while (*lock) {
+            __asm__ volatile ("pause");
+        }
+    }
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+    __sync_lock_release(lock);
+}
+
+#endif
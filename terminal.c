@@ -21,6 +21,13 @@
 #include "shutdown_screen.h"
 #include "ahci.h"
 #include "license.h"  
+#include "blkdev.h"
+#include "bcache.h"
+#include "timer.h"
+#include "idle.h"
+#include "diskbench.h"
+#include "pci.h"
+#include "ramblk.h"
 void gui_command();
 void calculator_command();
 void update_prompt();
@@ -65,9 +72,10 @@ const char* commands[] = {
     "add", "rm", "save", "load", "meta",
     "cd", "logoff", "audio", "panic", "guess",
     "calc", "meminfo", "time", "ide",
-    "vixfs", "vixcreate", "vixdelete", "vixlist", "vixwrite", "vixread", "snake", //"ahci"
+    "vixfs", "vixformat", "vixcreate", "vixdelete", "vixlist", "vixwrite", "vixread", "vixmkdir", "vixappend", "vixcompress", "snake",
+    "blkstat", "iosched", "sync", "bcache", "iostat", "diskbench", "lspci", "ramblk", //"ahci"
 };
-const int num_commands = 33;
+const int num_commands = 43;
 
 // Добавляем вспомогательную функцию для форматирования вывода памяти
 void print_memory_info(const char* label, uint64_t bytes) {
@@ -209,7 +217,12 @@ void handle_command(const char* cmd_line) {
         video_print("echo, cat <file>, read <file>, add <file>\n");
         video_print("rm <file>, save, load, meta <file> logoff, audio, guess, meminfo, time, snake,\n");
         video_print("panic <message>, calc, ideinfo,\n");
-        video_print("vixfs, vixcreate <file>, vixdelete <file>, vixlist, vixwrite <file> <data>, vixread <file>\n");
+        video_print("vixfs [dev], vixformat <dev> (erases it), vixcreate <file>, vixdelete <file>, vixlist [dir], vixwrite <file> <data>, vixread <file>\n");
+        video_print("vixmkdir <dir>, vixappend <file> <data>, vixcompress <path> [off] (paths: dir/sub/file)\n");
+        video_print("blkstat, iosched <dev> <noop|deadline|clook> [max_kb], sync, bcache\n");
+        video_print("iostat [interval_sec | <dev>]\n");
+        video_print("diskbench <dev> [bs_kb] [qd] [size_mb] [read|seq|rand|write|all], lspci\n");
+        video_print("ramblk [size_mb] [latency_us], ramblk <dev> <latency_us>\n");
     } else if (strcmp(cmd, "add") == 0) {
         if (!arg1) {
             video_print("Usage: add <filename>\n");
@@ -268,8 +281,12 @@ void handle_command(const char* cmd_line) {
     } else if (strcmp(cmd, "off") == 0 || strcmp(cmd, "shutdown") == 0) {
     // Просто вызываем shutdown_screen, который сам вызовет shutdown()
     // и покажет соответствующее сообщение
+    vixfs_sync();
+    bcache_sync();
     shutdown_screen();
 }else if (strcmp(cmd, "reboot") == 0) {
+    vixfs_sync();
+    bcache_sync();
     video_clear();
     reboot_screen();
 
@@ -408,7 +425,16 @@ void handle_command(const char* cmd_line) {
     } else if (strcmp(cmd, "time") == 0) {
         time_command();
     }else if (strcmp(cmd, "vixfs") == 0) {
-    vixfs_init();
+    vixfs_init(arg1);
+} else if (strcmp(cmd, "vixformat") == 0) {
+    blkdev_t *dev = arg1 ? blkdev_find(arg1) : NULL;
+    if (!arg1) {
+        video_print("Usage: vixformat <dev>\n");
+    } else if (!dev) {
+        video_print("No such block device\n");
+    } else {
+        vixfs_format(dev);
+    }
 } else if (strcmp(cmd, "vixcreate") == 0) {
     if (!arg1) {
         video_print("Usage: vixcreate <filename>\n");
@@ -422,24 +448,56 @@ void handle_command(const char* cmd_line) {
         vixfs_delete(arg1);
     }
 } else if (strcmp(cmd, "vixlist") == 0) {
-    vixfs_list_files();
+    vixfs_list_files(arg1);
+} else if (strcmp(cmd, "vixmkdir") == 0) {
+    if (!arg1) {
+        video_print("Usage: vixmkdir <dir>\n");
+    } else {
+        vixfs_mkdir(arg1);
+    }
 } else if (strcmp(cmd, "vixwrite") == 0) {
     if (!arg1 || !arg2) {
         video_print("Usage: vixwrite <filename> <data>\n");
     } else {
         vixfs_write(arg1, arg2, strlen(arg2));
     }
+} else if (strcmp(cmd, "vixappend") == 0) {
+    if (!arg1 || !arg2) {
+        video_print("Usage: vixappend <filename> <data>\n");
+    } else {
+        int fd = vixfs_open(arg1, VIXFS_O_CREATE | VIXFS_O_APPEND);
+        if (fd >= 0) {
+            vixfs_fwrite(fd, arg2, strlen(arg2));
+            vixfs_close(fd);
+        }
+    }
+} else if (strcmp(cmd, "vixcompress") == 0) {
+    if (!arg1) {
+        video_print("Usage: vixcompress <file|dir> [off]\n");
+    } else {
+        int on = !(arg2 && strcmp(arg2, "off") == 0);
+        if (vixfs_set_compressed(arg1, on) == 0) {
+            video_print(on ? "Compression enabled: " : "Compression disabled: ");
+            video_print(arg1);
+            video_print("\n");
+        }
+    }
 } else if (strcmp(cmd, "vixread") == 0) {
     if (!arg1) {
         video_print("Usage: vixread <filename>\n");
     } else {
-        char buffer[1024];
-        int bytes_read = vixfs_read(arg1, buffer, sizeof(buffer));
-        if (bytes_read > 0) {
-            buffer[bytes_read] = '\0';
+        // Файл читается кусками, целиком он в память не нужен
+        int fd = vixfs_open(arg1, 0);
+        if (fd >= 0) {
+            char buffer[513];
+            int bytes_read;
             video_print("File content: ");
-            video_print(buffer);
+            while ((bytes_read = vixfs_fread(fd, buffer, sizeof(buffer) - 1)) > 0) {
+                buffer[bytes_read] = '\0';
+                video_print(buffer);
+            }
             video_print("\n");
+            vixfs_close(fd);
         }
     }
 } else if (strcmp(cmd, "snake") == 0) {
@@ -472,6 +530,161 @@ void handle_command(const char* cmd_line) {
        // video_print("\n");
    // }
 //} 
+else if (strcmp(cmd, "blkstat") == 0) {
+    blkdev_print_stats();
+} else if (strcmp(cmd, "iosched") == 0) {
+    blkdev_t *dev = arg1 ? blkdev_find(arg1) : NULL;
+    char *policy = arg2 ? strtok(arg2, " ") : NULL;
+    char *max_kb = policy ? strtok(NULL, " ") : NULL;
+
+    if (!arg1 || !policy) {
+        video_print("Usage: iosched <dev> <noop|deadline|clook> [max_kb]\n");
+    } else if (!dev) {
+        video_print("No such block device: ");
+        video_print(arg1);
+        video_print("\n");
+    } else if (blkdev_set_scheduler(dev, policy) != 0) {
+        video_print("Unknown scheduler: ");
+        video_print(policy);
+        video_print("\n");
+    } else {
+        if (max_kb) {
+            blkdev_set_max_sectors(dev, atoi(max_kb) * 2);
+        }
+        video_print(dev->name);
+        video_print(": scheduler set to ");
+        video_print(policy);
+        video_print("\n");
+    }
+}
+else if (strcmp(cmd, "sync") == 0) {
+    if (vixfs_sync() == 0 && bcache_sync() == 0) {
+        video_print("All dirty buffers written\n");
+    } else {
+        video_print("sync: I/O errors while writing buffers\n");
+    }
+} else if (strcmp(cmd, "bcache") == 0) {
+    bcache_print_stats();
+} else if (strcmp(cmd, "iostat") == 0) {
+    blkdev_t *dev = arg1 ? blkdev_find(arg1) : NULL;
+
+    if (dev) {
+        blkdev_print_latency(dev);
+    } else {
+        uint32_t interval = arg1 ? atoi(arg1) : 0;
+
+        // Первый отчет — с начала работы, дальше — за каждый интервал
+        blkdev_print_iostat(1);
+        if (interval) {
+            video_print("Press any key to stop\n");
+        }
+        while (interval) {
+            uint64_t until = timer_get_us() + (uint64_t)interval * 1000000;
+            int stop = 0;
+            while (timer_get_us() < until && !stop) {
+                stop = keyboard_getchar_noblock() != 0;
+                idle_run();
+            }
+            if (stop) {
+                break;
+            }
+            blkdev_print_iostat(0);
+        }
+    }
+} else if (strcmp(cmd, "diskbench") == 0) {
+    blkdev_t *dev = arg1 ? blkdev_find(arg1) : NULL;
+    char *bs_kb = arg2 ? strtok(arg2, " ") : NULL;
+    char *qd = bs_kb ? strtok(NULL, " ") : NULL;
+    char *size_mb = qd ? strtok(NULL, " ") : NULL;
+    char *mode = size_mb ? strtok(NULL, " ") : NULL;
+
+    if (!arg1) {
+        video_print("Usage: diskbench <dev> [bs_kb] [qd] [size_mb] [read|seq|rand|write|all]\n");
+    } else if (!dev) {
+        video_print("No such block device: ");
+        video_print(arg1);
+        video_print("\n");
+    } else {
+        diskbench_params_t params;
+        uint32_t range = (size_mb ? atoi(size_mb) : 16) * 2048;
+
+        params.block_sectors = (bs_kb ? atoi(bs_kb) : 64) * 2;
+        params.queue_depth = qd ? atoi(qd) : 1;
+        // Запись — только по явному write или all
+        params.tests = DISKBENCH_READS;
+        if (mode && strcmp(mode, "write") == 0) {
+            params.tests = DISKBENCH_WRITES;
+        } else if (mode && strcmp(mode, "all") == 0) {
+            params.tests = DISKBENCH_ALL;
+        } else if (mode && strcmp(mode, "seq") == 0) {
+            params.tests = DISKBENCH_SEQ_READ;
+        } else if (mode && strcmp(mode, "rand") == 0) {
+            params.tests = DISKBENCH_RAND_READ;
+        }
+
+        // Рабочая область — конец диска
+        if (range == 0 || range > dev->total_sectors) {
+            range = dev->total_sectors;
+        }
+        params.range_sectors = range;
+        params.start_lba = dev->total_sectors - range;
+
+        // ViXFS занимает весь диск, а запись мимо кэша испортила бы ее
+        // метаданные; диск целиком не затирается никогда
+        uint32_t writes = params.tests & DISKBENCH_WRITES;
+        if (writes && dev == vixfs_device()) {
+            video_print("Refusing write tests: device holds the mounted ViXFS\n");
+        } else if (writes && range >= dev->total_sectors) {
+            video_print("Refusing write tests over the whole device, give a smaller size_mb\n");
+        } else {
+            if (writes) {
+                video_set_color(0x0E, 0x00); // Желтый
+                video_print("Warning: write tests overwrite the last ");
+                char buf[16];
+                itoa(range / 2048, buf, 10);
+                video_print(buf);
+                video_print(" MB of the device\n");
+                video_set_color(0x07, 0x00); // Белый
+            }
+            diskbench_run(dev, &params);
+        }
+    }
+}
+else if (strcmp(cmd, "lspci") == 0) {
+    pci_print_devices();
+}
+else if (strcmp(cmd, "ramblk") == 0) {
+    char *latency = arg2 ? strtok(arg2, " ") : NULL;
+
+    blkdev_t *existing = arg1 ? blkdev_find(arg1) : NULL;
+
+    if (!arg1) {
+        ramblk_print_devices();
+    } else if (existing) {
+        if (!latency) {
+            video_print("Usage: ramblk <dev> <latency_us>\n");
+        } else if (ramblk_set_latency(existing, atoi(latency)) != 0) {
+            video_print("Not a RAM block device\n");
+        } else {
+            video_print("Latency set\n");
+        }
+    } else {
+        uint32_t size_mb = atoi(arg1);
+        blkdev_t *dev = ramblk_create(size_mb, latency ? atoi(latency) : 0);
+
+        if (!dev) {
+            video_print("Cannot create RAM block device (1..");
+            char buf[16];
+            itoa(RAMBLK_MAX_MB, buf, 10);
+            video_print(buf);
+            video_print(" MB, up to 4 devices)\n");
+        } else {
+            video_print("Created ");
+            video_print(dev->name);
+            video_print("\n");
+        }
+    }
+}
 // Добавьте этот блок в функцию handle_command(), например после "snake":
 else if (strcmp(cmd, "gpl") == 0 || strcmp(cmd, "license") == 0) {
     show_gpl_license();
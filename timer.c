@@ -3,8 +3,14 @@
 #include "port_io.h"
 #include "video.h"
 
+#define PIT_BASE_FREQUENCY 1193182
+#define PIT_CAL_MS         10       // Длительность калибровки TSC
+
 volatile unsigned int tick = 0;
 
+// Частота TSC в кГц (0 — не откалиброван)
+static uint32_t tsc_khz = 0;
+
 static void timer_callback() {
     tick++;
     if (tick % 100 == 0) {
@@ -12,6 +18,39 @@ static void timer_callback() {
     }
 }
 
+uint64_t timer_read_tsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Калибровка TSC по каналу 2 PIT (режим 0, без прерываний)
+static void timer_calibrate_tsc(void) {
+    uint16_t count = (PIT_BASE_FREQUENCY / 1000) * PIT_CAL_MS;
+
+    // Включаем gate канала 2, выключаем динамик
+    uint8_t ctrl = inb(0x61);
+    outb((ctrl & ~0x02) | 0x01, 0x61);
+
+    outb(0xB0, 0x43);                  // Канал 2, lo/hi, режим 0
+    outb(count & 0xFF, 0x42);
+    outb((count >> 8) & 0xFF, 0x42);
+
+    uint64_t start = timer_read_tsc();
+    uint32_t guard = 0;
+    while (!(inb(0x61) & 0x20)) {      // OUT2 поднимается по окончании счета
+        if (++guard > 100000000) {
+            break;
+        }
+    }
+    uint64_t end = timer_read_tsc();
+
+    outb(ctrl, 0x61);
+
+    uint64_t khz = (end - start) / PIT_CAL_MS;
+    tsc_khz = (khz > 0 && khz < 0xFFFFFFFFULL) ? (uint32_t)khz : 0;
+}
+
 void timer_install() {
     irq_set_handler(0, timer_callback);
 
@@ -21,9 +60,41 @@ void timer_install() {
     outb(0x43, 0x36);
     outb(0x40, divisor & 0xFF);
     outb(0x40, (divisor >> 8) & 0xFF);
+
+    timer_calibrate_tsc();
 }
 void timer_wait(int ticks) {
     for (int i = 0; i < ticks * 100000; i++) {
         asm volatile ("nop");
     }
 }
+
+uint64_t timer_get_ticks(void) {
+    return tick;
+}
+
+uint32_t timer_get_tsc_khz(void) {
+    return tsc_khz;
+}
+
+uint64_t timer_tsc_to_us(uint64_t tsc_delta) {
+    if (tsc_khz == 0) {
+        return 0;
+    }
+    return (tsc_delta * 1000) / tsc_khz;
+}
+
+uint64_t timer_get_us(void) {
+    return timer_tsc_to_us(timer_read_tsc());
+}
+
+void timer_delay_ms(uint32_t ms) {
+    if (tsc_khz == 0) {
+        timer_wait(ms);
+        return;
+    }
+    uint64_t end = timer_read_tsc() + (uint64_t)tsc_khz * ms;
+    while (timer_read_tsc() < end) {
+        asm volatile ("pause");
+    }
+}
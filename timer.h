@@ -11,4 +11,11 @@ void timer_wait(int ticks);
 uint64_t timer_get_ticks(void);
 void timer_delay_ms(uint32_t ms);
 
+// Монотонные часы высокого разрешения на основе TSC
+// (откалиброваны по каналу 2 PIT при timer_install)
+uint64_t timer_read_tsc(void);
+uint32_t timer_get_tsc_khz(void);
+uint64_t timer_get_us(void);
+uint64_t timer_tsc_to_us(uint64_t tsc_delta);
+
 #endif
@@ -0,0 +1,387 @@
+#include "virtio.h"
+#include "pmm.h"
+#include "port_io.h"
+#include "string.h"
+
+// ===== Обнаружение и регистры =====
+
+uint16_t virtio_pci_device_type(const pci_device_t *pci) {
+    if (pci->vendor_id != VIRTIO_PCI_VENDOR) {
+        return 0;
+    }
+    if (pci->device_id >= VIRTIO_PCI_MODERN_BASE) {
+        return pci->device_id - VIRTIO_PCI_MODERN_BASE;
+    }
+    if (pci->device_id <= VIRTIO_PCI_LEGACY_LAST) {
+        // Переходные устройства: тип в Subsystem ID
+        return pci_read_config(pci->bus, pci->device, pci->function, 0x2C) >> 16;
+    }
+    return 0;
+}
+
+// Адрес memory BAR или 0, если он недоступен (I/O или выше 4 GB)
+static uint32_t virtio_bar_address(const pci_device_t *pci, uint8_t bar) {
+    uint32_t value = pci->bar[bar];
+
+    if (value & 1) {
+        return 0;
+    }
+    if ((value & 0x6) == 0x4 && (bar == 5 || pci->bar[bar + 1] != 0)) {
+        return 0;
+    }
+    return pci_get_bar(*pci, bar);
+}
+
+// Разбор vendor-specific capabilities: берем первую подходящую каждого типа
+static void virtio_find_modern(virtio_dev_t *dev) {
+    const pci_device_t *pci = &dev->pci;
+
+    for (uint8_t cap = pci_find_next_capability(*pci, 0, PCI_CAP_ID_VENDOR); cap;
+         cap = pci_find_next_capability(*pci, cap, PCI_CAP_ID_VENDOR)) {
+        uint32_t header = pci_read_config(pci->bus, pci->device, pci->function, cap);
+        uint8_t type = header >> 24;
+        uint8_t bar = pci_read_config(pci->bus, pci->device, pci->function, cap + 4) & 0xFF;
+        uint32_t offset = pci_read_config(pci->bus, pci->device, pci->function, cap + 8);
+
+        if (bar > 5) {
+            continue;
+        }
+        uint32_t base = virtio_bar_address(pci, bar);
+        if (!base) {
+            continue;
+        }
+        uint8_t *addr = (uint8_t*)(uintptr_t)(base + offset);
+
+        if (type == VIRTIO_PCI_CAP_COMMON && !dev->common) {
+            dev->common = (virtio_pci_common_cfg_t*)addr;
+        } else if (type == VIRTIO_PCI_CAP_NOTIFY && !dev->notify_base) {
+            dev->notify_base = addr;
+            dev->notify_mult = pci_read_config(pci->bus, pci->device, pci->function, cap + 16);
+        } else if (type == VIRTIO_PCI_CAP_ISR && !dev->isr) {
+            dev->isr = addr;
+        } else if (type == VIRTIO_PCI_CAP_DEVICE && !dev->device_cfg) {
+            dev->device_cfg = addr;
+        }
+    }
+
+    dev->modern = dev->common && dev->notify_base && dev->isr && dev->device_cfg;
+}
+
+static uint8_t virtio_get_status(virtio_dev_t *dev) {
+    if (dev->modern) {
+        return dev->common->device_status;
+    }
+    return inb(dev->io_base + VIRTIO_LEGACY_STATUS);
+}
+
+static void virtio_set_status(virtio_dev_t *dev, uint8_t status) {
+    if (dev->modern) {
+        dev->common->device_status = status;
+    } else {
+        outb(status, dev->io_base + VIRTIO_LEGACY_STATUS);
+    }
+}
+
+int virtio_pci_init(virtio_dev_t *dev, const pci_device_t *pci) {
+    memset(dev, 0, sizeof(virtio_dev_t));
+    dev->pci = *pci;
+
+    // Переходное устройство умеет оба интерфейса — предпочитаем modern
+    virtio_find_modern(dev);
+    if (!dev->modern) {
+        if (pci->device_id > VIRTIO_PCI_LEGACY_LAST || !(pci->bar[0] & 1)) {
+            return -1;
+        }
+        dev->io_base = (uint16_t)pci_get_bar(*pci, 0);
+        // Legacy-регистры в I/O-пространстве
+        uint32_t command = pci_read_config(pci->bus, pci->device, pci->function, 0x04);
+        pci_write_config(pci->bus, pci->device, pci->function, 0x04, (command & 0xFFFF) | 0x01);
+    } else {
+        pci_enable_memory_space(*pci);
+    }
+    pci_enable_busmaster(*pci);
+
+    // Сброс: modern-устройство подтверждает его, возвращая 0
+    virtio_set_status(dev, 0);
+    for (int spins = 0; virtio_get_status(dev) != 0 && spins < 1000000; spins++) {
+        __asm__ volatile ("pause");
+    }
+
+    virtio_set_status(dev, VIRTIO_STATUS_ACKNOWLEDGE);
+    virtio_set_status(dev, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    return 0;
+}
+
+int virtio_negotiate(virtio_dev_t *dev, uint64_t wanted) {
+    uint64_t offered;
+
+    if (dev->modern) {
+        dev->common->device_feature_select = 0;
+        offered = dev->common->device_feature;
+        dev->common->device_feature_select = 1;
+        offered |= (uint64_t)dev->common->device_feature << 32;
+
+        // Без VERSION_1 modern-интерфейс не работает
+        wanted |= 1ull << VIRTIO_F_VERSION_1;
+        if (!(offered & (1ull << VIRTIO_F_VERSION_1))) {
+            virtio_fail(dev);
+            return -1;
+        }
+    } else {
+        offered = inl(dev->io_base + VIRTIO_LEGACY_HOST_FEATURES);
+    }
+
+    dev->features = offered & wanted;
+
+    if (!dev->modern) {
+        outl((uint32_t)dev->features, dev->io_base + VIRTIO_LEGACY_GUEST_FEATURES);
+        return 0;
+    }
+
+    dev->common->driver_feature_select = 0;
+    dev->common->driver_feature = (uint32_t)dev->features;
+    dev->common->driver_feature_select = 1;
+    dev->common->driver_feature = (uint32_t)(dev->features >> 32);
+
+    uint8_t status = virtio_get_status(dev) | VIRTIO_STATUS_FEATURES_OK;
+    virtio_set_status(dev, status);
+    if (!(virtio_get_status(dev) & VIRTIO_STATUS_FEATURES_OK)) {
+        virtio_fail(dev);
+        return -1;
+    }
+    return 0;
+}
+
+void virtio_set_config_vector(virtio_dev_t *dev, uint16_t msix_vector) {
+    if (dev->modern) {
+        dev->common->msix_config = msix_vector;
+    } else if (dev->msix) {
+        outw(msix_vector, dev->io_base + VIRTIO_LEGACY_CONFIG_VECTOR);
+    }
+}
+
+void virtio_driver_ok(virtio_dev_t *dev) {
+    virtio_set_status(dev, virtio_get_status(dev) | VIRTIO_STATUS_DRIVER_OK);
+}
+
+void virtio_fail(virtio_dev_t *dev) {
+    virtio_set_status(dev, virtio_get_status(dev) | VIRTIO_STATUS_FAILED);
+}
+
+uint8_t virtio_read_isr(virtio_dev_t *dev) {
+    if (dev->modern) {
+        return *dev->isr;
+    }
+    return inb(dev->io_base + VIRTIO_LEGACY_ISR);
+}
+
+// ===== Конфигурация устройства =====
+
+static uint16_t legacy_config_base(virtio_dev_t *dev) {
+    return dev->io_base + (dev->msix ? VIRTIO_LEGACY_CONFIG_MSIX : VIRTIO_LEGACY_CONFIG);
+}
+
+uint8_t virtio_config_read8(virtio_dev_t *dev, uint32_t offset) {
+    if (dev->modern) {
+        return dev->device_cfg[offset];
+    }
+    return inb(legacy_config_base(dev) + offset);
+}
+
+uint16_t virtio_config_read16(virtio_dev_t *dev, uint32_t offset) {
+    if (dev->modern) {
+        return *(volatile uint16_t*)(dev->device_cfg + offset);
+    }
+    return inw(legacy_config_base(dev) + offset);
+}
+
+uint32_t virtio_config_read32(virtio_dev_t *dev, uint32_t offset) {
+    if (dev->modern) {
+        return *(volatile uint32_t*)(dev->device_cfg + offset);
+    }
+    return inl(legacy_config_base(dev) + offset);
+}
+
+// 64-битное поле читается двумя половинами: modern-устройство сообщает
+// об изменении конфигурации между ними через config_generation
+uint64_t virtio_config_read64(virtio_dev_t *dev, uint32_t offset) {
+    uint64_t value;
+    uint8_t generation;
+
+    do {
+        generation = dev->modern ? dev->common->config_generation : 0;
+        value = virtio_config_read32(dev, offset) |
+                ((uint64_t)virtio_config_read32(dev, offset + 4) << 32);
+    } while (dev->modern && generation != dev->common->config_generation);
+
+    return value;
+}
+
+// ===== Virtqueue =====
+
+// Раскладка split-очереди (как у legacy, годится и для modern):
+// дескрипторы и avail подряд, used с границы страницы
+int virtio_setup_queue(virtio_dev_t *dev, uint16_t index, virtq_t *vq,
+                       uint16_t max_size, uint16_t msix_vector) {
+    uint16_t size;
+
+    memset(vq, 0, sizeof(virtq_t));
+
+    if (dev->modern) {
+        dev->common->queue_select = index;
+        size = dev->common->queue_size;
+        // Размер modern-очереди можно уменьшить (обе величины — степени двойки)
+        if (size > max_size) {
+            size = max_size;
+        }
+    } else {
+        outw(index, dev->io_base + VIRTIO_LEGACY_QUEUE_SELECT);
+        size = inw(dev->io_base + VIRTIO_LEGACY_QUEUE_SIZE);
+        // Legacy-устройство не дает изменить размер очереди
+        if (size > max_size) {
+            return -1;
+        }
+    }
+    if (size == 0) {
+        return -1;
+    }
+
+    uint32_t desc_bytes = size * sizeof(virtq_desc_t);
+    uint32_t avail_bytes = 6 + 2 * size;
+    uint32_t used_offset = (desc_bytes + avail_bytes + VIRTIO_LEGACY_ALIGN - 1) &
+                           ~(VIRTIO_LEGACY_ALIGN - 1);
+    uint32_t used_bytes = 6 + sizeof(virtq_used_elem_t) * size;
+    uint32_t pages = (used_offset + used_bytes + 4095) / 4096;
+
+    uint8_t *mem = (uint8_t*)pmm_alloc_blocks(pages);
+    if (!mem) {
+        return -1;
+    }
+    memset(mem, 0, pages * 4096);
+
+    vq->index = index;
+    vq->size = size;
+    vq->ring_mem = mem;
+    vq->ring_pages = pages;
+    vq->desc = (virtq_desc_t*)mem;
+    vq->avail = (volatile virtq_avail_t*)(mem + desc_bytes);
+    vq->used = (volatile virtq_used_t*)(mem + used_offset);
+    vq->event_idx = virtio_has_feature(dev, VIRTIO_F_EVENT_IDX);
+
+    for (uint16_t i = 0; i < size; i++) {
+        vq->desc[i].next = (i + 1 < size) ? i + 1 : VIRTQ_NO_DESC;
+    }
+    vq->free_head = 0;
+    vq->num_free = size;
+
+    uint32_t phys = (uint32_t)(uintptr_t)mem;
+
+    if (dev->modern) {
+        virtio_pci_common_cfg_t *common = dev->common;
+        common->queue_size = size;
+        common->queue_msix_vector = dev->msix ? msix_vector : VIRTIO_MSI_NO_VECTOR;
+        common->queue_desc_lo = phys;
+        common->queue_desc_hi = 0;
+        common->queue_avail_lo = phys + desc_bytes;
+        common->queue_avail_hi = 0;
+        common->queue_used_lo = phys + used_offset;
+        common->queue_used_hi = 0;
+        vq->notify_addr = (volatile uint16_t*)(dev->notify_base +
+                                               common->queue_notify_off * dev->notify_mult);
+        common->queue_enable = 1;
+    } else {
+        if (dev->msix) {
+            outw(msix_vector, dev->io_base + VIRTIO_LEGACY_QUEUE_VECTOR);
+        }
+        outl(phys / VIRTIO_LEGACY_ALIGN, dev->io_base + VIRTIO_LEGACY_QUEUE_PFN);
+        vq->notify_port = dev->io_base + VIRTIO_LEGACY_QUEUE_NOTIFY;
+    }
+    return 0;
+}
+
+int virtq_alloc_desc(virtq_t *vq) {
+    if (vq->num_free == 0) {
+        return -1;
+    }
+    uint16_t i = vq->free_head;
+    vq->free_head = vq->desc[i].next;
+    vq->num_free--;
+    return i;
+}
+
+void virtq_free_chain(virtq_t *vq, uint16_t head) {
+    uint16_t i = head;
+
+    while (1) {
+        uint16_t flags = vq->desc[i].flags;
+        uint16_t next = vq->desc[i].next;
+
+        vq->desc[i].flags = 0;
+        vq->desc[i].next = vq->free_head;
+        vq->free_head = i;
+        vq->num_free++;
+
+        if (!(flags & VIRTQ_DESC_F_NEXT)) {
+            break;
+        }
+        i = next;
+    }
+}
+
+void virtq_push(virtq_t *vq, uint16_t head) {
+    uint16_t idx = vq->avail->idx;
+
+    vq->avail->ring[idx % vq->size] = head;
+    // Дескрипторы и элемент кольца должны стать видны раньше нового idx
+    __asm__ volatile ("" ::: "memory");
+    vq->avail->idx = idx + 1;
+}
+
+void virtq_kick(virtio_dev_t *dev, virtq_t *vq) {
+    // Новый avail->idx виден устройству до того, как мы прочитаем его флаги
+    __sync_synchronize();
+
+    uint16_t new_idx = vq->avail->idx;
+    uint16_t old_idx = vq->kicked_avail;
+
+    if (new_idx == old_idx) {
+        return;
+    }
+    vq->kicked_avail = new_idx;
+
+    if (vq->event_idx) {
+        // Устройство просит уведомить, только когда idx перешагнет avail_event
+        uint16_t event = *(volatile uint16_t*)&vq->used->ring[vq->size];
+        if ((uint16_t)(new_idx - event - 1) >= (uint16_t)(new_idx - old_idx)) {
+            return;
+        }
+    } else if (vq->used->flags & VIRTQ_USED_F_NO_NOTIFY) {
+        return;
+    }
+
+    if (dev->modern) {
+        *vq->notify_addr = vq->index;
+    } else {
+        outw(vq->index, vq->notify_port);
+    }
+}
+
+int virtq_pop_used(virtq_t *vq, uint32_t *len) {
+    if (vq->last_used == vq->used->idx) {
+        return -1;
+    }
+    __asm__ volatile ("" ::: "memory");
+
+    volatile virtq_used_elem_t *elem = &vq->used->ring[vq->last_used % vq->size];
+    int id = (int)elem->id;
+    if (len) {
+        *len = elem->len;
+    }
+    vq->last_used++;
+
+    if (vq->event_idx) {
+        // Прерывание — не раньше следующего завершения
+        *(volatile uint16_t*)&vq->avail->ring[vq->size] = vq->last_used;
+    }
+    return id;
+}
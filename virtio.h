@@ -0,0 +1,174 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include <stdint.h>
+#include "pci.h"
+
+// Транспорт virtio-pci (legacy 0.9.5 и modern 1.0) и split virtqueue
+
+#define VIRTIO_PCI_VENDOR          0x1AF4
+#define VIRTIO_PCI_LEGACY_FIRST    0x1000
+#define VIRTIO_PCI_LEGACY_LAST     0x103F
+#define VIRTIO_PCI_MODERN_BASE     0x1040   // + ID типа устройства
+#define VIRTIO_ID_BLOCK            2
+
+// Регистр состояния устройства
+#define VIRTIO_STATUS_ACKNOWLEDGE  0x01
+#define VIRTIO_STATUS_DRIVER       0x02
+#define VIRTIO_STATUS_DRIVER_OK    0x04
+#define VIRTIO_STATUS_FEATURES_OK  0x08
+#define VIRTIO_STATUS_FAILED       0x80
+
+// Общие биты возможностей (номера битов)
+#define VIRTIO_F_INDIRECT_DESC     28
+#define VIRTIO_F_EVENT_IDX         29
+#define VIRTIO_F_VERSION_1         32
+
+// Регистры legacy-устройства в I/O BAR0
+#define VIRTIO_LEGACY_HOST_FEATURES   0x00
+#define VIRTIO_LEGACY_GUEST_FEATURES  0x04
+#define VIRTIO_LEGACY_QUEUE_PFN       0x08
+#define VIRTIO_LEGACY_QUEUE_SIZE      0x0C
+#define VIRTIO_LEGACY_QUEUE_SELECT    0x0E
+#define VIRTIO_LEGACY_QUEUE_NOTIFY    0x10
+#define VIRTIO_LEGACY_STATUS          0x12
+#define VIRTIO_LEGACY_ISR             0x13
+#define VIRTIO_LEGACY_CONFIG_VECTOR   0x14   // Есть только при включенном MSI-X
+#define VIRTIO_LEGACY_QUEUE_VECTOR    0x16
+#define VIRTIO_LEGACY_CONFIG          0x14   // Конфигурация устройства без MSI-X
+#define VIRTIO_LEGACY_CONFIG_MSIX     0x18   // ...и с MSI-X
+#define VIRTIO_LEGACY_ALIGN           4096   // Выравнивание used-кольца
+
+// Vendor-specific capabilities modern-устройства
+#define VIRTIO_PCI_CAP_COMMON      1
+#define VIRTIO_PCI_CAP_NOTIFY      2
+#define VIRTIO_PCI_CAP_ISR         3
+#define VIRTIO_PCI_CAP_DEVICE      4
+
+#define VIRTIO_MSI_NO_VECTOR       0xFFFF
+
+// Common configuration (modern), BAR + смещение из capability
+typedef volatile struct {
+    uint32_t device_feature_select;
+    uint32_t device_feature;
+    uint32_t driver_feature_select;
+    uint32_t driver_feature;
+    uint16_t msix_config;
+    uint16_t num_queues;
+    uint8_t device_status;
+    uint8_t config_generation;
+    uint16_t queue_select;
+    uint16_t queue_size;
+    uint16_t queue_msix_vector;
+    uint16_t queue_enable;
+    uint16_t queue_notify_off;
+    uint32_t queue_desc_lo;
+    uint32_t queue_desc_hi;
+    uint32_t queue_avail_lo;
+    uint32_t queue_avail_hi;
+    uint32_t queue_used_lo;
+    uint32_t queue_used_hi;
+} virtio_pci_common_cfg_t;
+
+// ===== Split virtqueue =====
+
+#define VIRTQ_DESC_F_NEXT          1
+#define VIRTQ_DESC_F_WRITE         2      // Буфер пишет устройство
+#define VIRTQ_DESC_F_INDIRECT      4
+#define VIRTQ_USED_F_NO_NOTIFY     1
+#define VIRTQ_MAX_SIZE             256
+#define VIRTQ_NO_DESC              0xFFFF
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} virtq_desc_t;
+
+// За ring[size] следует used_event (при VIRTIO_F_EVENT_IDX)
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} virtq_avail_t;
+
+typedef struct {
+    uint32_t id;                  // Голова цепочки дескрипторов
+    uint32_t len;                 // Сколько байт записало устройство
+} virtq_used_elem_t;
+
+// За ring[size] следует avail_event (при VIRTIO_F_EVENT_IDX)
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    virtq_used_elem_t ring[];
+} virtq_used_t;
+
+typedef struct {
+    uint16_t index;
+    uint16_t size;
+    virtq_desc_t *desc;
+    volatile virtq_avail_t *avail;
+    volatile virtq_used_t *used;
+    uint16_t free_head;           // Список свободных дескрипторов через next
+    uint16_t num_free;
+    uint16_t last_used;           // Следующий непрочитанный элемент used
+    uint16_t kicked_avail;        // avail->idx на момент последнего уведомления
+    uint8_t event_idx;
+    uint8_t *ring_mem;
+    uint32_t ring_pages;
+    volatile uint16_t *notify_addr;   // modern
+    uint16_t notify_port;             // legacy
+} virtq_t;
+
+// Устройство на шине PCI
+typedef struct {
+    pci_device_t pci;
+    uint8_t modern;
+    uint16_t io_base;                       // legacy
+    virtio_pci_common_cfg_t *common;        // modern
+    volatile uint8_t *notify_base;
+    uint32_t notify_mult;
+    volatile uint8_t *isr;
+    volatile uint8_t *device_cfg;
+    uint8_t msix;                           // Векторы MSI-X назначены
+    uint64_t features;                      // Согласованные возможности
+} virtio_dev_t;
+
+// Тип устройства по PCI ID (VIRTIO_ID_*) или 0, если это не virtio
+uint16_t virtio_pci_device_type(const pci_device_t *pci);
+// Найти регистры, сбросить устройство, выставить ACKNOWLEDGE|DRIVER. 0 — успех.
+int virtio_pci_init(virtio_dev_t *dev, const pci_device_t *pci);
+// Согласовать возможности: wanted & предложенные. -1, если устройство отказалось.
+int virtio_negotiate(virtio_dev_t *dev, uint64_t wanted);
+static inline int virtio_has_feature(const virtio_dev_t *dev, int bit) {
+    return (dev->features >> bit) & 1;
+}
+// Очередь index размером не больше max_size; msix_vector — запись таблицы MSI-X
+int virtio_setup_queue(virtio_dev_t *dev, uint16_t index, virtq_t *vq,
+                       uint16_t max_size, uint16_t msix_vector);
+// После включения MSI-X: вектор изменений конфигурации
+void virtio_set_config_vector(virtio_dev_t *dev, uint16_t msix_vector);
+void virtio_driver_ok(virtio_dev_t *dev);
+void virtio_fail(virtio_dev_t *dev);
+// Чтение ISR снимает прерывание INTx
+uint8_t virtio_read_isr(virtio_dev_t *dev);
+
+// Конфигурация устройства (смещения из спецификации типа устройства)
+uint8_t virtio_config_read8(virtio_dev_t *dev, uint32_t offset);
+uint16_t virtio_config_read16(virtio_dev_t *dev, uint32_t offset);
+uint32_t virtio_config_read32(virtio_dev_t *dev, uint32_t offset);
+uint64_t virtio_config_read64(virtio_dev_t *dev, uint32_t offset);
+
+// Дескрипторы: выделение по одному и возврат всей цепочки
+int virtq_alloc_desc(virtq_t *vq);
+void virtq_free_chain(virtq_t *vq, uint16_t head);
+// Выставить цепочку в avail-кольцо (уведомление — отдельно)
+void virtq_push(virtq_t *vq, uint16_t head);
+// Уведомить устройство, если оно этого ждет (event idx / NO_NOTIFY)
+void virtq_kick(virtio_dev_t *dev, virtq_t *vq);
+// Очередная завершенная цепочка или -1
+int virtq_pop_used(virtq_t *vq, uint32_t *len);
+
+#endif
@@ -0,0 +1,410 @@
+#include "virtio_blk.h"
+#include "msi.h"
+#include "idle.h"
+#include "pmm.h"
+#include "string.h"
+#include "video.h"
+
+// Завершение запросов определяется опросом used-кольца; обработчик
+// прерывания только снимает его (чтение ISR для INTx/MSI). Дескрипторы
+// косвенные, если устройство их поддерживает: запрос любого размера
+// занимает в кольце один дескриптор.
+//
+// VIRTIO_BLK_F_MQ не запрашивается: ViXOS работает на одном процессоре,
+// и очередь на процессор — это одна очередь. С VIRTIO_BLK_F_FLUSH у
+// устройства кэш записи, его сбрасывает VIRTIO_BLK_T_FLUSH; без этой
+// возможности устройство обязано писать сквозь свой кэш.
+
+static virtio_blk_t devices[VIRTIO_BLK_MAX_DEVICES];
+static int device_count = 0;
+
+#define VIRTIO_BLK_INDIRECT_DESCS (VIRTIO_BLK_MAX_SEGS + 2)
+
+static void virtio_blk_irq_handler(void) {
+    for (int i = 0; i < device_count; i++) {
+        if (devices[i].irq_type != MSI_IRQ_MSIX) {
+            virtio_read_isr(&devices[i].vdev);
+        }
+    }
+}
+
+// ===== Построение запросов =====
+
+// Сегменты данных по списку bio: физически смежные буферы склеиваются
+static int virtio_blk_map(virtio_blk_t *vb, blk_request_t *rq,
+                          uint32_t *addr, uint32_t *len) {
+    int n = 0;
+
+    for (blk_bio_t *bio = rq->bio_head; bio; bio = bio->next) {
+        uint32_t a = (uint32_t)(uintptr_t)bio->buffer;
+        uint32_t bytes = bio->count * BLK_SECTOR_SIZE;
+
+        while (bytes > 0) {
+            uint32_t chunk = bytes > vb->size_max ? vb->size_max : bytes;
+
+            if (n > 0 && addr[n - 1] + len[n - 1] == a &&
+                len[n - 1] + chunk <= vb->size_max) {
+                len[n - 1] += chunk;
+            } else {
+                if (n >= vb->max_segs) {
+                    return -1;
+                }
+                addr[n] = a;
+                len[n] = chunk;
+                n++;
+            }
+            a += chunk;
+            bytes -= chunk;
+        }
+    }
+    return n;
+}
+
+// Диапазоны discard: каждый bio запроса — отдельный диапазон
+static int virtio_blk_map_discard(virtio_blk_t *vb, blk_request_t *rq,
+                                  uint32_t *addr, uint32_t *len) {
+    virtio_blk_discard_t *ranges = vb->discard_ranges;
+    int n = 0;
+
+    for (blk_bio_t *bio = rq->bio_head; bio; bio = bio->next) {
+        if (n >= VIRTIO_BLK_DISCARD_SEGS) {
+            return -1;
+        }
+        ranges[n].sector = bio->lba;
+        ranges[n].num_sectors = bio->count;
+        ranges[n].flags = 0;
+        n++;
+    }
+    addr[0] = (uint32_t)(uintptr_t)ranges;
+    len[0] = n * sizeof(virtio_blk_discard_t);
+    return 1;
+}
+
+static void fill_desc(virtq_desc_t *d, uint32_t addr, uint32_t len,
+                      uint16_t flags, uint16_t next) {
+    d->addr = addr;
+    d->len = len;
+    d->flags = flags;
+    d->next = next;
+}
+
+static int virtio_blk_submit(blkdev_t *dev, blk_request_t *rq) {
+    virtio_blk_t *vb = (virtio_blk_t*)dev->driver_data;
+    uint32_t addr[VIRTIO_BLK_MAX_SEGS];
+    uint32_t len[VIRTIO_BLK_MAX_SEGS];
+    virtio_blk_slot_t *slot = NULL;
+    int slot_index;
+
+    // Диск только для чтения: ни запись, ни discard не меняют данные
+    if ((rq->op == BLK_OP_WRITE || rq->op == BLK_OP_DISCARD) && vb->read_only) {
+        blk_end_request(rq, BLK_ERR_IO);
+        return 0;
+    }
+
+    for (slot_index = 0; slot_index < VIRTIO_BLK_MAX_REQS; slot_index++) {
+        if (!vb->slots[slot_index].in_use) {
+            slot = &vb->slots[slot_index];
+            break;
+        }
+    }
+    if (!slot) {
+        return 1;
+    }
+
+    int discard = rq->op == BLK_OP_DISCARD;
+    int flush = rq->op == BLK_OP_FLUSH;
+    int segs = discard ? virtio_blk_map_discard(vb, rq, addr, len) :
+               flush ? 0 : virtio_blk_map(vb, rq, addr, len);
+    if (segs < 0) {
+        blk_end_request(rq, BLK_ERR_IO);
+        return 0;
+    }
+
+    // Данные чтения пишет устройство; заголовок, данные записи и диапазоны
+    // discard — только читает
+    uint16_t data_flags = (rq->op == BLK_OP_READ) ? VIRTQ_DESC_F_WRITE : 0;
+    int total = segs + 2;
+    int head;
+
+    slot->hdr.type = discard ? VIRTIO_BLK_T_DISCARD :
+                     flush ? VIRTIO_BLK_T_FLUSH :
+                     (rq->op == BLK_OP_WRITE ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN);
+    slot->hdr.reserved = 0;
+    slot->hdr.sector = (discard || flush) ? 0 : rq->lba;
+    slot->status = 0xFF;
+
+    if (slot->indirect) {
+        // Вся цепочка — в таблице слота, в кольце один дескриптор
+        virtq_desc_t *table = slot->indirect;
+
+        head = virtq_alloc_desc(&vb->vq);
+        if (head < 0) {
+            return 1;
+        }
+        fill_desc(&table[0], (uint32_t)(uintptr_t)&slot->hdr,
+                  sizeof(virtio_blk_req_hdr_t), VIRTQ_DESC_F_NEXT, 1);
+        for (int i = 0; i < segs; i++) {
+            fill_desc(&table[i + 1], addr[i], len[i],
+                      data_flags | VIRTQ_DESC_F_NEXT, i + 2);
+        }
+        fill_desc(&table[segs + 1], (uint32_t)(uintptr_t)&slot->status, 1,
+                  VIRTQ_DESC_F_WRITE, 0);
+        fill_desc(&vb->vq.desc[head], (uint32_t)(uintptr_t)table,
+                  total * sizeof(virtq_desc_t), VIRTQ_DESC_F_INDIRECT, 0);
+    } else {
+        uint16_t chain[VIRTIO_BLK_MAX_SEGS + 2];
+
+        if (vb->vq.num_free < total) {
+            return 1;
+        }
+        for (int i = 0; i < total; i++) {
+            chain[i] = (uint16_t)virtq_alloc_desc(&vb->vq);
+        }
+        head = chain[0];
+        fill_desc(&vb->vq.desc[chain[0]], (uint32_t)(uintptr_t)&slot->hdr,
+                  sizeof(virtio_blk_req_hdr_t), VIRTQ_DESC_F_NEXT, chain[1]);
+        for (int i = 0; i < segs; i++) {
+            fill_desc(&vb->vq.desc[chain[i + 1]], addr[i], len[i],
+                      data_flags | VIRTQ_DESC_F_NEXT, chain[i + 2]);
+        }
+        fill_desc(&vb->vq.desc[chain[total - 1]], (uint32_t)(uintptr_t)&slot->status,
+                  1, VIRTQ_DESC_F_WRITE, 0);
+    }
+
+    slot->in_use = 1;
+    slot->rq = rq;
+    slot->head = (int16_t)head;
+    vb->slot_of_head[head] = (int16_t)slot_index;
+
+    virtq_push(&vb->vq, (uint16_t)head);
+    virtq_kick(&vb->vdev, &vb->vq);
+    return 0;
+}
+
+// ===== Завершение =====
+
+static void virtio_blk_poll_device(virtio_blk_t *vb) {
+    blk_request_t *done[VIRTIO_BLK_MAX_REQS];
+    int results[VIRTIO_BLK_MAX_REQS];
+    int n = 0;
+    int head;
+
+    // Сначала забираем все завершенные, потом уведомляем вызывающих:
+    // end_io может сразу отправить новый запрос в эту же очередь
+    while (n < VIRTIO_BLK_MAX_REQS && (head = virtq_pop_used(&vb->vq, NULL)) >= 0) {
+        if (head >= vb->vq.size || vb->slot_of_head[head] < 0) {
+            continue;
+        }
+        virtio_blk_slot_t *slot = &vb->slots[vb->slot_of_head[head]];
+
+        vb->slot_of_head[head] = -1;
+        virtq_free_chain(&vb->vq, (uint16_t)head);
+        done[n] = slot->rq;
+        results[n++] = slot->status == VIRTIO_BLK_S_OK ? BLK_OK : BLK_ERR_IO;
+        slot->rq = NULL;
+        slot->in_use = 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        blk_end_request(done[i], results[i]);
+    }
+    if (n) {
+        blk_run_queue(vb->blk);
+    }
+}
+
+void virtio_blk_poll(void) {
+    for (int i = 0; i < device_count; i++) {
+        if (devices[i].blk) {
+            virtio_blk_poll_device(&devices[i]);
+        }
+    }
+}
+
+// Ожидая один диск, продвигаем и остальные (как и AHCI)
+static void virtio_blk_blk_poll(blkdev_t *dev) {
+    (void)dev;
+    virtio_blk_poll();
+}
+
+static const blkdev_ops_t virtio_blk_ops = {
+    virtio_blk_submit,
+    virtio_blk_blk_poll
+};
+
+// ===== Инициализация =====
+
+static void virtio_blk_print(virtio_blk_t *vb) {
+    char buf[16];
+
+    video_print("virtio-blk: /dev/");
+    video_print(vb->blk->name);
+    itoa((uint32_t)(vb->capacity / 2048), buf, 10);
+    video_print(" ");
+    video_print(buf);
+    video_print(" MB  ");
+    video_print(vb->vdev.modern ? "modern" : "legacy");
+    video_print(vb->irq_type == MSI_IRQ_MSIX ? " MSI-X" :
+                vb->irq_type == MSI_IRQ_MSI ? " MSI" : " INTx");
+    itoa(vb->vq.size, buf, 10);
+    video_print("  queue:");
+    video_print(buf);
+    if (virtio_has_feature(&vb->vdev, VIRTIO_F_INDIRECT_DESC)) {
+        video_print(" indirect");
+    }
+    if (virtio_has_feature(&vb->vdev, VIRTIO_F_EVENT_IDX)) {
+        video_print(" event-idx");
+    }
+    if (vb->blk->queue.max_discard_sectors) {
+        video_print(" discard");
+    }
+    if (vb->blk->queue.write_cache) {
+        video_print(" flush");
+    }
+    if (vb->read_only) {
+        video_print(" ro");
+    }
+    video_print("\n");
+}
+
+static int virtio_blk_probe(virtio_blk_t *vb, const pci_device_t *pci, const char *name) {
+    virtio_dev_t *vdev = &vb->vdev;
+
+    memset(vb, 0, sizeof(virtio_blk_t));
+    if (virtio_pci_init(vdev, pci) != 0) {
+        return -1;
+    }
+
+    uint64_t wanted = (1ull << VIRTIO_F_INDIRECT_DESC) | (1ull << VIRTIO_F_EVENT_IDX) |
+                      (1ull << VIRTIO_BLK_F_SIZE_MAX) | (1ull << VIRTIO_BLK_F_SEG_MAX) |
+                      (1ull << VIRTIO_BLK_F_RO) | (1ull << VIRTIO_BLK_F_DISCARD) |
+                      (1ull << VIRTIO_BLK_F_FLUSH);
+    if (virtio_negotiate(vdev, wanted) != 0) {
+        return -1;
+    }
+
+    // MSI-X включаем до чтения конфигурации: у legacy она при этом сдвигается
+    vb->irq_type = msi_request_irq(*pci, virtio_blk_irq_handler, &vb->irq);
+    vdev->msix = vb->irq_type == MSI_IRQ_MSIX;
+    if (vdev->msix) {
+        virtio_set_config_vector(vdev, VIRTIO_MSI_NO_VECTOR);
+    }
+
+    if (virtio_setup_queue(vdev, 0, &vb->vq, VIRTQ_MAX_SIZE, 0) != 0) {
+        virtio_fail(vdev);
+        return -1;
+    }
+    memset(vb->slot_of_head, 0xFF, sizeof(vb->slot_of_head));
+
+    vb->capacity = virtio_config_read64(vdev, VIRTIO_BLK_CFG_CAPACITY);
+    vb->read_only = virtio_has_feature(vdev, VIRTIO_BLK_F_RO);
+    vb->size_max = VIRTIO_BLK_MAX_SECTORS * BLK_SECTOR_SIZE;
+    if (virtio_has_feature(vdev, VIRTIO_BLK_F_SIZE_MAX)) {
+        uint32_t size_max = virtio_config_read32(vdev, VIRTIO_BLK_CFG_SIZE_MAX);
+        if (size_max >= BLK_SECTOR_SIZE && size_max < vb->size_max) {
+            vb->size_max = size_max & ~(BLK_SECTOR_SIZE - 1);
+        }
+    }
+
+    // Без косвенных дескрипторов запрос занимает segs + 2 места в кольце
+    int indirect = virtio_has_feature(vdev, VIRTIO_F_INDIRECT_DESC);
+    vb->max_segs = indirect ? VIRTIO_BLK_MAX_SEGS :
+                   (vb->vq.size - 2 < VIRTIO_BLK_MAX_SEGS ? vb->vq.size - 2
+                                                          : VIRTIO_BLK_MAX_SEGS);
+    if (virtio_has_feature(vdev, VIRTIO_BLK_F_SEG_MAX)) {
+        uint32_t seg_max = virtio_config_read32(vdev, VIRTIO_BLK_CFG_SEG_MAX);
+        if (seg_max && seg_max < vb->max_segs) {
+            vb->max_segs = (uint16_t)seg_max;
+        }
+    }
+    if (vb->max_segs < 1) {
+        virtio_fail(vdev);
+        return -1;
+    }
+
+    if (indirect) {
+        uint32_t per_page = 4096 / (VIRTIO_BLK_INDIRECT_DESCS * sizeof(virtq_desc_t));
+        uint32_t pages = (VIRTIO_BLK_MAX_REQS + per_page - 1) / per_page;
+        uint8_t *tables = (uint8_t*)pmm_alloc_blocks(pages);
+        if (!tables) {
+            virtio_fail(vdev);
+            return -1;
+        }
+        for (int i = 0; i < VIRTIO_BLK_MAX_REQS; i++) {
+            vb->slots[i].indirect = (virtq_desc_t*)(tables +
+                i * VIRTIO_BLK_INDIRECT_DESCS * sizeof(virtq_desc_t));
+        }
+    }
+
+    uint32_t discard_sectors = 0;
+    uint32_t discard_segs = 0;
+    if (virtio_has_feature(vdev, VIRTIO_BLK_F_DISCARD) && !vb->read_only) {
+        discard_sectors = virtio_config_read32(vdev, VIRTIO_BLK_CFG_MAX_DISCARD);
+        discard_segs = virtio_config_read32(vdev, VIRTIO_BLK_CFG_MAX_DISCARD_SEG);
+        if (discard_segs > VIRTIO_BLK_DISCARD_SEGS) {
+            discard_segs = VIRTIO_BLK_DISCARD_SEGS;
+        }
+        // Блочный уровень держит в полете не больше одного discard
+        vb->discard_ranges = (virtio_blk_discard_t*)pmm_alloc_block();
+        if (!vb->discard_ranges) {
+            discard_sectors = 0;
+        }
+    }
+
+    virtio_driver_ok(vdev);
+
+    // Блочный уровень адресует 32-битными LBA
+    uint32_t sectors = vb->capacity > 0xFFFFFFFFull ? 0xFFFFFFFF : (uint32_t)vb->capacity;
+    vb->blk = blkdev_register(name, sectors, &virtio_blk_ops, vb);
+    if (!vb->blk) {
+        virtio_fail(vdev);
+        return -1;
+    }
+
+    uint32_t max_hw = vb->size_max * vb->max_segs / BLK_SECTOR_SIZE;
+    if (max_hw > VIRTIO_BLK_MAX_SECTORS) {
+        max_hw = VIRTIO_BLK_MAX_SECTORS;
+    }
+    blkdev_set_hw_limits(vb->blk, max_hw, vb->max_segs);
+    blkdev_set_max_sectors(vb->blk, VIRTIO_BLK_MAX_SECTORS / 2);
+
+    // Без косвенных дескрипторов глубина рассчитана на запросы из одного
+    // сегмента; длинной цепочке не хватит места — submit вернет "занято"
+    uint32_t depth = indirect ? vb->vq.size : vb->vq.size / 3;
+    if (depth > VIRTIO_BLK_MAX_REQS) {
+        depth = VIRTIO_BLK_MAX_REQS;
+    }
+    blkdev_set_queue_depth(vb->blk, depth);
+
+    if (discard_sectors && discard_segs) {
+        blkdev_set_discard(vb->blk, discard_sectors, discard_segs);
+    }
+    blkdev_set_write_cache(vb->blk, virtio_has_feature(vdev, VIRTIO_BLK_F_FLUSH));
+
+    virtio_blk_print(vb);
+    return 0;
+}
+
+// Диски регистрируются как vda, vdb, ... в порядке обхода PCI
+void virtio_blk_init(void) {
+    char name[4] = "vd?";
+
+    for (int i = 0; device_count < VIRTIO_BLK_MAX_DEVICES; i++) {
+        const pci_device_t *pci = pci_find_vendor(VIRTIO_PCI_VENDOR, 0xFFFF, i);
+        if (!pci) {
+            break;
+        }
+        if (virtio_pci_device_type(pci) != VIRTIO_ID_BLOCK) {
+            continue;
+        }
+
+        name[2] = 'a' + device_count;
+        if (virtio_blk_probe(&devices[device_count], pci, name) == 0) {
+            device_count++;
+        }
+    }
+
+    if (device_count > 0) {
+        idle_register_task("virtio", virtio_blk_poll);
+    }
+}
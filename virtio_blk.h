@@ -0,0 +1,78 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdint.h>
+#include "virtio.h"
+#include "blkdev.h"
+
+// Блочное устройство virtio (QEMU: -drive if=virtio)
+
+#define VIRTIO_BLK_MAX_DEVICES    4
+#define VIRTIO_BLK_MAX_REQS       32      // Запросов в полете на устройство
+#define VIRTIO_BLK_MAX_SEGS       62      // Сегментов данных (+ заголовок и статус)
+#define VIRTIO_BLK_MAX_SECTORS    2048    // 1 MB на запрос
+#define VIRTIO_BLK_DISCARD_SEGS   64      // Диапазонов в одном discard
+
+// Возможности virtio-blk (номера битов)
+#define VIRTIO_BLK_F_SIZE_MAX     1
+#define VIRTIO_BLK_F_SEG_MAX      2
+#define VIRTIO_BLK_F_RO           5
+#define VIRTIO_BLK_F_FLUSH        9
+#define VIRTIO_BLK_F_MQ           12
+#define VIRTIO_BLK_F_DISCARD      13
+
+// Конфигурация устройства
+#define VIRTIO_BLK_CFG_CAPACITY        0
+#define VIRTIO_BLK_CFG_SIZE_MAX        8
+#define VIRTIO_BLK_CFG_SEG_MAX         12
+#define VIRTIO_BLK_CFG_MAX_DISCARD     36
+#define VIRTIO_BLK_CFG_MAX_DISCARD_SEG 40
+
+// Типы запросов и состояние
+#define VIRTIO_BLK_T_IN           0
+#define VIRTIO_BLK_T_OUT          1
+#define VIRTIO_BLK_T_FLUSH        4
+#define VIRTIO_BLK_T_DISCARD      11
+#define VIRTIO_BLK_S_OK           0
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} virtio_blk_req_hdr_t;
+
+typedef struct {
+    uint64_t sector;
+    uint32_t num_sectors;
+    uint32_t flags;
+} virtio_blk_discard_t;
+
+// Запрос в полете: заголовок и статус читает/пишет устройство
+typedef struct {
+    virtio_blk_req_hdr_t hdr;
+    volatile uint8_t status;
+    uint8_t in_use;
+    int16_t head;                         // Голова цепочки в кольце
+    blk_request_t *rq;
+    virtq_desc_t *indirect;               // Таблица косвенных дескрипторов
+} virtio_blk_slot_t;
+
+typedef struct {
+    virtio_dev_t vdev;
+    virtq_t vq;
+    blkdev_t *blk;
+    uint64_t capacity;                    // В секторах по 512 байт
+    uint32_t size_max;                    // Байт в одном сегменте
+    uint16_t max_segs;
+    uint8_t read_only;
+    uint8_t irq;
+    uint8_t irq_type;                     // MSI_IRQ_*
+    virtio_blk_discard_t *discard_ranges;
+    int16_t slot_of_head[VIRTQ_MAX_SIZE]; // Запрос по голове цепочки
+    virtio_blk_slot_t slots[VIRTIO_BLK_MAX_REQS];
+} virtio_blk_t;
+
+void virtio_blk_init(void);
+void virtio_blk_poll(void);
+
+#endif
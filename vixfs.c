@@ -3,231 +3,3132 @@
 #include "terminal.h"
 #include "string.h"
 #include "port_io.h"
+#include "bcache.h"
+#include "idle.h"
+#include "timer.h"
+#include "lz4.h"
+#include "crc32c.h"
 
 static vixfs_superblock_t superblock;
 static vixfs_inode_t inodes[VIXFS_MAX_FILES];
-static uint8_t block_bitmap[4096]; // Битовая карта для 32768 блоков
-static uint8_t inode_bitmap[32];   // Битовая карта для 256 инодов
+static uint8_t *block_bitmap = NULL;          // Страницы PMM, block_bitmap_blocks блоков
+static uint32_t block_bitmap_pages = 0;
+static uint8_t inode_bitmap[VIXFS_BLOCK_SIZE]; // Целый блок, значимы первые 32 байта
+static blkdev_t *backing_dev = NULL; // Диск под ФС (NULL — не смонтирована)
+static uint32_t alloc_goal = 0;      // Следующее выделение для нового файла
+
+// Открытый файл: инод и позиция для vixfs_fread/vixfs_fwrite
+typedef struct {
+    uint8_t used;
+    uint8_t flags;
+    uint32_t inode;
+    uint32_t pos;
+} vixfs_file_t;
+
+static vixfs_file_t handles[VIXFS_MAX_HANDLES];
+
+// Изменения метаданных копятся в текущей транзакции. Образы в памяти
+// (суперблок, битовые карты, таблица инодов) отмечены в meta_dirty, блоки
+// в кэше (узлы экстентов, каталоги) закреплены: на место они попадут
+// только после записи транзакции в журнал. Много операций дают один
+// коммит — одну последовательную запись (групповой коммит).
+static uint8_t meta_dirty[VIXFS_MAX_META_BLOCKS / 8];
+static uint32_t txn_blocks[BCACHE_MAX_BUFFERS + VIXFS_MAX_META_BLOCKS];
+static uint32_t txn_count = 0;
+static uint32_t txn_frees[VIXFS_TXN_MAX_FREES + VIXFS_TXN_SPARE_FREES][2]; // (start, count)
+static uint32_t txn_free_count = 0;
+static uint32_t journal_seq = 1;          // Номер текущей транзакции
+static uint32_t journal_head = 1;         // Следующий свободный блок журнала
+static uint8_t *journal_stage = NULL;     // VIXFS_JOURNAL_STAGE блоков из PMM
+static uint8_t journal_busy = 0;
+static uint64_t last_commit_us = 0;
+static uint32_t delalloc_reserved = 0;    // Блоков обещано отложенным хвостам
+
+// Последний распакованный кластер сжатого файла: последовательное чтение
+// распаковывает каждый кластер один раз
+static uint8_t *cluster_data = NULL;      // VIXFS_CLUSTER_SIZE из PMM
+static uint8_t *cluster_comp = NULL;      // Сжатый образ кластера
+static uint32_t cluster_inode = 0;
+static uint32_t cluster_index = (uint32_t)-1; // -1 — в cluster_data ничего нет
+static uint32_t cluster_len = 0;          // Значимых байт, дальше нули
+
+static int vixfs_dir_init(vixfs_inode_t *dir);
+static int vixfs_commit(void);
+static void vixfs_mark_bitmap(uint32_t start, uint32_t count);
+static int vixfs_delalloc_flush_all(void);
+static int vixfs_delalloc_fits(uint32_t blocks);
+static int vixfs_inode_open(uint32_t inode);
+static void vixfs_cluster_forget(uint32_t inode);
+static int vixfs_write_blocks(vixfs_inode_t *inode, const uint8_t *data,
+                              uint32_t size, uint32_t offset);
+static int vixfs_resize_op(vixfs_inode_t *inode, uint32_t new_size);
+
+// Транзакция с запасом помещается в журнал
+static uint32_t vixfs_txn_limit(void) {
+    uint32_t limit = superblock.journal_blocks / 2;
+    return limit < VIXFS_TXN_MAX_BLOCKS ? limit : VIXFS_TXN_MAX_BLOCKS;
+}
+
+// Коммита здесь нет: посреди операции он записал бы половинчатое
+// состояние. Блок попадает в транзакцию один раз (образ отмечен в
+// meta_dirty, буфер закреплен), поэтому txn_blocks не переполняется.
+static void vixfs_txn_add(uint32_t block) {
+    txn_blocks[txn_count++] = block;
+}
+
+static void vixfs_mark_meta(uint32_t block) {
+    if (block < VIXFS_MAX_META_BLOCKS && !(meta_dirty[block / 8] & (1 << (block % 8)))) {
+        vixfs_txn_add(block);
+        meta_dirty[block / 8] |= (1 << (block % 8));
+    }
+}
+
+static void vixfs_mark_inode(uint32_t inode) {
+    vixfs_mark_meta(superblock.inode_table_start + inode / VIXFS_INODES_PER_BLOCK);
+}
+
+// Измененный блок метаданных в кэше
+static void vixfs_journal_dirty(bcache_buf_t *buf) {
+    // Сумма в хвосте блока станет верной при коммите, а до тех пор
+    // содержимое в памяти и есть правильное
+    bcache_mark_checked(buf);
+    bcache_mark_dirty(buf);
+    if (bcache_pin(buf)) {
+        vixfs_txn_add(buf->block);
+    }
+}
+
+// Образ блока метаданных в памяти
+static uint8_t *vixfs_meta_source(uint32_t block) {
+    if (block == 0) {
+        return (uint8_t*)&superblock;
+    }
+    if (block == superblock.inode_bitmap_start) {
+        return inode_bitmap;
+    }
+    if (block >= superblock.block_bitmap_start &&
+        block < superblock.block_bitmap_start + superblock.block_bitmap_blocks) {
+        return block_bitmap + (block - superblock.block_bitmap_start) * VIXFS_BLOCK_SIZE;
+    }
+    if (block >= superblock.inode_table_start &&
+        block < superblock.inode_table_start + superblock.inode_table_blocks) {
+        return (uint8_t*)inodes + (block - superblock.inode_table_start) * VIXFS_BLOCK_SIZE;
+    }
+    return NULL;
+}
+
+// ===== Контрольные суммы =====
+//
+// CRC32C есть у суперблока, каждого инода, узлов дерева экстентов, блоков
+// каталогов (в последних 4 байтах) и сжатых кластеров. В начальное значение
+// входит номер блока или инода: блок, записанный не на свое место, тоже не
+// сойдется. Суммы ставятся при коммите, проверяются при чтении с диска;
+// расхождения видны в iostat.
+
+static uint32_t vixfs_block_csum(uint32_t block, const uint8_t *data) {
+    return crc32c(block, data, VIXFS_BLOCK_CSUM);
+}
+
+static uint32_t vixfs_inode_csum(uint32_t inode_num) {
+    return crc32c(inode_num, &inodes[inode_num], offsetof(vixfs_inode_t, checksum));
+}
+
+static uint32_t vixfs_super_csum(void) {
+    return crc32c(0, &superblock, offsetof(vixfs_superblock_t, checksum));
+}
+
+static uint32_t vixfs_cluster_csum(uint32_t inode_num, uint32_t index,
+                                   const uint8_t *data, uint32_t len) {
+    return crc32c(crc32c(inode_num, &index, sizeof(index)), data, len);
+}
+
+static void vixfs_csum_error(const char *what) {
+    terminal_writestring(what);
+    terminal_writestring(" checksum mismatch!\n");
+    blk_account_csum_error(backing_dev);
+}
+
+// Узел или блок каталога проверяется один раз после чтения с диска
+static int vixfs_block_verify(bcache_buf_t *buf, const char *what) {
+    if (buf->flags & BCACHE_CHECKED) {
+        return 0;
+    }
+    if (*(uint32_t*)(buf->data + VIXFS_BLOCK_CSUM) != vixfs_block_csum(buf->block, buf->data)) {
+        vixfs_csum_error(what);
+        return -1;
+    }
+    bcache_mark_checked(buf);
+    return 0;
+}
+
+// Суммы во всех блоках транзакции — перед записью в журнал и на место
+static void vixfs_txn_csum(void) {
+    for (uint32_t i = 0; i < txn_count; i++) {
+        uint32_t block = txn_blocks[i];
+
+        if (block == 0) {
+            superblock.checksum = vixfs_super_csum();
+        } else if (block >= superblock.inode_table_start &&
+                   block < superblock.inode_table_start + superblock.inode_table_blocks) {
+            uint32_t first = (block - superblock.inode_table_start) * VIXFS_INODES_PER_BLOCK;
+            for (uint32_t k = first; k < first + VIXFS_INODES_PER_BLOCK; k++) {
+                inodes[k].checksum = vixfs_inode_csum(k);
+            }
+        } else if (block >= superblock.journal_start) {
+            bcache_buf_t *buf = bcache_get(backing_dev, block);
+            if (buf) {
+                *(uint32_t*)(buf->data + VIXFS_BLOCK_CSUM) = vixfs_block_csum(block, buf->data);
+                bcache_release(buf);
+            }
+        }
+    }
+}
+
+// ===== Журнал метаданных =====
+
+static int vixfs_journal_alloc(void) {
+    if (!journal_stage) {
+        journal_stage = (uint8_t*)pmm_alloc_blocks(VIXFS_JOURNAL_STAGE * VIXFS_BLOCK_SIZE / 4096);
+    }
+    return journal_stage ? 0 : -1;
+}
+
+// Журнал снова пуст: все его транзакции уже лежат на месте. Из кэша
+// устройства они уходят на носитель раньше, чем заголовок их отменит.
+static int vixfs_journal_reset(void) {
+    vixfs_journal_header_t *hdr = (vixfs_journal_header_t*)journal_stage;
+
+    if (blkdev_flush(backing_dev) != BLK_OK) {
+        return -1;
+    }
+    memset(hdr, 0, VIXFS_BLOCK_SIZE);
+    hdr->magic = VIXFS_JOURNAL_HEADER;
+    hdr->seq = journal_seq;
+    hdr->start = 1;
+    journal_head = 1;
+    return blkdev_write(backing_dev, superblock.journal_start, 1, hdr) == BLK_OK ? 0 : -1;
+}
+
+// Текущее содержимое блока транзакции
+static int vixfs_txn_image(uint32_t block, uint8_t *dst) {
+    if (block < superblock.journal_start) {
+        uint8_t *src = vixfs_meta_source(block);
+        if (!src) {
+            return -1;
+        }
+        memcpy(dst, src, VIXFS_BLOCK_SIZE);
+        return 0;
+    }
+
+    bcache_buf_t *buf = bcache_get(backing_dev, block);
+    if (!buf) {
+        return -1;
+    }
+    memcpy(dst, buf->data, VIXFS_BLOCK_SIZE);
+    bcache_release(buf);
+    return 0;
+}
+
+// Освобожденные за транзакцию участки попадают в карту блоков
+static void vixfs_apply_frees(void) {
+    for (uint32_t i = 0; i < txn_free_count; i++) {
+        uint32_t start = txn_frees[i][0];
+        uint32_t count = txn_frees[i][1];
+
+        for (uint32_t block = start; block < start + count; block++) {
+            block_bitmap[block / 8] &= ~(1 << (block % 8));
+        }
+        superblock.free_blocks += count;
+        vixfs_mark_bitmap(start, count);
+    }
+}
+
+// Транзакция уходит в обычный кэш: образы из памяти копируются в буферы,
+// закрепленные блоки открепляются, освобожденные отдаются диску
+static int vixfs_checkpoint(void) {
+    int result = 0;
+
+    for (uint32_t i = 0; i < txn_count; i++) {
+        uint32_t block = txn_blocks[i];
+        bcache_buf_t *buf = bcache_get(backing_dev, block);
+        if (!buf) {
+            result = -1;
+            continue;
+        }
+        if (block < superblock.journal_start) {
+            uint8_t *src = vixfs_meta_source(block);
+            if (src) {
+                memcpy(buf->data, src, VIXFS_BLOCK_SIZE);
+                bcache_mark_dirty(buf);
+            } else {
+                result = -1;
+            }
+            meta_dirty[block / 8] &= ~(1 << (block % 8));
+        } else {
+            bcache_unpin(buf);
+        }
+        bcache_release(buf);
+    }
+    txn_count = 0;
+
+    for (uint32_t i = 0; i < txn_free_count; i++) {
+        bcache_discard(backing_dev, txn_frees[i][0], txn_frees[i][1]);
+    }
+    txn_free_count = 0;
+    return result;
+}
+
+// Дескрипторы с образами кусками по VIXFS_JOURNAL_STAGE блоков, затем
+// блок коммита. Кэш устройства сбрасывается до него — раньше образов и
+// данных, на которые ссылаются новые метаданные, коммит на носитель не
+// попадет — и после, чтобы на место не легло ничего раньше коммита.
+static int vixfs_journal_write(void) {
+    uint32_t pos = journal_head;
+    uint32_t next_free = 0, next_block = 0;
+    uint32_t checksum = 0;
+
+    if (txn_count == 0 && txn_free_count == 0) {
+        return 0;
+    }
+    while (next_free < txn_free_count || next_block < txn_count) {
+        vixfs_journal_desc_t *desc = (vixfs_journal_desc_t*)journal_stage;
+        uint8_t *image = journal_stage + VIXFS_BLOCK_SIZE;
+        uint32_t tag = 0;
+
+        memset(desc, 0, VIXFS_BLOCK_SIZE);
+        desc->magic = VIXFS_JOURNAL_DESC;
+        desc->seq = journal_seq;
+        while (next_free < txn_free_count && tag + 2 <= VIXFS_JOURNAL_TAGS) {
+            desc->tags[tag++] = txn_frees[next_free][0];
+            desc->tags[tag++] = txn_frees[next_free][1];
+            desc->revokes++;
+            next_free++;
+        }
+        while (next_block < txn_count && tag < VIXFS_JOURNAL_TAGS) {
+            uint32_t block = txn_blocks[next_block++];
+            if (vixfs_txn_image(block, image) != 0) {
+                return -1;
+            }
+            desc->tags[tag++] = block;
+            desc->images++;
+            image += VIXFS_BLOCK_SIZE;
+        }
+
+        uint32_t chunk = 1 + desc->images;
+        checksum = crc32c(checksum, journal_stage, chunk * VIXFS_BLOCK_SIZE);
+        if (blkdev_write(backing_dev, superblock.journal_start + pos, chunk, journal_stage) != BLK_OK) {
+            return -1;
+        }
+        pos += chunk;
+    }
+
+    vixfs_journal_commit_t *commit = (vixfs_journal_commit_t*)journal_stage;
+    memset(commit, 0, VIXFS_BLOCK_SIZE);
+    commit->magic = VIXFS_JOURNAL_COMMIT;
+    commit->seq = journal_seq;
+    commit->blocks = pos + 1 - journal_head;
+    commit->checksum = checksum;
+    if (blkdev_flush(backing_dev) != BLK_OK ||
+        blkdev_write(backing_dev, superblock.journal_start + pos, 1, journal_stage) != BLK_OK ||
+        blkdev_flush(backing_dev) != BLK_OK) {
+        return -1;
+    }
+
+    journal_head = pos + 1;
+    journal_seq++;
+    return 0;
+}
+
+static int vixfs_commit(void) {
+    if (!backing_dev || journal_busy) {
+        return 0;
+    }
+    last_commit_us = timer_get_us();
+    if (txn_count == 0 && txn_free_count == 0 && delalloc_reserved == 0) {
+        return 0;
+    }
+    journal_busy = 1;
+    // Отложенные хвосты получают место и попадают в эту же транзакцию
+    int result = vixfs_delalloc_flush_all();
+    vixfs_apply_frees();
+
+    // Упорядоченный режим: данные, на которые ссылаются новые метаданные,
+    // и блоки прошлых транзакций ложатся на место раньше коммита
+    if (bcache_sync_dev(backing_dev) != 0) {
+        result = -1;
+    }
+    vixfs_txn_csum();
+
+    uint32_t tags = txn_free_count * 2 + txn_count;
+    uint32_t size = (tags + VIXFS_JOURNAL_TAGS - 1) / VIXFS_JOURNAL_TAGS + txn_count + 1;
+    if (size >= superblock.journal_blocks) {
+        // Сначала журнал опустошается: иначе восстановление после сбоя
+        // накатило бы его старые образы поверх наполовину записанного
+        terminal_writestring("Warning: transaction larger than journal, writing in place\n");
+        result = -1;
+        journal_seq++;
+        if (vixfs_journal_reset() == 0) {
+            blkdev_flush(backing_dev);
+        }
+    } else if ((journal_head + size > superblock.journal_blocks && vixfs_journal_reset() != 0) ||
+               vixfs_journal_write() != 0) {
+        terminal_writestring("Journal write failed!\n");
+        result = -1;
+    }
+
+    if (vixfs_checkpoint() != 0) {
+        result = -1;
+    }
+    journal_busy = 0;
+    return result;
+}
+
+// Начало операции: коммитить можно только между операциями, поэтому место
+// под худший случай освобождается заранее. blocks — сколько блоков данных
+// операция может занять; освобождения вернутся в карту только с коммитом.
+// Редкий перерасход VIXFS_OP_CREDITS ложится во вторую половину журнала.
+static int vixfs_journal_begin(uint32_t blocks) {
+    if (txn_count + VIXFS_OP_CREDITS > vixfs_txn_limit() ||
+        txn_free_count >= VIXFS_TXN_MAX_FREES ||
+        (txn_free_count > 0 && !vixfs_delalloc_fits(blocks))) {
+        vixfs_commit();
+    }
+    if (txn_count + VIXFS_OP_CREDITS > vixfs_txn_limit() ||
+        txn_free_count >= VIXFS_TXN_MAX_FREES) {
+        terminal_writestring("Journal full, operation refused!\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Конец операции: коммит, если транзакция велика или пора по времени.
+// Закрепленные блоки нельзя вытеснить, поэтому их доля в кэше ограничена.
+static void vixfs_journal_stop(void) {
+    bcache_stats_t cache = bcache_get_stats();
+
+    if (txn_count >= vixfs_txn_limit() / 2 || txn_count >= cache.capacity / 4 ||
+        timer_get_us() - last_commit_us >= VIXFS_COMMIT_INTERVAL_US) {
+        vixfs_commit();
+    }
+}
+
+// Фоновый групповой коммит
+static void vixfs_commit_timer(void) {
+    if (backing_dev && (txn_count || txn_free_count || delalloc_reserved) &&
+        timer_get_us() - last_commit_us >= VIXFS_COMMIT_INTERVAL_US) {
+        vixfs_commit();
+    }
+}
+
+// Блок pos журнала в буфер; дескриптор транзакции seq читается вместе с
+// образами за ним. Возвращает магическое число или 0.
+static uint32_t vixfs_journal_read(uint32_t pos, uint32_t seq) {
+    vixfs_journal_desc_t *desc = (vixfs_journal_desc_t*)journal_stage;
+
+    if (pos >= superblock.journal_blocks ||
+        blkdev_read(backing_dev, superblock.journal_start + pos, 1, journal_stage) != BLK_OK ||
+        desc->seq != seq) {
+        return 0;
+    }
+    if (desc->magic == VIXFS_JOURNAL_DESC) {
+        if (desc->revokes * 2 + desc->images > VIXFS_JOURNAL_TAGS ||
+            pos + 1 + desc->images > superblock.journal_blocks) {
+            return 0;
+        }
+        if (desc->images &&
+            blkdev_read(backing_dev, superblock.journal_start + pos + 1, desc->images,
+                        journal_stage + VIXFS_BLOCK_SIZE) != BLK_OK) {
+            return 0;
+        }
+        return VIXFS_JOURNAL_DESC;
+    }
+    return desc->magic == VIXFS_JOURNAL_COMMIT ? VIXFS_JOURNAL_COMMIT : 0;
+}
+
+// Число целых транзакций подряд с номера seq в блоке pos
+static uint32_t vixfs_journal_scan(uint32_t seq, uint32_t pos, uint32_t *revokes) {
+    uint32_t count = 0;
+    uint32_t found = 0;
+
+    for (;;) {
+        vixfs_journal_desc_t *desc = (vixfs_journal_desc_t*)journal_stage;
+        uint32_t start = pos;
+        uint32_t checksum = 0;
+        uint32_t magic;
+
+        while ((magic = vixfs_journal_read(pos, seq)) == VIXFS_JOURNAL_DESC) {
+            checksum = crc32c(checksum, journal_stage, (1 + desc->images) * VIXFS_BLOCK_SIZE);
+            found += desc->revokes;
+            pos += 1 + desc->images;
+        }
+
+        vixfs_journal_commit_t *commit = (vixfs_journal_commit_t*)journal_stage;
+        if (magic != VIXFS_JOURNAL_COMMIT || pos == start ||
+            commit->blocks != pos + 1 - start || commit->checksum != checksum) {
+            return count;
+        }
+        *revokes += found;
+        found = 0;
+        pos++;
+        seq++;
+        count++;
+    }
+}
+
+typedef struct {
+    uint32_t start;
+    uint32_t count;
+    uint32_t seq;
+} vixfs_revoke_t;
+
+typedef struct {
+    vixfs_revoke_t *revokes;
+    uint32_t revoke_count;
+    uint32_t replayed;
+} vixfs_replay_t;
+
+typedef void (*vixfs_journal_visitor_t)(vixfs_journal_desc_t *desc, const uint8_t *images,
+                                        vixfs_replay_t *replay);
+
+// Обход count уже проверенных транзакций
+static int vixfs_journal_walk(uint32_t seq, uint32_t pos, uint32_t count,
+                              vixfs_journal_visitor_t visit, vixfs_replay_t *replay) {
+    while (count > 0) {
+        uint32_t magic = vixfs_journal_read(pos, seq);
+        vixfs_journal_desc_t *desc = (vixfs_journal_desc_t*)journal_stage;
+
+        if (magic == VIXFS_JOURNAL_DESC) {
+            visit(desc, journal_stage + VIXFS_BLOCK_SIZE, replay);
+            pos += 1 + desc->images;
+        } else if (magic == VIXFS_JOURNAL_COMMIT) {
+            pos++;
+            seq++;
+            count--;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void vixfs_collect_revokes(vixfs_journal_desc_t *desc, const uint8_t *images,
+                                  vixfs_replay_t *replay) {
+    (void)images;
+    for (uint32_t i = 0; i < desc->revokes; i++) {
+        vixfs_revoke_t *r = &replay->revokes[replay->revoke_count++];
+        r->start = desc->tags[i * 2];
+        r->count = desc->tags[i * 2 + 1];
+        r->seq = desc->seq;
+    }
+}
+
+// Блок освобожден в транзакции seq или позже: он мог уже достаться
+// данным другого файла, и старый образ метаданных их бы затер
+static int vixfs_revoked(vixfs_replay_t *replay, uint32_t block, uint32_t seq) {
+    for (uint32_t i = 0; i < replay->revoke_count; i++) {
+        vixfs_revoke_t *r = &replay->revokes[i];
+        if (block >= r->start && block - r->start < r->count && r->seq - seq < 0x80000000u) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void vixfs_replay_images(vixfs_journal_desc_t *desc, const uint8_t *images,
+                                vixfs_replay_t *replay) {
+    for (uint32_t i = 0; i < desc->images; i++) {
+        uint32_t block = desc->tags[desc->revokes * 2 + i];
+        if (block >= superblock.total_blocks || vixfs_revoked(replay, block, desc->seq)) {
+            continue;
+        }
+        bcache_buf_t *buf = bcache_get(backing_dev, block);
+        if (buf) {
+            memcpy(buf->data, images + i * VIXFS_BLOCK_SIZE, VIXFS_BLOCK_SIZE);
+            bcache_mark_dirty(buf);
+            bcache_release(buf);
+            replay->replayed++;
+        }
+    }
+}
+
+// Целые транзакции журнала переписываются на место, после чего журнал пуст
+static int vixfs_journal_replay(void) {
+    vixfs_journal_header_t *hdr = (vixfs_journal_header_t*)journal_stage;
+
+    if (blkdev_read(backing_dev, superblock.journal_start, 1, journal_stage) != BLK_OK ||
+        hdr->magic != VIXFS_JOURNAL_HEADER ||
+        hdr->start == 0 || hdr->start >= superblock.journal_blocks) {
+        return -1;
+    }
+    uint32_t seq = hdr->seq;
+    uint32_t start = hdr->start;
+    uint32_t revokes = 0;
+    uint32_t count = vixfs_journal_scan(seq, start, &revokes);
+
+    journal_seq = seq + count;
+    if (count > 0) {
+        vixfs_replay_t replay = { NULL, 0, 0 };
+        uint32_t pages = (revokes * sizeof(vixfs_revoke_t) + 4095) / 4096;
+        if (pages) {
+            replay.revokes = (vixfs_revoke_t*)pmm_alloc_blocks(pages);
+            if (!replay.revokes) {
+                return -1;
+            }
+        }
+
+        int result = 0;
+        if (vixfs_journal_walk(seq, start, count, vixfs_collect_revokes, &replay) != 0 ||
+            vixfs_journal_walk(seq, start, count, vixfs_replay_images, &replay) != 0 ||
+            bcache_sync_dev(backing_dev) != 0) {
+            result = -1;
+        }
+        if (pages) {
+            pmm_free_blocks(replay.revokes, pages);
+        }
+        if (result != 0) {
+            return -1;
+        }
+
+        char buf[16];
+        terminal_writestring("ViXFS: journal replayed, transactions=");
+        itoa(count, buf, 10);
+        terminal_writestring(buf);
+        terminal_writestring(" blocks=");
+        itoa(replay.replayed, buf, 10);
+        terminal_writestring(buf);
+        terminal_writestring("\n");
+    }
+    return vixfs_journal_reset();
+}
+
+static void vixfs_journal_start(void) {
+    static uint8_t task_registered = 0;
+
+    txn_count = 0;
+    txn_free_count = 0;
+    memset(meta_dirty, 0, sizeof(meta_dirty));
+    memset(handles, 0, sizeof(handles));
+    cluster_index = (uint32_t)-1;
+    last_commit_us = timer_get_us();
+    if (!task_registered) {
+        idle_register_task("vixfs_commit", vixfs_commit_timer);
+        task_registered = 1;
+    }
+}
+
+// Чтение подряд идущих блоков метаданных (упреждение кэша склеит их)
+static int vixfs_load(uint32_t start, uint32_t count, uint8_t *dst) {
+    for (uint32_t i = 0; i < count; i++) {
+        bcache_buf_t *buf = bcache_read(backing_dev, start + i);
+        if (!buf) {
+            return -1;
+        }
+        memcpy(dst + i * VIXFS_BLOCK_SIZE, buf->data, VIXFS_BLOCK_SIZE);
+        bcache_release(buf);
+    }
+    return 0;
+}
+
+static int vixfs_alloc_bitmap(uint32_t blocks) {
+    uint32_t pages = (blocks * VIXFS_BLOCK_SIZE + 4095) / 4096;
+
+    if (block_bitmap && block_bitmap_pages == pages) {
+        return 0;
+    }
+    if (block_bitmap) {
+        pmm_free_blocks(block_bitmap, block_bitmap_pages);
+        block_bitmap = NULL;
+        block_bitmap_pages = 0;
+    }
+    block_bitmap = (uint8_t*)pmm_alloc_blocks(pages);
+    if (!block_bitmap) {
+        return -1;
+    }
+    block_bitmap_pages = pages;
+    return 0;
+}
+
+static int vixfs_check_mounted(void) {
+    if (!backing_dev) {
+        terminal_writestring("ViXFS is not mounted!\n");
+        return -1;
+    }
+    return 0;
+}
 
 // Инициализация файловой системы
-void vixfs_init(void) {
+void vixfs_init(const char* devname) {
     terminal_writestring("Initializing ViXFS...\n");
-    
-    // Инициализация битовых карт
-    memset(block_bitmap, 0, sizeof(block_bitmap));
+
+    blkdev_t *dev = devname ? blkdev_find(devname) : blkdev_get(0);
+    if (!dev) {
+        terminal_writestring("No block device for ViXFS!\n");
+        return;
+    }
+
+    // Только монтирование: на диске могут быть чужие данные или ФС
+    // другой версии, форматирует лишь явная команда vixformat
+    if (vixfs_mount(dev) != 0) {
+        terminal_writestring("ViXFS not mounted, disk left untouched (use vixformat <dev>)\n");
+    }
+}
+
+// Форматирование файловой системы
+int vixfs_format(blkdev_t* dev) {
+    terminal_writestring("Formatting ViXFS...\n");
+
+    vixfs_sync();
+    backing_dev = NULL;
+
+    uint32_t total = dev->total_sectors;
+    if (total > VIXFS_MAX_BLOCKS) {
+        total = VIXFS_MAX_BLOCKS;
+    }
+
+    // Инициализация суперблока
+    memset(&superblock, 0, sizeof(superblock));
+    superblock.magic = VIXFS_MAGIC;
+    superblock.version = VIXFS_VERSION;
+    superblock.block_size = VIXFS_BLOCK_SIZE;
+    superblock.total_blocks = total;
+    superblock.inode_count = VIXFS_MAX_FILES;
+    superblock.free_inodes = VIXFS_MAX_FILES - 1; // Минус корневой инод
+    superblock.root_inode = 0;
+    superblock.inode_bitmap_start = 1;
+    superblock.block_bitmap_start = 2;
+    superblock.block_bitmap_blocks = (total + VIXFS_BITS_PER_BLOCK - 1) / VIXFS_BITS_PER_BLOCK;
+    superblock.inode_table_start = superblock.block_bitmap_start + superblock.block_bitmap_blocks;
+    superblock.inode_table_blocks = VIXFS_MAX_FILES / VIXFS_INODES_PER_BLOCK;
+    superblock.journal_start = superblock.inode_table_start + superblock.inode_table_blocks;
+    superblock.journal_blocks = total / 64;
+    if (superblock.journal_blocks < VIXFS_JOURNAL_MIN_BLOCKS) {
+        superblock.journal_blocks = VIXFS_JOURNAL_MIN_BLOCKS;
+    }
+    if (superblock.journal_blocks > VIXFS_JOURNAL_MAX_BLOCKS) {
+        superblock.journal_blocks = VIXFS_JOURNAL_MAX_BLOCKS;
+    }
+    superblock.data_start = superblock.journal_start + superblock.journal_blocks;
+
+    if (superblock.data_start >= total) {
+        terminal_writestring("Device too small for ViXFS!\n");
+        return -1;
+    }
+    superblock.free_blocks = total - superblock.data_start;
+
+    if (vixfs_alloc_bitmap(superblock.block_bitmap_blocks) != 0 || vixfs_journal_alloc() != 0) {
+        terminal_writestring("Out of memory for block bitmap!\n");
+        return -1;
+    }
+    memset(block_bitmap, 0, block_bitmap_pages * 4096);
     memset(inode_bitmap, 0, sizeof(inode_bitmap));
-    
-    // Попытка монтирования существующей ФС
-    if (vixfs_mount() != 0) {
-        terminal_writestring("No existing ViXFS found, formatting...\n");
-        vixfs_format();
+    memset(inodes, 0, sizeof(inodes));
+
+    // Инициализация корневого инода
+    inodes[0].mode = VIXFS_MODE_DIR;
+    inodes[0].size = 0;
+    inodes[0].blocks = 0;
+    inodes[0].extent_header.magic = VIXFS_EXTENT_MAGIC;
+    inodes[0].extent_header.max = VIXFS_INODE_EXTENTS;
+    inodes[0].created_time = 0;
+    inodes[0].modified_time = 0;
+
+    // Помечаем корневой инод как использованный
+    inode_bitmap[0] = 1;
+
+    // Блоки метаданных заняты
+    for (uint32_t i = 0; i < superblock.data_start; i++) {
+        block_bitmap[i / 8] |= (1 << (i % 8));
+    }
+
+    // Вся область метаданных пишется заново, мимо журнала. Номер первой
+    // транзакции берется от таймера, чтобы хвост журнала прежней ФС на
+    // этом диске не сошелся с новой последовательностью.
+    backing_dev = dev;
+    vixfs_journal_start();
+    journal_busy = 1;
+    for (uint32_t i = 0; i < superblock.journal_start; i++) {
+        vixfs_mark_meta(i);
+    }
+    alloc_goal = superblock.data_start;
+    journal_seq = (uint32_t)timer_get_us() | 1;
+    memset(journal_stage, 0, 2 * VIXFS_BLOCK_SIZE);
+    int result = vixfs_dir_init(&inodes[0]);
+    vixfs_txn_csum();
+    if (vixfs_checkpoint() != 0 ||
+        blkdev_write(dev, superblock.journal_start + 1, 1, journal_stage) != BLK_OK ||
+        vixfs_journal_reset() != 0) {
+        result = -1;
+    }
+    journal_busy = 0;
+    if (result != 0 || vixfs_sync() != 0) {
+        terminal_writestring("I/O error while formatting!\n");
+        backing_dev = NULL;
+        return -1;
+    }
+
+    terminal_writestring("ViXFS formatted successfully!\n");
+    return 0;
+}
+
+// Суперблок с диска (через кэш) и проверка раскладки
+static int vixfs_read_super(blkdev_t *dev) {
+    bcache_buf_t *buf = bcache_read(dev, 0);
+    if (!buf) {
+        terminal_writestring("I/O error while reading ViXFS superblock!\n");
+        return -1;
+    }
+    memcpy(&superblock, buf->data, sizeof(superblock));
+    bcache_release(buf);
+
+    // Проверяем магическое число и раскладку
+    if (superblock.magic != VIXFS_MAGIC) {
+        terminal_writestring("No ViXFS found on device\n");
+        return -1;
+    }
+    if (superblock.version != VIXFS_VERSION) {
+        terminal_writestring("Unsupported ViXFS version\n");
+        superblock.magic = 0;
+        return -1;
+    }
+    if (superblock.block_size != VIXFS_BLOCK_SIZE ||
+        superblock.inode_count != VIXFS_MAX_FILES ||
+        superblock.total_blocks > dev->total_sectors ||
+        superblock.total_blocks > VIXFS_MAX_BLOCKS ||
+        superblock.block_bitmap_blocks * VIXFS_BITS_PER_BLOCK < superblock.total_blocks ||
+        superblock.inode_table_blocks != VIXFS_MAX_FILES / VIXFS_INODES_PER_BLOCK ||
+        superblock.journal_start != superblock.inode_table_start + superblock.inode_table_blocks ||
+        superblock.journal_start > VIXFS_MAX_META_BLOCKS ||
+        superblock.journal_blocks < VIXFS_JOURNAL_MIN_BLOCKS ||
+        superblock.journal_blocks > VIXFS_JOURNAL_MAX_BLOCKS ||
+        superblock.data_start != superblock.journal_start + superblock.journal_blocks ||
+        superblock.data_start >= superblock.total_blocks) {
+        terminal_writestring("ViXFS superblock is damaged!\n");
+        superblock.magic = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Монтирование файловой системы
+int vixfs_mount(blkdev_t* dev) {
+    vixfs_sync();
+    backing_dev = NULL;
+
+    if (vixfs_read_super(dev) != 0) {
+        return -1;
+    }
+    if (vixfs_alloc_bitmap(superblock.block_bitmap_blocks) != 0 || vixfs_journal_alloc() != 0) {
+        terminal_writestring("Out of memory for block bitmap!\n");
+        return -1;
+    }
+
+    // После сбоя метаданные на месте могут быть старше журнала
+    backing_dev = dev;
+    vixfs_journal_start();
+    if (vixfs_journal_replay() != 0 || vixfs_read_super(dev) != 0) {
+        terminal_writestring("ViXFS journal is damaged!\n");
+        backing_dev = NULL;
+        return -1;
+    }
+
+    if (vixfs_load(superblock.inode_bitmap_start, 1, inode_bitmap) != 0 ||
+        vixfs_load(superblock.block_bitmap_start, superblock.block_bitmap_blocks, block_bitmap) != 0 ||
+        vixfs_load(superblock.inode_table_start, superblock.inode_table_blocks, (uint8_t*)inodes) != 0) {
+        terminal_writestring("I/O error while mounting ViXFS!\n");
+        backing_dev = NULL;
+        return -1;
+    }
+
+    // Поля суперблока уже проверены на разумность, поэтому расхождение
+    // сумм только сообщается: остальное остается доступным, а испорченные
+    // иноды разбирает fsck
+    if (superblock.checksum != vixfs_super_csum()) {
+        vixfs_csum_error("Superblock");
+    }
+    for (uint32_t i = 0; i < VIXFS_MAX_FILES; i++) {
+        if ((inode_bitmap[i / 8] & (1 << (i % 8))) && inodes[i].checksum != vixfs_inode_csum(i)) {
+            vixfs_csum_error("Inode");
+        }
+    }
+
+    terminal_writestring("ViXFS mounted successfully!\n");
+    return 0;
+}
+
+blkdev_t *vixfs_device(void) {
+    return backing_dev;
+}
+
+int vixfs_sync(void) {
+    if (!backing_dev) {
+        return 0;
+    }
+    int result = vixfs_commit();
+    if (bcache_sync_dev(backing_dev) != 0 || blkdev_flush(backing_dev) != BLK_OK) {
+        result = -1;
+    }
+    return result;
+}
+
+// ===== Дерево экстентов =====
+
+// Узел дерева: корень лежит в иноде, остальные узлы — в буферном кэше
+typedef struct {
+    vixfs_extent_header_t *hdr;
+    vixfs_extent_t *ext;
+    bcache_buf_t *buf;      // NULL — корень в иноде
+} vixfs_node_t;
+
+static void vixfs_node_root(vixfs_inode_t *inode, vixfs_node_t *node) {
+    node->hdr = &inode->extent_header;
+    node->ext = inode->extents;
+    node->buf = NULL;
+}
+
+static int vixfs_node_load(uint32_t block, uint16_t depth, vixfs_node_t *node) {
+    bcache_buf_t *buf = bcache_read(backing_dev, block);
+    if (!buf) {
+        return -1;
+    }
+    node->hdr = (vixfs_extent_header_t*)buf->data;
+    node->ext = (vixfs_extent_t*)(buf->data + sizeof(vixfs_extent_header_t));
+    node->buf = buf;
+
+    if (vixfs_block_verify(buf, "Extent tree node") != 0) {
+        bcache_release(buf);
+        return -1;
+    }
+    if (node->hdr->magic != VIXFS_EXTENT_MAGIC || node->hdr->max != VIXFS_NODE_EXTENTS ||
+        node->hdr->count > node->hdr->max || node->hdr->depth != depth) {
+        terminal_writestring("Corrupted extent tree node!\n");
+        bcache_release(buf);
+        return -1;
+    }
+    return 0;
+}
+
+static void vixfs_node_put(vixfs_node_t *node, int dirty) {
+    if (node->buf) {
+        if (dirty) {
+            vixfs_journal_dirty(node->buf);
+        }
+        bcache_release(node->buf);
+        node->buf = NULL;
+    }
+}
+
+// Новый узел с единственной записью
+static uint32_t vixfs_node_new(uint16_t depth, const vixfs_extent_t *entry) {
+    uint32_t block = vixfs_alloc_block();
+    if (block == (uint32_t)-1) {
+        return block;
+    }
+
+    bcache_buf_t *buf = bcache_get(backing_dev, block);
+    if (!buf) {
+        vixfs_free_block(block);
+        return (uint32_t)-1;
+    }
+    vixfs_extent_header_t *hdr = (vixfs_extent_header_t*)buf->data;
+    memset(buf->data, 0, VIXFS_BLOCK_SIZE);
+    hdr->magic = VIXFS_EXTENT_MAGIC;
+    hdr->count = 1;
+    hdr->max = VIXFS_NODE_EXTENTS;
+    hdr->depth = depth;
+    memcpy(buf->data + sizeof(vixfs_extent_header_t), entry, sizeof(vixfs_extent_t));
+    vixfs_journal_dirty(buf);
+    bcache_release(buf);
+    return block;
+}
+
+// Запись листа, последняя из начинающихся не позже file_block, — в *e.
+// update — заменить ее этой записью (кластер сжатого файла переехал).
+static int vixfs_extent_lookup(vixfs_inode_t *inode, uint32_t file_block,
+                               vixfs_extent_t *e, const vixfs_extent_t *update) {
+    vixfs_node_t node;
+    vixfs_node_root(inode, &node);
+
+    for (;;) {
+        int lo = 0, hi = node.hdr->count - 1, found = -1;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            if (node.ext[mid].file_block <= file_block) {
+                found = mid;
+                lo = mid + 1;
+            } else {
+                hi = mid - 1;
+            }
+        }
+
+        if (found < 0) {
+            vixfs_node_put(&node, 0);
+            return -1;
+        }
+        *e = node.ext[found];
+        uint16_t depth = node.hdr->depth;
+        if (depth == 0 && update) {
+            node.ext[found] = *update;
+            if (!node.buf) {
+                vixfs_mark_inode(inode - inodes);
+            }
+        }
+        vixfs_node_put(&node, depth == 0 && update);
+
+        if (depth == 0) {
+            return 0;
+        }
+        if (vixfs_node_load(e->start, depth - 1, &node) != 0) {
+            return -1;
+        }
+    }
+}
+
+// Физический блок для блока файла file_block; в *run — сколько блоков
+// подряд отображено начиная с него. Сжатые кластеры так не отображаются.
+static uint32_t vixfs_map(vixfs_inode_t *inode, uint32_t file_block, uint32_t *run) {
+    vixfs_extent_t e;
+
+    if (vixfs_extent_lookup(inode, file_block, &e, NULL) != 0 ||
+        (e.length & VIXFS_EXTENT_COMPRESSED) || file_block >= e.file_block + e.length) {
+        return (uint32_t)-1;
+    }
+    *run = e.file_block + e.length - file_block;
+    return e.start + (file_block - e.file_block);
+}
+
+// Корень заполнен: его записи уходят в новый узел, дерево растет на уровень
+static int vixfs_grow_root(vixfs_inode_t *inode) {
+    vixfs_extent_header_t *root = &inode->extent_header;
+
+    if (root->depth >= VIXFS_MAX_DEPTH) {
+        return -1;
+    }
+
+    uint32_t block = vixfs_alloc_block();
+    if (block == (uint32_t)-1) {
+        return -1;
+    }
+    bcache_buf_t *buf = bcache_get(backing_dev, block);
+    if (!buf) {
+        vixfs_free_block(block);
+        return -1;
+    }
+    vixfs_extent_header_t *hdr = (vixfs_extent_header_t*)buf->data;
+    memset(buf->data, 0, VIXFS_BLOCK_SIZE);
+    hdr->magic = VIXFS_EXTENT_MAGIC;
+    hdr->count = root->count;
+    hdr->max = VIXFS_NODE_EXTENTS;
+    hdr->depth = root->depth;
+    memcpy(buf->data + sizeof(vixfs_extent_header_t), inode->extents,
+           root->count * sizeof(vixfs_extent_t));
+    vixfs_journal_dirty(buf);
+    bcache_release(buf);
+
+    // extents[0].file_block остается первым блоком файла под новым узлом
+    inode->extents[0].start = block;
+    inode->extents[0].length = 0;
+    root->count = 1;
+    root->depth++;
+    return 0;
+}
+
+// Добавить в конец файла отображение [file_block, file_block + count) -> start.
+// Файлы растут только с конца, поэтому меняется лишь правый край дерева.
+static int vixfs_extent_append(vixfs_inode_t *inode, uint32_t file_block,
+                               uint32_t start, uint32_t count) {
+    vixfs_node_t path[VIXFS_MAX_DEPTH + 1];
+    int dirty[VIXFS_MAX_DEPTH + 1];
+    int level = 0;
+    int result = 0;
+
+    vixfs_node_root(inode, &path[0]);
+    dirty[0] = 0;
+    while (path[level].hdr->depth > 0) {
+        vixfs_node_t *node = &path[level];
+        if (level == VIXFS_MAX_DEPTH || node->hdr->count == 0 ||
+            vixfs_node_load(node->ext[node->hdr->count - 1].start,
+                            node->hdr->depth - 1, &path[level + 1]) != 0) {
+            result = -1;
+            goto out;
+        }
+        level++;
+        dirty[level] = 0;
+    }
+
+    vixfs_node_t *leaf = &path[level];
+    vixfs_extent_t *last = leaf->hdr->count ? &leaf->ext[leaf->hdr->count - 1] : NULL;
+    vixfs_extent_t entry = { file_block, start, count };
+
+    // Сжатые кластеры не склеиваются: у каждого свое окно
+    if (last && !((last->length | count) & VIXFS_EXTENT_COMPRESSED) &&
+        last->file_block + last->length == file_block &&
+        last->start + last->length == start) {
+        // Продолжение последнего экстента — самый частый случай
+        last->length += count;
+        dirty[level] = 1;
+        goto out;
+    }
+    if (leaf->hdr->count < leaf->hdr->max) {
+        leaf->ext[leaf->hdr->count++] = entry;
+        dirty[level] = 1;
+        goto out;
+    }
+
+    // Лист полон: ближайший сверху узел со свободным местом получает
+    // новую цепочку узлов, на конце которой лежит новый экстент
+    int parent = level - 1;
+    while (parent >= 0 && path[parent].hdr->count == path[parent].hdr->max) {
+        parent--;
+    }
+    if (parent < 0) {
+        for (int i = level; i > 0; i--) {
+            vixfs_node_put(&path[i], dirty[i]);
+        }
+        if (vixfs_grow_root(inode) != 0) {
+            return -1;
+        }
+        return vixfs_extent_append(inode, file_block, start, count);
+    }
+
+    uint32_t chain[VIXFS_MAX_DEPTH];
+    for (int depth = 0; depth < path[parent].hdr->depth; depth++) {
+        chain[depth] = vixfs_node_new(depth, &entry);
+        if (chain[depth] == (uint32_t)-1) {
+            // Уже созданные узлы цепочки никуда не подвешены
+            while (depth-- > 0) {
+                vixfs_free_block(chain[depth]);
+            }
+            result = -1;
+            goto out;
+        }
+        entry.start = chain[depth];
+        entry.length = 0;
+    }
+    path[parent].ext[path[parent].hdr->count++] = entry;
+    dirty[parent] = 1;
+
+out:
+    for (int i = level; i > 0; i--) {
+        vixfs_node_put(&path[i], dirty[i]);
+    }
+    return result;
+}
+
+// Все, что отображено за блоком файла new_blocks, освобождается
+static int vixfs_truncate_node(vixfs_node_t *node, uint32_t new_blocks, int *dirty) {
+    while (node->hdr->count > 0) {
+        vixfs_extent_t *e = &node->ext[node->hdr->count - 1];
+
+        if (node->hdr->depth == 0) {
+            // Сжатый кластер обрезается только целиком: граница — по окну
+            if (e->file_block >= new_blocks) {
+                vixfs_free_extent(e->start, VIXFS_EXTENT_LENGTH(e->length));
+                node->hdr->count--;
+                *dirty = 1;
+                continue;
+            }
+            if (!(e->length & VIXFS_EXTENT_COMPRESSED) && e->file_block + e->length > new_blocks) {
+                uint32_t keep = new_blocks - e->file_block;
+                vixfs_free_extent(e->start + keep, e->length - keep);
+                e->length = keep;
+                *dirty = 1;
+            }
+            return 0;
+        }
+
+        vixfs_node_t child;
+        int child_dirty = 0;
+        if (vixfs_node_load(e->start, node->hdr->depth - 1, &child) != 0) {
+            return -1;
+        }
+        int result = vixfs_truncate_node(&child, new_blocks, &child_dirty);
+        int empty = child.hdr->count == 0;
+        vixfs_node_put(&child, child_dirty && !empty);
+        if (result != 0) {
+            return -1;
+        }
+        if (!empty) {
+            return 0;
+        }
+        vixfs_free_block(e->start);
+        node->hdr->count--;
+        *dirty = 1;
+    }
+    return 0;
+}
+
+static int vixfs_truncate_blocks(vixfs_inode_t *inode, uint32_t new_blocks) {
+    vixfs_node_t root;
+    int dirty = 0;
+
+    vixfs_node_root(inode, &root);
+    int result = vixfs_truncate_node(&root, new_blocks, &dirty);
+
+    // Дерево снова помещается в инод — узел больше не нужен
+    while (result == 0 && root.hdr->depth > 0 && root.hdr->count <= 1) {
+        vixfs_node_t child;
+        if (root.hdr->count == 0) {
+            root.hdr->depth = 0;
+            break;
+        }
+        uint32_t block = root.ext[0].start;
+        if (vixfs_node_load(block, root.hdr->depth - 1, &child) != 0) {
+            result = -1;
+            break;
+        }
+        if (child.hdr->count > VIXFS_INODE_EXTENTS) {
+            vixfs_node_put(&child, 0);
+            break;
+        }
+        memcpy(root.ext, child.ext, child.hdr->count * sizeof(vixfs_extent_t));
+        root.hdr->count = child.hdr->count;
+        root.hdr->depth = child.hdr->depth;
+        vixfs_node_put(&child, 0);
+        vixfs_free_block(block);
+    }
+
+    if (result == 0 && new_blocks < inode->blocks) {
+        inode->blocks = new_blocks;
+    }
+    return result;
+}
+
+// Конец последнего экстента файла — отсюда продолжаем выделение
+static uint32_t vixfs_goal(vixfs_inode_t *inode) {
+    vixfs_extent_t e;
+
+    if (inode->blocks > 0 && vixfs_extent_lookup(inode, inode->blocks - 1, &e, NULL) == 0) {
+        return e.start + VIXFS_EXTENT_LENGTH(e.length);
+    }
+    return alloc_goal;
+}
+
+// Дорастить файл до new_blocks блоков данных как можно более длинными
+// участками сразу за его последним блоком
+static int vixfs_extend(vixfs_inode_t *inode, uint32_t new_blocks) {
+    uint32_t old_blocks = inode->blocks;
+
+    while (inode->blocks < new_blocks) {
+        uint32_t start;
+        uint32_t got = vixfs_alloc_extent(vixfs_goal(inode), new_blocks - inode->blocks, &start);
+        if (got == 0 || vixfs_extent_append(inode, inode->blocks, start, got) != 0) {
+            if (got) {
+                vixfs_free_extent(start, got);
+            }
+            vixfs_truncate_blocks(inode, old_blocks);
+            return -1;
+        }
+        inode->blocks += got;
+    }
+    return 0;
+}
+
+// ===== Отложенное выделение =====
+//
+// Новые блоки в конце файла сначала копятся в памяти без места на диске.
+// Место выделяется при коммите или когда буфер файла заполнен — сразу на
+// весь хвост: череда дописываний дает один экстент и одну крупную запись,
+// а не блоки вперемешку с другими файлами.
+
+typedef struct {
+    uint32_t inode;
+    uint32_t count;       // Блоков хвоста начиная с inode->blocks (0 — слот свободен)
+    uint8_t *pages[VIXFS_DELALLOC_PAGES];
+} vixfs_delalloc_t;
+
+static vixfs_delalloc_t delalloc[VIXFS_DELALLOC_FILES];
+
+static vixfs_delalloc_t *vixfs_delalloc_find(uint32_t inode) {
+    for (int i = 0; i < VIXFS_DELALLOC_FILES; i++) {
+        if (delalloc[i].count && delalloc[i].inode == inode) {
+            return &delalloc[i];
+        }
+    }
+    return NULL;
+}
+
+// Хвост сокращается до keep блоков
+static void vixfs_delalloc_trim(vixfs_delalloc_t *da, uint32_t keep) {
+    uint32_t first_page = (keep * VIXFS_BLOCK_SIZE + 4095) / 4096;
+
+    for (uint32_t i = first_page; i < VIXFS_DELALLOC_PAGES && da->pages[i]; i++) {
+        pmm_free_block(da->pages[i]);
+        da->pages[i] = NULL;
+    }
+    delalloc_reserved -= da->count - keep;
+    da->count = keep;
+}
+
+// Хватит ли места еще на blocks блоков хвостов (с запасом под узлы дерева)
+static int vixfs_delalloc_fits(uint32_t blocks) {
+    return delalloc_reserved + blocks + VIXFS_MAX_DEPTH <= superblock.free_blocks;
+}
+
+static int vixfs_cluster_flush(vixfs_delalloc_t *da);
+
+// Хвост получает место на диске, данные уходят в кэш
+static int vixfs_delalloc_flush(vixfs_delalloc_t *da) {
+    vixfs_inode_t *inode = &inodes[da->inode];
+    uint32_t first = inode->blocks;
+    uint32_t count = da->count;
+    int result = 0;
+
+    if (inode->flags & VIXFS_INODE_COMPRESSED) {
+        return vixfs_cluster_flush(da);
+    }
+    delalloc_reserved -= count;
+    da->count = 0;
+    if (vixfs_extend(inode, first + count) != 0) {
+        // Запас съели каталоги и узлы дерева: хвост теряется
+        terminal_writestring("No space for delayed blocks, data lost!\n");
+        if (inode->size > first * VIXFS_BLOCK_SIZE) {
+            inode->size = first * VIXFS_BLOCK_SIZE;
+        }
+        result = -1;
+    }
+
+    uint32_t run = 0;
+    uint32_t block = 0;
+    for (uint32_t i = 0; i < count && result == 0; i++) {
+        if (run == 0) {
+            block = vixfs_map(inode, first + i, &run);
+        }
+        bcache_buf_t *buf = block != (uint32_t)-1 ? bcache_get(backing_dev, block) : NULL;
+        if (!buf) {
+            result = -1;
+            break;
+        }
+        memcpy(buf->data, da->pages[i / 8] + (i % 8) * VIXFS_BLOCK_SIZE, VIXFS_BLOCK_SIZE);
+        bcache_mark_dirty(buf);
+        bcache_release(buf);
+        block++;
+        run--;
+    }
+
+    for (uint32_t i = 0; i < VIXFS_DELALLOC_PAGES && da->pages[i]; i++) {
+        pmm_free_block(da->pages[i]);
+        da->pages[i] = NULL;
+    }
+    vixfs_mark_inode(da->inode);
+    return result;
+}
+
+static int vixfs_delalloc_flush_all(void) {
+    int result = 0;
+
+    for (int i = 0; i < VIXFS_DELALLOC_FILES; i++) {
+        if (delalloc[i].count && vixfs_delalloc_flush(&delalloc[i]) != 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+// Буфер блока file_block (не меньше inode->blocks) из хвоста файла.
+// create — продлить хвост на этот блок, если он следующий.
+static uint8_t *vixfs_delalloc_block(vixfs_inode_t *inode, uint32_t file_block, int create) {
+    uint32_t ino = inode - inodes;
+    vixfs_delalloc_t *da = vixfs_delalloc_find(ino);
+    uint32_t index = file_block - inode->blocks;
+
+    if (da && index < da->count) {
+        return da->pages[index / 8] + (index % 8) * VIXFS_BLOCK_SIZE;
+    }
+    if (!create || index != (da ? da->count : 0) || !vixfs_delalloc_fits(1)) {
+        return NULL;
+    }
+
+    // Буфер файла полон — хвост уходит на диск, новый начинается с нуля
+    if (da && da->count == VIXFS_DELALLOC_BLOCKS) {
+        if (vixfs_delalloc_flush(da) != 0) {
+            return NULL;
+        }
+        return vixfs_delalloc_block(inode, file_block, create);
+    }
+    if (!da) {
+        for (int i = 0; i < VIXFS_DELALLOC_FILES && !da; i++) {
+            if (!delalloc[i].count) {
+                da = &delalloc[i];
+            }
+        }
+        if (!da) {
+            if (vixfs_delalloc_flush_all() != 0) {
+                return NULL;
+            }
+            da = &delalloc[0];
+        }
+        da->inode = ino;
+    }
+
+    if (!da->pages[index / 8]) {
+        da->pages[index / 8] = (uint8_t*)pmm_alloc_block();
+        if (!da->pages[index / 8]) {
+            return NULL;
+        }
+    }
+    da->count++;
+    delalloc_reserved++;
+    uint8_t *data = da->pages[index / 8] + (index % 8) * VIXFS_BLOCK_SIZE;
+    memset(data, 0, VIXFS_BLOCK_SIZE);
+    return data;
+}
+
+// Файл укорачивается до new_blocks блоков: сначала хвост в памяти,
+// затем, если нужно, блоки на диске
+static int vixfs_file_truncate(vixfs_inode_t *inode, uint32_t new_blocks) {
+    vixfs_delalloc_t *da = vixfs_delalloc_find(inode - inodes);
+
+    vixfs_cluster_forget(inode - inodes);
+    uint32_t keep = new_blocks > inode->blocks ? new_blocks - inode->blocks : 0;
+
+    if (da && keep < da->count) {
+        vixfs_delalloc_trim(da, keep);
+    }
+    if (new_blocks < inode->blocks) {
+        return vixfs_truncate_blocks(inode, new_blocks);
+    }
+    return 0;
+}
+
+// ===== Сжатие =====
+//
+// Файл с VIXFS_INODE_COMPRESSED хранится независимыми кластерами по
+// VIXFS_CLUSTER_SIZE: чтение с любого места распаковывает только свой
+// кластер. Кластер занимает окно в VIXFS_CLUSTER_BLOCKS блоков файла —
+// сжатый лежит одним экстентом с VIXFS_EXTENT_COMPRESSED, несжимаемый
+// обычными экстентами. Кластеры запечатываются при сбросе отложенного
+// хвоста, поэтому inode->blocks всегда кратно окну.
+
+static int vixfs_cluster_alloc(void) {
+    if (!cluster_data) {
+        cluster_data = (uint8_t*)pmm_alloc_blocks(VIXFS_CLUSTER_SIZE / 4096);
+    }
+    if (!cluster_comp) {
+        cluster_comp = (uint8_t*)pmm_alloc_blocks(VIXFS_CLUSTER_SIZE / 4096);
+    }
+    return cluster_data && cluster_comp ? 0 : -1;
+}
+
+static void vixfs_cluster_forget(uint32_t inode) {
+    if (cluster_inode == inode) {
+        cluster_index = (uint32_t)-1;
+    }
+}
+
+// Запечатанный кластер index — в cluster_data
+static int vixfs_cluster_load(vixfs_inode_t *inode, uint32_t index) {
+    uint32_t file_block = index * VIXFS_CLUSTER_BLOCKS;
+    vixfs_extent_t e;
+
+    if (cluster_index == index && cluster_inode == (uint32_t)(inode - inodes)) {
+        return 0;
+    }
+    cluster_index = (uint32_t)-1;
+    if (vixfs_cluster_alloc() != 0 || vixfs_extent_lookup(inode, file_block, &e, NULL) != 0) {
+        return -1;
+    }
+
+    if (e.length & VIXFS_EXTENT_COMPRESSED) {
+        vixfs_cluster_header_t *hdr = (vixfs_cluster_header_t*)cluster_comp;
+        uint32_t stored = VIXFS_EXTENT_LENGTH(e.length);
+        int length = -1;
+
+        if (e.file_block != file_block || stored == 0 || stored >= VIXFS_CLUSTER_BLOCKS) {
+            terminal_writestring("Corrupted compressed cluster!\n");
+            return -1;
+        }
+        bcache_prefetch(backing_dev, e.start, stored);
+        if (vixfs_load(e.start, stored, cluster_comp) != 0) {
+            return -1;
+        }
+        if (hdr->comp_len <= stored * VIXFS_BLOCK_SIZE - sizeof(vixfs_cluster_header_t) &&
+            hdr->raw_len <= VIXFS_CLUSTER_SIZE) {
+            if (hdr->checksum != vixfs_cluster_csum(inode - inodes, index,
+                                                    cluster_comp + sizeof(vixfs_cluster_header_t),
+                                                    hdr->comp_len)) {
+                vixfs_csum_error("Compressed cluster");
+                return -1;
+            }
+            length = lz4_decompress(cluster_comp + sizeof(vixfs_cluster_header_t), hdr->comp_len,
+                                    cluster_data, VIXFS_CLUSTER_SIZE);
+        }
+        if (length < 0 || (uint32_t)length != hdr->raw_len) {
+            terminal_writestring("Corrupted compressed cluster!\n");
+            return -1;
+        }
+        cluster_len = length;
+    } else {
+        // Несжатый кластер: блоки до конца файла по обычному отображению
+        uint32_t bytes = index * VIXFS_CLUSTER_SIZE;
+        cluster_len = inode->size > bytes ? inode->size - bytes : 0;
+        if (cluster_len > VIXFS_CLUSTER_SIZE) {
+            cluster_len = VIXFS_CLUSTER_SIZE;
+        }
+        uint32_t count = (cluster_len + VIXFS_BLOCK_SIZE - 1) / VIXFS_BLOCK_SIZE;
+        for (uint32_t i = 0, run; i < count; i += run) {
+            uint32_t block = vixfs_map(inode, file_block + i, &run);
+            if (block == (uint32_t)-1) {
+                return -1;
+            }
+            if (run > count - i) {
+                run = count - i;
+            }
+            if (run > 1) {
+                bcache_prefetch(backing_dev, block, run);
+            }
+            if (vixfs_load(block, run, cluster_data + i * VIXFS_BLOCK_SIZE) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    memset(cluster_data + cluster_len, 0, VIXFS_CLUSTER_SIZE - cluster_len);
+    cluster_inode = inode - inodes;
+    cluster_index = index;
+    return 0;
+}
+
+// count блоков кластера из src: подряд со start или, если start == -1,
+// по отображению начиная с блока файла file_block
+static int vixfs_cluster_put(vixfs_inode_t *inode, uint32_t file_block, uint32_t start,
+                             const uint8_t *src, uint32_t count) {
+    uint32_t run = 0;
+    uint32_t block = start;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (start == (uint32_t)-1 && run == 0) {
+            block = vixfs_map(inode, file_block + i, &run);
+        }
+        bcache_buf_t *buf = block != (uint32_t)-1 ? bcache_get(backing_dev, block) : NULL;
+        if (!buf) {
+            return -1;
+        }
+        memcpy(buf->data, src + i * VIXFS_BLOCK_SIZE, VIXFS_BLOCK_SIZE);
+        bcache_mark_dirty(buf);
+        bcache_release(buf);
+        block++;
+        run--;
+    }
+    return 0;
+}
+
+// Кластер index из cluster_data (len байт, дальше нули) — на диск. Сжатым
+// он ложится, только если экономит хотя бы блок. Новый кластер дописывается
+// в конец файла; сжатый перезаписывается на месте или, если вырос,
+// переезжает; несжатый перезаписывается по своему отображению.
+static int vixfs_cluster_store(vixfs_inode_t *inode, uint32_t index, uint32_t len) {
+    vixfs_cluster_header_t *hdr = (vixfs_cluster_header_t*)cluster_comp;
+    uint32_t file_block = index * VIXFS_CLUSTER_BLOCKS;
+    uint32_t raw_blocks = (len + VIXFS_BLOCK_SIZE - 1) / VIXFS_BLOCK_SIZE;
+    uint32_t stored = raw_blocks;
+    uint32_t flag = 0;
+    vixfs_extent_t old;
+
+    cluster_inode = inode - inodes;
+    cluster_index = index;
+    cluster_len = len;
+
+    int sealed = file_block < inode->blocks;
+    if (sealed) {
+        if (vixfs_extent_lookup(inode, file_block, &old, NULL) != 0) {
+            return -1;
+        }
+        if (!(old.length & VIXFS_EXTENT_COMPRESSED)) {
+            return vixfs_cluster_put(inode, file_block, (uint32_t)-1, cluster_data, raw_blocks);
+        }
+    }
+
+    if (raw_blocks > 1) {
+        uint32_t cap = (raw_blocks - 1) * VIXFS_BLOCK_SIZE - sizeof(vixfs_cluster_header_t);
+        uint32_t comp_len = lz4_compress(cluster_data, len,
+                                         cluster_comp + sizeof(vixfs_cluster_header_t), cap);
+        if (comp_len) {
+            uint32_t used = sizeof(vixfs_cluster_header_t) + comp_len;
+            hdr->comp_len = comp_len;
+            hdr->raw_len = len;
+            hdr->checksum = vixfs_cluster_csum(inode - inodes, index,
+                                               cluster_comp + sizeof(vixfs_cluster_header_t),
+                                               comp_len);
+            stored = (used + VIXFS_BLOCK_SIZE - 1) / VIXFS_BLOCK_SIZE;
+            memset(cluster_comp + used, 0, stored * VIXFS_BLOCK_SIZE - used);
+            flag = VIXFS_EXTENT_COMPRESSED;
+        }
+    }
+    const uint8_t *src = flag ? cluster_comp : cluster_data;
+
+    if (sealed) {
+        uint32_t old_stored = VIXFS_EXTENT_LENGTH(old.length);
+        uint32_t start = old.start;
+        if (stored > old_stored) {
+            uint32_t got = vixfs_alloc_extent(vixfs_goal(inode), stored, &start);
+            if (got != stored) {
+                if (got) {
+                    vixfs_free_extent(start, got);
+                }
+                terminal_writestring("No contiguous space for cluster!\n");
+                return -1;
+            }
+        }
+        vixfs_extent_t entry = { file_block, start, stored | flag };
+        if (vixfs_cluster_put(inode, file_block, start, src, stored) != 0 ||
+            vixfs_extent_lookup(inode, file_block, &old, &entry) != 0) {
+            return -1;
+        }
+        if (start != old.start) {
+            vixfs_free_extent(old.start, old_stored);
+        } else if (stored < old_stored) {
+            vixfs_free_extent(start + stored, old_stored - stored);
+        }
+        return 0;
+    }
+
+    if (flag) {
+        uint32_t start;
+        uint32_t got = vixfs_alloc_extent(vixfs_goal(inode), stored, &start);
+        if (got != stored || vixfs_extent_append(inode, file_block, start, stored | flag) != 0) {
+            if (got) {
+                vixfs_free_extent(start, got);
+            }
+            return -1;
+        }
+        inode->blocks = file_block + VIXFS_CLUSTER_BLOCKS;
+        return vixfs_cluster_put(inode, file_block, start, src, stored);
+    }
+    if (vixfs_extend(inode, file_block + stored) != 0) {
+        return -1;
+    }
+    inode->blocks = file_block + VIXFS_CLUSTER_BLOCKS;
+    return vixfs_cluster_put(inode, file_block, (uint32_t)-1, src, stored);
+}
+
+// Хвост сжатого файла запечатывается кластер за кластером
+static int vixfs_cluster_flush(vixfs_delalloc_t *da) {
+    vixfs_inode_t *inode = &inodes[da->inode];
+    uint32_t first = inode->blocks;
+    uint32_t count = da->count;
+    int result = vixfs_cluster_alloc();
+
+    delalloc_reserved -= count;
+    da->count = 0;
+    for (uint32_t done = 0; done < count && result == 0; done += VIXFS_CLUSTER_BLOCKS) {
+        uint32_t n = count - done < VIXFS_CLUSTER_BLOCKS ? count - done : VIXFS_CLUSTER_BLOCKS;
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t index = done + i;
+            memcpy(cluster_data + i * VIXFS_BLOCK_SIZE,
+                   da->pages[index / 8] + (index % 8) * VIXFS_BLOCK_SIZE, VIXFS_BLOCK_SIZE);
+        }
+        memset(cluster_data + n * VIXFS_BLOCK_SIZE, 0, VIXFS_CLUSTER_SIZE - n * VIXFS_BLOCK_SIZE);
+        result = vixfs_cluster_store(inode, (first + done) / VIXFS_CLUSTER_BLOCKS,
+                                     n * VIXFS_BLOCK_SIZE);
+    }
+    if (result != 0) {
+        terminal_writestring("No space for delayed blocks, data lost!\n");
+        if (inode->size > inode->blocks * VIXFS_BLOCK_SIZE) {
+            inode->size = inode->blocks * VIXFS_BLOCK_SIZE;
+        }
+        cluster_index = (uint32_t)-1;
+    }
+
+    for (uint32_t i = 0; i < VIXFS_DELALLOC_PAGES && da->pages[i]; i++) {
+        pmm_free_block(da->pages[i]);
+        da->pages[i] = NULL;
+    }
+    vixfs_mark_inode(da->inode);
+    return result;
+}
+
+// Последний неполный кластер возвращается в отложенный хвост: дописывания
+// копятся в памяти, а не пересжимают кластер каждый раз
+static int vixfs_cluster_unseal(vixfs_inode_t *inode) {
+    uint32_t index = inode->blocks / VIXFS_CLUSTER_BLOCKS - 1;
+    uint32_t file_block = index * VIXFS_CLUSTER_BLOCKS;
+    uint32_t count = (inode->size - index * VIXFS_CLUSTER_SIZE + VIXFS_BLOCK_SIZE - 1) /
+                     VIXFS_BLOCK_SIZE;
+
+    if (!vixfs_delalloc_fits(count)) {
+        terminal_writestring("No free blocks!\n");
+        return -1;
+    }
+    // Слот хвоста занимаем заранее: сброс чужих хвостов затер бы cluster_data
+    int slot = 0;
+    for (int i = 0; i < VIXFS_DELALLOC_FILES; i++) {
+        slot |= delalloc[i].count == 0;
+    }
+    if ((!slot && vixfs_delalloc_flush_all() != 0) || vixfs_cluster_load(inode, index) != 0 ||
+        vixfs_file_truncate(inode, file_block) != 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t *dst = vixfs_delalloc_block(inode, file_block + i, 1);
+        if (!dst) {
+            return -1;
+        }
+        memcpy(dst, cluster_data + i * VIXFS_BLOCK_SIZE, VIXFS_BLOCK_SIZE);
+    }
+    return 0;
+}
+
+// Запись в сжатый файл: запечатанные кластеры пересжимаются целиком,
+// новые данные копятся в отложенном хвосте
+static int vixfs_cluster_write(vixfs_inode_t *inode, const uint8_t *data,
+                               uint32_t size, uint32_t offset) {
+    uint32_t end = offset + size;
+    uint32_t pos = offset;
+
+    if (end > inode->size && inode->size < inode->blocks * VIXFS_BLOCK_SIZE &&
+        vixfs_cluster_unseal(inode) != 0) {
+        terminal_writestring("I/O error while writing!\n");
+        return -1;
+    }
+
+    while (pos < end && pos / VIXFS_BLOCK_SIZE < inode->blocks) {
+        uint32_t index = pos / VIXFS_CLUSTER_SIZE;
+        uint32_t skip = pos % VIXFS_CLUSTER_SIZE;
+        uint32_t chunk = VIXFS_CLUSTER_SIZE - skip;
+        if (chunk > end - pos) {
+            chunk = end - pos;
+        }
+
+        vixfs_extent_t e;
+        int result = vixfs_extent_lookup(inode, index * VIXFS_CLUSTER_BLOCKS, &e, NULL);
+        if (result == 0 && !(e.length & VIXFS_EXTENT_COMPRESSED)) {
+            // Несжатый кластер пишется на месте поблочно
+            vixfs_cluster_forget(inode - inodes);
+            if (vixfs_write_blocks(inode, data + (pos - offset), chunk, pos) < 0) {
+                return -1;
+            }
+        } else if (result == 0 && vixfs_cluster_load(inode, index) == 0) {
+            memcpy(cluster_data + skip, data + (pos - offset), chunk);
+            uint32_t len = skip + chunk > cluster_len ? skip + chunk : cluster_len;
+            result = vixfs_cluster_store(inode, index, len);
+        } else {
+            result = -1;
+        }
+        if (result != 0) {
+            cluster_index = (uint32_t)-1;
+            terminal_writestring("I/O error while writing!\n");
+            return -1;
+        }
+        pos += chunk;
+    }
+
+    // Хвост пишется по кластеру за раз: заполненный хвост сбрасывается
+    // только на границе кластера, и записываемые блоки остаются в памяти
+    while (pos < end) {
+        uint32_t chunk = VIXFS_CLUSTER_SIZE - pos % VIXFS_CLUSTER_SIZE;
+        if (chunk > end - pos) {
+            chunk = end - pos;
+        }
+        if (vixfs_write_blocks(inode, data + (pos - offset), chunk, pos) < 0) {
+            return -1;
+        }
+        pos += chunk;
+    }
+    if (end > inode->size && vixfs_write_blocks(inode, NULL, 0, end) < 0) {
+        return -1;
+    }
+    return size;
+}
+
+// Укорачивание внутри запечатанной части: кластеры за новым концом
+// освобождаются целиком, хвост последнего обнуляется и пересжимается
+static int vixfs_cluster_truncate(vixfs_inode_t *inode, uint32_t new_size) {
+    uint32_t index = new_size / VIXFS_CLUSTER_SIZE;
+    uint32_t skip = new_size % VIXFS_CLUSTER_SIZE;
+
+    if (skip && vixfs_cluster_load(inode, index) != 0) {
+        return -1;
+    }
+    uint32_t keep = (index + (skip ? 1 : 0)) * VIXFS_CLUSTER_BLOCKS;
+    if (vixfs_file_truncate(inode, keep) != 0) {
+        return -1;
+    }
+    inode->size = new_size;
+    if (!skip) {
+        return 0;
+    }
+    memset(cluster_data + skip, 0, VIXFS_CLUSTER_SIZE - skip);
+    if (vixfs_cluster_store(inode, index, skip) != 0) {
+        cluster_index = (uint32_t)-1;
+        return -1;
+    }
+    return 0;
+}
+
+// Включить или выключить сжатие. Уже записанные данные не пересжимаются,
+// поэтому у файла это возможно, только пока он пуст; каталог передает
+// флаг новым файлам и подкаталогам.
+int vixfs_set_compressed(const char* path, int on) {
+    if (vixfs_check_mounted() != 0) {
+        return -1;
+    }
+
+    vixfs_inode_t *inode = vixfs_find_file(path);
+    if (inode == NULL) {
+        terminal_writestring("File not found!\n");
+        return -1;
+    }
+    uint32_t inode_num = inode - inodes;
+    if (inode->mode == VIXFS_MODE_FILE &&
+        (inode->size || inode->blocks || vixfs_delalloc_find(inode_num))) {
+        terminal_writestring("File is not empty!\n");
+        return -1;
+    }
+    if (vixfs_journal_begin(0) != 0) {
+        return -1;
+    }
+
+    if (on) {
+        inode->flags |= VIXFS_INODE_COMPRESSED;
+    } else {
+        inode->flags &= ~VIXFS_INODE_COMPRESSED;
+    }
+    vixfs_mark_inode(inode_num);
+    vixfs_journal_stop();
+    return 0;
+}
+
+// ===== Каталоги =====
+
+// Путь до листа: индексные узлы от корня (buf[0]) и лист (buf[levels])
+typedef struct {
+    bcache_buf_t *buf[VIXFS_DX_MAX_DEPTH + 2];
+    int slot[VIXFS_DX_MAX_DEPTH + 1];   // Выбранная запись в индексном узле
+    int levels;                         // Число индексных узлов на пути
+} vixfs_dx_path_t;
+
+#define DX_HDR(buf)     ((vixfs_dx_header_t*)(buf)->data)
+#define DX_ENTRIES(buf) ((vixfs_dx_entry_t*)((buf)->data + sizeof(vixfs_dx_header_t)))
+#define DL_HDR(buf)     ((vixfs_dirleaf_header_t*)(buf)->data)
+#define DL_ENTRY(buf, offset) \
+    ((vixfs_direntry_t*)((buf)->data + sizeof(vixfs_dirleaf_header_t) + (offset)))
+
+// FNV-1a
+static uint32_t vixfs_name_hash(const char *name, uint32_t len) {
+    uint32_t hash = 2166136261u;
+
+    for (uint32_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bcache_buf_t *vixfs_dir_read(vixfs_inode_t *dir, uint32_t lblock) {
+    uint32_t run;
+    uint32_t block = vixfs_map(dir, lblock, &run);
+    bcache_buf_t *buf = block != (uint32_t)-1 ? bcache_read(backing_dev, block) : NULL;
+
+    if (buf && vixfs_block_verify(buf, "Directory block") != 0) {
+        bcache_release(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+// Новый обнуленный блок в конце файла каталога; *lblock — его номер в файле
+static bcache_buf_t *vixfs_dir_grow(vixfs_inode_t *dir, uint32_t *lblock) {
+    uint32_t run;
+
+    if (vixfs_extend(dir, dir->blocks + 1) != 0) {
+        return NULL;
+    }
+    *lblock = dir->blocks - 1;
+    dir->size = dir->blocks * VIXFS_BLOCK_SIZE;
+
+    uint32_t block = vixfs_map(dir, *lblock, &run);
+    bcache_buf_t *buf = block != (uint32_t)-1 ? bcache_get(backing_dev, block) : NULL;
+    if (!buf) {
+        vixfs_truncate_blocks(dir, *lblock);
+        dir->size = dir->blocks * VIXFS_BLOCK_SIZE;
+        return NULL;
+    }
+    memset(buf->data, 0, VIXFS_BLOCK_SIZE);
+    return buf;
+}
+
+// Пустой каталог: корень индекса с одной записью и пустой лист
+static int vixfs_dir_init(vixfs_inode_t *dir) {
+    uint32_t root_block, leaf_block;
+
+    bcache_buf_t *root = vixfs_dir_grow(dir, &root_block);
+    if (!root) {
+        return -1;
+    }
+    bcache_buf_t *leaf = vixfs_dir_grow(dir, &leaf_block);
+    if (!leaf) {
+        bcache_release(root);
+        vixfs_truncate_blocks(dir, 0);
+        dir->size = 0;
+        return -1;
+    }
+
+    DX_HDR(root)->magic = VIXFS_DX_MAGIC;
+    DX_HDR(root)->count = 1;
+    DX_ENTRIES(root)[0].hash = 0;
+    DX_ENTRIES(root)[0].block = leaf_block;
+    DL_HDR(leaf)->magic = VIXFS_DL_MAGIC;
+
+    vixfs_journal_dirty(root);
+    vixfs_journal_dirty(leaf);
+    bcache_release(root);
+    bcache_release(leaf);
+    return 0;
+}
+
+static void vixfs_dx_release(vixfs_dx_path_t *path) {
+    for (int i = 0; i <= path->levels; i++) {
+        if (path->buf[i]) {
+            bcache_release(path->buf[i]);
+        }
+    }
+}
+
+// Спуск по индексу к листу, в котором должно лежать имя с этим хэшем
+static int vixfs_dx_find(vixfs_inode_t *dir, uint32_t hash, vixfs_dx_path_t *path) {
+    uint32_t lblock = 0;
+    int depth = -1;
+
+    memset(path, 0, sizeof(*path));
+    for (;;) {
+        bcache_buf_t *buf = vixfs_dir_read(dir, lblock);
+        path->buf[path->levels] = buf;
+        if (!buf) {
+            break;
+        }
+
+        if (depth == 0) {
+            if (DL_HDR(buf)->magic != VIXFS_DL_MAGIC ||
+                DL_HDR(buf)->used > VIXFS_DIRLEAF_SPACE) {
+                break;
+            }
+            return 0;
+        }
+
+        vixfs_dx_header_t *hdr = DX_HDR(buf);
+        if (hdr->magic != VIXFS_DX_MAGIC || hdr->count == 0 || hdr->count > VIXFS_DX_ENTRIES ||
+            hdr->depth > VIXFS_DX_MAX_DEPTH || (depth > 0 && hdr->depth != depth - 1)) {
+            break;
+        }
+        depth = hdr->depth;
+
+        // Последняя запись с хэшем не больше искомого (у первой он 0)
+        vixfs_dx_entry_t *entries = DX_ENTRIES(buf);
+        int lo = 1, hi = hdr->count - 1, found = 0;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            if (entries[mid].hash <= hash) {
+                found = mid;
+                lo = mid + 1;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        path->slot[path->levels] = found;
+        lblock = entries[found].block;
+        path->levels++;
+    }
+
+    if (path->buf[path->levels]) {
+        terminal_writestring("Corrupted directory index!\n");
+    }
+    vixfs_dx_release(path);
+    return -1;
+}
+
+// Смещение записи с этим именем в листе или -1
+static int vixfs_leaf_find(bcache_buf_t *leaf, uint32_t hash, const char *name, uint32_t len) {
+    uint32_t offset = 0;
+
+    for (uint16_t i = 0; i < DL_HDR(leaf)->count; i++) {
+        vixfs_direntry_t *e = DL_ENTRY(leaf, offset);
+        if (e->hash == hash && e->name_len == len &&
+            strncmp((const char*)e->name, name, len) == 0) {
+            return offset;
+        }
+        offset += VIXFS_DIRENT_SIZE(e->name_len);
+    }
+    return -1;
+}
+
+static uint32_t vixfs_dir_lookup(vixfs_inode_t *dir, const char *name, uint32_t len) {
+    vixfs_dx_path_t path;
+    uint32_t hash = vixfs_name_hash(name, len);
+    uint32_t inode = (uint32_t)-1;
+
+    if (vixfs_dx_find(dir, hash, &path) != 0) {
+        return inode;
+    }
+    int offset = vixfs_leaf_find(path.buf[path.levels], hash, name, len);
+    if (offset >= 0) {
+        inode = DL_ENTRY(path.buf[path.levels], offset)->inode;
+    }
+    vixfs_dx_release(&path);
+    return inode < VIXFS_MAX_FILES ? inode : (uint32_t)-1;
+}
+
+// Вставка записи в индексный узел сразу за записью slot
+static void vixfs_dx_insert(bcache_buf_t *node, int slot, uint32_t hash, uint32_t block) {
+    vixfs_dx_entry_t *entries = DX_ENTRIES(node);
+    vixfs_dx_header_t *hdr = DX_HDR(node);
+
+    for (int i = hdr->count; i > slot + 1; i--) {
+        entries[i] = entries[i - 1];
+    }
+    entries[slot + 1].hash = hash;
+    entries[slot + 1].block = block;
+    hdr->count++;
+    vixfs_journal_dirty(node);
+}
+
+// Лист делится по хэшу пополам: верхняя половина уходит в новый лист.
+// Записи с одинаковым хэшем остаются вместе, иначе их нельзя было бы найти.
+static int vixfs_split_leaf(vixfs_inode_t *dir, vixfs_dx_path_t *path) {
+    bcache_buf_t *leaf = path->buf[path->levels];
+    uint16_t count = DL_HDR(leaf)->count;
+    uint16_t order[VIXFS_DIRLEAF_SPACE / 12];
+    uint8_t copy[VIXFS_BLOCK_SIZE];
+    uint32_t offset = 0;
+
+    memcpy(copy, leaf->data, VIXFS_BLOCK_SIZE);
+    for (uint16_t i = 0; i < count; i++) {
+        order[i] = offset;
+        offset += VIXFS_DIRENT_SIZE(DL_ENTRY(leaf, offset)->name_len);
+    }
+
+    // Сортировка смещений записей по хэшу (записей в листе немного)
+    for (uint16_t i = 1; i < count; i++) {
+        uint16_t cur = order[i];
+        int j = i - 1;
+        while (j >= 0 && DL_ENTRY(leaf, order[j])->hash > DL_ENTRY(leaf, cur)->hash) {
+            order[j + 1] = order[j];
+            j--;
+        }
+        order[j + 1] = cur;
+    }
+
+    uint16_t mid = count / 2;
+    while (mid < count && DL_ENTRY(leaf, order[mid])->hash == DL_ENTRY(leaf, order[mid - 1])->hash) {
+        mid++;
+    }
+    if (mid == count) {
+        mid = count / 2;
+        while (mid > 0 && DL_ENTRY(leaf, order[mid])->hash == DL_ENTRY(leaf, order[mid - 1])->hash) {
+            mid--;
+        }
+    }
+    if (mid == 0) {
+        terminal_writestring("Too many names with the same hash!\n");
+        return -1;
+    }
+    uint32_t split_hash = DL_ENTRY(leaf, order[mid])->hash;
+
+    uint32_t lblock;
+    bcache_buf_t *sibling = vixfs_dir_grow(dir, &lblock);
+    if (!sibling) {
+        return -1;
+    }
+    DL_HDR(sibling)->magic = VIXFS_DL_MAGIC;
+
+    // Обе половины собираются заново из копии исходного листа
+    DL_HDR(leaf)->count = 0;
+    DL_HDR(leaf)->used = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        vixfs_direntry_t *e = (vixfs_direntry_t*)(copy + sizeof(vixfs_dirleaf_header_t) + order[i]);
+        bcache_buf_t *dst = i < mid ? leaf : sibling;
+        uint32_t size = VIXFS_DIRENT_SIZE(e->name_len);
+        memcpy(DL_ENTRY(dst, DL_HDR(dst)->used), e, size);
+        DL_HDR(dst)->used += size;
+        DL_HDR(dst)->count++;
+    }
+    vixfs_journal_dirty(leaf);
+    vixfs_journal_dirty(sibling);
+    bcache_release(sibling);
+
+    int parent = path->levels - 1;
+    vixfs_dx_insert(path->buf[parent], path->slot[parent], split_hash, lblock);
+    return 0;
+}
+
+// Индексный узел (не корень) делится пополам
+static int vixfs_split_index(vixfs_inode_t *dir, vixfs_dx_path_t *path, int level) {
+    bcache_buf_t *node = path->buf[level];
+    uint16_t count = DX_HDR(node)->count;
+    uint16_t mid = count / 2;
+    uint32_t lblock;
+
+    bcache_buf_t *sibling = vixfs_dir_grow(dir, &lblock);
+    if (!sibling) {
+        return -1;
+    }
+    DX_HDR(sibling)->magic = VIXFS_DX_MAGIC;
+    DX_HDR(sibling)->count = count - mid;
+    DX_HDR(sibling)->depth = DX_HDR(node)->depth;
+    memcpy(DX_ENTRIES(sibling), &DX_ENTRIES(node)[mid], (count - mid) * sizeof(vixfs_dx_entry_t));
+    DX_HDR(node)->count = mid;
+    vixfs_journal_dirty(node);
+    vixfs_journal_dirty(sibling);
+    bcache_release(sibling);
+
+    vixfs_dx_insert(path->buf[level - 1], path->slot[level - 1], DX_ENTRIES(node)[mid].hash, lblock);
+    return 0;
+}
+
+// Корень полон: его записи уходят в новый узел, индекс растет на уровень
+static int vixfs_grow_dx_root(vixfs_inode_t *dir, vixfs_dx_path_t *path) {
+    bcache_buf_t *root = path->buf[0];
+    uint32_t lblock;
+
+    if (DX_HDR(root)->depth >= VIXFS_DX_MAX_DEPTH) {
+        terminal_writestring("Directory index is full!\n");
+        return -1;
+    }
+    bcache_buf_t *child = vixfs_dir_grow(dir, &lblock);
+    if (!child) {
+        return -1;
+    }
+    memcpy(child->data, root->data, VIXFS_BLOCK_SIZE);
+    vixfs_journal_dirty(child);
+    bcache_release(child);
+
+    DX_HDR(root)->count = 1;
+    DX_HDR(root)->depth++;
+    DX_ENTRIES(root)[0].hash = 0;
+    DX_ENTRIES(root)[0].block = lblock;
+    vixfs_journal_dirty(root);
+    return 0;
+}
+
+static int vixfs_dir_add(vixfs_inode_t *dir, const char *name, uint32_t len, uint32_t inode) {
+    uint32_t hash = vixfs_name_hash(name, len);
+    uint32_t size = VIXFS_DIRENT_SIZE(len);
+
+    // Каждая попытка либо вставляет запись, либо делит один узел
+    for (int attempt = 0; attempt < 2 * (VIXFS_DX_MAX_DEPTH + 2); attempt++) {
+        vixfs_dx_path_t path;
+        if (vixfs_dx_find(dir, hash, &path) != 0) {
+            return -1;
+        }
+
+        bcache_buf_t *leaf = path.buf[path.levels];
+        if (DL_HDR(leaf)->used + size <= VIXFS_DIRLEAF_SPACE) {
+            vixfs_direntry_t *e = DL_ENTRY(leaf, DL_HDR(leaf)->used);
+            e->hash = hash;
+            e->inode = inode;
+            e->name_len = len;
+            memcpy(e->name, name, len);
+            DL_HDR(leaf)->used += size;
+            DL_HDR(leaf)->count++;
+            vixfs_journal_dirty(leaf);
+            vixfs_dx_release(&path);
+            return 0;
+        }
+
+        // Делим самый нижний узел, у родителя которого есть место
+        int level = path.levels;
+        while (level > 0 && DX_HDR(path.buf[level - 1])->count == VIXFS_DX_ENTRIES) {
+            level--;
+        }
+        int result;
+        if (level == 0) {
+            result = vixfs_grow_dx_root(dir, &path);
+        } else if (level == path.levels) {
+            result = vixfs_split_leaf(dir, &path);
+        } else {
+            result = vixfs_split_index(dir, &path, level);
+        }
+        vixfs_dx_release(&path);
+        if (result != 0) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+static int vixfs_dir_remove(vixfs_inode_t *dir, const char *name, uint32_t len) {
+    vixfs_dx_path_t path;
+    uint32_t hash = vixfs_name_hash(name, len);
+
+    if (vixfs_dx_find(dir, hash, &path) != 0) {
+        return -1;
+    }
+    bcache_buf_t *leaf = path.buf[path.levels];
+    int offset = vixfs_leaf_find(leaf, hash, name, len);
+    if (offset >= 0) {
+        // Хвост листа сдвигается на место удаленной записи
+        uint32_t size = VIXFS_DIRENT_SIZE(DL_ENTRY(leaf, offset)->name_len);
+        uint8_t *dst = (uint8_t*)DL_ENTRY(leaf, offset);
+        for (uint32_t i = offset + size; i < DL_HDR(leaf)->used; i++) {
+            dst[i - offset - size] = dst[i - offset];
+        }
+        DL_HDR(leaf)->used -= size;
+        DL_HDR(leaf)->count--;
+        vixfs_journal_dirty(leaf);
+    }
+    vixfs_dx_release(&path);
+    return offset >= 0 ? 0 : -1;
+}
+
+// Обход всех записей каталога: листья — блоки с сигнатурой листа
+typedef int (*vixfs_dir_visitor_t)(vixfs_direntry_t *entry, void *ctx);
+
+static int vixfs_dir_iterate(vixfs_inode_t *dir, vixfs_dir_visitor_t visit, void *ctx) {
+    for (uint32_t lblock = 1; lblock < dir->blocks; lblock++) {
+        bcache_buf_t *buf = vixfs_dir_read(dir, lblock);
+        if (!buf) {
+            return -1;
+        }
+        if (DL_HDR(buf)->magic == VIXFS_DL_MAGIC) {
+            uint32_t offset = 0;
+            for (uint16_t i = 0; i < DL_HDR(buf)->count; i++) {
+                vixfs_direntry_t *e = DL_ENTRY(buf, offset);
+                if (visit(e, ctx) != 0) {
+                    bcache_release(buf);
+                    return 1;
+                }
+                offset += VIXFS_DIRENT_SIZE(e->name_len);
+            }
+        }
+        bcache_release(buf);
+    }
+    return 0;
+}
+
+static int vixfs_visit_any(vixfs_direntry_t *entry, void *ctx) {
+    (void)entry;
+    (void)ctx;
+    return 1;
+}
+
+// Следующая компонента пути: пропускает '/', в *len — длина компоненты
+static const char *vixfs_path_next(const char *path, uint32_t *len) {
+    while (*path == '/') {
+        path++;
+    }
+    const char *end = path;
+    while (*end && *end != '/') {
+        end++;
+    }
+    *len = end - path;
+    return path;
+}
+
+// Инод по пути или -1. В *parent — каталог, где лежит (или лег бы)
+// последний элемент пути, в *name/*name_len — сам этот элемент.
+static uint32_t vixfs_lookup_path(const char *path, uint32_t *parent,
+                                  const char **name, uint32_t *name_len) {
+    uint32_t inode = superblock.root_inode;
+    uint32_t dir = (uint32_t)-1;
+    uint32_t len;
+    const char *comp = vixfs_path_next(path, &len);
+
+    *name = NULL;
+    *name_len = 0;
+    while (len > 0) {
+        uint32_t next_len;
+        const char *next = vixfs_path_next(comp + len, &next_len);
+
+        dir = inode;
+        if (inodes[dir].mode != VIXFS_MODE_DIR || len >= VIXFS_MAX_FILENAME) {
+            inode = (uint32_t)-1;
+        } else {
+            inode = vixfs_dir_lookup(&inodes[dir], comp, len);
+        }
+        if (next_len == 0) {
+            *name = comp;
+            *name_len = len;
+            if (inodes[dir].mode != VIXFS_MODE_DIR) {
+                dir = (uint32_t)-1;
+            }
+            break;
+        }
+        if (inode == (uint32_t)-1) {
+            dir = (uint32_t)-1;       // Промежуточного каталога нет
+            break;
+        }
+        comp = next;
+        len = next_len;
+    }
+
+    *parent = dir;
+    return inode;
+}
+
+// Новый файл или каталог
+static int vixfs_make_node(const char *path, uint32_t mode) {
+    uint32_t parent, len;
+    const char *name;
+
+    if (vixfs_check_mounted() != 0) {
+        return -1;
+    }
+
+    uint32_t existing = vixfs_lookup_path(path, &parent, &name, &len);
+    if (!name) {
+        terminal_writestring("Invalid name!\n");
+        return -1;
+    }
+    if (len >= VIXFS_MAX_FILENAME) {
+        terminal_writestring("Filename too long!\n");
+        return -1;
+    }
+    // Проверяем, не существует ли уже файл с таким именем
+    if (existing != (uint32_t)-1) {
+        terminal_writestring("File already exists!\n");
+        return -1;
+    }
+    if (parent == (uint32_t)-1) {
+        terminal_writestring("Directory not found!\n");
+        return -1;
+    }
+
+    if (vixfs_journal_begin(1) != 0) {
+        return -1;
+    }
+
+    // Ищем свободный инод
+    uint32_t inode_num = vixfs_alloc_inode();
+    if (inode_num == (uint32_t)-1) {
+        char buf[16];
+        itoa(VIXFS_MAX_FILES, buf, 10);
+        terminal_writestring("No free inodes: ViXFS holds at most ");
+        terminal_writestring(buf);
+        terminal_writestring(" files and directories!\n");
+        return -1;
+    }
+
+    // Инициализируем инод
+    vixfs_inode_t* inode = &inodes[inode_num];
+    inode->mode = mode;
+    inode->size = 0;
+    inode->blocks = 0;
+    inode->extent_header.magic = VIXFS_EXTENT_MAGIC;
+    inode->extent_header.count = 0;
+    inode->extent_header.max = VIXFS_INODE_EXTENTS;
+    inode->extent_header.depth = 0;
+    inode->flags = inodes[parent].flags & VIXFS_INODE_COMPRESSED;
+    inode->created_time = 0;
+    inode->modified_time = 0;
+
+    if ((mode == VIXFS_MODE_DIR && vixfs_dir_init(inode) != 0) ||
+        vixfs_dir_add(&inodes[parent], name, len, inode_num) != 0) {
+        terminal_writestring("Cannot add directory entry!\n");
+        vixfs_truncate_blocks(inode, 0);
+        vixfs_free_inode(inode_num);
+        vixfs_mark_inode(parent);
+        vixfs_journal_stop();
+        return -1;
+    }
+    vixfs_mark_inode(inode_num);
+    vixfs_mark_inode(parent);
+    vixfs_journal_stop();
+    return 0;
+}
+
+// Создание файла
+int vixfs_create(const char* filename) {
+    if (vixfs_make_node(filename, VIXFS_MODE_FILE) != 0) {
+        return -1;
+    }
+
+    terminal_writestring("File created: ");
+    terminal_writestring(filename);
+    terminal_writestring("\n");
+
+    return 0;
+}
+
+// Создание каталога
+int vixfs_mkdir(const char* path) {
+    if (vixfs_make_node(path, VIXFS_MODE_DIR) != 0) {
+        return -1;
+    }
+
+    terminal_writestring("Directory created: ");
+    terminal_writestring(path);
+    terminal_writestring("\n");
+
+    return 0;
+}
+
+// Удаление файла или пустого каталога
+int vixfs_delete(const char* filename) {
+    uint32_t parent, len;
+    const char *name;
+
+    if (vixfs_check_mounted() != 0) {
+        return -1;
+    }
+
+    uint32_t inode_num = vixfs_lookup_path(filename, &parent, &name, &len);
+    if (inode_num == (uint32_t)-1) {
+        terminal_writestring("File not found!\n");
+        return -1;
+    }
+    if (parent == (uint32_t)-1) {
+        terminal_writestring("Cannot delete the root directory!\n");
+        return -1;
+    }
+
+    if (vixfs_inode_open(inode_num)) {
+        terminal_writestring("File is open!\n");
+        return -1;
+    }
+
+    vixfs_inode_t* inode = &inodes[inode_num];
+    if (inode->mode == VIXFS_MODE_DIR && vixfs_dir_iterate(inode, vixfs_visit_any, NULL) != 0) {
+        terminal_writestring("Directory not empty!\n");
+        return -1;
+    }
+
+    // Большой файл сначала укорачивается шагами, чтобы само удаление
+    // уместилось в одну операцию
+    uint32_t step = VIXFS_OP_BLOCKS * VIXFS_BLOCK_SIZE;
+    if (inode->mode == VIXFS_MODE_FILE && inode->size > step &&
+        vixfs_resize_op(inode, step) != 0) {
+        terminal_writestring("I/O error while deleting!\n");
+        return -1;
+    }
+    if (vixfs_journal_begin(0) != 0) {
+        return -1;
+    }
+
+    if (vixfs_dir_remove(&inodes[parent], name, len) != 0) {
+        terminal_writestring("Cannot remove directory entry!\n");
+        return -1;
+    }
+
+    // Освобождаем блоки файла и узлы дерева экстентов
+    if (vixfs_file_truncate(inode, 0) != 0) {
+        terminal_writestring("Warning: extent tree damaged, blocks leaked\n");
+    }
+
+    // Освобождаем инод
+    vixfs_free_inode(inode_num);
+    vixfs_journal_stop();
+
+    terminal_writestring("File deleted: ");
+    terminal_writestring(filename);
+    terminal_writestring("\n");
+
+    return 0;
+}
+
+// ===== Чтение и запись по смещению =====
+
+// Данные файла с позиции offset; возвращает прочитанное (0 — конец файла)
+static int vixfs_file_read(vixfs_inode_t *inode, uint8_t *dst, uint32_t size, uint32_t offset) {
+    if (offset >= inode->size) {
+        return 0;
+    }
+    uint32_t length = size > inode->size - offset ? inode->size - offset : size;
+
+    // Маленький файл целиком в иноде: ни одного обращения к блокам
+    if (inode->flags & VIXFS_INODE_INLINE) {
+        memcpy(dst, inode->inline_data + offset, length);
+        return length;
+    }
+
+    uint32_t run = 0;
+    uint32_t block = 0;
+    for (uint32_t done = 0; done < length; ) {
+        uint32_t pos = offset + done;
+        uint32_t file_block = pos / VIXFS_BLOCK_SIZE;
+        uint32_t skip = pos % VIXFS_BLOCK_SIZE;
+        uint32_t chunk = VIXFS_BLOCK_SIZE - skip;
+        if (chunk > length - done) {
+            chunk = length - done;
+        }
+
+        // Хвост, еще не получивший места на диске
+        if (file_block >= inode->blocks) {
+            uint8_t *tail = vixfs_delalloc_block(inode, file_block, 0);
+            if (!tail) {
+                terminal_writestring("I/O error while reading!\n");
+                return -1;
+            }
+            memcpy(dst + done, tail + skip, chunk);
+            done += chunk;
+            continue;
+        }
+
+        // Сжатый кластер распаковывается целиком, дальше чтение из памяти
+        if (inode->flags & VIXFS_INODE_COMPRESSED) {
+            skip = pos % VIXFS_CLUSTER_SIZE;
+            chunk = VIXFS_CLUSTER_SIZE - skip;
+            if (chunk > length - done) {
+                chunk = length - done;
+            }
+            if (vixfs_cluster_load(inode, pos / VIXFS_CLUSTER_SIZE) != 0) {
+                terminal_writestring("I/O error while reading!\n");
+                return -1;
+            }
+            memcpy(dst + done, cluster_data + skip, chunk);
+            done += chunk;
+            continue;
+        }
+
+        // На границе экстента весь его нужный кусок запрашивается разом
+        if (run == 0) {
+            uint32_t last = (offset + length - 1) / VIXFS_BLOCK_SIZE;
+            block = vixfs_map(inode, file_block, &run);
+            if (block == (uint32_t)-1) {
+                terminal_writestring("I/O error while reading!\n");
+                return -1;
+            }
+            if (run > last - file_block + 1) {
+                run = last - file_block + 1;
+            }
+            if (run > 1) {
+                bcache_prefetch(backing_dev, block, run);
+            }
+        }
+
+        bcache_buf_t *buf = bcache_read(backing_dev, block);
+        if (!buf) {
+            terminal_writestring("I/O error while reading!\n");
+            return -1;
+        }
+        memcpy(dst + done, buf->data + skip, chunk);
+        bcache_release(buf);
+        done += chunk;
+        block++;
+        run--;
+    }
+
+    return length;
+}
+
+// Запись в блоки файла. Блоки за концом размещенной части идут в
+// отложенный хвост; промежуток между концом файла и offset — нули.
+static int vixfs_write_blocks(vixfs_inode_t *inode, const uint8_t *data,
+                              uint32_t size, uint32_t offset) {
+    uint32_t end = offset + size;
+    vixfs_delalloc_t *da = vixfs_delalloc_find(inode - inodes);
+    uint32_t have = inode->blocks + (da ? da->count : 0);
+    uint32_t need = (end + VIXFS_BLOCK_SIZE - 1) / VIXFS_BLOCK_SIZE;
+    uint32_t grow = need > have ? need - have : 0;
+
+    // Новые блоки получат место позже, но его должно хватить уже сейчас
+    if (!vixfs_delalloc_fits(grow)) {
+        terminal_writestring("No free blocks!\n");
+        return -1;
+    }
+    for (uint32_t i = have; i < need; i++) {
+        if (!vixfs_delalloc_block(inode, i, 1)) {
+            terminal_writestring("Out of memory while writing!\n");
+            return -1;
+        }
+    }
+
+    uint32_t run = 0;
+    uint32_t block = 0;
+    for (uint32_t pos = offset; pos < end; ) {
+        uint32_t file_block = pos / VIXFS_BLOCK_SIZE;
+        uint32_t skip = pos % VIXFS_BLOCK_SIZE;
+        uint32_t chunk = VIXFS_BLOCK_SIZE - skip;
+        if (chunk > end - pos) {
+            chunk = end - pos;
+        }
+
+        uint8_t *dst;
+        bcache_buf_t *buf = NULL;
+        if (file_block >= inode->blocks) {
+            dst = vixfs_delalloc_block(inode, file_block, 0);
+        } else {
+            if (run == 0) {
+                block = vixfs_map(inode, file_block, &run);
+            }
+            // Запись покрывает все данные блока — старое содержимое не нужно
+            int whole = skip == 0 &&
+                        (chunk == VIXFS_BLOCK_SIZE || pos + chunk >= inode->size);
+            if (block != (uint32_t)-1) {
+                buf = whole ? bcache_get(backing_dev, block) : bcache_read(backing_dev, block);
+            }
+            if (buf && whole && chunk < VIXFS_BLOCK_SIZE) {
+                memset(buf->data + chunk, 0, VIXFS_BLOCK_SIZE - chunk);
+            }
+            dst = buf ? buf->data : NULL;
+            block++;
+            run--;
+        }
+        if (!dst) {
+            terminal_writestring("I/O error while writing!\n");
+            return -1;
+        }
+        memcpy(dst + skip, data + (pos - offset), chunk);
+        if (buf) {
+            bcache_mark_dirty(buf);
+            bcache_release(buf);
+        }
+        pos += chunk;
     }
-}
 
-// Форматирование файловой системы
-int vixfs_format(void) {
-    terminal_writestring("Formatting ViXFS...\n");
-    
-    // Инициализация суперблока
-    superblock.magic = VIXFS_MAGIC;
-    superblock.version = VIXFS_VERSION;
-    superblock.block_size = VIXFS_BLOCK_SIZE;
-    superblock.total_blocks = 32768; // 16MB при размере блока 512 байт
-    superblock.free_blocks = superblock.total_blocks - 1; // Минус суперблок
-    superblock.inode_count = VIXFS_MAX_FILES;
-    superblock.free_inodes = VIXFS_MAX_FILES - 1; // Минус корневой инод
-    superblock.root_inode = 0;
-    
-    // Инициализация корневого инода
-    inodes[0].mode = 0xFFFF; // Каталог
-    inodes[0].size = 0;
-    inodes[0].blocks = 0;
-    inodes[0].created_time = 0;
-    inodes[0].modified_time = 0;
-    strcpy((char*)inodes[0].name, "/");
-    
-    // Помечаем корневой инод как использованный
-    inode_bitmap[0] = 1;
-    
-    // Помечаем блок 0 как использованный (суперблок)
-    block_bitmap[0] = 1;
-    
-    terminal_writestring("ViXFS formatted successfully!\n");
-    return 0;
+    if (end > inode->size) {
+        inode->size = end;
+    }
+    return size;
 }
 
-// Монтирование файловой системы
-int vixfs_mount(void) {
-    // Проверяем магическое число
-    if (superblock.magic != VIXFS_MAGIC) {
-        return -1; // ФС не найдена
+static int vixfs_file_write(vixfs_inode_t *inode, const uint8_t *data,
+                            uint32_t size, uint32_t offset) {
+    uint32_t end = offset + size;
+
+    if (end < offset) {
+        terminal_writestring("File too large!\n");
+        return -1;
     }
-    
-    terminal_writestring("ViXFS mounted successfully!\n");
-    return 0;
+    vixfs_mark_inode(inode - inodes);
+
+    // Пустой файл начинает жизнь в иноде
+    if (!(inode->flags & VIXFS_INODE_INLINE) && inode->size == 0 && inode->blocks == 0 &&
+        !vixfs_delalloc_find(inode - inodes) && end <= VIXFS_INLINE_SIZE) {
+        memset(inode->inline_data, 0, VIXFS_INLINE_SIZE);
+        inode->flags |= VIXFS_INODE_INLINE;
+    }
+
+    if (inode->flags & VIXFS_INODE_INLINE) {
+        if (end <= VIXFS_INLINE_SIZE) {
+            if (size) {
+                memcpy(inode->inline_data + offset, data, size);
+            }
+            if (end > inode->size) {
+                inode->size = end;
+            }
+            return size;
+        }
+
+        // Файл перерос инод: прежнее содержимое переезжает в блоки
+        uint8_t old[VIXFS_INLINE_SIZE];
+        uint32_t old_size = inode->size;
+        memcpy(old, inode->inline_data, old_size);
+        memset(inode->inline_data, 0, VIXFS_INLINE_SIZE);
+        inode->flags &= ~VIXFS_INODE_INLINE;
+        inode->size = 0;
+        if (old_size && vixfs_write_blocks(inode, old, old_size, 0) < 0) {
+            return -1;
+        }
+    }
+    if (inode->flags & VIXFS_INODE_COMPRESSED) {
+        return vixfs_cluster_write(inode, data, size, offset);
+    }
+    return vixfs_write_blocks(inode, data, size, offset);
 }
 
-// Создание файла
-int vixfs_create(const char* filename) {
-    if (strlen(filename) >= VIXFS_MAX_FILENAME) {
-        terminal_writestring("Filename too long!\n");
-        return -1;
+// Новый размер файла: лишнее освобождается, недостающее — нули
+static int vixfs_file_resize(vixfs_inode_t *inode, uint32_t new_size) {
+    vixfs_mark_inode(inode - inodes);
+
+    if (new_size >= inode->size) {
+        return vixfs_file_write(inode, NULL, 0, new_size) < 0 ? -1 : 0;
     }
-    
-    // Проверяем, не существует ли уже файл с таким именем
-    if (vixfs_find_file(filename) != NULL) {
-        terminal_writestring("File already exists!\n");
+
+    // За концом файла в последнем блоке всегда нули: на них опирается
+    // запись без чтения и рост файла
+    if (inode->flags & VIXFS_INODE_INLINE) {
+        memset(inode->inline_data + new_size, 0, inode->size - new_size);
+        inode->size = new_size;
+        return 0;
+    }
+
+    uint32_t keep = (new_size + VIXFS_BLOCK_SIZE - 1) / VIXFS_BLOCK_SIZE;
+    if ((inode->flags & VIXFS_INODE_COMPRESSED) && keep <= inode->blocks) {
+        return vixfs_cluster_truncate(inode, new_size);
+    }
+    if (vixfs_file_truncate(inode, keep) != 0) {
         return -1;
     }
-    
-    // Ищем свободный инод
-    uint32_t inode_num = vixfs_alloc_inode();
-    if (inode_num == (uint32_t)-1) {
-        terminal_writestring("No free inodes!\n");
+    inode->size = new_size;
+
+    uint32_t skip = new_size % VIXFS_BLOCK_SIZE;
+    if (skip == 0) {
+        return 0;
+    }
+    uint32_t file_block = new_size / VIXFS_BLOCK_SIZE;
+    if (file_block >= inode->blocks) {
+        uint8_t *tail = vixfs_delalloc_block(inode, file_block, 0);
+        if (tail) {
+            memset(tail + skip, 0, VIXFS_BLOCK_SIZE - skip);
+        }
+        return tail ? 0 : -1;
+    }
+
+    uint32_t run;
+    uint32_t block = vixfs_map(inode, file_block, &run);
+    bcache_buf_t *buf = block != (uint32_t)-1 ? bcache_read(backing_dev, block) : NULL;
+    if (!buf) {
         return -1;
     }
-    
-    // Инициализируем инод
-    vixfs_inode_t* inode = &inodes[inode_num];
-    inode->mode = 0xFFFE; // Файл
-    inode->size = 0;
-    inode->blocks = 0;
-    inode->created_time = 0;
-    inode->modified_time = 0;
-    strcpy((char*)inode->name, filename);
-    
-    terminal_writestring("File created: ");
-    terminal_writestring(filename);
-    terminal_writestring("\n");
-    
+    memset(buf->data + skip, 0, VIXFS_BLOCK_SIZE - skip);
+    bcache_mark_dirty(buf);
+    bcache_release(buf);
     return 0;
 }
 
-// Удаление файла
-int vixfs_delete(const char* filename) {
-    vixfs_inode_t* inode = vixfs_find_file(filename);
-    if (inode == NULL) {
-        terminal_writestring("File not found!\n");
+// Длинные изменения идут шагами до границ VIXFS_OP_BLOCKS блоков, каждый
+// шаг — отдельная операция журнала. После сбоя файл может оказаться
+// изменен лишь частично, но ФС остается целой.
+static int vixfs_resize_op(vixfs_inode_t *inode, uint32_t new_size) {
+    uint32_t step = VIXFS_OP_BLOCKS * VIXFS_BLOCK_SIZE;
+
+    while (inode->size != new_size) {
+        uint32_t next = new_size;
+        if (new_size < inode->size && inode->size - new_size > step) {
+            next = (inode->size - 1) / step * step;
+        } else if (new_size > inode->size && new_size - inode->size > step) {
+            next = (inode->size / step + 1) * step;
+        }
+
+        if (vixfs_journal_begin(VIXFS_OP_BLOCKS + VIXFS_CLUSTER_BLOCKS) != 0) {
+            return -1;
+        }
+        int result = vixfs_file_resize(inode, next);
+        inode->modified_time = 0;
+        vixfs_journal_stop();
+        if (result != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int vixfs_write_op(vixfs_inode_t *inode, const uint8_t *data,
+                          uint32_t size, uint32_t offset) {
+    uint32_t step = VIXFS_OP_BLOCKS * VIXFS_BLOCK_SIZE;
+    uint32_t done = 0;
+
+    if (offset + size < offset) {
+        terminal_writestring("File too large!\n");
         return -1;
     }
-    
-    // Освобождаем блоки файла
-    for (uint32_t i = 0; i < inode->blocks; i++) {
-        vixfs_free_block(inode->block_pointers[i]);
+    // Дыра перед записью заполняется нулями тоже шагами
+    if (offset > inode->size && vixfs_resize_op(inode, offset) != 0) {
+        return -1;
     }
-    
-    // Освобождаем инод
-    uint32_t inode_num = inode - inodes;
-    vixfs_free_inode(inode_num);
-    
-    terminal_writestring("File deleted: ");
-    terminal_writestring(filename);
-    terminal_writestring("\n");
-    
-    return 0;
+    do {
+        uint32_t pos = offset + done;
+        uint32_t chunk = step - pos % step;
+        if (chunk > size - done) {
+            chunk = size - done;
+        }
+
+        // Запас на распечатанный кластер и переезд из инода
+        if (vixfs_journal_begin(chunk / VIXFS_BLOCK_SIZE + VIXFS_CLUSTER_BLOCKS + 1) != 0) {
+            return -1;
+        }
+        int result = vixfs_file_write(inode, data + done, chunk, pos);
+        inode->modified_time = 0;
+        vixfs_journal_stop();
+        if (result < 0) {
+            return -1;
+        }
+        done += chunk;
+    } while (done < size);
+    return size;
 }
 
 // Чтение файла
 int vixfs_read(const char* filename, void* buffer, size_t size) {
+    if (vixfs_check_mounted() != 0) {
+        return -1;
+    }
+
     vixfs_inode_t* inode = vixfs_find_file(filename);
     if (inode == NULL) {
         terminal_writestring("File not found!\n");
         return -1;
     }
-    
-    // Здесь должна быть логика чтения блоков с диска
-    // Для демонстрации просто заполняем нулями
-    memset(buffer, 0, size > inode->size ? inode->size : size);
-    
-    return size > inode->size ? inode->size : size;
+    if (inode->mode != VIXFS_MODE_FILE) {
+        terminal_writestring("Is a directory!\n");
+        return -1;
+    }
+
+    return vixfs_file_read(inode, (uint8_t*)buffer, size, 0);
 }
 
-// Запись в файл
+// Запись в файл (содержимое заменяется целиком)
 int vixfs_write(const char* filename, const void* data, size_t size) {
+    if (vixfs_check_mounted() != 0) {
+        return -1;
+    }
+
     vixfs_inode_t* inode = vixfs_find_file(filename);
     if (inode == NULL) {
         terminal_writestring("File not found!\n");
         return -1;
     }
-    
-    // Вычисляем необходимое количество блоков
-    uint32_t required_blocks = (size + VIXFS_BLOCK_SIZE - 1) / VIXFS_BLOCK_SIZE;
-    
-    if (required_blocks > 12) {
-        terminal_writestring("File too large!\n");
+    if (inode->mode != VIXFS_MODE_FILE) {
+        terminal_writestring("Is a directory!\n");
         return -1;
     }
-    
-    // Выделяем блоки
-    for (uint32_t i = 0; i < required_blocks; i++) {
-        if (i >= inode->blocks) {
-            uint32_t block = vixfs_alloc_block();
-            if (block == (uint32_t)-1) {
-                terminal_writestring("No free blocks!\n");
-                return -1;
-            }
-            inode->block_pointers[i] = block;
-            inode->blocks++;
-        }
+
+    // Лишние блоки старого содержимого освобождаем (хвост последнего
+    // обнуляется); уцелевшие перезаписываются целиком, без чтения.
+    // Короткое содержимое переезжает из блоков обратно в инод
+    uint32_t keep = size;
+    if (!(inode->flags & VIXFS_INODE_INLINE) && size <= VIXFS_INLINE_SIZE) {
+        keep = 0;
     }
-    
-    // Здесь должна быть логика записи блоков на диск
-    inode->size = size;
-    inode->modified_time = 0;
-    
+    int result = inode->size > keep ? vixfs_resize_op(inode, keep) : 0;
+    if (result == 0) {
+        result = vixfs_write_op(inode, (const uint8_t*)data, size, 0);
+    } else {
+        terminal_writestring("I/O error while writing!\n");
+    }
+    if (result < 0) {
+        return -1;
+    }
+
     terminal_writestring("Data written to: ");
     terminal_writestring(filename);
     terminal_writestring("\n");
-    
+
     return size;
 }
 
-// Список файлов
-int vixfs_list_files(void) {
+// ===== Дескрипторы файлов =====
+
+static vixfs_file_t *vixfs_handle(int fd) {
+    if (fd < 0 || fd >= VIXFS_MAX_HANDLES || !handles[fd].used || !backing_dev) {
+        terminal_writestring("Bad file handle!\n");
+        return NULL;
+    }
+    return &handles[fd];
+}
+
+static int vixfs_inode_open(uint32_t inode) {
+    for (int i = 0; i < VIXFS_MAX_HANDLES; i++) {
+        if (handles[i].used && handles[i].inode == inode) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int vixfs_open(const char* path, int flags) {
+    uint32_t parent, len;
+    const char *name;
+
+    if (vixfs_check_mounted() != 0) {
+        return -1;
+    }
+
+    int fd = 0;
+    while (fd < VIXFS_MAX_HANDLES && handles[fd].used) {
+        fd++;
+    }
+    if (fd == VIXFS_MAX_HANDLES) {
+        terminal_writestring("Too many open files!\n");
+        return -1;
+    }
+
+    uint32_t inode = vixfs_lookup_path(path, &parent, &name, &len);
+    if (inode == (uint32_t)-1 && (flags & VIXFS_O_CREATE)) {
+        if (vixfs_make_node(path, VIXFS_MODE_FILE) != 0) {
+            return -1;
+        }
+        inode = vixfs_lookup_path(path, &parent, &name, &len);
+    }
+    if (inode == (uint32_t)-1) {
+        terminal_writestring("File not found!\n");
+        return -1;
+    }
+    if (inodes[inode].mode != VIXFS_MODE_FILE) {
+        terminal_writestring("Is a directory!\n");
+        return -1;
+    }
+    if ((flags & VIXFS_O_TRUNC) && inodes[inode].size > 0) {
+        if (vixfs_resize_op(&inodes[inode], 0) != 0) {
+            terminal_writestring("I/O error while truncating!\n");
+            return -1;
+        }
+    }
+
+    handles[fd].used = 1;
+    handles[fd].flags = flags;
+    handles[fd].inode = inode;
+    handles[fd].pos = 0;
+    return fd;
+}
+
+int vixfs_close(int fd) {
+    vixfs_file_t *file = vixfs_handle(fd);
+    if (!file) {
+        return -1;
+    }
+    file->used = 0;
+    return 0;
+}
+
+int vixfs_pread(int fd, void* buffer, uint32_t size, uint32_t offset) {
+    vixfs_file_t *file = vixfs_handle(fd);
+    if (!file) {
+        return -1;
+    }
+    return vixfs_file_read(&inodes[file->inode], (uint8_t*)buffer, size, offset);
+}
+
+int vixfs_pwrite(int fd, const void* data, uint32_t size, uint32_t offset) {
+    vixfs_file_t *file = vixfs_handle(fd);
+    if (!file) {
+        return -1;
+    }
+
+    vixfs_inode_t *inode = &inodes[file->inode];
+    if (file->flags & VIXFS_O_APPEND) {
+        offset = inode->size;
+    }
+    return vixfs_write_op(inode, (const uint8_t*)data, size, offset);
+}
+
+int vixfs_fread(int fd, void* buffer, uint32_t size) {
+    vixfs_file_t *file = vixfs_handle(fd);
+    if (!file) {
+        return -1;
+    }
+    int result = vixfs_file_read(&inodes[file->inode], (uint8_t*)buffer, size, file->pos);
+    if (result > 0) {
+        file->pos += result;
+    }
+    return result;
+}
+
+int vixfs_fwrite(int fd, const void* data, uint32_t size) {
+    vixfs_file_t *file = vixfs_handle(fd);
+    if (!file) {
+        return -1;
+    }
+    if (file->flags & VIXFS_O_APPEND) {
+        file->pos = inodes[file->inode].size;
+    }
+    int result = vixfs_pwrite(fd, data, size, file->pos);
+    if (result > 0) {
+        file->pos += result;
+    }
+    return result;
+}
+
+int vixfs_seek(int fd, uint32_t offset) {
+    vixfs_file_t *file = vixfs_handle(fd);
+    if (!file) {
+        return -1;
+    }
+    file->pos = offset;
+    return 0;
+}
+
+int vixfs_truncate(int fd, uint32_t size) {
+    vixfs_file_t *file = vixfs_handle(fd);
+    if (!file) {
+        return -1;
+    }
+
+    int result = vixfs_resize_op(&inodes[file->inode], size);
+    if (result != 0) {
+        terminal_writestring("I/O error while truncating!\n");
+    }
+    return result;
+}
+
+int vixfs_fsize(int fd) {
+    vixfs_file_t *file = vixfs_handle(fd);
+    return file ? (int)inodes[file->inode].size : -1;
+}
+
+static int vixfs_print_entry(vixfs_direntry_t *entry, void *ctx) {
+    char name[VIXFS_MAX_FILENAME];
+    (void)ctx;
+
+    memcpy(name, entry->name, entry->name_len);
+    name[entry->name_len] = '\0';
+    terminal_writestring(name);
+    terminal_writestring(" [");
+
+    vixfs_inode_t* inode = &inodes[entry->inode < VIXFS_MAX_FILES ? entry->inode : 0];
+    if (inode->mode == VIXFS_MODE_DIR) {
+        terminal_writestring("DIR");
+    } else {
+        terminal_writestring("FILE");
+        char size_str[16];
+        itoa(inode->size, size_str, 10);
+        terminal_writestring(", ");
+        terminal_writestring(size_str);
+        terminal_writestring(" bytes");
+        if (inode->flags & VIXFS_INODE_INLINE) {
+            terminal_writestring(", inline");
+        }
+    }
+    if (inode->flags & VIXFS_INODE_COMPRESSED) {
+        terminal_writestring(", compressed");
+    }
+
+    terminal_writestring("]\n");
+    return 0;
+}
+
+// Список файлов каталога (NULL — корень)
+int vixfs_list_files(const char* path) {
+    if (vixfs_check_mounted() != 0) {
+        return -1;
+    }
+
+    vixfs_inode_t* dir = vixfs_find_file(path ? path : "/");
+    if (dir == NULL || dir->mode != VIXFS_MODE_DIR) {
+        terminal_writestring("Directory not found!\n");
+        return -1;
+    }
+
     terminal_writestring("Files in ViXFS:\n");
     terminal_writestring("===============\n");
-    
-    for (uint32_t i = 0; i < VIXFS_MAX_FILES; i++) {
-        if (inode_bitmap[i / 8] & (1 << (i % 8))) {
-            vixfs_inode_t* inode = &inodes[i];
-            terminal_writestring(inode->name);
-            terminal_writestring(" [");
-            
-            if (inode->mode == 0xFFFF) {
-                terminal_writestring("DIR");
-            } else {
-                terminal_writestring("FILE");
-                char size_str[16];
-                itoa(inode->size, size_str, 10);
-                terminal_writestring(", ");
-                terminal_writestring(size_str);
-                terminal_writestring(" bytes");
+
+    if (vixfs_dir_iterate(dir, vixfs_print_entry, NULL) < 0) {
+        terminal_writestring("I/O error while reading directory!\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Вспомогательные функции
+static int vixfs_block_used(uint32_t block) {
+    return block_bitmap[block / 8] & (1 << (block % 8));
+}
+
+static void vixfs_mark_bitmap(uint32_t start, uint32_t count) {
+    uint32_t first = start / VIXFS_BITS_PER_BLOCK;
+    uint32_t last = (start + count - 1) / VIXFS_BITS_PER_BLOCK;
+
+    vixfs_mark_meta(0);
+    for (uint32_t i = first; i <= last; i++) {
+        vixfs_mark_meta(superblock.block_bitmap_start + i);
+    }
+}
+
+// Первый свободный участок из want блоков начиная с goal (по кругу);
+// если такого нет — самый длинный из найденных
+uint32_t vixfs_alloc_extent(uint32_t goal, uint32_t want, uint32_t* start) {
+    uint32_t best_start = 0, best_len = 0;
+    uint32_t pos = goal;
+    uint32_t left = superblock.total_blocks - superblock.data_start;
+
+    if (want == 0 || superblock.free_blocks == 0) {
+        return 0;
+    }
+    if (pos < superblock.data_start || pos >= superblock.total_blocks) {
+        pos = superblock.data_start;
+    }
+
+    while (left > 0) {
+        if (pos >= superblock.total_blocks) {
+            pos = superblock.data_start;
+        }
+        // Целиком занятые байты карты пропускаем разом
+        if ((pos % 8) == 0 && block_bitmap[pos / 8] == 0xFF &&
+            left >= 8 && pos + 8 <= superblock.total_blocks) {
+            pos += 8;
+            left -= 8;
+            continue;
+        }
+        if (vixfs_block_used(pos)) {
+            pos++;
+            left--;
+            continue;
+        }
+
+        uint32_t run = 0;
+        while (run < want && run < left && pos + run < superblock.total_blocks &&
+               !vixfs_block_used(pos + run)) {
+            run++;
+        }
+        if (run > best_len) {
+            best_start = pos;
+            best_len = run;
+            if (run == want) {
+                break;
             }
-            
-            terminal_writestring("]\n");
+        }
+        pos += run;
+        left -= run;
+    }
+
+    if (best_len == 0) {
+        return 0;
+    }
+    for (uint32_t i = best_start; i < best_start + best_len; i++) {
+        block_bitmap[i / 8] |= (1 << (i % 8));
+    }
+    superblock.free_blocks -= best_len;
+    vixfs_mark_bitmap(best_start, best_len);
+    alloc_goal = best_start + best_len;
+    *start = best_start;
+    return best_len;
+}
+
+// Участок примыкает к одному из записанных (начиная с from) — сливаем
+static int vixfs_txn_merge_free(uint32_t start, uint32_t count, uint32_t from) {
+    for (uint32_t i = from; i < txn_free_count; i++) {
+        if (txn_frees[i][0] + txn_frees[i][1] == start) {
+            txn_frees[i][1] += count;
+            return 1;
+        }
+        if (start + count == txn_frees[i][0]) {
+            txn_frees[i][0] = start;
+            txn_frees[i][1] += count;
+            return 1;
         }
     }
-    
     return 0;
 }
 
-// Вспомогательные функции
-uint32_t vixfs_alloc_block(void) {
-    for (uint32_t i = 0; i < sizeof(block_bitmap) * 8; i++) {
-        if (!(block_bitmap[i / 8] & (1 << (i % 8)))) {
-            block_bitmap[i / 8] |= (1 << (i % 8));
-            superblock.free_blocks--;
-            return i;
+// Блоки остаются занятыми до коммита: иначе их новый владелец мог бы
+// записать данные на место раньше, чем станет прочным само освобождение
+void vixfs_free_extent(uint32_t start, uint32_t count) {
+    if (count == 0 || start < superblock.data_start ||
+        start + count > superblock.total_blocks) {
+        return;
+    }
+
+    // Обычно участок продолжает предыдущий
+    int merged = txn_free_count > 0 && vixfs_txn_merge_free(start, count, txn_free_count - 1);
+    if (!merged && txn_free_count == VIXFS_TXN_MAX_FREES + VIXFS_TXN_SPARE_FREES) {
+        // Запас кончился: ищем соседа среди всех участков, а не найдя —
+        // оставляем блоки занятыми (и в транзакции), их вернет fsck
+        if (!vixfs_txn_merge_free(start, count, 0)) {
+            terminal_writestring("Warning: too many frees in one transaction, blocks kept until fsck\n");
+            return;
         }
+        merged = 1;
+    }
+
+    // Освобожденные узлы и блоки каталогов больше не метаданные: в журнал
+    // не идут, но остаются закрепленными, пока коммит не выбросит их из кэша
+    for (uint32_t i = 0; i < txn_count; ) {
+        if (txn_blocks[i] >= start && txn_blocks[i] - start < count) {
+            txn_blocks[i] = txn_blocks[--txn_count];
+        } else {
+            i++;
+        }
+    }
+
+    if (!merged) {
+        txn_frees[txn_free_count][0] = start;
+        txn_frees[txn_free_count][1] = count;
+        txn_free_count++;
     }
-    return (uint32_t)-1;
 }
 
-void vixfs_free_block(uint32_t block) {
-    if (block < sizeof(block_bitmap) * 8) {
-        block_bitmap[block / 8] &= ~(1 << (block % 8));
-        superblock.free_blocks++;
+uint32_t vixfs_alloc_block(void) {
+    uint32_t block;
+
+    if (vixfs_alloc_extent(alloc_goal, 1, &block) == 0) {
+        return (uint32_t)-1;
     }
+    return block;
+}
+
+void vixfs_free_block(uint32_t block) {
+    vixfs_free_extent(block, 1);
 }
 
 uint32_t vixfs_alloc_inode(void) {
@@ -235,6 +3136,8 @@ uint32_t vixfs_alloc_inode(void) {
         if (!(inode_bitmap[i / 8] & (1 << (i % 8)))) {
             inode_bitmap[i / 8] |= (1 << (i % 8));
             superblock.free_inodes--;
+            vixfs_mark_meta(0);
+            vixfs_mark_meta(superblock.inode_bitmap_start);
             return i;
         }
     }
@@ -246,16 +3149,19 @@ void vixfs_free_inode(uint32_t inode) {
         inode_bitmap[inode / 8] &= ~(1 << (inode % 8));
         superblock.free_inodes++;
         memset(&inodes[inode], 0, sizeof(vixfs_inode_t));
+        vixfs_mark_meta(0);
+        vixfs_mark_meta(superblock.inode_bitmap_start);
+        vixfs_mark_inode(inode);
     }
 }
 
 vixfs_inode_t* vixfs_find_file(const char* filename) {
-    for (uint32_t i = 0; i < VIXFS_MAX_FILES; i++) {
-        if (inode_bitmap[i / 8] & (1 << (i % 8))) {
-            if (strcmp((char*)inodes[i].name, filename) == 0) {
-                return &inodes[i];
-            }
-        }
+    uint32_t parent, len;
+    const char *name;
+
+    if (!backing_dev) {
+        return NULL;
     }
-    return NULL;
-}
\ No newline at end of file
+    uint32_t inode = vixfs_lookup_path(filename, &parent, &name, &len);
+    return inode != (uint32_t)-1 ? &inodes[inode] : NULL;
+}
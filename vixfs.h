@@ -3,12 +3,65 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "blkdev.h"
 
 #define VIXFS_MAGIC 0x56495846  // "VIXF"
-#define VIXFS_VERSION 1
+#define VIXFS_VERSION 8
 #define VIXFS_MAX_FILENAME 128
-#define VIXFS_MAX_FILES 256
+#define VIXFS_MAX_FILES 256     // Таблица инодов фиксирована: всего файлов и каталогов, включая корень
 #define VIXFS_BLOCK_SIZE 512
+#define VIXFS_INODE_SIZE 256
+#define VIXFS_INODES_PER_BLOCK (VIXFS_BLOCK_SIZE / VIXFS_INODE_SIZE)
+#define VIXFS_BITS_PER_BLOCK (VIXFS_BLOCK_SIZE * 8)
+#define VIXFS_MAX_BLOCKS (1 << 25)          // 16 GB; битовая карта в памяти — до 4 MB
+#define VIXFS_MAX_META_BLOCKS (2 + VIXFS_MAX_BLOCKS / VIXFS_BITS_PER_BLOCK + \
+                               VIXFS_MAX_FILES / VIXFS_INODES_PER_BLOCK) // Суперблок, битовые карты, таблица инодов
+#define VIXFS_EXTENT_MAGIC 0x5845           // "EX"
+#define VIXFS_INODE_EXTENTS 4               // Корень дерева экстентов в иноде
+#define VIXFS_NODE_EXTENTS 41               // (512 - 8 - 4) / 12 в блоке узла
+#define VIXFS_BLOCK_CSUM (VIXFS_BLOCK_SIZE - 4) // CRC32C узла и блока каталога — в хвосте
+#define VIXFS_MAX_DEPTH 4
+#define VIXFS_MODE_DIR 0xFFFF
+#define VIXFS_MODE_FILE 0xFFFE
+#define VIXFS_INLINE_SIZE 160              // Данные маленького файла прямо в иноде
+#define VIXFS_INODE_INLINE 0x01             // inode->flags: данные в inline_data
+#define VIXFS_INODE_COMPRESSED 0x02         // Данные сжаты кластерами; у каталога — наследуется
+#define VIXFS_CLUSTER_SIZE 32768            // Кластер сжатия
+#define VIXFS_CLUSTER_BLOCKS (VIXFS_CLUSTER_SIZE / VIXFS_BLOCK_SIZE)
+#define VIXFS_EXTENT_COMPRESSED 0x80000000  // В extent.length: сжатый кластер
+#define VIXFS_EXTENT_LENGTH(length) ((length) & ~VIXFS_EXTENT_COMPRESSED)
+#define VIXFS_MAX_HANDLES 16
+#define VIXFS_O_CREATE 0x01                 // Создать, если файла нет
+#define VIXFS_O_TRUNC 0x02                  // Обрезать до нуля при открытии
+#define VIXFS_O_APPEND 0x04                 // Запись всегда в конец файла
+#define VIXFS_DX_MAGIC 0x5844               // "DX" — индексный узел каталога
+#define VIXFS_DL_MAGIC 0x4C44               // "DL" — лист каталога
+#define VIXFS_DX_ENTRIES 62                 // (512 - 8 - 4) / 8
+#define VIXFS_DX_MAX_DEPTH 2                // Уровней индекса под корнем
+#define VIXFS_JOURNAL_MIN_BLOCKS 256
+#define VIXFS_JOURNAL_MAX_BLOCKS 8192       // 4 MB
+#define VIXFS_JOURNAL_HEADER 0x4A484452     // "JHDR"
+#define VIXFS_JOURNAL_DESC 0x4A445343       // "JDSC"
+#define VIXFS_JOURNAL_COMMIT 0x4A434D54     // "JCMT"
+#define VIXFS_JOURNAL_TAGS 124              // (512 - 16) / 4
+#define VIXFS_JOURNAL_STAGE 128             // Блоков в буфере записи журнала
+#define VIXFS_TXN_MAX_BLOCKS 2048           // Блоков метаданных в транзакции
+#define VIXFS_TXN_MAX_FREES 1024            // Освобожденных участков в транзакции
+#define VIXFS_TXN_SPARE_FREES 1024          // Запас сверх него на операцию и сам коммит
+#define VIXFS_COMMIT_INTERVAL_US 5000000    // Групповой коммит не реже раза в 5 с
+#define VIXFS_DELALLOC_FILES 16             // Файлов с хвостом без места на диске
+#define VIXFS_DELALLOC_PAGES 64             // До 256 KB хвоста на файл
+#define VIXFS_DELALLOC_BLOCKS (VIXFS_DELALLOC_PAGES * 4096 / VIXFS_BLOCK_SIZE)
+#define VIXFS_OP_CREDITS 32                 // Блоков метаданных на одну операцию
+#define VIXFS_OP_BLOCKS VIXFS_DELALLOC_BLOCKS // Блоков данных на одну операцию
+
+// Раскладка на диске (номера блоков):
+//   0                    суперблок
+//   inode_bitmap_start   битовая карта инодов (1 блок)
+//   block_bitmap_start   битовая карта блоков (block_bitmap_blocks)
+//   inode_table_start    таблица инодов (inode_table_blocks)
+//   journal_start        журнал метаданных (journal_blocks)
+//   data_start           данные файлов
 
 // Структура суперблока
 typedef struct {
@@ -20,41 +73,166 @@ typedef struct {
     uint32_t inode_count;
     uint32_t free_inodes;
     uint32_t root_inode;
-    uint8_t padding[480]; // Дополнение до 512 байт
+    uint32_t inode_bitmap_start;
+    uint32_t block_bitmap_start;
+    uint32_t block_bitmap_blocks;
+    uint32_t inode_table_start;
+    uint32_t inode_table_blocks;
+    uint32_t journal_start;
+    uint32_t journal_blocks;
+    uint32_t data_start;
+    uint32_t checksum;    // CRC32C полей выше
+    uint8_t padding[444]; // Дополнение до 512 байт
 } vixfs_superblock_t;
 
+// Заголовок узла дерева экстентов (корень в иноде, остальные — блоки)
+typedef struct {
+    uint16_t magic;
+    uint16_t count;
+    uint16_t max;
+    uint16_t depth;       // 0 — записи узла описывают данные
+} vixfs_extent_header_t;
+
+// Экстент: блоки файла [file_block, file_block + length) лежат на диске
+// начиная со start. В индексных узлах start — блок дочернего узла,
+// file_block — первый блок файла под ним, length не используется.
+// С VIXFS_EXTENT_COMPRESSED экстент хранит сжатый кластер: окно
+// [file_block, file_block + VIXFS_CLUSTER_BLOCKS) занимает на диске
+// VIXFS_EXTENT_LENGTH(length) блоков.
+typedef struct {
+    uint32_t file_block;
+    uint32_t start;
+    uint32_t length;
+} vixfs_extent_t;
+
+// Начало сжатого кластера на диске, дальше comp_len байт LZ4. Байты
+// окна за raw_len — нули. Кластер всегда пишется целиком, поэтому только
+// у него и есть контрольная сумма данных.
+typedef struct {
+    uint32_t comp_len;
+    uint32_t raw_len;
+    uint32_t checksum;    // CRC32C номера кластера и сжатых байт, начальное значение — номер инода
+} vixfs_cluster_header_t;
+
 // Структура индексного дескриптора
 typedef struct {
     uint32_t mode;
     uint32_t size;
-    uint32_t blocks;
-    uint32_t block_pointers[12];
-    uint32_t indirect_block;
-    uint32_t double_indirect_block;
+    uint32_t blocks;      // Блоков данных, отображенных экстентами
+    vixfs_extent_header_t extent_header;
+    vixfs_extent_t extents[VIXFS_INODE_EXTENTS];
+    uint32_t flags;
     uint64_t created_time;
     uint64_t modified_time;
-    uint8_t name[VIXFS_MAX_FILENAME];
+    uint8_t inline_data[VIXFS_INLINE_SIZE]; // При VIXFS_INODE_INLINE, блоков нет
+    uint8_t reserved[4];
+    uint32_t checksum;     // CRC32C инода до этого поля, начальное значение — номер инода
 } vixfs_inode_t;
 
-// Структура директории
+// Каталог — обычный файл из блоков. Блок 0 — корень хэш-индекса, записи
+// индекса (хэш имени, блок) упорядочены по хэшу и ведут в индексные узлы
+// нижнего уровня или в листья. Поиск читает не больше depth + 2 блоков
+// независимо от числа файлов в каталоге.
+typedef struct {
+    uint16_t magic;
+    uint16_t count;
+    uint16_t depth;       // 0 — записи ведут в листья
+    uint16_t reserved;
+} vixfs_dx_header_t;
+
+typedef struct {
+    uint32_t hash;        // Наименьший хэш под этой записью
+    uint32_t block;       // Номер блока внутри файла каталога
+} vixfs_dx_entry_t;
+
+// Лист: записи переменной длины, выровненные на 4 байта
+typedef struct {
+    uint16_t magic;
+    uint16_t count;
+    uint16_t used;        // Занято байт записями
+    uint16_t reserved;
+} vixfs_dirleaf_header_t;
+
 typedef struct {
+    uint32_t hash;
     uint32_t inode;
-    uint8_t name[VIXFS_MAX_FILENAME];
+    uint8_t name_len;
+    uint8_t name[];       // Без завершающего нуля
 } vixfs_direntry_t;
 
+// Журнал: блок 0 — заголовок, дальше транзакции подряд. Транзакция —
+// один или несколько дескрипторов, каждый со следующими за ним образами
+// блоков, и блок коммита. Транзакция без целого коммита с верной
+// контрольной суммой при монтировании отбрасывается.
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;         // Первая транзакция для воспроизведения
+    uint32_t start;       // Ее блок в журнале
+    uint8_t padding[500];
+} vixfs_journal_header_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint16_t images;      // Образов блоков за дескриптором
+    uint16_t revokes;     // Освобожденных участков (start, count)
+    uint32_t reserved;
+    // Сначала пары (start, count) освобожденных участков, затем номера
+    // блоков образов
+    uint32_t tags[VIXFS_JOURNAL_TAGS];
+} vixfs_journal_desc_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t blocks;      // Блоков транзакции вместе с коммитом
+    uint32_t checksum;    // CRC32C по всем дескрипторам и образам
+    uint8_t padding[496];
+} vixfs_journal_commit_t;
+
+#define VIXFS_DIRENT_SIZE(len) ((9 + (len) + 3) & ~3)
+#define VIXFS_DIRLEAF_SPACE (VIXFS_BLOCK_CSUM - sizeof(vixfs_dirleaf_header_t))
+
 // Основные функции файловой системы
-void vixfs_init(void);
-int vixfs_format(void);
-int vixfs_mount(void);
+// devname == NULL — первое зарегистрированное блочное устройство
+void vixfs_init(const char* devname);
+int vixfs_format(blkdev_t* dev);
+int vixfs_mount(blkdev_t* dev);
+// Устройство смонтированной ФС; NULL — не смонтирована
+blkdev_t *vixfs_device(void);
+// Коммит текущей транзакции и запись всего грязного на диск
+int vixfs_sync(void);
+// Пути вида "dir/sub/file" от корня
 int vixfs_create(const char* filename);
+int vixfs_mkdir(const char* path);
 int vixfs_delete(const char* filename);
 int vixfs_read(const char* filename, void* buffer, size_t size);
 int vixfs_write(const char* filename, const void* data, size_t size);
-int vixfs_list_files(void);
+int vixfs_list_files(const char* path);
+// Сжатие для пустого файла или для новых файлов каталога (on = 0 — выключить)
+int vixfs_set_compressed(const char* path, int on);
+
+// Дескрипторы: путь разрешается один раз при открытии. Функции
+// возвращают число байт (0 при чтении — конец файла) или -1.
+int vixfs_open(const char* path, int flags);
+int vixfs_close(int fd);
+int vixfs_pread(int fd, void* buffer, uint32_t size, uint32_t offset);
+int vixfs_pwrite(int fd, const void* data, uint32_t size, uint32_t offset);
+// С текущей позиции дескриптора, которая сдвигается на обработанное
+int vixfs_fread(int fd, void* buffer, uint32_t size);
+int vixfs_fwrite(int fd, const void* data, uint32_t size);
+int vixfs_seek(int fd, uint32_t offset);
+// Укоротить или дорастить нулями до size байт
+int vixfs_truncate(int fd, uint32_t size);
+int vixfs_fsize(int fd);
 
 // Вспомогательные функции
 uint32_t vixfs_alloc_block(void);
 void vixfs_free_block(uint32_t block);
+// Непрерывный участок до want блоков, по возможности начиная с goal
+uint32_t vixfs_alloc_extent(uint32_t goal, uint32_t want, uint32_t* start);
+// Блоки снова доступны для выделения после коммита транзакции
+void vixfs_free_extent(uint32_t start, uint32_t count);
 uint32_t vixfs_alloc_inode(void);
 void vixfs_free_inode(uint32_t inode);
 vixfs_inode_t* vixfs_find_file(const char* filename);